@@ -0,0 +1,189 @@
+#include "Admission.h"
+
+#include <iostream>
+
+#include "ProcStats.h"
+
+//SIP codes of rejected calls
+static const uint32_t kOverloadCode = 503;
+static const uint32_t kAccountBusyCode = 486;
+
+const char* getAdmissionMetricStr(AdmissionMetric metric)
+{
+    switch (metric)
+    {
+        case eAdmitCalls:      return "calls";
+        case eAdmitQueueDepth: return "queueDepth";
+        case eAdmitCpu:        return "cpu";
+        case eAdmitProcessCpu: return "processCpu";
+        default:               return "???";
+    }
+}
+
+void AdmissionControl::start(const AdmissionParams& params, const Actions& actions, AppStats& stats)
+{
+    stop();
+    params_  = params;
+    actions_ = actions;
+    stats_   = &stats;
+    if (!params_.isEnabled())
+        return;
+    queueLimit_.store(params_.maxQueueDepth, std::memory_order_relaxed);
+
+    //First sample is the base of CPU deltas
+    sampleCpu();
+    if (params_.hasOverloadLimits() && params_.sampleMs)
+        sampleTimer_ = loop_.addTimer(params_.sampleMs, params_.sampleMs, [this]() {
+            sampleCpu();
+            update();
+        });
+}
+
+void AdmissionControl::stop()
+{
+    if (sampleTimer_)
+    {
+        loop_.cancelTimer(sampleTimer_);
+        sampleTimer_ = 0;
+    }
+    queueLimit_.store(0, std::memory_order_relaxed);
+    if (overloaded_)
+    {
+        update();
+        overloaded_ = false;
+        overloadedEarly_.store(false, std::memory_order_relaxed);
+        stats_->overloaded.store(0, std::memory_order_relaxed);
+    }
+}
+
+double AdmissionControl::limit(AdmissionMetric metric) const
+{
+    switch (metric)
+    {
+        case eAdmitCalls:      return params_.maxCalls;
+        case eAdmitQueueDepth: return params_.maxQueueDepth;
+        case eAdmitCpu:        return params_.maxCpu;
+        case eAdmitProcessCpu: return params_.maxProcessCpu;
+        default:               return 0;
+    }
+}
+
+uint32_t AdmissionControl::admit(size_t accountCalls)
+{
+    if (!isEnabled())
+        return 0;
+
+    update();
+    if (overloaded_)
+    {
+        ++stats_->callsShed;
+        return kOverloadCode;
+    }
+    if (params_.maxAccountCalls && (accountCalls >= params_.maxAccountCalls))
+    {
+        ++stats_->callsShedAccount;
+        return kAccountBusyCode;
+    }
+    ++stats_->callsAdmitted;
+    return 0;
+}
+
+uint32_t AdmissionControl::admitEarly() const
+{
+    const uint32_t queueLimit = queueLimit_.load(std::memory_order_relaxed);
+    if (overloadedEarly_.load(std::memory_order_relaxed) || (queueLimit && (loop_.pendingTasks() >= queueLimit)))
+        return kOverloadCode;
+    return 0;
+}
+
+void AdmissionControl::onShedEarly()
+{
+    if (stats_)
+        ++stats_->callsShed;
+}
+
+void AdmissionControl::sampleCpu()
+{
+    const auto now = EventLoop::Clock::now();
+    const double elapsedMs = std::chrono::duration<double, std::milli>(now - sampled_).count();
+    sampled_ = now;
+
+    uint64_t busy = 0, total = 0;
+    if (procSystemCpu(busy, total))
+    {
+        values_[eAdmitCpu] = (total > cpuTotal_) ? (busy - cpuBusy_) * 100.0 / (total - cpuTotal_) : 0;
+        cpuBusy_  = busy;
+        cpuTotal_ = total;
+    }
+
+    const uint64_t processCpuMs = procCpuMs();
+    values_[eAdmitProcessCpu] = (elapsedMs > 0) ? (processCpuMs - processCpuMs_) * 100.0 / elapsedMs : 0;
+    processCpuMs_ = processCpuMs;
+}
+
+void AdmissionControl::update()
+{
+    const auto now = EventLoop::Clock::now();
+    if (actions_.calls)      values_[eAdmitCalls] = static_cast<double>(actions_.calls());
+    if (actions_.queueDepth) values_[eAdmitQueueDepth] = static_cast<double>(actions_.queueDepth());
+
+    if (overloaded_)
+    {
+        stats_->overloadMs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - overloadCounted_).count());
+        overloadCounted_ = now;
+    }
+
+    //Enter when any metric reaches limit, leave when all are below resume level
+    bool over = false, under = true;
+    AdmissionMetric metric = eAdmitCalls;
+    for (int i = 0; i < eAdmitMetrics; ++i)
+    {
+        const double lim = limit(static_cast<AdmissionMetric>(i));
+        if (lim <= 0)
+            continue;
+        if (!over && (values_[i] >= lim))
+        {
+            over = true;
+            metric = static_cast<AdmissionMetric>(i);
+        }
+        if (values_[i] >= lim * params_.resumePercent / 100)
+            under = false;
+    }
+
+    if (!overloaded_ && over)
+    {
+        overloaded_ = true;
+        overloadedEarly_.store(true, std::memory_order_relaxed);
+        overloadMetric_ = metric;
+        overloadStarted_ = overloadCounted_ = now;
+        shedAtOverloadStart_ = stats_->callsShed;
+        ++stats_->overloads;
+        stats_->overloaded.store(1, std::memory_order_relaxed);
+        std::cout << "\n--- Overload: rejecting incoming calls (" << getAdmissionMetricStr(metric) << " "
+                  << values_[metric] << " >= " << limit(metric) << ")" << std::endl;
+    }
+    else if (overloaded_ && under && (now - overloadStarted_ >= std::chrono::milliseconds(params_.minOverloadMs)))
+    {
+        overloaded_ = false;
+        overloadedEarly_.store(false, std::memory_order_relaxed);
+        stats_->overloaded.store(0, std::memory_order_relaxed);
+        std::cout << "\n--- Overload ended after "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(now - overloadStarted_).count()
+                  << "ms, rejected " << stats_->callsShed - shedAtOverloadStart_ << " calls" << std::endl;
+    }
+}
+
+void AdmissionControl::print(std::ostream& os) const
+{
+    os << "admission " << (overloaded_ ? "OVERLOADED" : "ok");
+    for (int i = 0; i < eAdmitMetrics; ++i)
+    {
+        const AdmissionMetric metric = static_cast<AdmissionMetric>(i);
+        os << " " << getAdmissionMetricStr(metric) << ":" << values_[i];
+        if (limit(metric) > 0)
+            os << "/" << limit(metric);
+    }
+    if (stats_ && stats_->overloads)
+        os << " lastOverload:" << getAdmissionMetricStr(overloadMetric_);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+#include "EventLoop.h"
+#include "Stats.h"
+
+////////////////////////////////////////////////////////////////////////////
+//AdmissionParams
+
+struct AdmissionParams
+{
+    uint32_t maxCalls = 0;         //Concurrent calls of the process (0 - no limit)
+    uint32_t maxAccountCalls = 0;  //Concurrent calls of one account, more are rejected with 486 (0 - no limit)
+    uint32_t maxQueueDepth = 0;    //Tasks waiting in the loop (0 - no limit)
+    double   maxCpu = 0;           //CPU of the host, percent of all cores (0 - no limit)
+    double   maxProcessCpu = 0;    //CPU of the process, percent of one core (0 - no limit)
+    double   resumePercent = 80;   //Overload ends when each metric falls below this percent of its limit
+    uint32_t minOverloadMs = 2000; //Overload lasts at least this time
+    uint32_t sampleMs = 500;       //Interval of CPU samples
+
+    bool hasOverloadLimits() const { return maxCalls || maxQueueDepth || (maxCpu > 0) || (maxProcessCpu > 0); }
+    bool isEnabled() const { return hasOverloadLimits() || maxAccountCalls; }
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//AdmissionControl
+//Decides whether incoming call is accepted for handling. Process is overloaded when any
+//metric (concurrent calls, tasks queued in the loop, CPU of the host from /proc/stat, CPU of
+//the process) reaches its limit; while it's overloaded incoming calls are rejected with 503.
+//Overload ends when every metric falls below 'resumePercent' of its limit and it lasted at
+//least 'minOverloadMs' (hysteresis, state doesn't flap on the edge). Calls of account which
+//already has 'maxAccountCalls' are rejected with 486. Counters and time spent in overload
+//are kept in AppStats (merged by supervisor). Invoked on the loop thread, except 'admitEarly'.
+
+enum AdmissionMetric
+{
+    eAdmitCalls,
+    eAdmitQueueDepth,
+    eAdmitCpu,
+    eAdmitProcessCpu,
+    eAdmitMetrics
+};
+
+const char* getAdmissionMetricStr(AdmissionMetric metric);
+
+class AdmissionControl
+{
+public:
+    struct Actions {
+        std::function<size_t()> calls;       //Concurrent calls
+        std::function<size_t()> queueDepth;  //Tasks waiting in the loop
+    };
+
+    AdmissionControl(EventLoop& loop) : loop_(loop) {}
+    ~AdmissionControl() { stop(); }
+
+    //Applies limits (can be invoked again to change them)
+    void start(const AdmissionParams& params, const Actions& actions, AppStats& stats);
+    void stop();
+    bool isEnabled() const { return stats_ && params_.isEnabled(); }
+    const AdmissionParams& params() const { return params_; }
+
+    //SIP code of rejection for the incoming call (0 - call is admitted)
+    uint32_t admit(size_t accountCalls);
+    //Thread safe (SDK thread): 503 while overloaded or when queue of the loop has reached its limit,
+    //so call is rejected before it waits behind the backlog (0 - loop decides by 'admit')
+    uint32_t admitEarly() const;
+    //Incoming call was rejected by 'admitEarly'
+    void onShedEarly();
+
+    bool isOverloaded() const { return overloaded_; }
+    AdmissionMetric overloadMetric() const { return overloadMetric_; }//Which caused the last overload
+    double value(AdmissionMetric metric) const { return values_[metric]; }
+    double limit(AdmissionMetric metric) const;
+    uint64_t overloadMs() const { return stats_ ? stats_->overloadMs.load() : 0; }//Total, updated by samples
+    void print(std::ostream& os) const;
+
+protected:
+    void sampleCpu();
+    void update();
+
+    EventLoop& loop_;
+    AdmissionParams params_;
+    Actions actions_;
+    AppStats* stats_ = nullptr;
+    EventLoop::TimerId sampleTimer_ = 0;
+
+    double values_[eAdmitMetrics] = {};
+    uint64_t cpuBusy_ = 0;
+    uint64_t cpuTotal_ = 0;
+    uint64_t processCpuMs_ = 0;
+    EventLoop::Clock::time_point sampled_;
+
+    bool overloaded_ = false;
+    std::atomic<bool> overloadedEarly_{ false };//Copy of 'overloaded_' for 'admitEarly'
+    std::atomic<uint32_t> queueLimit_{ 0 };     //Copy of 'maxQueueDepth' for 'admitEarly' (0 - disabled)
+    AdmissionMetric overloadMetric_ = eAdmitCalls;
+    EventLoop::Clock::time_point overloadStarted_;
+    EventLoop::Clock::time_point overloadCounted_;//Overload till this time is added to 'overloadMs'
+    uint64_t shedAtOverloadStart_ = 0;
+};
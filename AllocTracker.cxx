@@ -0,0 +1,298 @@
+#include "AllocTracker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef ALLOC_TRACKING
+
+////////////////////////////////////////////////////////////////////////////
+//Counters (zero-initialized before any constructor runs)
+
+struct AllocSlot
+{
+    std::atomic<uint64_t> allocs;
+    std::atomic<uint64_t> frees;
+    std::atomic<uint64_t> bytes;
+    std::atomic<int> tid;   //Of thread slots
+};
+
+static AllocSlot threadSlots[AllocTracker::kMaxThreads];
+static AllocSlot tagSlots[AllocTracker::kMaxTags];
+static std::atomic<const char*> tagNames[AllocTracker::kMaxTags];
+static std::atomic<size_t> threadsUsed(0);
+static std::atomic<uint16_t> tagsUsed(1);//Tag 0 - allocations outside of scopes
+static std::mutex tagsMutex;
+
+static thread_local AllocSlot* threadSlot = nullptr;
+static thread_local uint16_t threadTag = 0;
+
+static AllocSlot* currentThreadSlot()
+{
+    if (!threadSlot)
+    {
+        //Threads above limit share the last slot
+        const size_t index = threadsUsed.fetch_add(1, std::memory_order_relaxed);
+        threadSlot = &threadSlots[(index < AllocTracker::kMaxThreads) ? index : AllocTracker::kMaxThreads - 1];
+#ifdef __linux__
+        threadSlot->tid.store(static_cast<int>(syscall(SYS_gettid)), std::memory_order_relaxed);
+#endif
+    }
+    return threadSlot;
+}
+
+static inline void countAlloc(size_t size)
+{
+    AllocSlot* slot = currentThreadSlot();
+    slot->allocs.fetch_add(1, std::memory_order_relaxed);
+    slot->bytes.fetch_add(size, std::memory_order_relaxed);
+    if (threadTag)
+    {
+        tagSlots[threadTag].allocs.fetch_add(1, std::memory_order_relaxed);
+        tagSlots[threadTag].bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+static inline void countFree(void* ptr)
+{
+    if (!ptr)
+        return;
+    currentThreadSlot()->frees.fetch_add(1, std::memory_order_relaxed);
+    if (threadTag)
+        tagSlots[threadTag].frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+static AllocTracker::Counters readSlot(const AllocSlot& slot)
+{
+    AllocTracker::Counters c;
+    c.allocs = slot.allocs.load(std::memory_order_relaxed);
+    c.frees  = slot.frees.load(std::memory_order_relaxed);
+    c.bytes  = slot.bytes.load(std::memory_order_relaxed);
+    return c;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Replaced global operators
+
+static void* trackedAlloc(size_t size)
+{
+    void* ptr = malloc(size ? size : 1);
+    if (ptr) countAlloc(size);
+    return ptr;
+}
+
+static void* trackedAlignedAlloc(size_t size, std::align_val_t align)
+{
+    const size_t alignment = static_cast<size_t>(align);
+#ifdef _WIN32
+    void* ptr = _aligned_malloc(size ? size : 1, alignment);
+#else
+    void* ptr = aligned_alloc(alignment, ((size ? size : 1) + alignment - 1) / alignment * alignment);
+#endif
+    if (ptr) countAlloc(size);
+    return ptr;
+}
+
+static void trackedFree(void* ptr)
+{
+    countFree(ptr);
+    free(ptr);
+}
+
+static void trackedAlignedFree(void* ptr)
+{
+    countFree(ptr);
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void* operator new(size_t size)
+{
+    if (void* ptr = trackedAlloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    if (void* ptr = trackedAlloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+    if (void* ptr = trackedAlignedAlloc(size, align)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t align)
+{
+    if (void* ptr = trackedAlignedAlloc(size, align)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept   { return trackedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return trackedAlloc(size); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept   { return trackedAlignedAlloc(size, align); }
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return trackedAlignedAlloc(size, align); }
+
+void operator delete(void* ptr) noexcept                          { trackedFree(ptr); }
+void operator delete[](void* ptr) noexcept                        { trackedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept                  { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept                { trackedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept   { trackedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept                { trackedAlignedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept              { trackedAlignedFree(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept        { trackedAlignedFree(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept      { trackedAlignedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept   { trackedAlignedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { trackedAlignedFree(ptr); }
+
+
+////////////////////////////////////////////////////////////////////////////
+//AllocTracker
+
+bool AllocTracker::enabled()
+{
+    return true;
+}
+
+uint16_t AllocTracker::tag(const char* name)
+{
+    const uint16_t used = tagsUsed.load(std::memory_order_acquire);
+    for (uint16_t i = 1; i < used; ++i)
+        if (tagNames[i].load(std::memory_order_relaxed) == name)
+            return i;
+
+    //Not found by pointer: registered under lock, same text shares the tag
+    std::lock_guard<std::mutex> lock(tagsMutex);
+    const uint16_t count = tagsUsed.load(std::memory_order_relaxed);
+    for (uint16_t i = 1; i < count; ++i)
+        if (strcmp(tagNames[i].load(std::memory_order_relaxed), name) == 0)
+            return i;
+    if (count >= kMaxTags)
+        return 0;
+    tagNames[count].store(name, std::memory_order_relaxed);
+    tagsUsed.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+const char* AllocTracker::tagName(uint16_t tag)
+{
+    return (tag && (tag < tagsCount())) ? tagNames[tag].load(std::memory_order_relaxed) : "untagged";
+}
+
+uint16_t AllocTracker::tagsCount()
+{
+    return tagsUsed.load(std::memory_order_acquire);
+}
+
+uint16_t AllocTracker::enter(uint16_t tag)
+{
+    const uint16_t prev = threadTag;
+    threadTag = tag;
+    return prev;
+}
+
+void AllocTracker::leave(uint16_t prevTag)
+{
+    threadTag = prevTag;
+}
+
+AllocTracker::Counters AllocTracker::total()
+{
+    Counters c;
+    const size_t used = std::min<size_t>(threadsUsed.load(std::memory_order_relaxed), kMaxThreads);
+    for (size_t i = 0; i < used; ++i)
+    {
+        const Counters slot = readSlot(threadSlots[i]);
+        c.allocs += slot.allocs;
+        c.frees  += slot.frees;
+        c.bytes  += slot.bytes;
+    }
+    return c;
+}
+
+AllocTracker::Counters AllocTracker::ofTag(uint16_t tag)
+{
+    return (tag < kMaxTags) ? readSlot(tagSlots[tag]) : Counters();
+}
+
+AllocTracker::Counters AllocTracker::ofThread()
+{
+    return readSlot(*currentThreadSlot());
+}
+
+bool AllocTracker::ofThread(size_t slot, int& tid, Counters& counters)
+{
+    if ((slot >= kMaxThreads) || (slot >= threadsUsed.load(std::memory_order_relaxed)))
+        return false;
+    tid = threadSlots[slot].tid.load(std::memory_order_relaxed);
+    counters = readSlot(threadSlots[slot]);
+    return true;
+}
+
+#else
+
+bool AllocTracker::enabled()                     { return false; }
+uint16_t AllocTracker::tag(const char*)          { return 0; }
+const char* AllocTracker::tagName(uint16_t)      { return "untagged"; }
+uint16_t AllocTracker::tagsCount()               { return 1; }
+uint16_t AllocTracker::enter(uint16_t)           { return 0; }
+void AllocTracker::leave(uint16_t)               {}
+AllocTracker::Counters AllocTracker::total()     { return Counters(); }
+AllocTracker::Counters AllocTracker::ofTag(uint16_t) { return Counters(); }
+AllocTracker::Counters AllocTracker::ofThread()  { return Counters(); }
+bool AllocTracker::ofThread(size_t, int&, Counters&) { return false; }
+
+#endif
+
+void AllocTracker::print(std::ostream& os)
+{
+    if (!enabled())
+    {
+        os << "allocs: not tracked (build with ALLOC_TRACKING)";
+        return;
+    }
+
+    const Counters all = total();
+    os << "allocs:" << all.allocs << " frees:" << all.frees << " live:" << (all.allocs - all.frees)
+       << " bytes:" << all.bytes;
+
+    Counters c;
+    int tid = 0;
+    for (size_t slot = 0; ofThread(slot, tid, c); ++slot)
+    {
+        char name[32] = "";
+#ifdef __linux__
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+        if (FILE* f = fopen(path, "r"))
+        {
+            if (fgets(name, sizeof(name), f))
+                name[strcspn(name, "\n")] = '\0';
+            fclose(f);
+        }
+#endif
+        os << "\n      thread " << tid << " " << (name[0] ? name : "(exited)") << " allocs:" << c.allocs
+           << " frees:" << c.frees << " bytes:" << c.bytes;
+    }
+    for (uint16_t tag = 1; tag < tagsCount(); ++tag)
+    {
+        c = ofTag(tag);
+        if (c.allocs || c.frees)
+            os << "\n      " << tagName(tag) << " allocs:" << c.allocs << " frees:" << c.frees << " bytes:" << c.bytes;
+    }
+}
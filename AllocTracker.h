@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+////////////////////////////////////////////////////////////////////////////
+//AllocTracker
+//Counts heap allocations of each thread and of tagged scopes (callbacks of the SDK, handling
+//of events, commands). Built with ALLOC_TRACKING (cmake -DALLOC_TRACKING=ON), which replaces
+//global operator new/delete of the process (SDK libraries included); otherwise scopes are
+//empty and nothing is counted. Counters don't allocate: threads and tags are kept in fixed
+//tables, thread finds its slot by thread_local pointer.
+//
+//    ALLOC_SCOPE("OnCallIncoming");        //Tag of the code site (name is literal)
+//    ALLOC_SCOPE_NAME(getAppEventName(t)); //Name with static storage chosen at runtime
+
+class AllocTracker
+{
+public:
+    enum { kMaxThreads = 256, kMaxTags = 128 };
+
+    struct Counters {
+        uint64_t allocs = 0;
+        uint64_t frees = 0;
+        uint64_t bytes = 0;  //Requested by allocations
+
+        Counters operator-(const Counters& other) const {
+            Counters c;
+            c.allocs = allocs - other.allocs;
+            c.frees  = frees - other.frees;
+            c.bytes  = bytes - other.bytes;
+            return c;
+        }
+    };
+
+    static bool enabled();
+
+    //Registers tag or finds registered one ('name' has to stay valid, 0 - table is full)
+    static uint16_t tag(const char* name);
+    static const char* tagName(uint16_t tag);
+    static uint16_t tagsCount();
+
+    //Tag of the allocations of the current thread, returns previous one
+    static uint16_t enter(uint16_t tag);
+    static void leave(uint16_t prevTag);
+
+    static Counters total();
+    static Counters ofTag(uint16_t tag);
+    static Counters ofThread();                      //Current thread
+    static bool ofThread(size_t slot, int& tid, Counters& counters);//False when slot isn't used
+
+    static void print(std::ostream& os);
+};
+
+class AllocScope
+{
+public:
+    explicit AllocScope(uint16_t tag) : prev_(AllocTracker::enter(tag)) {}
+    ~AllocScope() { AllocTracker::leave(prev_); }
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+protected:
+    uint16_t prev_;
+};
+
+#define ALLOC_CONCAT2(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT2(a, b)
+
+#ifdef ALLOC_TRACKING
+#define ALLOC_SCOPE(name) \
+    static const uint16_t ALLOC_CONCAT(allocTag, __LINE__) = AllocTracker::tag(name); \
+    AllocScope ALLOC_CONCAT(allocScope, __LINE__)(ALLOC_CONCAT(allocTag, __LINE__))
+#define ALLOC_SCOPE_NAME(name) AllocScope ALLOC_CONCAT(allocScope, __LINE__)(AllocTracker::tag(name))
+#else
+#define ALLOC_SCOPE(name)
+#define ALLOC_SCOPE_NAME(name)
+#endif
@@ -0,0 +1,217 @@
+#include "AppEvent.h"
+
+#include "AllocTracker.h"
+#include "EventLoop.h"
+
+const char* getAppEventName(AppEvent::Type type)
+{
+    switch (type)
+    {
+        case AppEvent::eTrialModeNotified:   return "TrialModeNotified";
+        case AppEvent::eDevicesAudioChanged: return "DevicesAudioChanged";
+        case AppEvent::eAccountRegState:     return "AccountRegState";
+        case AppEvent::eNetworkState:        return "NetworkState";
+        case AppEvent::ePlayerState:         return "PlayerState";
+        case AppEvent::eRingerState:         return "RingerState";
+        case AppEvent::eCallIncoming:        return "CallIncoming";
+        case AppEvent::eCallConnected:       return "CallConnected";
+        case AppEvent::eCallTerminated:      return "CallTerminated";
+        case AppEvent::eCallProceeding:      return "CallProceeding";
+        case AppEvent::eCallTransferred:     return "CallTransferred";
+        case AppEvent::eCallRedirected:      return "CallRedirected";
+        case AppEvent::eCallDtmfReceived:    return "CallDtmfReceived";
+        case AppEvent::eCallHeld:            return "CallHeld";
+        case AppEvent::eCallSwitched:        return "CallSwitched";
+        case AppEvent::eCallAudioDetected:   return "CallAudioDetected";
+        default:                             return "Unknown";
+    }
+}
+
+const char* getAccRegStateStr(Siprix::RegState state)
+{
+    switch (state)
+    {
+        case Siprix::RegState::Success: return "Success";    
+        case Siprix::RegState::Removed: return "Removed";
+        default:                        return "Failed";
+    }
+}
+
+const char* getNetworkStateStr(Siprix::NetworkState state)
+{
+    switch (state)
+    {
+        case Siprix::NetworkState::NetworkRestored: return "Restored";
+        case Siprix::NetworkState::NetworkSwitched: return "Switched";
+        default:                                    return "Lost";
+    }
+}
+
+const char* getPlayerStateStr(Siprix::PlayerState state)
+{
+    switch (state)
+    {
+        case Siprix::PlayerState::PlayerStarted: return "PlayerStarted";
+        case Siprix::PlayerState::PlayerStopped: return "PlayerStopped";
+        default:                                 return "PlayerFailed";
+    }
+}
+
+char getDtmfToneChar(uint16_t tone)
+{
+    return (tone == 10) ? '*' : (tone==11 ? '#' : static_cast<char>(tone+'0'));
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//EventBridge
+
+//Capacity reserved for texts of pooled event (longer texts grow it once)
+static const size_t kEventTextReserve = 256;
+
+EventBridge::EventBridge(EventLoop& loop, IAppEventListener& listener, uint8_t module)
+    : loop_(loop), listener_(listener), module_(module)
+{
+}
+
+AppEvent* EventBridge::acquire()
+{
+    std::lock_guard<std::mutex> lock(poolMtx_);
+    if (freeEvents_.empty())
+    {
+        //Strings of each event get capacity of usual headers: events are taken in any order,
+        //so event which held only short texts may get long From/To later
+        std::unique_ptr<AppEvent> ev = std::make_unique<AppEvent>();
+        ev->text1.reserve(kEventTextReserve);
+        ev->text2.reserve(kEventTextReserve);
+        events_.push_back(std::move(ev));
+        freeEvents_.reserve(events_.capacity());
+        return events_.back().get();
+    }
+    AppEvent* ev = freeEvents_.back();
+    freeEvents_.pop_back();
+    return ev;
+}
+
+void EventBridge::release(AppEvent* ev)
+{
+    std::lock_guard<std::mutex> lock(poolMtx_);
+    freeEvents_.push_back(ev);
+}
+
+size_t EventBridge::pooledEvents() const
+{
+    std::lock_guard<std::mutex> lock(poolMtx_);
+    return events_.size();
+}
+
+void EventBridge::post(AppEvent::Type type, uint32_t id, uint32_t relatedId, uint32_t code,
+                       bool withVideo, const char* text1, const char* text2)
+{
+    AppEvent* ev = acquire();
+    ev->type = type;
+    ev->module = module_;
+    ev->id = id;
+    ev->relatedId = relatedId;
+    ev->code = code;
+    ev->withVideo = withVideo;
+    ev->text1.assign(text1 ? text1 : "");
+    ev->text2.assign(text2 ? text2 : "");
+    ev->time = std::chrono::steady_clock::now();
+
+    loop_.post([this, ev]() {
+        listener_.onAppEvent(*ev);
+        release(ev);
+    });
+}
+
+void EventBridge::OnTrialModeNotified()
+{
+    ALLOC_SCOPE("OnTrialModeNotified");
+    post(AppEvent::eTrialModeNotified);
+}
+
+void EventBridge::OnDevicesAudioChanged()
+{
+    ALLOC_SCOPE("OnDevicesAudioChanged");
+    post(AppEvent::eDevicesAudioChanged);
+}
+
+void EventBridge::OnAccountRegState(Siprix::AccountId accId, Siprix::RegState state, const char* response)
+{
+    ALLOC_SCOPE("OnAccountRegState");
+    post(AppEvent::eAccountRegState, accId, 0, state, false, response);
+}
+
+void EventBridge::OnNetworkState(const char* name, Siprix::NetworkState state)
+{
+    ALLOC_SCOPE("OnNetworkState");
+    post(AppEvent::eNetworkState, 0, 0, state, false, name);
+}
+
+void EventBridge::OnPlayerState(Siprix::PlayerId playerId, Siprix::PlayerState state)
+{
+    ALLOC_SCOPE("OnPlayerState");
+    post(AppEvent::ePlayerState, playerId, 0, state);
+}
+
+void EventBridge::OnRingerState(bool started)
+{
+    ALLOC_SCOPE("OnRingerState");
+    post(AppEvent::eRingerState, 0, 0, started ? 1 : 0);
+}
+
+void EventBridge::OnCallIncoming(Siprix::CallId callId, Siprix::AccountId accId, bool withVideo, const char* hdrFrom, const char* hdrTo)
+{
+    ALLOC_SCOPE("OnCallIncoming");
+    const uint32_t rejected = incomingGate_ ? incomingGate_(callId) : 0;
+    post(AppEvent::eCallIncoming, callId, accId, rejected, withVideo, hdrFrom, hdrTo);
+}
+
+void EventBridge::OnCallConnected(Siprix::CallId callId, const char* hdrFrom, const char* hdrTo, bool withVideo)
+{
+    ALLOC_SCOPE("OnCallConnected");
+    post(AppEvent::eCallConnected, callId, 0, 0, withVideo, hdrFrom, hdrTo);
+}
+
+void EventBridge::OnCallTerminated(Siprix::CallId callId, uint32_t statusCode)
+{
+    ALLOC_SCOPE("OnCallTerminated");
+    post(AppEvent::eCallTerminated, callId, 0, statusCode);
+}
+
+void EventBridge::OnCallProceeding(Siprix::CallId callId, const char* response)
+{
+    ALLOC_SCOPE("OnCallProceeding");
+    post(AppEvent::eCallProceeding, callId, 0, 0, false, response);
+}
+
+void EventBridge::OnCallTransferred(Siprix::CallId callId, uint32_t statusCode)
+{
+    ALLOC_SCOPE("OnCallTransferred");
+    post(AppEvent::eCallTransferred, callId, 0, statusCode);
+}
+
+void EventBridge::OnCallRedirected(Siprix::CallId origCallId, Siprix::CallId relatedCallId, const char* referTo)
+{
+    ALLOC_SCOPE("OnCallRedirected");
+    post(AppEvent::eCallRedirected, origCallId, relatedCallId, 0, false, referTo);
+}
+
+void EventBridge::OnCallDtmfReceived(Siprix::CallId callId, uint16_t tone)
+{
+    ALLOC_SCOPE("OnCallDtmfReceived");
+    post(AppEvent::eCallDtmfReceived, callId, 0, tone);
+}
+
+void EventBridge::OnCallHeld(Siprix::CallId callId, Siprix::HoldState state)
+{
+    ALLOC_SCOPE("OnCallHeld");
+    post(AppEvent::eCallHeld, callId, 0, state);
+}
+
+void EventBridge::OnCallSwitched(Siprix::CallId callId)
+{
+    ALLOC_SCOPE("OnCallSwitched");
+    post(AppEvent::eCallSwitched, callId);
+}
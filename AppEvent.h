@@ -0,0 +1,129 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+class EventLoop;
+
+////////////////////////////////////////////////////////////////////////////
+//AppEvent
+//Copy of the arguments of one ISiprixEventHandler callback.
+//Created on the SDK thread and handled on the thread which runs EventLoop.
+
+struct AppEvent
+{
+    enum Type : uint8_t {
+        eTrialModeNotified = 0,
+        eDevicesAudioChanged,
+        eAccountRegState,
+        eNetworkState,
+        ePlayerState,
+        eRingerState,
+        eCallIncoming,
+        eCallConnected,
+        eCallTerminated,
+        eCallProceeding,
+        eCallTransferred,
+        eCallRedirected,
+        eCallDtmfReceived,
+        eCallHeld,
+        eCallSwitched,
+        eCallAudioDetected, //Raised by the app (live tap of the recording)
+        eCount
+    };
+
+    Type     type = eTrialModeNotified;
+    uint8_t  module = 0;    //Index of the module which raised callback
+    uint32_t id = 0;        //accId, callId, playerId or origCallId (depends on type)
+    uint32_t relatedId = 0; //accId of incoming call or relatedCallId of redirected call
+    uint32_t code = 0;      //statusCode, tone, value of state enum or SIP code of incoming call rejected by bridge
+    bool     withVideo = false;
+    std::string text1;      //response, network name, hdrFrom or referTo
+    std::string text2;      //hdrTo
+    std::chrono::steady_clock::time_point time;//When SDK raised callback
+};
+
+const char* getAppEventName(AppEvent::Type type);
+const char* getAccRegStateStr(Siprix::RegState state);
+const char* getNetworkStateStr(Siprix::NetworkState state);
+const char* getPlayerStateStr(Siprix::PlayerState state);
+char        getDtmfToneChar(uint16_t tone);
+
+
+////////////////////////////////////////////////////////////////////////////
+//IAppEventListener
+
+class IAppEventListener
+{
+public:
+    virtual void onAppEvent(const AppEvent& ev) = 0;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//EventBridge
+//Receives callbacks of Siprix module and posts them to the EventLoop,
+//so application state is modified only by one thread.
+//Each module has own bridge, which marks events with the module index.
+//Events are taken from the pool of the bridge and returned to it after handling: strings
+//have capacity reserved (256) and posted task fits std::function without allocation, so callbacks don't
+//allocate memory once pool has grown to the number of events in flight.
+
+class EventBridge : public Siprix::ISiprixEventHandler
+{
+public:
+    EventBridge(EventLoop& loop, IAppEventListener& listener, uint8_t module = 0);
+
+    //Invoked on the SDK thread for incoming call before it's queued: returns SIP code of rejection
+    //(call was rejected, event carries the code) or 0. Set before module raises callbacks.
+    typedef std::function<uint32_t(Siprix::CallId callId)> IncomingGate;
+    void setIncomingGate(IncomingGate gate) { incomingGate_ = std::move(gate); }
+
+    void OnTrialModeNotified();
+    void OnDevicesAudioChanged();
+
+    void OnAccountRegState(Siprix::AccountId accId, Siprix::RegState state, const char* response);
+    void OnNetworkState(const char* name, Siprix::NetworkState state);
+    void OnPlayerState(Siprix::PlayerId playerId, Siprix::PlayerState state);
+    void OnRingerState(bool started);
+
+    void OnCallIncoming(Siprix::CallId callId, Siprix::AccountId accId, bool withVideo, const char* hdrFrom, const char* hdrTo);
+    void OnCallConnected(Siprix::CallId callId, const char* hdrFrom, const char* hdrTo, bool withVideo);
+    void OnCallTerminated(Siprix::CallId callId, uint32_t statusCode);
+    void OnCallProceeding(Siprix::CallId callId, const char* response);
+    void OnCallTransferred(Siprix::CallId callId, uint32_t statusCode);
+    void OnCallRedirected(Siprix::CallId origCallId, Siprix::CallId relatedCallId, const char* referTo);
+    void OnCallDtmfReceived(Siprix::CallId callId, uint16_t tone);
+    void OnCallHeld(Siprix::CallId callId, Siprix::HoldState state);
+    void OnCallSwitched(Siprix::CallId callId);
+
+    //Events created by the pool (max number of events in flight)
+    size_t pooledEvents() const;
+
+protected:
+    void post(AppEvent::Type type, uint32_t id = 0, uint32_t relatedId = 0, uint32_t code = 0,
+              bool withVideo = false, const char* text1 = nullptr, const char* text2 = nullptr);
+    AppEvent* acquire();
+    void release(AppEvent* ev);
+
+protected:
+    EventLoop& loop_;
+    IAppEventListener& listener_;
+    uint8_t module_;
+    IncomingGate incomingGate_;
+
+    mutable std::mutex poolMtx_;
+    std::vector<std::unique_ptr<AppEvent>> events_;
+    std::vector<AppEvent*> freeEvents_;
+};
@@ -0,0 +1,491 @@
+#include "AudioAnalysis.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "Wav.h"
+#include "WorkPool.h"
+
+static const double kPi = 3.14159265358979323846;
+
+//Min normalized correlation to accept peak as position of the signal
+static const double kMinPeak = 0.3;
+
+//Block of signal is lost when it correlates weaker
+static const double kBlockCorrelation = 0.5;
+static const uint32_t kBlockMs = 20;
+
+////////////////////////////////////////////////////////////////////////////
+//RealFft
+
+static inline RealFft::Cpx cmul(RealFft::Cpx a, RealFft::Cpx b)
+{
+    return RealFft::Cpx{ a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+}
+
+static inline RealFft::Cpx conj(RealFft::Cpx a)
+{
+    return RealFft::Cpx{ a.re, -a.im };
+}
+
+size_t RealFft::nextPow2(size_t n)
+{
+    size_t size = 4;
+    while (size < n)
+        size <<= 1;
+    return size;
+}
+
+RealFft::RealFft(size_t size) : size_(nextPow2(size))
+{
+    const size_t half = size_ / 2;
+
+    uint32_t bits = 0;
+    while ((size_t(1) << bits) < half)
+        ++bits;
+    bitrev_.resize(half);
+    for (size_t i = 0; i < half; ++i)
+    {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; ++b)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        bitrev_[i] = r;
+    }
+
+    //Tables are computed in double precision
+    twiddles_.resize(half / 2);
+    for (size_t k = 0; k < twiddles_.size(); ++k)
+    {
+        const double a = -2 * kPi * k / half;
+        twiddles_[k] = Cpx{ static_cast<float>(cos(a)), static_cast<float>(sin(a)) };
+    }
+    split_.resize(half + 1);
+    for (size_t k = 0; k <= half; ++k)
+    {
+        const double a = -2 * kPi * k / size_;
+        split_[k] = Cpx{ static_cast<float>(cos(a)), static_cast<float>(sin(a)) };
+    }
+}
+
+void RealFft::fft(Cpx* data) const
+{
+    const size_t n = size_ / 2;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const size_t j = bitrev_[i];
+        if (i < j)
+            std::swap(data[i], data[j]);
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        const size_t half = len / 2;
+        const size_t step = n / len;
+        for (size_t start = 0; start < n; start += len)
+        {
+            Cpx* a = data + start;
+            Cpx* b = a + half;
+            for (size_t j = 0; j < half; ++j)
+            {
+                const Cpx t = cmul(b[j], twiddles_[j * step]);
+                b[j] = Cpx{ a[j].re - t.re, a[j].im - t.im };
+                a[j] = Cpx{ a[j].re + t.re, a[j].im + t.im };
+            }
+        }
+    }
+}
+
+void RealFft::forward(const float* in, Cpx* out) const
+{
+    //Even samples - real part, odd - imaginary
+    const size_t m = size_ / 2;
+    for (size_t n = 0; n < m; ++n)
+        out[n] = Cpx{ in[2 * n], in[2 * n + 1] };
+    fft(out);
+
+    //X[k] = E[k] + W^k*O[k], where E = (Z[k] + Z*[m-k])/2, O = -i(Z[k] - Z*[m-k])/2
+    const Cpx z0 = out[0];
+    out[0] = Cpx{ z0.re + z0.im, 0 };
+    out[m] = Cpx{ z0.re - z0.im, 0 };
+    for (size_t k = 1; k <= m / 2; ++k)
+    {
+        const Cpx zk = out[k];
+        const Cpx zmk = conj(out[m - k]);
+        const Cpx e{ (zk.re + zmk.re) / 2, (zk.im + zmk.im) / 2 };
+        const Cpx o{ (zk.im - zmk.im) / 2, -(zk.re - zmk.re) / 2 };
+
+        const Cpx to = cmul(split_[k], o);
+        out[k] = Cpx{ e.re + to.re, e.im + to.im };
+        if (k != m - k)
+        {
+            //E[m-k] = E*[k], O[m-k] = O*[k]
+            const Cpx tmo = cmul(split_[m - k], conj(o));
+            out[m - k] = Cpx{ e.re + tmo.re, -e.im + tmo.im };
+        }
+    }
+}
+
+void RealFft::inverse(Cpx* in, float* out) const
+{
+    //Z[k] = E[k] + i*O[k], where E = (X[k] + X*[m-k])/2, O = (X[k] - X*[m-k])*W^-k/2
+    const size_t m = size_ / 2;
+    for (size_t k = 0; k <= m / 2; ++k)
+    {
+        const Cpx xk = in[k];
+        const Cpx xmk = in[m - k];
+
+        const Cpx e{ (xk.re + xmk.re) / 2, (xk.im - xmk.im) / 2 };
+        const Cpx o = cmul(Cpx{ (xk.re - xmk.re) / 2, (xk.im + xmk.im) / 2 }, conj(split_[k]));
+        in[k] = Cpx{ e.re - o.im, e.im + o.re };
+        if (k != m - k)
+        {
+            const Cpx o2 = cmul(Cpx{ (xmk.re - xk.re) / 2, (xmk.im + xk.im) / 2 }, conj(split_[m - k]));
+            in[m - k] = Cpx{ e.re - o2.im, -e.im + o2.re };
+        }
+    }
+
+    //Inverse complex FFT by conjugation
+    for (size_t n = 0; n < m; ++n)
+        in[n].im = -in[n].im;
+    fft(in);
+    const float scale = 1.0f / m;
+    for (size_t n = 0; n < m; ++n)
+    {
+        out[2 * n]     =  in[n].re * scale;
+        out[2 * n + 1] = -in[n].im * scale;
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Test signals
+
+std::vector<int16_t> makeChirp(uint32_t sampleRate, uint32_t durationMs, double f0, double f1)
+{
+    const size_t count = static_cast<size_t>(sampleRate) * durationMs / 1000;
+    const size_t fade = sampleRate / 100;
+    const double duration = durationMs / 1000.0;
+
+    std::vector<int16_t> samples(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const double t = static_cast<double>(i) / sampleRate;
+        const double phase = 2 * kPi * (f0 * t + (f1 - f0) * t * t / (2 * duration));
+        double gain = 0.5;
+        if (i < fade)               gain *= 0.5 - 0.5 * cos(kPi * i / fade);
+        else if (i >= count - fade) gain *= 0.5 - 0.5 * cos(kPi * (count - 1 - i) / fade);
+        samples[i] = static_cast<int16_t>(32767 * gain * sin(phase));
+    }
+    return samples;
+}
+
+std::vector<int16_t> makeMls(uint32_t order)
+{
+    //Taps of maximal length Fibonacci LFSR (bit numbers counted from 1)
+    static const uint32_t kTaps[][4] = {
+        { 8, 6, 5, 4 }, { 9, 5, 0, 0 }, { 10, 7, 0, 0 }, { 11, 9, 0, 0 }, { 12, 11, 10, 4 }, { 13, 12, 11, 8 },
+        { 14, 13, 12, 2 }, { 15, 14, 0, 0 }, { 16, 15, 13, 4 }, { 17, 14, 0, 0 }, { 18, 11, 0, 0 }, { 19, 18, 17, 14 },
+        { 20, 17, 0, 0 }
+    };
+    order = std::min<uint32_t>(std::max<uint32_t>(order, 8), 20);
+    const uint32_t* taps = kTaps[order - 8];
+
+    const uint32_t length = (1u << order) - 1;
+    std::vector<int16_t> samples(length);
+    uint32_t state = 1;
+    for (uint32_t i = 0; i < length; ++i)
+    {
+        uint32_t bit = 0;
+        for (int t = 0; (t < 4) && taps[t]; ++t)
+            bit ^= state >> (order - taps[t]);
+        state = (state >> 1) | ((bit & 1) << (order - 1));
+        samples[i] = (state & 1) ? 10000 : -10000;
+    }
+    return samples;
+}
+
+bool writeTestSignal(const std::string& path, const std::string& kind, std::string& err, uint32_t sampleRate)
+{
+    std::vector<int16_t> signal;
+    if (kind == "chirp")
+        signal = makeChirp(sampleRate, 1000, 300, 3400);//Passes narrowband codecs
+    else if (kind == "mls")
+    {
+        uint32_t order = 0;
+        while ((2u << order) <= sampleRate + 1) ++order;
+        signal = makeMls(order);
+    }
+    else
+    {
+        err = "Unknown test signal '" + kind + "' (expected 'chirp' or 'mls')";
+        return false;
+    }
+
+    //Silence lets measure delay up to its length without wrapping into previous playback
+    std::vector<int16_t> samples(sampleRate / 5, 0);
+    samples.insert(samples.end(), signal.begin(), signal.end());
+    samples.insert(samples.end(), sampleRate / 2, 0);
+    return writeWav(path, sampleRate, samples, err);
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//LatencyAnalyzer
+
+static std::vector<float> resample(const std::vector<float>& in, uint32_t fromRate, uint32_t toRate)
+{
+    if (fromRate == toRate)
+        return in;
+
+    const size_t count = static_cast<size_t>(static_cast<double>(in.size()) * toRate / fromRate);
+    std::vector<float> out(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const double pos = static_cast<double>(i) * fromRate / toRate;
+        const size_t idx = static_cast<size_t>(pos);
+        const double frac = pos - idx;
+        const float a = in[std::min(idx, in.size() - 1)];
+        const float b = in[std::min(idx + 1, in.size() - 1)];
+        out[i] = static_cast<float>(a + (b - a) * frac);
+    }
+    return out;
+}
+
+LatencyAnalyzer::LatencyAnalyzer(const std::vector<float>& reference, uint32_t refRate, uint32_t sampleRate, uint32_t maxDelayMs)
+    : sampleRate_(sampleRate),
+      reference_(resample(reference, refRate, sampleRate)),
+      maxLag_(static_cast<size_t>(sampleRate) * maxDelayMs / 1000),
+      fft_(reference_.size() + maxLag_)
+{
+    for (float v : reference_)
+        refEnergy_ += static_cast<double>(v) * v;
+
+    std::vector<float> padded(fft_.size(), 0);
+    std::copy(reference_.begin(), reference_.end(), padded.begin());
+    refSpectrum_.resize(fft_.size() / 2 + 1);
+    fft_.forward(padded.data(), refSpectrum_.data());
+    for (RealFft::Cpx& c : refSpectrum_)
+        c.im = -c.im;
+}
+
+LatencyResult LatencyAnalyzer::analyze(const std::vector<float>& recording, Scratch& scratch) const
+{
+    LatencyResult result;
+    const size_t refLen = reference_.size();
+    if (!refLen || (refEnergy_ <= 0) || recording.empty())
+        return result;
+
+    //Correlation c[k] = sum(rec[n+k] * ref[n]) = IFFT(REC * conj(REF)),
+    //window fits into FFT size, so circular correlation doesn't wrap for k <= maxLag
+    const size_t window = std::min(recording.size(), refLen + maxLag_);
+    scratch.signal.assign(fft_.size(), 0);
+    std::copy(recording.begin(), recording.begin() + window, scratch.signal.begin());
+    scratch.spectrum.resize(refSpectrum_.size());
+    fft_.forward(scratch.signal.data(), scratch.spectrum.data());
+    for (size_t k = 0; k < refSpectrum_.size(); ++k)
+        scratch.spectrum[k] = cmul(scratch.spectrum[k], refSpectrum_[k]);
+    fft_.inverse(scratch.spectrum.data(), scratch.signal.data());
+    const float* corr = scratch.signal.data();
+
+    //Normalize by energy of the recording under reference (sliding window)
+    double energy = 0;
+    for (size_t n = 0; n < std::min(refLen, window); ++n)
+        energy += static_cast<double>(recording[n]) * recording[n];
+
+    const size_t lastLag = std::min(maxLag_, window - 1);
+    size_t bestLag = 0;
+    double best = 0;
+    for (size_t k = 0; k <= lastLag; ++k)
+    {
+        if (energy > 1e-9)
+        {
+            const double ncc = std::fabs(corr[k]) / std::sqrt(refEnergy_ * energy);
+            if (ncc > best) { best = ncc; bestLag = k; }
+        }
+        const double out = recording[k];
+        const double in = (k + refLen < window) ? recording[k + refLen] : 0;
+        energy += in * in - out * out;
+    }
+
+    result.peak = std::min(best, 1.0);
+    result.found = best >= kMinPeak;
+    if (!result.found)
+        return result;
+
+    //Parabolic interpolation gives sub-sample delay
+    double lag = static_cast<double>(bestLag);
+    if ((bestLag > 0) && (bestLag < lastLag))
+    {
+        const double y0 = std::fabs(corr[bestLag - 1]), y1 = std::fabs(corr[bestLag]), y2 = std::fabs(corr[bestLag + 1]);
+        const double denom = y0 - 2 * y1 + y2;
+        if (denom < 0)
+            lag += 0.5 * (y0 - y2) / denom;
+    }
+    result.delayMs = lag * 1000.0 / sampleRate_;
+
+    measureLoss(recording, bestLag, result);
+    return result;
+}
+
+void LatencyAnalyzer::measureLoss(const std::vector<float>& recording, size_t lag, LatencyResult& result) const
+{
+    const size_t blockLen = sampleRate_ * kBlockMs / 1000;
+    const size_t blocks = reference_.size() / blockLen;
+    if (!blocks)
+        return;
+
+    //Blocks of silence in reference are skipped (20dB below average)
+    const double minEnergy = 0.01 * refEnergy_ / blocks;
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        const float* ref = reference_.data() + b * blockLen;
+        double refEnergy = 0;
+        for (size_t n = 0; n < blockLen; ++n)
+            refEnergy += static_cast<double>(ref[n]) * ref[n];
+        if (refEnergy < minEnergy)
+            continue;
+
+        ++result.blocks;
+        const size_t offset = lag + b * blockLen;
+        if (offset + blockLen > recording.size())
+        {
+            ++result.lostBlocks;
+            continue;
+        }
+
+        const float* rec = recording.data() + offset;
+        double cross = 0, recEnergy = 0;
+        for (size_t n = 0; n < blockLen; ++n)
+        {
+            cross += static_cast<double>(ref[n]) * rec[n];
+            recEnergy += static_cast<double>(rec[n]) * rec[n];
+        }
+        if ((recEnergy <= 0) || (std::fabs(cross) / std::sqrt(refEnergy * recEnergy) < kBlockCorrelation))
+            ++result.lostBlocks;
+    }
+    result.lossPercent = result.blocks ? 100.0 * result.lostBlocks / result.blocks : 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//LatencySummary
+
+void LatencySummary::add(const LatencyResult& r)
+{
+    ++total_;
+    if (!r.found)
+        return;
+    delays_.push_back(r.delayMs);
+    blocks_ += r.blocks;
+    lostBlocks_ += r.lostBlocks;
+}
+
+double LatencySummary::avgMs() const
+{
+    double sum = 0;
+    for (double d : delays_)
+        sum += d;
+    return delays_.empty() ? 0 : sum / delays_.size();
+}
+
+double LatencySummary::jitterMs() const
+{
+    if (delays_.size() < 2)
+        return 0;
+    const double avg = avgMs();
+    double sum = 0;
+    for (double d : delays_)
+        sum += (d - avg) * (d - avg);
+    return std::sqrt(sum / (delays_.size() - 1));
+}
+
+void LatencySummary::print(std::ostream& os) const
+{
+    os << "latency runs:" << total_ << " found:" << delays_.size();
+    if (delays_.empty())
+        return;
+
+    std::vector<double> sorted = delays_;
+    std::sort(sorted.begin(), sorted.end());
+    const auto pct = [&sorted](double p) { return sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * p / 100))]; };
+
+    const std::ios::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(1)
+       << " avg:" << avgMs() << "ms min:" << sorted.front() << " p50:" << pct(50) << " p95:" << pct(95)
+       << " max:" << sorted.back() << " jitter:" << jitterMs() << "ms loss:" << lossPercent() << "%";
+    os.flags(flags);
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Offline analysis
+
+int runLatencyAnalysis(const std::string& referencePath, const std::string& path, uint32_t maxDelayMs)
+{
+    const auto began = std::chrono::steady_clock::now();
+
+    std::string err;
+    WavAudio reference;
+    std::vector<std::string> files;
+    if (!readWav(referencePath, reference, err) || !listWavFiles(path, files, err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+
+    //Analyzers (reference spectrum) are shared by threads, one per sample rate of recordings
+    std::mutex mutex;
+    std::map<uint32_t, std::shared_ptr<const LatencyAnalyzer>> analyzers;
+    const auto analyzerFor = [&](uint32_t rate) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<const LatencyAnalyzer>& a = analyzers[rate];
+        if (!a)
+            a = std::make_shared<LatencyAnalyzer>(reference.samples, reference.sampleRate, rate, maxDelayMs);
+        return a;
+    };
+
+    //Part of recording after the searched window isn't read (at most 48kHz)
+    const uint64_t refMs = 1000ull * reference.samples.size() / reference.sampleRate;
+    const size_t maxSamples = static_cast<size_t>((refMs + maxDelayMs) * 48);
+
+    struct Item {
+        LatencyResult result;
+        std::string err;
+    };
+    std::vector<Item> items(files.size());
+    std::vector<LatencyAnalyzer::Scratch> scratch(std::max(1u, std::thread::hardware_concurrency()));
+    const WorkStealingPool::Stats stats = WorkStealingPool::run(files.size(), scratch.size(), [&](size_t i, size_t worker) {
+        WavAudio audio;
+        if (readWav(files[i], audio, items[i].err, maxSamples))
+            items[i].result = analyzerFor(audio.sampleRate)->analyze(audio.samples, scratch[worker]);
+    });
+
+    LatencySummary summary;
+    std::cout << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const Item& item = items[i];
+        std::cout << files[i];
+        if (!item.err.empty())
+            std::cout << " error: " << item.err << "\n";
+        else if (!item.result.found)
+            std::cout << " not found (peak:" << std::setprecision(2) << item.result.peak << std::setprecision(1) << ")\n";
+        else
+            std::cout << " delay:" << item.result.delayMs << "ms peak:" << std::setprecision(2) << item.result.peak
+                      << std::setprecision(1) << " loss:" << item.result.lossPercent << "%\n";
+        if (item.err.empty())
+            summary.add(item.result);
+    }
+
+    const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+    summary.print(std::cout);
+    std::cout << "\nAnalyzed " << files.size() << " files in " << elapsedMs << "ms by " << stats.threads << " threads" << std::endl;
+    return summary.found() ? 0 : 2;
+}
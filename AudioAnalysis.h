@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////
+//RealFft
+//FFT of real signal of size N (power of 2), computed as complex FFT of size N/2
+//(even/odd samples packed into re/im) plus split step. Tables are built once,
+//transforms don't allocate and may be invoked by several threads at once.
+
+class RealFft
+{
+public:
+    struct Cpx { float re, im; };
+
+    explicit RealFft(size_t size);
+    size_t size() const { return size_; }
+
+    //'in' - N samples, 'out' - N/2+1 bins
+    void forward(const float* in, Cpx* out) const;
+
+    //'in' - N/2+1 bins (modified), 'out' - N samples. inverse(forward(x)) == x.
+    void inverse(Cpx* in, float* out) const;
+
+    static size_t nextPow2(size_t n);
+
+protected:
+    void fft(Cpx* data) const;//In place, size N/2
+
+    size_t size_;
+    std::vector<uint32_t> bitrev_;//Permutation of N/2 points
+    std::vector<Cpx> twiddles_;   //exp(-2*pi*i*k/(N/2)), k < N/4
+    std::vector<Cpx> split_;      //exp(-2*pi*i*k/N), k <= N/2
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//Test signals (mono PCM16) for latency measurement
+
+//Linear sweep 'f0'..'f1' Hz with short fades
+std::vector<int16_t> makeChirp(uint32_t sampleRate, uint32_t durationMs, double f0, double f1);
+
+//Maximum length sequence of 2^order-1 samples
+std::vector<int16_t> makeMls(uint32_t order);
+
+//Writes test signal ('chirp' or 'mls') surrounded by silence
+bool writeTestSignal(const std::string& path, const std::string& kind, std::string& err, uint32_t sampleRate = 16000);
+
+
+////////////////////////////////////////////////////////////////////////////
+//LatencyAnalyzer
+//Finds delay of reference signal in recording by cross-correlation (computed in frequency domain).
+//Signal loss is estimated in 20ms blocks: block of reference is lost when it doesn't correlate
+//with recording at the found delay (dropped packets, concealment, silence).
+
+struct LatencyResult
+{
+    bool   found = false; //Peak of correlation is strong enough
+    double delayMs = 0;
+    double peak = 0;      //Normalized correlation at the delay (0..1)
+    double lossPercent = 0;
+    uint32_t blocks = 0;  //Blocks of reference with signal
+    uint32_t lostBlocks = 0;
+};
+
+class LatencyAnalyzer
+{
+public:
+    //Reference is resampled to 'sampleRate' of recordings when it differs
+    LatencyAnalyzer(const std::vector<float>& reference, uint32_t refRate, uint32_t sampleRate, uint32_t maxDelayMs);
+
+    uint32_t sampleRate() const { return sampleRate_; }
+
+    //Buffers of one thread
+    struct Scratch {
+        std::vector<float> signal;
+        std::vector<RealFft::Cpx> spectrum;
+    };
+
+    //Thread-safe
+    LatencyResult analyze(const std::vector<float>& recording, Scratch& scratch) const;
+
+protected:
+    void measureLoss(const std::vector<float>& recording, size_t lag, LatencyResult& result) const;
+
+    uint32_t sampleRate_;
+    std::vector<float> reference_;
+    double refEnergy_ = 0;
+    size_t maxLag_;
+    RealFft fft_;
+    std::vector<RealFft::Cpx> refSpectrum_;//Conjugated
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//LatencySummary
+//Delays of repeated measurements: average, percentiles and jitter (standard deviation).
+
+class LatencySummary
+{
+public:
+    void add(const LatencyResult& r);
+    void print(std::ostream& os) const;
+
+    size_t count() const { return total_; }
+    size_t found() const { return delays_.size(); }
+    double avgMs() const;
+    double jitterMs() const;
+    double lossPercent() const { return blocks_ ? 100.0 * lostBlocks_ / blocks_ : 0; }
+
+protected:
+    std::vector<double> delays_;
+    size_t total_ = 0;
+    uint64_t blocks_ = 0;
+    uint64_t lostBlocks_ = 0;
+};
+
+
+//Analyzes recordings ('path' - file or folder with *.wav) in parallel and prints results.
+//Returns process exit code.
+int runLatencyAnalysis(const std::string& referencePath, const std::string& path, uint32_t maxDelayMs);
@@ -0,0 +1,343 @@
+#include "AudioQuality.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define QUALITY_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "Wav.h"
+#include "WorkPool.h"
+
+static const double kPi = 3.14159265358979323846;
+static const uint32_t kFrameMs = 20;
+
+//DTMF: 205 samples at 8kHz (~25.6ms), tone of 2 blocks gives digit
+static const double kDtmfBlockSec = 205.0 / 8000;
+static const float kDtmfFreqs[8] = { 697, 770, 852, 941, 1209, 1336, 1477, 1633 };
+static const char kDtmfDigits[4][5] = { "123A", "456B", "789C", "*0#D" };
+static const double kDtmfMinDb = -40;     //Min level of the block
+static const double kDtmfMinTone = 0.2;   //Min part of block energy of each tone
+static const double kDtmfMinPair = 0.7;   //Min part of block energy of both tones
+static const double kDtmfMaxOther = 0.15; //Max power of other frequency of the group (relative to the tone)
+
+const char* qualityVerdictName(QualityVerdict verdict)
+{
+    switch (verdict)
+    {
+        case eQualityOk:           return "OK";
+        case eQualityLow:          return "LOW";
+        case eQualityClipped:      return "CLIPPED";
+        case eQualityDeadAir:      return "DEAD_AIR";
+        case eQualityDtmfMismatch: return "DTMF";
+        case eQualitySilent:       return "SILENT";
+        case eQualityError:        return "ERROR";
+        default:                   return "?";
+    }
+}
+
+static double toDb(double meanSquare)
+{
+    return (meanSquare > 0) ? 10 * log10(meanSquare / (32768.0 * 32768.0)) : -100;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Kernels
+
+struct LevelStats
+{
+    uint64_t sumSq = 0;
+    int32_t  peak = 0;     //Max magnitude
+    uint32_t clipped = 0;  //Samples with magnitude 'clipLevel' and above
+};
+
+//'n' - length of the frame (< 256K samples, so counters of SIMD lanes don't overflow)
+static LevelStats levelStats(const int16_t* x, size_t n, int16_t clipLevel)
+{
+    LevelStats st;
+    int32_t maxV = 0, minV = 0;
+    size_t i = 0;
+#ifdef QUALITY_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i hi = _mm_set1_epi16(static_cast<int16_t>(clipLevel - 1));
+    const __m128i lo = _mm_set1_epi16(static_cast<int16_t>(1 - clipLevel));
+    __m128i acc = zero, vmax = zero, vmin = zero, clips = zero;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        //Pairs of squares (up to 2^31, so lanes are zero-extended as unsigned)
+        const __m128i sq = _mm_madd_epi16(v, v);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+        vmax = _mm_max_epi16(vmax, v);
+        vmin = _mm_min_epi16(vmin, v);
+        //Mask of clipped lanes is -1
+        clips = _mm_sub_epi16(clips, _mm_or_si128(_mm_cmpgt_epi16(v, hi), _mm_cmplt_epi16(v, lo)));
+    }
+    uint64_t sums[2];
+    int16_t maxs[8], mins[8], counts[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), acc);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs), vmax);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(mins), vmin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(counts), clips);
+    st.sumSq = sums[0] + sums[1];
+    for (int k = 0; k < 8; ++k)
+    {
+        maxV = std::max<int32_t>(maxV, maxs[k]);
+        minV = std::min<int32_t>(minV, mins[k]);
+        st.clipped += static_cast<uint16_t>(counts[k]);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        const int32_t v = x[i];
+        st.sumSq += static_cast<uint64_t>(v * v);
+        maxV = std::max(maxV, v);
+        minV = std::min(minV, v);
+        if ((v >= clipLevel) || (v <= -clipLevel))
+            ++st.clipped;
+    }
+    st.peak = std::max(maxV, -minV);
+    return st;
+}
+
+//Powers of Goertzel filters with coefficients 'coef' (2*cos(w) of 8 frequencies)
+static void goertzelBank(const int16_t* x, size_t n, const float coef[8], float power[8])
+{
+#ifdef QUALITY_SSE2
+    const __m128 c0 = _mm_loadu_ps(coef);
+    const __m128 c1 = _mm_loadu_ps(coef + 4);
+    __m128 a1 = _mm_setzero_ps(), a2 = a1, b1 = a1, b2 = a1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const __m128 v = _mm_set1_ps(static_cast<float>(x[i]));
+        const __m128 a0 = _mm_sub_ps(_mm_add_ps(v, _mm_mul_ps(c0, a1)), a2);
+        const __m128 b0 = _mm_sub_ps(_mm_add_ps(v, _mm_mul_ps(c1, b1)), b2);
+        a2 = a1; a1 = a0;
+        b2 = b1; b1 = b0;
+    }
+    //s1^2 + s2^2 - c*s1*s2
+    const __m128 pa = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(a1, a1), _mm_mul_ps(a2, a2)), _mm_mul_ps(c0, _mm_mul_ps(a1, a2)));
+    const __m128 pb = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(b1, b1), _mm_mul_ps(b2, b2)), _mm_mul_ps(c1, _mm_mul_ps(b1, b2)));
+    _mm_storeu_ps(power, pa);
+    _mm_storeu_ps(power + 4, pb);
+#else
+    float s1[8] = {}, s2[8] = {};
+    for (size_t i = 0; i < n; ++i)
+    {
+        const float v = static_cast<float>(x[i]);
+        for (int k = 0; k < 8; ++k)
+        {
+            const float s0 = v + coef[k] * s1[k] - s2[k];
+            s2[k] = s1[k];
+            s1[k] = s0;
+        }
+    }
+    for (int k = 0; k < 8; ++k)
+        power[k] = s1[k] * s1[k] + s2[k] * s2[k] - coef[k] * s1[k] * s2[k];
+#endif
+}
+
+//Strongest frequency of the group, false when others aren't much weaker
+static bool dtmfTone(const float* power, double& best, int& index)
+{
+    index = static_cast<int>(std::max_element(power, power + 4) - power);
+    best = power[index];
+    for (int k = 0; k < 4; ++k)
+    {
+        if ((k != index) && (power[k] > best * kDtmfMaxOther))
+            return false;
+    }
+    return true;
+}
+
+static std::string detectDtmf(const int16_t* x, size_t count, uint32_t sampleRate)
+{
+    float coef[8];
+    for (int k = 0; k < 8; ++k)
+        coef[k] = static_cast<float>(2 * cos(2 * kPi * kDtmfFreqs[k] / sampleRate));
+
+    const size_t block = static_cast<size_t>(sampleRate * kDtmfBlockSec + 0.5);
+    const double minMeanSquare = 32768.0 * 32768.0 * pow(10, kDtmfMinDb / 10);
+
+    std::string digits;
+    char last = 0;
+    bool emitted = false;
+    for (size_t pos = 0; pos + block <= count; pos += block)
+    {
+        char digit = 0;
+        const double energy = static_cast<double>(levelStats(x + pos, block, 32767).sumSq);
+        if (energy >= minMeanSquare * block)
+        {
+            float power[8];
+            goertzelBank(x + pos, block, coef, power);
+
+            //Pure tone of amplitude A gives power (A*N/2)^2 and energy N*A^2/2
+            double row, col;
+            int r, c;
+            const double scale = 2.0 / (block * energy);
+            if (dtmfTone(power, row, r) && dtmfTone(power + 4, col, c) &&
+                (row * scale >= kDtmfMinTone) && (col * scale >= kDtmfMinTone) && ((row + col) * scale >= kDtmfMinPair))
+                digit = kDtmfDigits[r][c];
+        }
+
+        //Digit is accepted once, when it's detected in 2 consecutive blocks
+        if (digit && (digit == last) && !emitted)
+        {
+            digits += digit;
+            emitted = true;
+        }
+        else if (digit != last)
+            emitted = false;
+        last = digit;
+    }
+    return digits;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Analysis
+
+QualityResult analyzeQuality(const std::string& path, const QualityParams& params, std::vector<int16_t>& buf)
+{
+    QualityResult r;
+    WavMapping wav;
+    if (!wav.open(path, r.error))
+        return r;
+
+    const WavInfo& info = wav.info();
+    const int16_t* x = wav.samples(buf);
+    const size_t count = wav.frames();
+    r.bytes = wav.fileSize();
+    r.durationSec = static_cast<double>(count) / info.sampleRate;
+
+    //Max magnitudes of 8-bit formats are lower
+    const int16_t clipLevel = (info.format == eWavAlaw) ? 32256 : (info.format == eWavMulaw) ? 32124 : 32767;
+
+    const size_t frame = std::max<size_t>(1, info.sampleRate * kFrameMs / 1000);
+    const double silenceMeanSquare = 32768.0 * 32768.0 * pow(10, params.silenceDb / 10);
+    uint64_t activeSumSq = 0, activeSamples = 0, clipped = 0;
+    size_t silentFrames = 0, frames = 0, silentRun = 0, longestRun = 0;
+    int32_t peak = 0;
+    const auto endSilence = [&]() {
+        if (silentRun * kFrameMs >= params.deadAirMs)
+        {
+            ++r.deadAirSegments;
+            longestRun = std::max(longestRun, silentRun);
+        }
+        silentRun = 0;
+    };
+    for (size_t pos = 0; pos < count; pos += frame, ++frames)
+    {
+        const size_t n = std::min(frame, count - pos);
+        const LevelStats st = levelStats(x + pos, n, clipLevel);
+        peak = std::max(peak, st.peak);
+        clipped += st.clipped;
+        if (static_cast<double>(st.sumSq) < silenceMeanSquare * n)
+        {
+            ++silentFrames;
+            ++silentRun;
+            continue;
+        }
+        endSilence();
+        activeSumSq += st.sumSq;
+        activeSamples += n;
+    }
+    endSilence();
+
+    r.activeDb = activeSamples ? toDb(static_cast<double>(activeSumSq) / activeSamples) : -100;
+    r.peakDb = toDb(static_cast<double>(peak) * peak);
+    r.clipPercent = count ? 100.0 * clipped / count : 0;
+    r.silencePercent = frames ? 100.0 * silentFrames / frames : 0;
+    r.longestDeadAirSec = longestRun * kFrameMs / 1000.0;
+    r.dtmf = detectDtmf(x, count, info.sampleRate);
+
+    if (!activeSamples)                                                     r.verdict = eQualitySilent;
+    else if (!params.expectDtmf.empty() && (r.dtmf != params.expectDtmf))   r.verdict = eQualityDtmfMismatch;
+    else if (r.deadAirSegments)                                             r.verdict = eQualityDeadAir;
+    else if (r.clipPercent > params.maxClipPercent)                         r.verdict = eQualityClipped;
+    else if (r.activeDb < params.lowDb)                                     r.verdict = eQualityLow;
+    else                                                                    r.verdict = eQualityOk;
+    return r;
+}
+
+int runQualityAnalysis(const std::string& path, const QualityParams& params)
+{
+    const auto began = std::chrono::steady_clock::now();
+
+    std::string err;
+    std::vector<std::string> files;
+    if (!listWavFiles(path, files, err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+
+    //Largest files are dealt first, so threads finish at the same time
+    std::vector<std::pair<uint64_t, size_t>> order;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        struct stat st;
+        order.emplace_back((stat(files[i].c_str(), &st) == 0) ? static_cast<uint64_t>(st.st_size) : 0, i);
+    }
+    std::sort(order.begin(), order.end(), [](const std::pair<uint64_t, size_t>& a, const std::pair<uint64_t, size_t>& b) {
+        return a.first > b.first;
+    });
+
+    std::vector<QualityResult> results(files.size());
+    std::vector<std::vector<int16_t>> buffers(std::max(1u, std::thread::hardware_concurrency()));
+    const WorkStealingPool::Stats stats = WorkStealingPool::run(files.size(), buffers.size(), [&](size_t i, size_t worker) {
+        const size_t index = order[i].second;
+        results[index] = analyzeQuality(files[index], params, buffers[worker]);
+    });
+
+    size_t verdicts[eQualityVerdicts] = {};
+    uint64_t bytes = 0;
+    double audioSec = 0;
+    const std::ios::fmtflags flags = std::cout.flags();
+    std::cout << std::left << std::setw(9) << "verdict" << std::right << std::setw(9) << "dur(s)" << std::setw(8) << "level"
+              << std::setw(8) << "peak" << std::setw(8) << "clip%" << std::setw(9) << "silence%" << std::setw(12) << "deadAir(s)"
+              << "  " << std::left << std::setw(12) << "dtmf" << "file\n" << std::fixed;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const QualityResult& r = results[i];
+        ++verdicts[r.verdict];
+        bytes += r.bytes;
+        audioSec += r.durationSec;
+
+        std::cout << std::left << std::setw(9) << qualityVerdictName(r.verdict) << std::right;
+        if (r.verdict == eQualityError)
+        {
+            std::cout << r.error << "\n";
+            continue;
+        }
+        char deadAir[32];//Segments/longest
+        snprintf(deadAir, sizeof(deadAir), "%u/%.1f", r.deadAirSegments, r.longestDeadAirSec);
+        std::cout << std::setprecision(1) << std::setw(9) << r.durationSec << std::setw(8) << r.activeDb
+                  << std::setw(8) << r.peakDb << std::setprecision(2) << std::setw(8) << r.clipPercent
+                  << std::setprecision(1) << std::setw(9) << r.silencePercent << std::setw(12) << deadAir
+                  << "  " << std::left << std::setw(12) << (r.dtmf.empty() ? "-" : r.dtmf) << files[i] << "\n";
+    }
+
+    const double elapsedSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+    std::cout << "\nfiles:" << files.size();
+    for (int v = 0; v < eQualityVerdicts; ++v)
+    {
+        if (verdicts[v])
+            std::cout << " " << qualityVerdictName(static_cast<QualityVerdict>(v)) << ":" << verdicts[v];
+    }
+    std::cout << std::setprecision(1) << "\nAnalyzed " << bytes / 1048576.0 << "MB (" << audioSec << "s of audio) in "
+              << elapsedSec * 1000 << "ms: " << (elapsedSec > 0 ? bytes / 1048576.0 / elapsedSec : 0) << "MB/s, "
+              << stats.threads << " threads, steals:" << stats.steals << std::endl;
+    std::cout.flags(flags);
+    return (verdicts[eQualityOk] == files.size()) ? 0 : 2;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////
+//Quality of call recordings
+//Recordings are memory-mapped and processed by SIMD kernels (SSE2 when available):
+//level and clipping in 20ms frames, silence/dead-air segments and DTMF digits
+//(Goertzel filters of 8 DTMF frequencies, computed at once).
+
+enum QualityVerdict
+{
+    eQualityOk,
+    eQualityLow,          //Level of active frames is below 'lowDb'
+    eQualityClipped,      //More than 'maxClipPercent' of samples at full scale
+    eQualityDeadAir,      //Silence longer than 'deadAirMs'
+    eQualityDtmfMismatch, //Detected digits differ from expected ones
+    eQualitySilent,       //No active frames at all
+    eQualityError,        //File can't be read
+    eQualityVerdicts
+};
+
+const char* qualityVerdictName(QualityVerdict verdict);
+
+struct QualityParams
+{
+    double silenceDb = -50;      //Frame with lower level (dBFS) is silent
+    uint32_t deadAirMs = 2000;   //Silence of this length is dead air
+    double lowDb = -35;          //Min level of active frames
+    double maxClipPercent = 0.1;
+    std::string expectDtmf;      //Digits which must be detected (sent by Call_SendDtmf), empty - not checked
+};
+
+struct QualityResult
+{
+    QualityVerdict verdict = eQualityError;
+    std::string error;
+    uint64_t bytes = 0;
+    double durationSec = 0;
+    double activeDb = -100;      //RMS of non-silent frames
+    double peakDb = -100;
+    double clipPercent = 0;
+    double silencePercent = 0;
+    uint32_t deadAirSegments = 0;
+    double longestDeadAirSec = 0;
+    std::string dtmf;            //Detected digits
+};
+
+//'buf' - decoding buffer of the thread (not used for mono PCM16 files)
+QualityResult analyzeQuality(const std::string& path, const QualityParams& params, std::vector<int16_t>& buf);
+
+//Analyzes recordings ('path' - file or folder with *.wav) on work-stealing thread pool
+//and prints table of verdicts. Returns process exit code.
+int runQualityAnalysis(const std::string& path, const QualityParams& params);
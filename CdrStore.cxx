@@ -0,0 +1,536 @@
+#include "CdrStore.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#define timegm _mkgmtime
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static const char kMagic[8] = { 'S', 'X', 'C', 'D', 'R', 'C', '1', '\0' };
+static const uint32_t kVersion = 1;
+
+struct SegmentHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t blocks;
+    uint64_t rows;
+    uint64_t blocksOffset;  //Array of BlockHeader
+    uint64_t dictOffset;    //uint32 offsets[dictSize + 1], then characters
+    uint32_t dictSize;
+    uint32_t reserved;
+    int64_t  minStart;
+    int64_t  maxStart;
+};
+
+size_t cdrColumnWidth(CdrColumn column)
+{
+    switch (column)
+    {
+        case eCdrStatus:
+        case eCdrTransfer:
+        case eCdrDtmf:  return 2;
+        case eCdrFlags: return 1;
+        default:        return 4;
+    }
+}
+
+const char* getCdrColumnName(CdrColumn column)
+{
+    switch (column)
+    {
+        case eCdrStart:    return "start";
+        case eCdrAccount:  return "account";
+        case eCdrFrom:     return "from";
+        case eCdrTo:       return "to";
+        case eCdrDuration: return "durationMs";
+        case eCdrSetup:    return "setupMs";
+        case eCdrCallId:   return "callId";
+        case eCdrStatus:   return "status";
+        case eCdrTransfer: return "transferStatus";
+        case eCdrDtmf:     return "dtmf";
+        case eCdrFlags:    return "flags";
+        default:           return "???";
+    }
+}
+
+bool parseCdrTime(const char* str, int64_t& ms)
+{
+    if (!*str)
+        return false;
+    if (strspn(str, "0123456789") == strlen(str))
+    {
+        ms = strtoll(str, nullptr, 10);
+        return true;
+    }
+
+    struct tm tm = {};
+    int millis = 0;
+    const int n = sscanf(str, "%d-%d-%d%*1[T ]%d:%d:%d.%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                         &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &millis);
+    if (n < 3)
+        return false;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    ms = static_cast<int64_t>(timegm(&tm)) * 1000 + millis;
+    return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//CSV
+
+//Splits line into fields (quoted field may contain separators and doubled quotes)
+static void splitCsv(const char* line, std::vector<std::string>& fields)
+{
+    fields.clear();
+    const char* p = line;
+    for (;;)
+    {
+        std::string field;
+        if (*p == '"')
+        {
+            for (++p; *p; ++p)
+            {
+                if (*p == '"')
+                {
+                    if (p[1] != '"')
+                    {
+                        ++p;
+                        break;
+                    }
+                    ++p;
+                }
+                field += *p;
+            }
+        }
+        for (; *p && (*p != ',') && (*p != '\n') && (*p != '\r'); ++p)
+            field += *p;
+        fields.push_back(field);
+        if (*p != ',')
+            break;
+        ++p;
+    }
+}
+
+bool readCdrCsv(const std::string& path, std::vector<CdrRow>& rows, std::string& err)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        err = "Can't open '" + path + "': " + strerror(errno);
+        return false;
+    }
+
+    enum { eStart, eAccount, eDirection, eFrom, eTo, eConnected, eSetup, eDuration, eCallId,
+           eStatus, eVideo, eDtmf, eTransfer, eRedirectedFrom, eRedirectedTo, eFields };
+    static const char* kNames[eFields] = { "start", "account", "direction", "from", "to", "connected", "setupMs",
+        "durationMs", "callId", "status", "video", "dtmf", "transferStatus", "redirectedFrom", "redirectedTo" };
+    int index[eFields];
+
+    std::vector<std::string> fields;
+    std::string line;
+    char buf[4096];
+    bool header = true;
+    size_t lineNo = 0;
+    while (fgets(buf, sizeof(buf), f))
+    {
+        line += buf;
+        if (line.back() != '\n' && !feof(f))
+            continue;//Longer than buffer
+        ++lineNo;
+        splitCsv(line.c_str(), fields);
+        line.clear();
+
+        if (header)
+        {
+            for (int i = 0; i < eFields; ++i)
+            {
+                auto it = std::find(fields.begin(), fields.end(), kNames[i]);
+                index[i] = (it != fields.end()) ? static_cast<int>(it - fields.begin()) : -1;
+            }
+            if (index[eStart] < 0)
+            {
+                err = path + ": column 'start' not found";
+                fclose(f);
+                return false;
+            }
+            header = false;
+            continue;
+        }
+
+        auto field = [&](int i) -> const std::string& {
+            static const std::string kEmpty;
+            return ((index[i] >= 0) && (static_cast<size_t>(index[i]) < fields.size())) ? fields[index[i]] : kEmpty;
+        };
+        auto number = [&](int i) -> uint32_t { return static_cast<uint32_t>(strtoul(field(i).c_str(), nullptr, 10)); };
+
+        CdrRow row;
+        if (!parseCdrTime(field(eStart).c_str(), row.start))
+        {
+            err = path + ":" + std::to_string(lineNo) + ": invalid start time";
+            fclose(f);
+            return false;
+        }
+        row.account  = field(eAccount);
+        row.from     = field(eFrom);
+        row.to       = field(eTo);
+        row.duration = number(eDuration);
+        row.setup    = number(eSetup);
+        row.callId   = number(eCallId);
+        row.status   = static_cast<uint16_t>(number(eStatus));
+        row.transfer = static_cast<uint16_t>(number(eTransfer));
+        row.dtmf     = static_cast<uint16_t>(std::min<uint32_t>(number(eDtmf), 0xFFFF));
+        if (field(eDirection) == "in") row.flags |= eCdrIncoming;
+        if (number(eConnected))        row.flags |= eCdrConnected;
+        if (number(eVideo))            row.flags |= eCdrVideo;
+        if (number(eRedirectedFrom) || number(eRedirectedTo)) row.flags |= eCdrRedirected;
+        rows.push_back(std::move(row));
+    }
+    fclose(f);
+    return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Writing
+
+static bool writeAligned(FILE* f, const void* data, size_t size, uint64_t& pos)
+{
+    static const char kZeros[8] = {};
+    const size_t pad = static_cast<size_t>((8 - pos % 8) % 8);
+    if ((pad && (fwrite(kZeros, 1, pad, f) != pad)) || (size && (fwrite(data, 1, size, f) != size)))
+        return false;
+    pos += pad + size;
+    return true;
+}
+
+bool writeCdrSegment(const std::string& path, std::vector<CdrRow>& rows, std::string& err)
+{
+    std::sort(rows.begin(), rows.end(), [](const CdrRow& a, const CdrRow& b) { return a.start < b.start; });
+
+    //Sorted dictionary: zone maps of ids are ranges of strings
+    std::vector<const std::string*> strings;
+    strings.reserve(rows.size() * 3);
+    for (const CdrRow& row : rows)
+    {
+        strings.push_back(&row.account);
+        strings.push_back(&row.from);
+        strings.push_back(&row.to);
+    }
+    std::sort(strings.begin(), strings.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+    strings.erase(std::unique(strings.begin(), strings.end(),
+        [](const std::string* a, const std::string* b) { return *a == *b; }), strings.end());
+    std::unordered_map<std::string, uint32_t> ids;
+    ids.reserve(strings.size());
+    for (size_t i = 0; i < strings.size(); ++i)
+        ids.emplace(*strings[i], static_cast<uint32_t>(i));
+
+    const std::string tmpPath = path + ".tmp";
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f)
+    {
+        err = "Can't create '" + tmpPath + "': " + strerror(errno);
+        return false;
+    }
+
+    SegmentHeader header = {};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.rows = rows.size();
+    header.minStart = rows.empty() ? 0 : rows.front().start;
+    header.maxStart = rows.empty() ? 0 : rows.back().start;
+    uint64_t pos = 0;
+    bool ok = writeAligned(f, &header, sizeof(header), pos);
+
+    //Block ends at max rows or when delta of start doesn't fit 32 bits
+    std::vector<CdrSegment::BlockHeader> blocks;
+    std::vector<uint8_t> column;
+    for (size_t first = 0; ok && (first < rows.size()); )
+    {
+        size_t last = first;
+        while ((last < rows.size()) && (last - first < kCdrBlockRows) && (rows[last].start - rows[first].start <= 0xFFFFFFFFLL))
+            ++last;
+
+        CdrSegment::BlockHeader block = {};
+        block.rows = static_cast<uint32_t>(last - first);
+        block.base = rows[first].start;
+        for (int c = 0; ok && (c < eCdrColumns); ++c)
+        {
+            const CdrColumn col = static_cast<CdrColumn>(c);
+            const size_t width = cdrColumnWidth(col);
+            column.resize(block.rows * width);
+            int64_t minValue = INT64_MAX, maxValue = INT64_MIN;
+            for (size_t r = first; r < last; ++r)
+            {
+                const CdrRow& row = rows[r];
+                int64_t value = 0;
+                switch (col)
+                {
+                    case eCdrStart:    value = row.start - block.base; break;
+                    case eCdrAccount:  value = ids[row.account]; break;
+                    case eCdrFrom:     value = ids[row.from]; break;
+                    case eCdrTo:       value = ids[row.to]; break;
+                    case eCdrDuration: value = row.duration; break;
+                    case eCdrSetup:    value = row.setup; break;
+                    case eCdrCallId:   value = row.callId; break;
+                    case eCdrStatus:   value = row.status; break;
+                    case eCdrTransfer: value = row.transfer; break;
+                    case eCdrDtmf:     value = row.dtmf; break;
+                    case eCdrFlags:    value = row.flags; break;
+                    default: break;
+                }
+                uint8_t* dst = column.data() + (r - first) * width;
+                if (width == 4)      { const uint32_t v = static_cast<uint32_t>(value); memcpy(dst, &v, 4); }
+                else if (width == 2) { const uint16_t v = static_cast<uint16_t>(value); memcpy(dst, &v, 2); }
+                else                 { *dst = static_cast<uint8_t>(value); }
+                minValue = std::min(minValue, value);
+                maxValue = std::max(maxValue, value);
+            }
+            if (col == eCdrStart)
+            {
+                minValue += block.base;
+                maxValue += block.base;
+            }
+            block.min[c] = minValue;
+            block.max[c] = maxValue;
+            ok = writeAligned(f, nullptr, 0, pos);
+            block.offsets[c] = pos;
+            ok = ok && writeAligned(f, column.data(), column.size(), pos);
+        }
+        blocks.push_back(block);
+        first = last;
+    }
+
+    //Dictionary
+    std::vector<uint32_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    uint32_t chars = 0;
+    for (const std::string* str : strings)
+    {
+        offsets.push_back(chars);
+        chars += static_cast<uint32_t>(str->size());
+    }
+    offsets.push_back(chars);
+    ok = ok && writeAligned(f, nullptr, 0, pos);
+    header.dictOffset = pos;
+    header.dictSize = static_cast<uint32_t>(strings.size());
+    ok = ok && writeAligned(f, offsets.data(), offsets.size() * sizeof(uint32_t), pos);
+    for (const std::string* str : strings)
+    {
+        ok = ok && (fwrite(str->data(), 1, str->size(), f) == str->size());
+        pos += str->size();
+    }
+
+    ok = ok && writeAligned(f, nullptr, 0, pos);
+    header.blocksOffset = pos;
+    header.blocks = static_cast<uint32_t>(blocks.size());
+    ok = ok && writeAligned(f, blocks.data(), blocks.size() * sizeof(CdrSegment::BlockHeader), pos);
+
+    //Header is complete only when the rest is written
+    ok = ok && (fseek(f, 0, SEEK_SET) == 0) && (fwrite(&header, sizeof(header), 1, f) == 1) && (fflush(f) == 0);
+#ifndef _WIN32
+    ok = ok && (fsync(fileno(f)) == 0);
+#endif
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || (rename(tmpPath.c_str(), path.c_str()) != 0))
+    {
+        err = "Can't write '" + path + "': " + strerror(errno);
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//CdrSegment
+
+bool CdrSegment::open(const std::string& path, std::string& err)
+{
+    close();
+    path_ = path;
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if ((fd == -1) || (fstat(fd, &st) != 0))
+    {
+        err = "Can't open " + path + ": " + strerror(errno);
+        if (fd != -1) ::close(fd);
+        return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void* data = (size_ > 0) ? mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0) : nullptr;
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        err = "Can't map " + path + ": " + strerror(errno);
+        size_ = 0;
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(data);
+#else
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        err = "Can't open " + path + ": " + strerror(errno);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    buffer_.resize(static_cast<size_t>(ftell(f)));
+    fseek(f, 0, SEEK_SET);
+    const bool read = buffer_.empty() || (fread(buffer_.data(), 1, buffer_.size(), f) == buffer_.size());
+    fclose(f);
+    if (!read)
+    {
+        err = "Can't read " + path;
+        return false;
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+
+    //Offsets are checked once, scans trust them
+    const SegmentHeader* header = reinterpret_cast<const SegmentHeader*>(data_);
+    bool valid = (size_ >= sizeof(SegmentHeader)) && !memcmp(header->magic, kMagic, sizeof(kMagic)) &&
+                 (header->version == kVersion) &&
+                 (header->blocksOffset + static_cast<uint64_t>(header->blocks) * sizeof(BlockHeader) <= size_) &&
+                 (header->dictOffset + (static_cast<uint64_t>(header->dictSize) + 1) * sizeof(uint32_t) <= size_);
+    if (valid)
+    {
+        blocks_ = reinterpret_cast<const BlockHeader*>(data_ + header->blocksOffset);
+        dictOffsets_ = reinterpret_cast<const uint32_t*>(data_ + header->dictOffset);
+        dictChars_ = reinterpret_cast<const char*>(dictOffsets_ + header->dictSize + 1);
+        dictSize_ = header->dictSize;
+        valid = (reinterpret_cast<const uint8_t*>(dictChars_) + dictOffsets_[dictSize_] <= data_ + size_);
+        for (uint32_t b = 0; valid && (b < header->blocks); ++b)
+            for (int c = 0; valid && (c < eCdrColumns); ++c)
+                valid = (blocks_[b].offsets[c] + static_cast<uint64_t>(blocks_[b].rows) * cdrColumnWidth(static_cast<CdrColumn>(c)) <= size_);
+    }
+    if (!valid)
+    {
+        err = path + ": not a valid segment of call records";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CdrSegment::close()
+{
+#ifndef _WIN32
+    if (data_)
+        munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+    buffer_.clear();
+    data_ = nullptr;
+    size_ = 0;
+    blocks_ = nullptr;
+    dictOffsets_ = nullptr;
+    dictChars_ = nullptr;
+    dictSize_ = 0;
+}
+
+uint64_t CdrSegment::rows() const     { return reinterpret_cast<const SegmentHeader*>(data_)->rows; }
+uint32_t CdrSegment::blocks() const   { return reinterpret_cast<const SegmentHeader*>(data_)->blocks; }
+int64_t  CdrSegment::minStart() const { return reinterpret_cast<const SegmentHeader*>(data_)->minStart; }
+int64_t  CdrSegment::maxStart() const { return reinterpret_cast<const SegmentHeader*>(data_)->maxStart; }
+
+std::string CdrSegment::dictString(uint32_t id) const
+{
+    if (id >= dictSize_)
+        return std::string();
+    return std::string(dictChars_ + dictOffsets_[id], dictOffsets_[id + 1] - dictOffsets_[id]);
+}
+
+bool CdrSegment::findDict(const std::string& str, uint32_t& id) const
+{
+    uint32_t first = 0, last = 0;
+    findDictPrefix(str, first, last);
+    for (; first < last; ++first)
+    {
+        if (dictOffsets_[first + 1] - dictOffsets_[first] == str.size())
+        {
+            id = first;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CdrSegment::findDictPrefix(const std::string& prefix, uint32_t& first, uint32_t& last) const
+{
+    //Binary search by comparison of the first 'prefix.size()' characters
+    auto compare = [&](uint32_t id) {
+        const size_t len = dictOffsets_[id + 1] - dictOffsets_[id];
+        const int r = memcmp(dictChars_ + dictOffsets_[id], prefix.data(), std::min(len, prefix.size()));
+        return (r != 0) ? r : ((len < prefix.size()) ? -1 : 0);
+    };
+    uint32_t lo = 0, hi = dictSize_;
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (compare(mid) < 0) lo = mid + 1; else hi = mid;
+    }
+    first = lo;
+    hi = dictSize_;
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (compare(mid) <= 0) lo = mid + 1; else hi = mid;
+    }
+    last = lo;
+}
+
+bool openCdrStore(const std::string& folder, std::vector<std::unique_ptr<CdrSegment>>& segments, std::string& err)
+{
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileA((folder + "\\*.cdrc").c_str(), &data);
+    if (h != INVALID_HANDLE_VALUE)
+    {
+        do {
+            names.push_back(data.cFileName);
+        } while (FindNextFileA(h, &data));
+        FindClose(h);
+    }
+#else
+    DIR* dir = opendir(folder.c_str());
+    if (!dir)
+    {
+        err = "Can't read folder '" + folder + "': " + strerror(errno);
+        return false;
+    }
+    while (const dirent* entry = readdir(dir))
+    {
+        const size_t len = strlen(entry->d_name);
+        if ((len > 5) && !strcmp(entry->d_name + len - 5, ".cdrc"))
+            names.push_back(entry->d_name);
+    }
+    closedir(dir);
+#endif
+
+    std::sort(names.begin(), names.end());
+    for (const std::string& name : names)
+    {
+        std::unique_ptr<CdrSegment> segment(new CdrSegment());
+        if (!segment->open(folder + "/" + name, err))
+            return false;
+        segments.push_back(std::move(segment));
+    }
+    return true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////
+//Columnar segment of call records
+//Immutable file '<store>/<name>.cdrc' created from CSV files of CdrWriter. Rows are sorted by
+//start time and split into blocks of up to 'kCdrBlockRows'; each column of the block is an
+//array of fixed width values (scanned without decoding):
+//  start      - ms since start of the block (delta of the timestamp)
+//  account, from, to - ids in the dictionary of the segment (sorted strings, so ranges of
+//               ids are ranges of strings)
+//  other numeric fields as they are, flags are bits of one byte
+//Block header keeps min/max of each column (zone map): blocks which can't match filter are
+//skipped without touching their data. File is read by mmap.
+
+enum CdrColumn
+{
+    eCdrStart,        //uint32
+    eCdrAccount,      //uint32
+    eCdrFrom,         //uint32
+    eCdrTo,           //uint32
+    eCdrDuration,     //uint32, ms
+    eCdrSetup,        //uint32, ms
+    eCdrCallId,       //uint32
+    eCdrStatus,       //uint16
+    eCdrTransfer,     //uint16, status of transfer
+    eCdrDtmf,         //uint16
+    eCdrFlags,        //uint8
+    eCdrColumns
+};
+
+enum CdrFlag : uint8_t
+{
+    eCdrIncoming   = 0x01,
+    eCdrConnected  = 0x02,
+    eCdrVideo      = 0x04,
+    eCdrRedirected = 0x08//Created by redirect or redirected
+};
+
+static const uint32_t kCdrBlockRows = 65536;
+
+size_t cdrColumnWidth(CdrColumn column);
+const char* getCdrColumnName(CdrColumn column);
+
+//Record of one call (strings aren't encoded yet)
+struct CdrRow
+{
+    int64_t  start = 0;       //Unix time, ms
+    std::string account;
+    std::string from;
+    std::string to;
+    uint32_t duration = 0;
+    uint32_t setup = 0;
+    uint32_t callId = 0;
+    uint16_t status = 0;
+    uint16_t transfer = 0;
+    uint16_t dtmf = 0;
+    uint8_t  flags = 0;
+};
+
+//Reads CSV file written by CdrWriter (columns are found by names of the header)
+bool readCdrCsv(const std::string& path, std::vector<CdrRow>& rows, std::string& err);
+
+//Sorts rows and writes new segment (temporary file renamed when complete)
+bool writeCdrSegment(const std::string& path, std::vector<CdrRow>& rows, std::string& err);
+
+//"YYYY-MM-DD[THH[:MM[:SS[.mmm]]]][Z]" (UTC) or unix time in ms
+bool parseCdrTime(const char* str, int64_t& ms);
+
+
+////////////////////////////////////////////////////////////////////////////
+//CdrSegment
+//Mapped segment file.
+
+class CdrSegment
+{
+public:
+    struct BlockHeader {
+        uint32_t rows;
+        uint32_t reserved;
+        int64_t  base;                  //Start of the first row, ms
+        uint64_t offsets[eCdrColumns];  //Of column arrays in the file
+        int64_t  min[eCdrColumns];      //Zone map (start is absolute)
+        int64_t  max[eCdrColumns];
+    };
+
+    CdrSegment() {}
+    ~CdrSegment() { close(); }
+    CdrSegment(const CdrSegment&) = delete;
+    CdrSegment& operator=(const CdrSegment&) = delete;
+
+    bool open(const std::string& path, std::string& err);
+    void close();
+
+    const std::string& path() const { return path_; }
+    uint64_t rows() const;
+    uint32_t blocks() const;
+    uint64_t fileSize() const { return size_; }
+    int64_t  minStart() const;
+    int64_t  maxStart() const;
+
+    const BlockHeader& block(uint32_t index) const { return blocks_[index]; }
+    template<typename T>
+    const T* column(uint32_t index, CdrColumn column) const {
+        return reinterpret_cast<const T*>(data_ + blocks_[index].offsets[column]);
+    }
+
+    //Dictionary of strings
+    uint32_t dictSize() const { return dictSize_; }
+    std::string dictString(uint32_t id) const;
+    bool findDict(const std::string& str, uint32_t& id) const;
+    //Ids of strings with given prefix (dictionary is sorted, so it's range [first, last))
+    void findDictPrefix(const std::string& prefix, uint32_t& first, uint32_t& last) const;
+
+protected:
+    std::string path_;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<uint8_t> buffer_;//File read into memory where mmap isn't available
+    const BlockHeader* blocks_ = nullptr;
+    const uint32_t* dictOffsets_ = nullptr;
+    const char* dictChars_ = nullptr;
+    uint32_t dictSize_ = 0;
+};
+
+//Opens all segments of the store folder (sorted by name)
+bool openCdrStore(const std::string& folder, std::vector<std::unique_ptr<CdrSegment>>& segments, std::string& err);
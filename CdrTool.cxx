@@ -0,0 +1,768 @@
+//siprixua-cdr - imports CSV files of call records to the columnar store and queries it
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define mkdir(path, mode) _mkdir(path)
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "CdrStore.h"
+#include "WorkPool.h"
+
+static void printUsage(const char* name)
+{
+    std::cout << "Usage:\n"
+              << "  " << name << " import <store> <file.csv>... [--delete]\n"
+              << "      Sort records of CSV files (written by --cdr) and add them to the store as one segment\n"
+              << "  " << name << " info <store>\n"
+              << "      Print segments of the store\n"
+              << "  " << name << " query <store> [options]\n"
+              << "      --since=<time> --until=<time>   Start of the call in range (YYYY-MM-DD[THH[:MM[:SS]]] UTC or unix ms)\n"
+              << "      --account=<uri> --from=<uri> --to=<uri>  Exact value or prefix ending with '*'\n"
+              << "      --direction=in|out --status=<code> --connected --failed --min-duration=<ms>\n"
+              << "      --group=<key>[,<key>]           Keys: account, from, to, status, direction, hour, day\n"
+              << "      --top=<n>                       Groups with the most calls (default - all, sorted by keys)\n"
+              << "      --percentiles                   p50/p90/p99 of duration of connected calls\n"
+              << "      --threads=<n>                   Scan threads (default - number of CPU cores)\n"
+              << "  " << name << " generate <store> <records> [--accounts=<n>] [--days=<n>]\n"
+              << "      Add synthetic records (benchmark of queries)\n";
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point from)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - from).count();
+}
+
+static std::string formatTime(int64_t ms, const char* format)
+{
+    const time_t t = static_cast<time_t>(ms / 1000);
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &t);
+#else
+    gmtime_r(&t, &tm);
+#endif
+    char buf[32];
+    strftime(buf, sizeof(buf), format, &tm);
+    return buf;
+}
+
+//Name of the new segment: time of import and pid keep it unique, names sort in order of imports
+static std::string newSegmentPath(const std::string& store)
+{
+    static uint32_t seq = 0;
+    const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return store + "/seg-" + formatTime(now, "%Y%m%d-%H%M%S") + "-" + std::to_string(getpid()) + "-"
+         + std::to_string(++seq) + ".cdrc";
+}
+
+static bool makeStore(const std::string& store)
+{
+    if ((mkdir(store.c_str(), 0755) == 0) || (errno == EEXIST))
+        return true;
+    std::cerr << "Can't create folder '" << store << "': " << strerror(errno) << std::endl;
+    return false;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Import
+
+static int runImport(const std::string& store, const std::vector<std::string>& files, bool removeFiles)
+{
+    if (!makeStore(store))
+        return 1;
+
+    const auto began = std::chrono::steady_clock::now();
+    std::vector<CdrRow> rows;
+    uint64_t csvBytes = 0;
+    std::string err;
+    for (const std::string& file : files)
+    {
+        if (!readCdrCsv(file, rows, err))
+        {
+            std::cerr << err << std::endl;
+            return 1;
+        }
+        struct stat st;
+        if (stat(file.c_str(), &st) == 0)
+            csvBytes += static_cast<uint64_t>(st.st_size);
+    }
+    if (rows.empty())
+    {
+        std::cout << "No records in " << files.size() << " files" << std::endl;
+        return 0;
+    }
+
+    const size_t count = rows.size();
+    const std::string path = newSegmentPath(store);
+    if (!writeCdrSegment(path, rows, err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+    struct stat st;
+    const uint64_t bytes = (stat(path.c_str(), &st) == 0) ? static_cast<uint64_t>(st.st_size) : 0;
+    std::cout << "Imported " << count << " records of " << files.size() << " files to " << path << ": "
+              << bytes << " bytes (" << bytes / count << " per record, CSV " << csvBytes / count << ") in "
+              << static_cast<uint64_t>(elapsedMs(began)) << "ms" << std::endl;
+
+    //Records are in the store, CSV files aren't needed
+    if (removeFiles)
+        for (const std::string& file : files)
+            remove(file.c_str());
+    return 0;
+}
+
+static int runGenerate(const std::string& store, uint64_t records, uint32_t accounts, uint32_t days)
+{
+    if (!makeStore(store) || !accounts || !days)
+        return 1;
+
+    //Segments of limited size keep memory of import bounded
+    const uint64_t kSegmentRows = 4000000;
+    const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const int64_t first = now - static_cast<int64_t>(days) * 86400000;
+    const uint16_t kFailures[] = { 486, 487, 404, 408, 480, 503, 603 };
+
+    std::mt19937_64 random(42);
+    std::vector<CdrRow> rows;
+    const auto began = std::chrono::steady_clock::now();
+    for (uint64_t done = 0; done < records; )
+    {
+        const uint64_t n = std::min(kSegmentRows, records - done);
+        rows.resize(n);
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            CdrRow& row = rows[i];
+            row = CdrRow();
+            row.start = first + static_cast<int64_t>(random() % (static_cast<uint64_t>(days) * 86400000));
+            const uint32_t acc = static_cast<uint32_t>(random() % accounts);
+            row.account = std::to_string(1000 + acc) + "@sip.example.com";
+            row.flags = (random() % 2) ? eCdrIncoming : 0;
+            row.from = std::to_string(200000 + random() % 50000);
+            row.to = row.account.substr(0, row.account.find('@'));
+            if (!(row.flags & eCdrIncoming))
+                std::swap(row.from, row.to);
+            row.callId = static_cast<uint32_t>(done + i + 1);
+            row.setup = static_cast<uint32_t>(50 + random() % 3000);
+            //Account's number defines its answer rate, so ASR differs between accounts
+            if (random() % 100 < 40 + acc % 50)
+            {
+                row.flags |= eCdrConnected;
+                row.duration = static_cast<uint32_t>(1000 + (random() % 300000) * (random() % 4 + 1) / 4);
+                row.status = 200;
+                row.dtmf = static_cast<uint16_t>(random() % 4 ? 0 : random() % 12);
+            }
+            else
+                row.status = kFailures[random() % (sizeof(kFailures) / sizeof(kFailures[0]))];
+        }
+
+        std::string err;
+        if (!writeCdrSegment(newSegmentPath(store), rows, err))
+        {
+            std::cerr << err << std::endl;
+            return 1;
+        }
+        done += n;
+        std::cout << "Generated " << done << " of " << records << " records" << std::endl;
+    }
+    std::cout << "Done in " << static_cast<uint64_t>(elapsedMs(began)) << "ms" << std::endl;
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Info
+
+static int runInfo(const std::string& store)
+{
+    std::vector<std::unique_ptr<CdrSegment>> segments;
+    std::string err;
+    if (!openCdrStore(store, segments, err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+
+    uint64_t rows = 0, bytes = 0, blocks = 0;
+    for (const auto& segment : segments)
+    {
+        std::cout << segment->path() << " records:" << segment->rows() << " blocks:" << segment->blocks()
+                  << " strings:" << segment->dictSize() << " bytes:" << segment->fileSize()
+                  << " start:" << formatTime(segment->minStart(), "%Y-%m-%dT%H:%M:%S")
+                  << ".." << formatTime(segment->maxStart(), "%Y-%m-%dT%H:%M:%S") << std::endl;
+        rows += segment->rows();
+        bytes += segment->fileSize();
+        blocks += segment->blocks();
+    }
+    std::cout << "segments:" << segments.size() << " records:" << rows << " blocks:" << blocks << " bytes:" << bytes;
+    if (rows)
+        std::cout << " (" << bytes / rows << " per record)";
+    std::cout << std::endl;
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Query
+
+enum GroupKey { eKeyAccount, eKeyFrom, eKeyTo, eKeyStatus, eKeyDirection, eKeyHour, eKeyDay };
+
+static const char* kKeyNames[] = { "account", "from", "to", "status", "direction", "hour", "day" };
+
+struct QueryParams
+{
+    int64_t since = INT64_MIN;
+    int64_t until = INT64_MAX;
+    std::string strings[3];             //account, from, to (trailing '*' - prefix)
+    int direction = -1;                 //eCdrIncoming or 0
+    int connected = -1;
+    int status = -1;
+    uint32_t minDuration = 0;
+    std::vector<GroupKey> keys;         //Up to 2
+    size_t top = 0;
+    bool percentiles = false;
+    size_t threads = 0;
+};
+
+//Durations of calls: exact values while they're few (most of groups), then log-linear
+//histogram with 16 sub-buckets per power of 2 (error below 7%), so memory of group is bounded
+class DurationHistogram
+{
+public:
+    enum { kExactValues = 256, kSubBits = 4, kBuckets = 33 << kSubBits };
+
+    void add(uint32_t value)
+    {
+        ++count_;
+        if (buckets_)
+            ++buckets_[bucketOf(value)];
+        else if (values_.push_back(value), values_.size() > kExactValues)
+            toBuckets();
+    }
+
+    void merge(const DurationHistogram& other)
+    {
+        if (other.buckets_)
+        {
+            if (!buckets_)
+                toBuckets();
+            for (int i = 0; i < kBuckets; ++i)
+                buckets_[i] += other.buckets_[i];
+            count_ += other.count_;
+            return;
+        }
+        for (uint32_t value : other.values_)
+            add(value);
+    }
+
+    //Exact value or middle of the bucket which contains requested percentile
+    uint32_t percentile(double p) const
+    {
+        if (!count_)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(count_ * p / 100.0);
+        if (rank >= count_) rank = count_ - 1;
+        if (!buckets_)
+        {
+            std::vector<uint32_t> values = values_;
+            std::nth_element(values.begin(), values.begin() + rank, values.end());
+            return values[rank];
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i)
+        {
+            seen += buckets_[i];
+            if (seen > rank)
+                return (lowerOf(i) + lowerOf(i + 1)) / 2;
+        }
+        return 0;
+    }
+
+protected:
+    void toBuckets()
+    {
+        buckets_.reset(new uint64_t[kBuckets]());
+        for (uint32_t value : values_)
+            ++buckets_[bucketOf(value)];
+        values_.clear();
+        values_.shrink_to_fit();
+    }
+
+    static int bucketOf(uint32_t value)
+    {
+        if (value < (1u << kSubBits))
+            return static_cast<int>(value);
+        int exp = 31;
+        while (!(value & (1u << exp))) --exp;
+        const int shift = exp - kSubBits;
+        return ((shift + 1) << kSubBits) + static_cast<int>((value >> shift) & ((1u << kSubBits) - 1));
+    }
+    static uint32_t lowerOf(int bucket)
+    {
+        if (bucket < (1 << kSubBits))
+            return static_cast<uint32_t>(bucket);
+        const int shift = (bucket >> kSubBits) - 1;
+        const uint64_t value = (static_cast<uint64_t>((1 << kSubBits) + (bucket & ((1 << kSubBits) - 1)))) << shift;
+        return static_cast<uint32_t>(std::min<uint64_t>(value, UINT32_MAX));
+    }
+
+    std::vector<uint32_t> values_;
+    std::unique_ptr<uint64_t[]> buckets_;
+    uint64_t count_ = 0;
+};
+
+struct Aggregate
+{
+    uint64_t calls = 0;
+    uint64_t connected = 0;
+    uint64_t durationMs = 0;            //Of connected calls
+    DurationHistogram durations;        //Filled with --percentiles
+
+    void merge(const Aggregate& other)
+    {
+        calls += other.calls;
+        connected += other.connected;
+        durationMs += other.durationMs;
+        durations.merge(other.durations);
+    }
+};
+
+//Filter resolved for one segment (strings to ranges of dictionary ids)
+struct SegmentFilter
+{
+    bool empty = false;                 //No row of the segment can match
+    bool byString[3] = {};
+    uint32_t first[3] = {};
+    uint32_t count[3] = {};
+};
+
+//State of the scan thread: groups of each segment by local key (ids of strings differ between segments)
+struct ScanState
+{
+    std::vector<std::unordered_map<uint64_t, Aggregate>> groups;
+    uint64_t scanned = 0;
+    uint64_t matched = 0;
+    uint64_t skippedBlocks = 0;
+    std::vector<uint8_t> selected;
+};
+
+static bool parseQuery(int argc, char** argv, QueryParams& query)
+{
+    for (int i = 3; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const size_t eq = arg.find('=');
+        const std::string name = arg.substr(0, eq);
+        const std::string value = (eq != std::string::npos) ? arg.substr(eq + 1) : std::string();
+
+        if ((name == "--since") || (name == "--until"))
+        {
+            if (!parseCdrTime(value.c_str(), (name == "--since") ? query.since : query.until))
+            {
+                std::cerr << "Invalid time: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (name == "--account")      query.strings[0] = value;
+        else if (name == "--from")         query.strings[1] = value;
+        else if (name == "--to")           query.strings[2] = value;
+        else if (name == "--direction")    query.direction = (value == "in") ? eCdrIncoming : 0;
+        else if (name == "--status")       query.status = atoi(value.c_str());
+        else if (name == "--connected")    query.connected = 1;
+        else if (name == "--failed")       query.connected = 0;
+        else if (name == "--min-duration") query.minDuration = static_cast<uint32_t>(atoi(value.c_str()));
+        else if (name == "--top")          query.top = static_cast<size_t>(atoi(value.c_str()));
+        else if (name == "--percentiles")  query.percentiles = true;
+        else if (name == "--threads")      query.threads = static_cast<size_t>(atoi(value.c_str()));
+        else if (name == "--group")
+        {
+            for (size_t pos = 0; pos <= value.size(); )
+            {
+                size_t end = value.find(',', pos);
+                if (end == std::string::npos) end = value.size();
+                const std::string key = value.substr(pos, end - pos);
+                const auto it = std::find_if(std::begin(kKeyNames), std::end(kKeyNames),
+                                             [&](const char* k) { return key == k; });
+                if ((it == std::end(kKeyNames)) || (query.keys.size() == 2))
+                {
+                    std::cerr << "Invalid group key '" << key << "' (up to 2 of: account, from, to, status, direction, hour, day)" << std::endl;
+                    return false;
+                }
+                query.keys.push_back(static_cast<GroupKey>(it - std::begin(kKeyNames)));
+                pos = end + 1;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static SegmentFilter resolveFilter(const CdrSegment& segment, const QueryParams& query)
+{
+    SegmentFilter filter;
+    filter.empty = (segment.maxStart() < query.since) || (segment.minStart() >= query.until);
+    for (int s = 0; s < 3; ++s)
+    {
+        const std::string& value = query.strings[s];
+        if (value.empty())
+            continue;
+        filter.byString[s] = true;
+        uint32_t first = 0, last = 0;
+        if (value.back() == '*')
+            segment.findDictPrefix(value.substr(0, value.size() - 1), first, last);
+        else if (segment.findDict(value, first))
+            last = first + 1;
+        filter.first[s] = first;
+        filter.count[s] = last - first;
+        filter.empty = filter.empty || (first == last);
+    }
+    return filter;
+}
+
+//Column filters produce mask of selected rows by branch-free loops over arrays (vectorized by compiler)
+template<typename T>
+static void selectRange(uint8_t* sel, const T* column, uint32_t rows, uint32_t first, uint32_t count)
+{
+    for (uint32_t i = 0; i < rows; ++i)
+        sel[i] &= static_cast<uint8_t>(static_cast<uint32_t>(column[i] - first) < count);
+}
+
+static void scanBlock(const CdrSegment& segment, uint32_t index, size_t segmentIndex, const SegmentFilter& filter,
+                      const QueryParams& query, ScanState& state)
+{
+    const CdrSegment::BlockHeader& block = segment.block(index);
+    const uint32_t rows = block.rows;
+
+    //Zone map
+    bool skip = (block.max[eCdrStart] < query.since) || (block.min[eCdrStart] >= query.until) ||
+                (block.max[eCdrDuration] < query.minDuration) ||
+                ((query.status >= 0) && ((query.status < block.min[eCdrStatus]) || (query.status > block.max[eCdrStatus])));
+    static const CdrColumn kStringColumns[3] = { eCdrAccount, eCdrFrom, eCdrTo };
+    for (int s = 0; !skip && (s < 3); ++s)
+        skip = filter.byString[s] && ((block.max[kStringColumns[s]] < filter.first[s]) ||
+                                      (block.min[kStringColumns[s]] >= filter.first[s] + filter.count[s]));
+    if (skip)
+    {
+        ++state.skippedBlocks;
+        return;
+    }
+    state.scanned += rows;
+
+    uint8_t* sel = state.selected.data();
+    std::fill(sel, sel + rows, 1);
+    const uint32_t* start = segment.column<uint32_t>(index, eCdrStart);
+    if ((block.min[eCdrStart] < query.since) || (block.max[eCdrStart] >= query.until))
+    {
+        //Bounds are clamped before subtraction (defaults are INT64_MIN/INT64_MAX)
+        const int64_t lo = (query.since <= block.base) ? 0 : std::min<int64_t>(query.since - block.base, int64_t(UINT32_MAX));
+        const int64_t hi = (query.until <= block.base) ? 0 : std::min<int64_t>(query.until - block.base, int64_t(UINT32_MAX));
+        selectRange(sel, start, rows, static_cast<uint32_t>(lo), static_cast<uint32_t>((hi > lo) ? hi - lo : 0));
+    }
+    for (int s = 0; s < 3; ++s)
+        if (filter.byString[s])
+            selectRange(sel, segment.column<uint32_t>(index, kStringColumns[s]), rows, filter.first[s], filter.count[s]);
+    const uint32_t* duration = segment.column<uint32_t>(index, eCdrDuration);
+    if (query.minDuration > block.min[eCdrDuration])
+        for (uint32_t i = 0; i < rows; ++i)
+            sel[i] &= static_cast<uint8_t>(duration[i] >= query.minDuration);
+    const uint16_t* status = segment.column<uint16_t>(index, eCdrStatus);
+    if ((query.status >= 0) && (block.min[eCdrStatus] != block.max[eCdrStatus]))
+        for (uint32_t i = 0; i < rows; ++i)
+            sel[i] &= static_cast<uint8_t>(status[i] == query.status);
+    const uint8_t* flags = segment.column<uint8_t>(index, eCdrFlags);
+    uint8_t flagMask = 0, flagValue = 0;
+    if (query.direction >= 0) { flagMask |= eCdrIncoming;  flagValue |= static_cast<uint8_t>(query.direction); }
+    if (query.connected >= 0) { flagMask |= eCdrConnected; flagValue |= query.connected ? eCdrConnected : 0; }
+    if (flagMask)
+        for (uint32_t i = 0; i < rows; ++i)
+            sel[i] &= static_cast<uint8_t>((flags[i] & flagMask) == flagValue);
+
+    //Aggregation of selected rows
+    const uint32_t* keyColumns[3] = { segment.column<uint32_t>(index, eCdrAccount),
+                                      segment.column<uint32_t>(index, eCdrFrom),
+                                      segment.column<uint32_t>(index, eCdrTo) };
+    auto keyOf = [&](GroupKey key, uint32_t i) -> uint32_t {
+        switch (key)
+        {
+            case eKeyAccount:   return keyColumns[0][i];
+            case eKeyFrom:      return keyColumns[1][i];
+            case eKeyTo:        return keyColumns[2][i];
+            case eKeyStatus:    return status[i];
+            case eKeyDirection: return flags[i] & eCdrIncoming;
+            case eKeyHour:      return static_cast<uint32_t>((block.base + start[i]) / 3600000);
+            default:            return static_cast<uint32_t>((block.base + start[i]) / 86400000);
+        }
+    };
+
+    auto& groups = state.groups[segmentIndex];
+    uint64_t lastKey = UINT64_MAX;
+    Aggregate* agg = nullptr;
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        if (!sel[i])
+            continue;
+        uint64_t key = 0;
+        for (GroupKey k : query.keys)
+            key = (key << 32) | keyOf(k, i);
+        //Rows are sorted by time, so neighbours often fall into the same group
+        if ((key != lastKey) || !agg)
+        {
+            agg = &groups[key];
+            lastKey = key;
+        }
+        ++state.matched;
+        ++agg->calls;
+        if (flags[i] & eCdrConnected)
+        {
+            ++agg->connected;
+            agg->durationMs += duration[i];
+            if (query.percentiles)
+                agg->durations.add(duration[i]);
+        }
+    }
+}
+
+static bool isStringKey(GroupKey key)
+{
+    return (key == eKeyAccount) || (key == eKeyFrom) || (key == eKeyTo);
+}
+
+//Ids of strings differ between segments, so they're mapped to ids of the query
+class GlobalStrings
+{
+public:
+    uint32_t idOf(const CdrSegment& segment, size_t segmentIndex, uint32_t localId)
+    {
+        if (remaps_.size() <= segmentIndex)
+            remaps_.resize(segmentIndex + 1);
+        std::vector<uint32_t>& remap = remaps_[segmentIndex];
+        if (remap.empty())
+            remap.assign(segment.dictSize(), UINT32_MAX);
+        uint32_t& id = remap[localId];
+        if (id == UINT32_MAX)
+        {
+            auto it = ids_.emplace(segment.dictString(localId), static_cast<uint32_t>(strings_.size())).first;
+            if (it->second == strings_.size())
+                strings_.push_back(it->first);
+            id = it->second;
+        }
+        return id;
+    }
+    const std::string& str(uint32_t id) const { return strings_[id]; }
+
+protected:
+    std::vector<std::vector<uint32_t>> remaps_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<std::string> strings_;
+};
+
+static std::string keyLabel(const GlobalStrings& strings, GroupKey key, uint32_t value)
+{
+    switch (key)
+    {
+        case eKeyAccount:
+        case eKeyFrom:
+        case eKeyTo:        return strings.str(value);
+        case eKeyStatus:    return std::to_string(value);
+        case eKeyDirection: return value ? "in" : "out";
+        case eKeyHour:      return formatTime(static_cast<int64_t>(value) * 3600000, "%Y-%m-%dT%H");
+        default:            return formatTime(static_cast<int64_t>(value) * 86400000, "%Y-%m-%d");
+    }
+}
+
+static uint32_t keyPart(uint64_t key, size_t index, size_t count)
+{
+    return static_cast<uint32_t>(key >> (32 * (count - 1 - index)));
+}
+
+static int runQuery(const std::string& store, const QueryParams& query)
+{
+    const auto began = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<CdrSegment>> segments;
+    std::string err;
+    if (!openCdrStore(store, segments, err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+
+    //Task is one block
+    std::vector<SegmentFilter> filters;
+    std::vector<std::pair<size_t, uint32_t>> tasks;
+    uint64_t total = 0;
+    for (size_t s = 0; s < segments.size(); ++s)
+    {
+        filters.push_back(resolveFilter(*segments[s], query));
+        total += segments[s]->rows();
+        if (!filters.back().empty)
+            for (uint32_t b = 0; b < segments[s]->blocks(); ++b)
+                tasks.emplace_back(s, b);
+    }
+
+    const size_t threads = query.threads ? query.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<ScanState> states(std::max<size_t>(1, std::min(threads, tasks.size())));
+    for (ScanState& state : states)
+    {
+        state.groups.resize(segments.size());
+        state.selected.resize(kCdrBlockRows);
+    }
+    const WorkStealingPool::Stats poolStats = WorkStealingPool::run(tasks.size(), threads, [&](size_t index, size_t worker) {
+        const auto& task = tasks[index];
+        scanBlock(*segments[task.first], task.second, task.first, filters[task.first], query, states[worker]);
+    });
+
+    //Strings of local keys are replaced by global ids, same groups of different segments are merged
+    GlobalStrings strings;
+    std::unordered_map<uint64_t, Aggregate> results;
+    uint64_t scanned = 0, matched = 0, skipped = 0;
+    const size_t keys = query.keys.size();
+    for (ScanState& state : states)
+    {
+        scanned += state.scanned;
+        matched += state.matched;
+        skipped += state.skippedBlocks;
+        for (size_t s = 0; s < segments.size(); ++s)
+        {
+            for (auto& item : state.groups[s])
+            {
+                uint64_t key = 0;
+                for (size_t k = 0; k < keys; ++k)
+                {
+                    uint32_t value = keyPart(item.first, k, keys);
+                    if (isStringKey(query.keys[k]))
+                        value = strings.idOf(*segments[s], s, value);
+                    key = (key << 32) | value;
+                }
+                results[key].merge(item.second);
+            }
+        }
+    }
+
+    //Sorted by keys (strings alphabetically, others by value) or by number of calls
+    typedef std::pair<uint64_t, const Aggregate*> Row;
+    std::vector<Row> rows;
+    rows.reserve(results.size());
+    for (const auto& item : results)
+        rows.emplace_back(item.first, &item.second);
+    auto byKeys = [&](const Row& a, const Row& b) {
+        for (size_t k = 0; k < keys; ++k)
+        {
+            const uint32_t va = keyPart(a.first, k, keys), vb = keyPart(b.first, k, keys);
+            if (va == vb)
+                continue;
+            return isStringKey(query.keys[k]) ? (strings.str(va) < strings.str(vb)) : (va < vb);
+        }
+        return false;
+    };
+    if (query.top && (rows.size() > query.top))
+    {
+        std::partial_sort(rows.begin(), rows.begin() + query.top, rows.end(), [&](const Row& a, const Row& b) {
+            return (a.second->calls != b.second->calls) ? (a.second->calls > b.second->calls) : byKeys(a, b); });
+        rows.resize(query.top);
+    }
+    else if (query.top)
+        std::sort(rows.begin(), rows.end(), [&](const Row& a, const Row& b) {
+            return (a.second->calls != b.second->calls) ? (a.second->calls > b.second->calls) : byKeys(a, b); });
+    else
+        std::sort(rows.begin(), rows.end(), byKeys);
+
+    for (GroupKey key : query.keys)
+        printf("%-24s ", kKeyNames[key]);
+    printf("%12s %12s %7s %9s", "calls", "connected", "asr%", "acdSec");
+    if (query.percentiles)
+        printf(" %9s %9s %9s", "p50Sec", "p90Sec", "p99Sec");
+    printf("\n");
+    for (const auto& row : rows)
+    {
+        for (size_t k = 0; k < keys; ++k)
+            printf("%-24s ", keyLabel(strings, query.keys[k], keyPart(row.first, k, keys)).c_str());
+        const Aggregate& agg = *row.second;
+        printf("%12" PRIu64 " %12" PRIu64 " %7.1f %9.1f", agg.calls, agg.connected,
+               agg.calls ? agg.connected * 100.0 / agg.calls : 0.0,
+               agg.connected ? agg.durationMs / 1000.0 / agg.connected : 0.0);
+        if (query.percentiles)
+        {
+            const DurationHistogram& hist = agg.durations;
+            printf(" %9.1f %9.1f %9.1f", hist.percentile(50) / 1000.0, hist.percentile(90) / 1000.0, hist.percentile(99) / 1000.0);
+        }
+        printf("\n");
+    }
+    printf("-- %zu groups, matched %" PRIu64 " of %" PRIu64 " records (scanned %" PRIu64 ", %" PRIu64 " of %zu blocks skipped by zone maps) in %.0fms, %zu threads\n",
+           results.size(), matched, total, scanned, skipped, tasks.size(), elapsedMs(began), poolStats.threads);
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//main
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const std::string cmd = argv[1];
+    const std::string store = argv[2];
+    if ((cmd == "import") && (argc > 3))
+    {
+        std::vector<std::string> files;
+        bool removeFiles = false;
+        for (int i = 3; i < argc; ++i)
+        {
+            if (!strcmp(argv[i], "--delete")) removeFiles = true;
+            else files.push_back(argv[i]);
+        }
+        return runImport(store, files, removeFiles);
+    }
+    if (cmd == "info")
+        return runInfo(store);
+    if (cmd == "query")
+    {
+        QueryParams query;
+        return parseQuery(argc, argv, query) ? runQuery(store, query) : 1;
+    }
+    if ((cmd == "generate") && (argc > 3))
+    {
+        uint32_t accounts = 1000, days = 30;
+        for (int i = 4; i < argc; ++i)
+        {
+            if (!strncmp(argv[i], "--accounts=", 11)) accounts = static_cast<uint32_t>(atoi(argv[i] + 11));
+            else if (!strncmp(argv[i], "--days=", 7)) days = static_cast<uint32_t>(atoi(argv[i] + 7));
+        }
+        return runGenerate(store, strtoull(argv[3], nullptr, 10), accounts, days);
+    }
+
+    printUsage(argv[0]);
+    return 1;
+}
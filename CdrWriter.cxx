@@ -0,0 +1,502 @@
+#include "CdrWriter.h"
+
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <process.h>
+#define mkdir(path, mode) _mkdir(path)
+#define getpid _getpid
+#else
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+static const uint64_t kMb = 1024 * 1024;
+
+static const char* kPartExt = ".part";
+
+static const char* kHeader = "start,module,callId,accId,account,direction,from,to,connected,setupMs,durationMs,"
+                             "status,video,dtmf,transferStatus,redirectedFrom,redirectedTo\n";
+
+////////////////////////////////////////////////////////////////////////////
+//Helpers
+
+bool parseCdrSync(const std::string& str, CdrParams& params)
+{
+    if (str == "none")        params.sync = eCdrSyncNone;
+    else if (str == "rotate") params.sync = eCdrSyncRotate;
+    else if (str == "batch")  params.sync = eCdrSyncBatch;
+    else if (!str.empty() && (str.find_first_not_of("0123456789") == std::string::npos))
+    {
+        params.sync = eCdrSyncInterval;
+        params.syncMs = static_cast<uint32_t>(atoi(str.c_str()));
+    }
+    else return false;
+    return true;
+}
+
+const char* getCdrSyncStr(CdrSync sync)
+{
+    switch (sync)
+    {
+        case eCdrSyncNone:     return "none";
+        case eCdrSyncRotate:   return "rotate";
+        case eCdrSyncBatch:    return "batch";
+        case eCdrSyncInterval: return "interval";
+        default:               return "???";
+    }
+}
+
+std::string parseSipUri(const std::string& header)
+{
+    //Address is inside of brackets when display name is present
+    size_t begin = header.find('<');
+    size_t end = std::string::npos;
+    if (begin != std::string::npos)
+        end = header.find('>', ++begin);
+    else
+        begin = header.find_first_not_of(' ');
+    if (begin == std::string::npos)
+        return std::string();
+
+    std::string uri = header.substr(begin, (end == std::string::npos) ? std::string::npos : end - begin);
+    for (const char* scheme : { "sip:", "sips:", "tel:" })
+    {
+        if (uri.compare(0, strlen(scheme), scheme) == 0)
+        {
+            uri.erase(0, strlen(scheme));
+            break;
+        }
+    }
+    const size_t params = uri.find_first_of(";?> ");
+    if (params != std::string::npos)
+        uri.erase(params);
+    return uri;
+}
+
+static bool makeFolder(const std::string& path)
+{
+    if (path.empty())
+        return true;
+
+    //Create parents first
+    const size_t pos = path.find_last_of("/\\");
+    if ((pos != std::string::npos) && (pos > 0) && !makeFolder(path.substr(0, pos)))
+        return false;
+    return (mkdir(path.c_str(), 0755) == 0) || (errno == EEXIST);
+}
+
+static void appendField(std::string& buf, const std::string& value)
+{
+    if (value.find_first_of(",\"\r\n") == std::string::npos)
+    {
+        buf += value;
+        return;
+    }
+    buf += '"';
+    for (char ch : value)
+    {
+        if (ch == '"')
+            buf += '"';
+        buf += ch;
+    }
+    buf += '"';
+}
+
+static void appendRecord(std::string& buf, const CdrRecord& rec)
+{
+    const time_t t = static_cast<time_t>(rec.startTime / 1000);
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &t);
+#else
+    gmtime_r(&t, &tm);
+#endif
+    char stamp[32];
+    const size_t len = strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(stamp + len, sizeof(stamp) - len, ".%03dZ", static_cast<int>(rec.startTime % 1000));
+
+    char ids[64];
+    snprintf(ids, sizeof(ids), ",%u,%u,%u,", static_cast<uint32_t>(rec.module), rec.callId, rec.accId);
+    buf += stamp;
+    buf += ids;
+    appendField(buf, rec.account);
+    buf += rec.incoming ? ",in," : ",out,";
+    appendField(buf, rec.from);
+    buf += ',';
+    appendField(buf, rec.to);
+
+    char tail[160];
+    snprintf(tail, sizeof(tail), ",%d,%u,%llu,%u,%d,%u,%u,%u,%u\n", rec.connected ? 1 : 0, rec.setupMs,
+             static_cast<unsigned long long>(rec.durationMs), rec.status, rec.video ? 1 : 0, rec.dtmf,
+             rec.transferStatus, rec.redirectedFrom, rec.redirectedTo);
+    buf += tail;
+}
+
+static uint64_t elapsedMs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return (to > from) ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count()) : 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//CdrWriter - loop thread
+
+bool CdrWriter::start(const CdrParams& params, std::string& err)
+{
+    params_ = params;
+    if (!makeFolder(params_.folder))
+    {
+        err = "Can't create folder of CDRs '" + params_.folder + "': " + strerror(errno);
+        return false;
+    }
+    repairFiles();
+
+    stopping_ = false;
+    pending_.reserve(params_.batchSize * 2);
+    batch_.reserve(params_.batchSize * 2);
+    writer_ = std::thread([this]() { runWriter(); });
+    return true;
+}
+
+void CdrWriter::stop()
+{
+    if (!writer_.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& item : open_)
+            pending_.push_back(std::move(item.second));
+        stopping_ = true;
+    }
+    open_.clear();
+    cond_.notify_one();
+    writer_.join();
+}
+
+CdrRecord& CdrWriter::create(uint8_t module, Siprix::CallId callId, std::chrono::steady_clock::time_point time)
+{
+    CdrRecord& rec = open_[key(module, callId)];
+    rec = CdrRecord();
+    rec.module = module;
+    rec.callId = callId;
+    rec.started = time;
+
+    //Callback could wait in the queue, so start is taken from the time SDK raised it
+    const auto age = std::chrono::steady_clock::now() - time;
+    rec.startTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+        (std::chrono::system_clock::now() - age).time_since_epoch()).count();
+    return rec;
+}
+
+const std::string& CdrWriter::accountOf(uint8_t module, Siprix::AccountId accId) const
+{
+    static const std::string kUnknown;
+    auto it = accounts_.find(key(module, accId));
+    return (it != accounts_.end()) ? it->second : kUnknown;
+}
+
+void CdrWriter::onInvite(uint8_t module, Siprix::CallId callId, Siprix::AccountId accId, const std::string& ext, bool withVideo)
+{
+    CdrRecord& rec = create(module, callId, std::chrono::steady_clock::now());
+    rec.accId = accId;
+    rec.account = accountOf(module, accId);
+    rec.to = ext;
+    rec.video = withVideo;
+}
+
+void CdrWriter::onAppEvent(const AppEvent& ev)
+{
+    switch (ev.type)
+    {
+        case AppEvent::eCallIncoming:
+        {
+            CdrRecord& rec = create(ev.module, ev.id, ev.time);
+            rec.accId = ev.relatedId;
+            rec.account = accountOf(ev.module, ev.relatedId);
+            rec.incoming = true;
+            rec.video = ev.withVideo;
+            rec.from = parseSipUri(ev.text1);
+            rec.to = parseSipUri(ev.text2);
+            break;
+        }
+        case AppEvent::eCallConnected:
+        {
+            auto it = open_.find(key(ev.module, ev.id));
+            CdrRecord& rec = (it != open_.end()) ? it->second : create(ev.module, ev.id, ev.time);
+            rec.connected = true;
+            rec.connectedAt = ev.time;
+            rec.setupMs = static_cast<uint32_t>(elapsedMs(rec.started, ev.time));
+            rec.video = ev.withVideo;
+            //Headers replace extension of outgoing call
+            if (!ev.text1.empty()) rec.from = parseSipUri(ev.text1);
+            if (!ev.text2.empty()) rec.to = parseSipUri(ev.text2);
+            break;
+        }
+        case AppEvent::eCallTransferred:
+        {
+            auto it = open_.find(key(ev.module, ev.id));
+            if (it != open_.end())
+                it->second.transferStatus = ev.code;
+            break;
+        }
+        case AppEvent::eCallRedirected:
+        {
+            //Redirect creates new outgoing call of the same account
+            CdrRecord& rec = create(ev.module, ev.relatedId, ev.time);
+            rec.redirectedFrom = ev.id;
+            rec.to = parseSipUri(ev.text1);
+            auto it = open_.find(key(ev.module, ev.id));
+            if (it != open_.end())
+            {
+                it->second.redirectedTo = ev.relatedId;
+                rec.accId = it->second.accId;
+                rec.account = it->second.account;
+                rec.from = it->second.incoming ? it->second.to : it->second.from;
+                rec.video = it->second.video;
+            }
+            break;
+        }
+        case AppEvent::eCallDtmfReceived:
+        {
+            auto it = open_.find(key(ev.module, ev.id));
+            if (it != open_.end())
+                ++it->second.dtmf;
+            break;
+        }
+        case AppEvent::eCallTerminated:
+        {
+            auto it = open_.find(key(ev.module, ev.id));
+            if (it == open_.end())
+                break;
+            it->second.status = ev.code;
+            if (it->second.connected)
+                it->second.durationMs = elapsedMs(it->second.connectedAt, ev.time);
+            finish(it->second);
+            open_.erase(it);
+            break;
+        }
+        default: break;
+    }
+}
+
+void CdrWriter::finish(CdrRecord& rec)
+{
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.size() >= params_.maxQueued)
+        {
+            ++dropped_;
+            return;
+        }
+        pending_.push_back(std::move(rec));
+        wake = (pending_.size() == params_.batchSize);
+    }
+    //Writer wakes by timer otherwise, so calls don't pay for notification
+    if (wake)
+        cond_.notify_one();
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//CdrWriter - writer thread
+
+void CdrWriter::runWriter()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        if (!stopping_ && (pending_.size() < params_.batchSize))
+            cond_.wait_for(lock, std::chrono::milliseconds(params_.flushMs));
+
+        const bool stopping = stopping_;
+        batch_.swap(pending_);
+        lock.unlock();
+
+        if (!batch_.empty())
+            writeBatch();
+        batch_.clear();
+
+        //Rotation by age doesn't wait for the next record
+        if (file_ && (std::chrono::steady_clock::now() - fileOpened_ >= std::chrono::seconds(params_.rotateSec)))
+            closeFile();
+        if (stopping)
+            break;
+        lock.lock();
+    }
+    closeFile();
+}
+
+void CdrWriter::writeBatch()
+{
+    const auto began = std::chrono::steady_clock::now();
+    if (file_ && params_.rotateMb && (fileBytes_ >= params_.rotateMb * kMb))
+        closeFile();
+    if (!file_ && !openFile())
+    {
+        errors_ += batch_.size();
+        return;
+    }
+
+    buffer_.clear();
+    for (const CdrRecord& rec : batch_)
+        appendRecord(buffer_, rec);
+
+    //One write per batch: process crash loses only records which weren't handed to the kernel
+    if ((fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) || (fflush(file_) != 0))
+    {
+        errors_ += batch_.size();
+        closeFile();
+        return;
+    }
+    fileBytes_ += buffer_.size();
+    written_ += batch_.size();
+    ++batches_;
+    if (batch_.size() > maxBatch_)
+        maxBatch_ = static_cast<uint32_t>(batch_.size());
+
+    const auto now = std::chrono::steady_clock::now();
+    if ((params_.sync == eCdrSyncBatch) ||
+        ((params_.sync == eCdrSyncInterval) && (now - lastSync_ >= std::chrono::milliseconds(params_.syncMs))))
+        sync();
+
+    const uint64_t us = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - began).count());
+    if (us > maxWriteUs_)
+        maxWriteUs_ = us;
+}
+
+bool CdrWriter::openFile()
+{
+    const time_t t = time(nullptr);
+    struct tm tm;
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+    //Pid keeps names of workers sharing the folder unique and tells whether writer is alive
+    path_ = params_.folder + "/cdr-" + stamp + "-" + std::to_string(getpid()) + "-" + std::to_string(++seq_) + ".csv";
+    file_ = fopen((path_ + kPartExt).c_str(), "wbx");
+    if (!file_)
+    {
+        //Reported once, next batches fail the same way
+        if (!errors_)
+            std::cerr << "Can't create CDR file '" << path_ << kPartExt << "': " << strerror(errno) << std::endl;
+        return false;
+    }
+    fputs(kHeader, file_);
+    fileBytes_ = strlen(kHeader);
+    fileOpened_ = lastSync_ = std::chrono::steady_clock::now();
+    ++files_;
+    return true;
+}
+
+void CdrWriter::closeFile()
+{
+    if (!file_)
+        return;
+
+    fflush(file_);
+    if (params_.sync != eCdrSyncNone)
+        sync();
+    fclose(file_);
+    file_ = nullptr;
+    if (rename((path_ + kPartExt).c_str(), path_.c_str()) != 0)
+        ++errors_;
+}
+
+void CdrWriter::sync()
+{
+#ifdef _WIN32
+    _commit(_fileno(file_));
+#else
+    fsync(fileno(file_));
+#endif
+    lastSync_ = std::chrono::steady_clock::now();
+    ++syncs_;
+}
+
+//Files are cut to the last complete line: record torn by crash is lost, others are kept
+void CdrWriter::repairFiles()
+{
+#ifndef _WIN32
+    DIR* dir = opendir(params_.folder.c_str());
+    if (!dir)
+        return;
+
+    std::vector<std::string> names;
+    while (const dirent* entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        const size_t extLen = strlen(kPartExt);
+        if ((name.compare(0, 4, "cdr-") != 0) || (name.size() <= extLen) ||
+            (name.compare(name.size() - extLen, extLen, kPartExt) != 0))
+            continue;
+
+        //cdr-<date>-<time>-<pid>-<seq>.csv.part
+        int pid = 0;
+        if ((sscanf(name.c_str(), "cdr-%*8s-%*6s-%d-", &pid) == 1) && (pid > 0) &&
+            ((pid == getpid()) || (kill(pid, 0) == 0) || (errno == EPERM)))
+            continue;//Written by running process
+        names.push_back(name);
+    }
+    closedir(dir);
+
+    for (const std::string& name : names)
+    {
+        const std::string path = params_.folder + "/" + name;
+        FILE* f = fopen(path.c_str(), "r+b");
+        if (!f)
+            continue;
+
+        //Find the last line feed from the end
+        fseek(f, 0, SEEK_END);
+        long pos = ftell(f);
+        char buf[4096];
+        long keep = 0;
+        while ((pos > 0) && !keep)
+        {
+            const long n = (pos > static_cast<long>(sizeof(buf))) ? static_cast<long>(sizeof(buf)) : pos;
+            pos -= n;
+            fseek(f, pos, SEEK_SET);
+            if (fread(buf, 1, static_cast<size_t>(n), f) != static_cast<size_t>(n))
+                break;
+            for (long i = n; i > 0; --i)
+            {
+                if (buf[i - 1] == '\n')
+                {
+                    keep = pos + i;
+                    break;
+                }
+            }
+        }
+        fclose(f);
+
+        if ((truncate(path.c_str(), keep) == 0) &&
+            (rename(path.c_str(), path.substr(0, path.size() - strlen(kPartExt)).c_str()) == 0))
+            ++repaired_;
+    }
+    if (repaired_)
+        std::cout << "Repaired " << repaired_ << " CDR files of stopped processes" << std::endl;
+#endif
+}
+
+void CdrWriter::print(std::ostream& os) const
+{
+    os << "cdr open:" << open_.size() << " written:" << written_ << " dropped:" << dropped_
+       << " errors:" << errors_ << " batches:" << batches_ << " maxBatch:" << maxBatch_
+       << " maxWriteUs:" << maxWriteUs_ << " files:" << files_ << " syncs:" << syncs_;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "AppEvent.h"
+
+////////////////////////////////////////////////////////////////////////////
+//CdrParams
+
+enum CdrSync
+{
+    eCdrSyncNone,     //OS decides when data reaches disk
+    eCdrSyncRotate,   //When file is closed
+    eCdrSyncBatch,    //After each written batch
+    eCdrSyncInterval  //After batch, at most once per 'syncMs'
+};
+
+struct CdrParams
+{
+    std::string folder;            //Folder of CDR files (empty - CDRs disabled)
+    uint64_t rotateMb = 64;        //File is closed when it reaches this size
+    uint32_t rotateSec = 3600;     //...or when it's open this time
+    CdrSync  sync = eCdrSyncInterval;
+    uint32_t syncMs = 1000;
+    uint32_t batchSize = 512;      //Writer is woken when this many records are waiting
+    uint32_t flushMs = 200;        //Max time record waits for the writer
+    uint32_t maxQueued = 100000;   //More waiting records are dropped (writer can't keep up with disk)
+};
+
+//"none", "rotate", "batch" or interval of fsync in ms
+bool parseCdrSync(const std::string& str, CdrParams& params);
+const char* getCdrSyncStr(CdrSync sync);
+
+
+////////////////////////////////////////////////////////////////////////////
+//CdrRecord
+
+struct CdrRecord
+{
+    uint8_t  module = 0;
+    Siprix::CallId callId = 0;
+    Siprix::AccountId accId = 0;   //0 - unknown
+    std::string account;           //extension@server of the account
+    bool     incoming = false;
+    bool     video = false;
+    bool     connected = false;
+    std::string from;              //URI without display name, scheme and parameters (user@host)
+    std::string to;                //Same or extension of outgoing call till it's connected
+    int64_t  startTime = 0;        //Unix time, ms
+    uint32_t setupMs = 0;          //Since started till connected
+    uint64_t durationMs = 0;       //Since connected till terminated
+    uint32_t status = 0;           //Of OnCallTerminated (0 - call didn't end before app stopped)
+    uint32_t dtmf = 0;             //Tones received
+    uint32_t transferStatus = 0;   //Of OnCallTransferred (0 - not transferred)
+    Siprix::CallId redirectedFrom = 0;
+    Siprix::CallId redirectedTo = 0;
+
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point connectedAt;
+};
+
+//Extracts 'user@host' from SIP header value ("Name" <sip:user@host;params>;tag=...)
+std::string parseSipUri(const std::string& header);
+
+
+////////////////////////////////////////////////////////////////////////////
+//CdrWriter
+//Assembles one record per call from Call_Invite and callbacks (incoming, connected,
+//transferred, redirected, DTMF, terminated) on the loop thread; finished records are handed
+//to the writer thread, which formats them and appends to CSV file by one write per batch.
+//Files are named '<folder>/cdr-<YYYYMMDD-HHMMSS>-<pid>-<seq>.csv.part' while they're written
+//and renamed to '.csv' when closed (rotated by size or age), so readers take only complete
+//files. '.part' files left by crashed process are cut to the last complete line and renamed
+//on start. Loop thread never waits for disk: when writer falls behind records are dropped.
+
+class CdrWriter
+{
+public:
+    CdrWriter() {}
+    ~CdrWriter() { stop(); }
+
+    //Creates folder, repairs files of crashed processes and starts writer
+    bool start(const CdrParams& params, std::string& err);
+
+    //Writes calls which are still open (status 0) and waits for writer
+    void stop();
+    bool isEnabled() const { return writer_.joinable(); }
+    const CdrParams& params() const { return params_; }
+
+    //Accounts are known by extension@server in records (ids are unique only inside of module/process)
+    void onAccount(uint8_t module, Siprix::AccountId accId, const std::string& uri) { accounts_[key(module, accId)] = uri; }
+    void onInvite(uint8_t module, Siprix::CallId callId, Siprix::AccountId accId, const std::string& ext, bool withVideo);
+    void onAppEvent(const AppEvent& ev);
+
+    size_t   openCount() const { return open_.size(); }
+    uint64_t written()   const { return written_; }
+    uint64_t dropped()   const { return dropped_; }
+    uint64_t batches()   const { return batches_; }
+    uint64_t files()     const { return files_; }
+    uint64_t syncs()     const { return syncs_; }
+    uint64_t errors()    const { return errors_; }
+    uint64_t repaired()  const { return repaired_; }
+    uint32_t maxBatch()  const { return maxBatch_; }
+    uint64_t maxWriteUs() const { return maxWriteUs_; }
+    void print(std::ostream& os) const;
+
+protected:
+    static uint64_t key(uint8_t module, Siprix::CallId callId) { return (static_cast<uint64_t>(module) << 32) | callId; }
+
+    CdrRecord& create(uint8_t module, Siprix::CallId callId, std::chrono::steady_clock::time_point time);
+    void finish(CdrRecord& rec);
+    void runWriter();
+    void writeBatch();
+    bool openFile();
+    void closeFile();
+    void sync();
+    void repairFiles();
+
+    const std::string& accountOf(uint8_t module, Siprix::AccountId accId) const;
+
+    CdrParams params_;
+    std::unordered_map<uint64_t, CdrRecord> open_;//Calls in progress (loop thread)
+    std::unordered_map<uint64_t, std::string> accounts_;
+
+    //Finished records, swapped with 'batch_' by writer
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<CdrRecord> pending_;
+    bool stopping_ = false;
+    std::thread writer_;
+
+    //Writer thread
+    std::vector<CdrRecord> batch_;
+    std::string buffer_;
+    FILE* file_ = nullptr;
+    std::string path_;
+    uint64_t fileBytes_ = 0;
+    uint64_t seq_ = 0;
+    std::chrono::steady_clock::time_point fileOpened_;
+    std::chrono::steady_clock::time_point lastSync_;
+
+    std::atomic<uint64_t> written_{ 0 };
+    std::atomic<uint64_t> dropped_{ 0 };
+    std::atomic<uint64_t> batches_{ 0 };
+    std::atomic<uint64_t> files_{ 0 };
+    std::atomic<uint64_t> syncs_{ 0 };
+    std::atomic<uint64_t> errors_{ 0 };
+    std::atomic<uint64_t> repaired_{ 0 };
+    std::atomic<uint32_t> maxBatch_{ 0 };
+    std::atomic<uint64_t> maxWriteUs_{ 0 };//Format, write and sync of one batch
+};
@@ -0,0 +1,522 @@
+#include "Conference.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+//Max time of waiting for OnCallSwitched(0) after Mixer_MakeConference
+static const uint32_t kMergeTimeoutMs = 2000;
+
+//Time given to SDK to close recording
+static const uint32_t kCloseDelayMs = 200;
+
+//Max time of waiting for termination of calls after BYE
+static const uint32_t kEndTimeoutMs = 5000;
+
+static double elapsedMs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+////////////////////////////////////////////////////////////////////////////
+//ConferenceTracker
+
+void ConferenceTracker::onCallTerminated(Siprix::CallId callId)
+{
+    connected_.erase(callId);
+    if (switched_ == callId)
+        switched_ = 0;
+
+    //Single remaining call isn't a conference
+    if (members_.erase(callId) && (members_.size() < 2))
+    {
+        members_.clear();
+        active_ = false;
+    }
+}
+
+void ConferenceTracker::onCallSwitched(Siprix::CallId callId)
+{
+    if (callId != 0)
+    {
+        members_.clear();
+        active_ = false;
+        switched_ = callId;
+        return;
+    }
+
+    //All connected calls are mixed
+    if (merging_)
+        lastMergeMs_ = elapsedMs(mergeStarted_, std::chrono::steady_clock::now());
+    merging_ = false;
+    members_ = connected_;
+    active_ = true;
+    switched_ = 0;
+    ++conferences_;
+}
+
+void ConferenceTracker::print(std::ostream& os) const
+{
+    os << "conference active:" << active_ << " members:" << members_.size()
+       << " connected:" << connected_.size() << " switched:" << switched_
+       << " conferences:" << conferences_ << " lastMergeMs:" << lastMergeMs_;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//ConferenceBench
+
+ConferenceBench::~ConferenceBench()
+{
+    cancelTimer();
+    if (worker_.joinable())
+        worker_.join();
+}
+
+bool ConferenceBench::start(uint8_t module, const ConferenceParams& params, const Actions& actions, std::string& err)
+{
+    if (isRunning())
+    {
+        err = "Conference benchmark is already running";
+        return false;
+    }
+
+    //Steps grow the same conference, so sizes are ascending
+    std::vector<uint32_t> sizes;
+    for (uint32_t size : params.sizes)
+        if (size >= 2) sizes.push_back(size);
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+
+    if (params.target.empty() || sizes.empty() || !params.holdSec)
+    {
+        err = "Conference benchmark requires target, sizes (2 and more participants) and hold time";
+        return false;
+    }
+    if (!params.prompt.empty())
+    {
+        if (params.reference.empty())
+        {
+            err = "Mixing latency requires reference of the prompt";
+            return false;
+        }
+        if (!readWav(params.reference, reference_, err))
+            return false;
+
+        mkdir(params.folder.c_str(), 0755);
+        struct stat st;
+        if ((stat(params.folder.c_str(), &st) != 0) || ((st.st_mode & S_IFMT) != S_IFDIR))
+        {
+            err = "Can't create folder '" + params.folder + "'";
+            return false;
+        }
+    }
+
+    char stamp[32];
+    const time_t now = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    stamp_ = stamp;
+
+    params_ = params;
+    params_.sizes = sizes;
+    actions_ = actions;
+    module_ = module;
+    analyzer_.reset();
+    steps_.clear();
+    calls_.clear();
+    connected_.clear();
+    stepIndex_ = 0;
+    baselineCpu_ = 0;
+
+    std::cout << "\nConference benchmark started: up to " << sizes.back() << " participants ("
+              << sizes.size() << " steps) to " << params_.target << std::endl;
+
+    //CPU of the process without calls
+    state_ = eBaseline;
+    sampleCpu(processMs_, moduleMs_, started_);
+    timer_ = loop_.addTimer(params_.baselineSec * 1000, 0, [this]() {
+        timer_ = 0;
+        uint64_t processMs = 0, moduleMs = 0;
+        std::chrono::steady_clock::time_point now;
+        sampleCpu(processMs, moduleMs, now);
+        const double ms = elapsedMs(started_, now);
+        baselineCpu_ = (ms > 0) ? (processMs - processMs_) * 100.0 / ms : 0;
+        startStep();
+    });
+    return true;
+}
+
+void ConferenceBench::stop()
+{
+    if (!isRunning())
+        return;
+
+    if (state_ < eEnding)
+    {
+        if ((state_ == eMeasuring) && !params_.prompt.empty() && !calls_.empty())
+            actions_.stopRecord(calls_.back());
+        endCalls();
+    }
+    if (isRunning())
+    {
+        cancelTimer();
+        finish();
+    }
+}
+
+void ConferenceBench::startStep()
+{
+    if (stepIndex_ >= params_.sizes.size())
+    {
+        endCalls();
+        return;
+    }
+
+    Step step;
+    step.participants = params_.sizes[stepIndex_];
+    steps_.push_back(step);
+
+    state_ = eGrowing;
+    started_ = std::chrono::steady_clock::now();
+    timer_ = loop_.addTimer(params_.connectTimeoutSec * 1000, 0, [this]() {
+        timer_ = 0;
+        stepDone("only " + std::to_string(connected_.size()) + " of " +
+                 std::to_string(steps_.back().participants) + " calls connected");
+    });
+
+    while (calls_.size() < step.participants)
+    {
+        Siprix::CallId callId = 0;
+        const Siprix::ErrorCode err = actions_.invite(callId);
+        if (err != Siprix::ErrorCode::EOK)
+        {
+            stepDone("invite failed: " + std::to_string(err));
+            return;
+        }
+        calls_.push_back(callId);
+    }
+}
+
+bool ConferenceBench::onCallConnected(Siprix::CallId callId)
+{
+    if (!isRunning() || (std::find(calls_.begin(), calls_.end(), callId) == calls_.end()))
+        return false;
+
+    connected_.insert(callId);
+    if ((state_ == eGrowing) && (connected_.size() == calls_.size()))
+    {
+        steps_.back().connectMs = elapsedMs(started_, std::chrono::steady_clock::now());
+        cancelTimer();
+        merge();
+    }
+    return true;
+}
+
+void ConferenceBench::merge()
+{
+    state_ = eMerging;
+    started_ = std::chrono::steady_clock::now();
+    const Siprix::ErrorCode err = actions_.merge();
+    if (err != Siprix::ErrorCode::EOK)
+    {
+        stepDone("merge failed: " + std::to_string(err));
+        return;
+    }
+
+    //SDK may not confirm conference, then it's measured anyway
+    timer_ = loop_.addTimer(kMergeTimeoutMs, 0, [this]() {
+        timer_ = 0;
+        merged(-1);
+    });
+}
+
+void ConferenceBench::onCallSwitched(Siprix::CallId callId)
+{
+    if ((state_ == eMerging) && (callId == 0))
+    {
+        cancelTimer();
+        merged(elapsedMs(started_, std::chrono::steady_clock::now()));
+    }
+    else if (((state_ == eSettling) || (state_ == eMeasuring)) && (callId != 0))
+    {
+        if ((state_ == eMeasuring) && !params_.prompt.empty())
+            actions_.stopRecord(calls_.back());
+        stepDone("conference broken by switch to call " + std::to_string(callId));
+    }
+}
+
+void ConferenceBench::merged(double mergeMs)
+{
+    steps_.back().mergeMs = mergeMs;
+    state_ = eSettling;
+    timer_ = loop_.addTimer(params_.settleMs, 0, [this]() {
+        timer_ = 0;
+        measure();
+    });
+}
+
+void ConferenceBench::measure()
+{
+    state_ = eMeasuring;
+    sampleCpu(processMs_, moduleMs_, started_);
+
+    if (!params_.prompt.empty())
+    {
+        //Signal goes from the first member through the mixer to the last one
+        Step& step = steps_.back();
+        step.path = params_.folder + "/conf-" + stamp_ + "-" + std::to_string(step.participants) + ".wav";
+        Siprix::ErrorCode err = actions_.record(calls_.back(), step.path);
+        if (err == Siprix::ErrorCode::EOK)
+            err = actions_.play(calls_.front(), player_);
+        if (err != Siprix::ErrorCode::EOK)
+            step.mixingError = "play/record failed: " + std::to_string(err);
+    }
+
+    timer_ = loop_.addTimer(params_.holdSec * 1000, 0, [this]() {
+        timer_ = 0;
+        measured();
+    });
+}
+
+void ConferenceBench::onPlayerState(Siprix::PlayerId playerId, Siprix::PlayerState state)
+{
+    if ((state_ == eMeasuring) && (playerId == player_) && (state == Siprix::PlayerState::PlayerFailed))
+        steps_.back().mixingError = "playback failed";
+}
+
+void ConferenceBench::measured()
+{
+    uint64_t processMs = 0, moduleMs = 0;
+    std::chrono::steady_clock::time_point now;
+    sampleCpu(processMs, moduleMs, now);
+    const double ms = elapsedMs(started_, now);
+
+    Step& step = steps_.back();
+    step.cpuPercent       = (ms > 0) ? (processMs - processMs_) * 100.0 / ms : 0;
+    step.moduleCpuPercent = (ms > 0) ? (moduleMs - moduleMs_) * 100.0 / ms : 0;
+    step.perParticipant   = std::max(0.0, step.cpuPercent - baselineCpu_) / step.participants;
+
+    if (params_.prompt.empty() || !step.mixingError.empty())
+    {
+        stepDone("");
+        return;
+    }
+
+    actions_.stopRecord(calls_.back());
+    state_ = eAnalyzing;
+    timer_ = loop_.addTimer(kCloseDelayMs, 0, [this]() {
+        timer_ = 0;
+        analyze();
+    });
+}
+
+void ConferenceBench::analyze()
+{
+    const std::string path = steps_.back().path;
+    const size_t maxSamples = static_cast<size_t>(reference_.samples.size() * 48000.0 / reference_.sampleRate) +
+                              params_.maxDelayMs * 48;
+    worker_ = std::thread([this, path, maxSamples]() {
+        WavAudio audio;
+        std::string err;
+        LatencyResult result;
+        if (readWav(path, audio, err, maxSamples))
+        {
+            if (!analyzer_ || (analyzer_->sampleRate() != audio.sampleRate))
+                analyzer_ = std::make_shared<LatencyAnalyzer>(reference_.samples, reference_.sampleRate,
+                                                              audio.sampleRate, params_.maxDelayMs);
+            LatencyAnalyzer::Scratch scratch;
+            result = analyzer_->analyze(audio.samples, scratch);
+        }
+        loop_.post([this, result, err]() { onAnalyzed(result, err); });
+    });
+}
+
+void ConferenceBench::onAnalyzed(const LatencyResult& result, const std::string& error)
+{
+    if (worker_.joinable())
+        worker_.join();
+    if (state_ != eAnalyzing)
+        return;
+
+    Step& step = steps_.back();
+    step.mixing = result;
+    step.mixingError = error;
+    step.mixingMeasured = error.empty();
+    stepDone("");
+}
+
+bool ConferenceBench::onCallTerminated(Siprix::CallId callId)
+{
+    auto it = std::find(calls_.begin(), calls_.end(), callId);
+    if (!isRunning() || (it == calls_.end()))
+        return false;
+
+    calls_.erase(it);
+    connected_.erase(callId);
+
+    if ((state_ >= eGrowing) && (state_ <= eMeasuring))
+    {
+        if ((state_ == eMeasuring) && !params_.prompt.empty() && !calls_.empty())
+            actions_.stopRecord(calls_.back());
+        stepDone("call " + std::to_string(callId) + " terminated");
+    }
+    else if ((state_ == eEnding) && calls_.empty())
+    {
+        finish();
+    }
+    return true;
+}
+
+void ConferenceBench::stepDone(const std::string& error)
+{
+    cancelTimer();
+    Step& step = steps_.back();
+    step.error = error;
+
+    const std::ios::fmtflags flags = std::cout.flags();
+    std::cout << "\n--- Conference step " << steps_.size() << "/" << params_.sizes.size()
+              << ": participants:" << step.participants << std::fixed << std::setprecision(1);
+    if (!error.empty())
+        std::cout << " failed (" << error << ")";
+    else
+    {
+        std::cout << " connectMs:" << step.connectMs << " mergeMs:" << step.mergeMs
+                  << " cpu:" << step.cpuPercent << "% module:" << step.moduleCpuPercent
+                  << "% perParticipant:" << std::setprecision(2) << step.perParticipant << "%" << std::setprecision(1);
+        if (step.mixingMeasured && step.mixing.found)
+            std::cout << " mixing:" << step.mixing.delayMs << "ms";
+        else if (step.mixingMeasured)
+            std::cout << " mixing: signal not found";
+        else if (!step.mixingError.empty())
+            std::cout << " mixing failed (" << step.mixingError << ")";
+    }
+    std::cout << std::endl;
+    std::cout.flags(flags);
+
+    //Next step adds calls to the same conference
+    if (!error.empty())
+    {
+        endCalls();
+        return;
+    }
+    ++stepIndex_;
+    startStep();
+}
+
+void ConferenceBench::endCalls()
+{
+    if (state_ == eEnding)
+        return;
+
+    cancelTimer();
+    state_ = eEnding;
+    if (calls_.empty())
+    {
+        finish();
+        return;
+    }
+
+    for (Siprix::CallId callId : calls_)
+        actions_.bye(callId);
+    timer_ = loop_.addTimer(kEndTimeoutMs, 0, [this]() {
+        timer_ = 0;
+        finish();
+    });
+}
+
+void ConferenceBench::finish()
+{
+    cancelTimer();
+    if (worker_.joinable())
+        worker_.join();
+    state_ = eIdle;
+    calls_.clear();
+    connected_.clear();
+
+    const std::ios::fmtflags flags = std::cout.flags();
+    std::cout << "\n--- Conference benchmark completed (baseline cpu:" << std::fixed << std::setprecision(1)
+              << baselineCpu_ << "%)\n"
+              << "    participants connectMs  mergeMs    cpu%  module%  cpu%/participant  mixingMs\n";
+    for (const Step& step : steps_)
+    {
+        std::cout << "    " << std::setw(12) << step.participants;
+        if (!step.error.empty())
+        {
+            std::cout << "  failed (" << step.error << ")\n";
+            continue;
+        }
+        std::cout << std::setw(10) << step.connectMs << std::setw(9) << step.mergeMs
+                  << std::setw(8) << step.cpuPercent << std::setw(9) << step.moduleCpuPercent
+                  << std::setw(18) << std::setprecision(2) << step.perParticipant << std::setprecision(1);
+        if (step.mixingMeasured && step.mixing.found) std::cout << std::setw(10) << step.mixing.delayMs;
+        else                                          std::cout << std::setw(10) << "-";
+        std::cout << "\n";
+    }
+    std::cout << "    ";
+    print(std::cout);
+    std::cout << std::endl;
+    std::cout.flags(flags);
+}
+
+void ConferenceBench::sampleCpu(uint64_t& processMs, uint64_t& moduleMs, std::chrono::steady_clock::time_point& time) const
+{
+    actions_.cpu(processMs, moduleMs);
+    time = std::chrono::steady_clock::now();
+}
+
+void ConferenceBench::cancelTimer()
+{
+    if (timer_) { loop_.cancelTimer(timer_); timer_ = 0; }
+}
+
+bool ConferenceBench::estimate(double& perParticipant, double& fixedPercent, uint32_t& maxPerCore) const
+{
+    //Least squares of cpu = fixed + perParticipant * participants
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (const Step& step : steps_)
+    {
+        if (!step.error.empty())
+            continue;
+        n += 1;
+        sx += step.participants;
+        sy += step.cpuPercent;
+        sxx += static_cast<double>(step.participants) * step.participants;
+        sxy += step.participants * step.cpuPercent;
+    }
+    perParticipant = fixedPercent = 0;
+    maxPerCore = 0;
+    const double det = n * sxx - sx * sx;
+    if ((n < 2) || (det <= 0))
+        return false;
+
+    perParticipant = (n * sxy - sx * sy) / det;
+    fixedPercent = (sy - perParticipant * sx) / n;
+    if ((perParticipant > 0) && (fixedPercent < 100))
+        maxPerCore = static_cast<uint32_t>(std::floor((100 - fixedPercent) / perParticipant));
+    return true;
+}
+
+void ConferenceBench::print(std::ostream& os) const
+{
+    size_t failed = 0;
+    for (const Step& step : steps_)
+        if (!step.error.empty()) ++failed;
+
+    double perParticipant = 0, fixedPercent = 0;
+    uint32_t maxPerCore = 0;
+    os << "confBench steps:" << steps_.size() << " failedSteps:" << failed << " baselineCpu:" << baselineCpu_ << "%";
+    if (!estimate(perParticipant, fixedPercent, maxPerCore))
+        os << " (not enough steps for estimate)";
+    else if (!maxPerCore)
+        os << " cpu/participant:" << perParticipant << "% (not measurable)";
+    else
+        os << " cpu/participant:" << perParticipant << "% fixed:" << fixedPercent << "% maxPerCore:" << maxPerCore;
+}
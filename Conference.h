@@ -0,0 +1,180 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "AudioAnalysis.h"
+#include "EventLoop.h"
+#include "NodeAllocator.h"
+#include "Wav.h"
+
+////////////////////////////////////////////////////////////////////////////
+//ConferenceTracker
+//Mixer state of one module, tracked by events. Mixer sends audio either of one call
+//(switched by Mixer_SwitchToCall or by SDK when call connected) or of all connected calls
+//(Mixer_MakeConference, confirmed by OnCallSwitched(0)). Calls connected later aren't members
+//until conference is made again. Conference ends when mixer is switched to a call or
+//less than 2 members remain.
+
+class ConferenceTracker
+{
+public:
+    typedef std::set<Siprix::CallId, std::less<Siprix::CallId>, NodeAllocator<Siprix::CallId>> CallIds;
+
+    void onCallConnected(Siprix::CallId callId) { connected_.insert(callId); }
+    void onCallTerminated(Siprix::CallId callId);
+    void onCallSwitched(Siprix::CallId callId);
+
+    //Invoked before Mixer_MakeConference
+    void merging() { mergeStarted_ = std::chrono::steady_clock::now(); merging_ = true; }
+
+    bool isActive() const { return active_; }
+    bool isConnected(Siprix::CallId callId) const { return connected_.count(callId) != 0; }
+    size_t connectedCount() const { return connected_.size(); }
+    const CallIds& members() const { return members_; }
+    Siprix::CallId switched() const { return switched_; }
+
+    uint64_t conferences() const { return conferences_; }
+    double lastMergeMs() const { return lastMergeMs_; }
+    void print(std::ostream& os) const;
+
+protected:
+    CallIds connected_;
+    CallIds members_;
+    Siprix::CallId switched_ = 0;   //Call heard when conference isn't active
+    bool active_ = false;
+    bool merging_ = false;
+    std::chrono::steady_clock::time_point mergeStarted_;
+    double lastMergeMs_ = 0;        //Mixer_MakeConference -> OnCallSwitched(0)
+    uint64_t conferences_ = 0;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ConferenceParams
+
+struct ConferenceParams
+{
+    std::string target;            //Extension called to get participants (has to answer automatically)
+    Siprix::AccountId accId = 0;   //Account which originates calls
+    std::vector<uint32_t> sizes{ 2, 4, 8, 16 };//Participants of the measured steps
+    uint32_t holdSec = 10;         //Measurement window of each step
+    uint32_t settleMs = 1000;      //Pause between merge and measurement
+    uint32_t baselineSec = 3;      //CPU of the idle process, subtracted from steps
+    uint32_t connectTimeoutSec = 30;
+
+    //Mixing latency (optional): prompt played to the first member is searched in recording of the last one
+    std::string prompt;
+    std::string reference;         //Same signal as WAV
+    std::string folder;            //Where recordings are written
+    uint32_t maxDelayMs = 2000;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ConferenceBench
+//Grows conference step by step: originates calls up to the size of the step, merges them
+//(Mixer_MakeConference) and measures CPU of the process and of the module threads while
+//conference is mixed. CPU above idle baseline gives per-participant cost, linear fit of
+//the steps gives max size of the conference per core. Invoked on the loop thread.
+
+class ConferenceBench
+{
+public:
+    struct Actions {
+        std::function<Siprix::ErrorCode(Siprix::CallId& callId)> invite;
+        std::function<Siprix::ErrorCode(Siprix::CallId callId)> bye;
+        std::function<Siprix::ErrorCode()> merge;
+        std::function<Siprix::ErrorCode(Siprix::CallId callId, Siprix::PlayerId& playerId)> play;
+        std::function<Siprix::ErrorCode(Siprix::CallId callId, const std::string& path)> record;
+        std::function<Siprix::ErrorCode(Siprix::CallId callId)> stopRecord;
+        std::function<void(uint64_t& processMs, uint64_t& moduleMs)> cpu;
+    };
+
+    struct Step {
+        uint32_t participants = 0;
+        std::string error;
+        double connectMs = 0;       //Time to connect calls added by the step
+        double mergeMs = -1;        //Mixer_MakeConference -> OnCallSwitched(0) (-1 not confirmed)
+        double cpuPercent = 0;      //Process
+        double moduleCpuPercent = 0;//Threads of the module (mixer)
+        double perParticipant = 0;  //Process CPU above baseline per participant
+        bool mixingMeasured = false;
+        std::string mixingError;
+        std::string path;           //Recording of the last member
+        LatencyResult mixing;
+    };
+
+    ConferenceBench(EventLoop& loop) : loop_(loop) {}
+    ~ConferenceBench();
+
+    bool start(uint8_t module, const ConferenceParams& params, const Actions& actions, std::string& err);
+    void stop();
+    bool isRunning() const { return state_ != eIdle; }
+    uint8_t module() const { return module_; }
+
+    //Events of the module where benchmark runs. Return true when call belongs to the benchmark.
+    bool onCallConnected(Siprix::CallId callId);
+    bool onCallTerminated(Siprix::CallId callId);
+    void onCallSwitched(Siprix::CallId callId);
+    void onPlayerState(Siprix::PlayerId playerId, Siprix::PlayerState state);
+
+    const std::vector<Step>& steps() const { return steps_; }
+    double baselineCpuPercent() const { return baselineCpu_; }
+
+    //Linear fit of process CPU by participants. Returns false when less than 2 steps succeeded.
+    bool estimate(double& perParticipant, double& fixedPercent, uint32_t& maxPerCore) const;
+    void print(std::ostream& os) const;
+
+protected:
+    enum State { eIdle, eBaseline, eGrowing, eMerging, eSettling, eMeasuring, eAnalyzing, eEnding };
+
+    void startStep();
+    void merge();
+    void merged(double mergeMs);
+    void measure();
+    void measured();
+    void analyze();
+    void onAnalyzed(const LatencyResult& result, const std::string& error);
+    void stepDone(const std::string& error);
+    void endCalls();
+    void finish();
+    void sampleCpu(uint64_t& processMs, uint64_t& moduleMs, std::chrono::steady_clock::time_point& time) const;
+    void cancelTimer();
+
+    EventLoop& loop_;
+    ConferenceParams params_;
+    Actions actions_;
+    uint8_t module_ = 0;
+    State state_ = eIdle;
+    WavAudio reference_;
+    std::shared_ptr<const LatencyAnalyzer> analyzer_;//Created for sample rate of recordings
+    std::thread worker_;
+    std::string stamp_;                //Part of recordings names
+
+    std::vector<Siprix::CallId> calls_;//Originated by benchmark, in order of creation
+    std::set<Siprix::CallId> connected_;
+    size_t stepIndex_ = 0;
+    Siprix::PlayerId player_ = 0;
+    EventLoop::TimerId timer_ = 0;
+
+    std::chrono::steady_clock::time_point started_;//Of the current state
+    uint64_t processMs_ = 0;
+    uint64_t moduleMs_ = 0;
+    double baselineCpu_ = 0;
+
+    std::vector<Step> steps_;
+};
@@ -0,0 +1,537 @@
+#include "Config.h"
+
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "SdkData.h"
+#include "SdkProxy.h"
+
+////////////////////////////////////////////////////////////////////////////
+//Loading
+
+bool loadConfigFile(const std::string& path, JsonValue& config, std::string& err)
+{
+#ifndef _WIN32
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if ((fd == -1) || (fstat(fd, &st) != 0))
+    {
+        err = "Can't open " + path + ": " + strerror(errno);
+        if (fd != -1) close(fd);
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* data = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        err = "Can't map " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    //File is read once from start to end
+    if (data) madvise(data, size, MADV_SEQUENTIAL);
+    const bool ok = JsonValue::parse(static_cast<const char*>(data), size, config, &err);
+    if (data) munmap(data, size);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        err = "Can't open " + path;
+        return false;
+    }
+    const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const bool ok = JsonValue::parse(text.data(), text.size(), config, &err);
+#endif
+
+    if (!ok)
+        err = path + ": " + err;
+    else if (!config.isObject())
+    {
+        err = path + ": root has to be an object";
+        return false;
+    }
+    return ok;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Value converters
+
+bool parseTransport(const std::string& str, Siprix::SipTransport& transp)
+{
+    if (str == "udp")      transp = Siprix::SipTransport::UDP;
+    else if (str == "tcp") transp = Siprix::SipTransport::TCP;
+    else if (str == "tls") transp = Siprix::SipTransport::TLS;
+    else return false;
+    return true;
+}
+
+static bool parseLogLevel(const JsonValue& v, uint8_t& level)
+{
+    static const char* const names[] = { "stack", "debug", "info", "warning", "error", "none" };
+    for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        if (v.str() == names[i])
+        {
+            level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseSecureMedia(const JsonValue& v, Siprix::SecureMedia& mode)
+{
+    if (v.str() == "disabled")  mode = Siprix::SecureMedia::Disabled;
+    else if (v.str() == "sdes") mode = Siprix::SecureMedia::SdesSrtp;
+    else if (v.str() == "dtls") mode = Siprix::SecureMedia::DtlsSrtp;
+    else return false;
+    return true;
+}
+
+static bool parseAudioCodec(const std::string& str, Siprix::AudioCodec& codec)
+{
+    static const std::unordered_map<std::string, Siprix::AudioCodec> codecs = {
+        { "opus", Siprix::AudioCodec::Opus }, { "isac16", Siprix::AudioCodec::ISAC16 },
+        { "isac32", Siprix::AudioCodec::ISAC32 }, { "g722", Siprix::AudioCodec::G722 },
+        { "ilbc", Siprix::AudioCodec::ILBC }, { "pcmu", Siprix::AudioCodec::PCMU },
+        { "pcma", Siprix::AudioCodec::PCMA }, { "dtmf", Siprix::AudioCodec::DTMF },
+        { "cn", Siprix::AudioCodec::CN },
+    };
+    auto it = codecs.find(str);
+    if (it == codecs.end())
+        return false;
+    codec = it->second;
+    return true;
+}
+
+static bool parseVideoCodec(const std::string& str, Siprix::VideoCodec& codec)
+{
+    if (str == "h264")     codec = Siprix::VideoCodec::H264;
+    else if (str == "vp8") codec = Siprix::VideoCodec::VP8;
+    else if (str == "vp9") codec = Siprix::VideoCodec::VP9;
+    else if (str == "av1") codec = Siprix::VideoCodec::AV1;
+    else return false;
+    return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Setters
+//Each setter validates type of the value and applies it, returns false when value is invalid
+
+template<typename Data>
+using ConfigSetter = bool (*)(Data* data, const JsonValue& v);
+
+//'skip' - keys which aren't applied (settings were validated before)
+template<typename Data>
+static bool applySection(const JsonValue& section, Data* data, const char* sectionName,
+                         const std::unordered_map<std::string, ConfigSetter<Data>>& setters, std::string& err,
+                         bool (*skip)(const std::string& key) = nullptr)
+{
+    if (!section.isObject())
+    {
+        err = std::string("Section '") + sectionName + "' has to be an object";
+        return false;
+    }
+
+    for (const auto& member : section.members())
+    {
+        auto it = setters.find(member.first);
+        if (it == setters.end())
+        {
+            err = std::string("Unknown key '") + member.first + "' in '" + sectionName + "'";
+            return false;
+        }
+        if (skip && skip(member.first))
+            continue;
+        if (!it->second(data, member.second))
+        {
+            err = std::string("Invalid value of '") + member.first + "' in '" + sectionName + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool applyIniConfig(const JsonValue& ini, Siprix::IniData* data, std::string& err)
+{
+    static const std::unordered_map<std::string, ConfigSetter<Siprix::IniData>> setters = {
+        { "license", [](Siprix::IniData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Ini_SetLicense(d, v.str().c_str());
+            return true; } },
+        { "logLevelFile", [](Siprix::IniData* d, const JsonValue& v) {
+            uint8_t level = 0;
+            if (!parseLogLevel(v, level))
+                return false;
+            Sdk::Ini_SetLogLevelFile(d, level);
+            return true; } },
+        { "logLevelIde", [](Siprix::IniData* d, const JsonValue& v) {
+            uint8_t level = 0;
+            if (!parseLogLevel(v, level))
+                return false;
+            Sdk::Ini_SetLogLevelIde(d, level);
+            return true; } },
+        { "shareUdpTransport", [](Siprix::IniData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Ini_SetShareUdpTransport(d, v.asBool());
+            return true; } },
+        { "useExternalRinger", [](Siprix::IniData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Ini_SetUseExternalRinger(d, v.asBool());
+            return true; } },
+        { "dmpOnUnhandledExc", [](Siprix::IniData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Ini_SetDmpOnUnhandledExc(d, v.asBool());
+            return true; } },
+        { "tlsVerifyServer", [](Siprix::IniData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Ini_SetTlsVerifyServer(d, v.asBool());
+            return true; } },
+        { "singleCallMode", [](Siprix::IniData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Ini_SetSingleCallMode(d, v.asBool());
+            return true; } },
+        { "dnsServers", [](Siprix::IniData* d, const JsonValue& v) {
+            if (!v.isArray())
+                return false;
+            for (const JsonValue& dns : v.items())
+                if (!dns.isString())
+                    return false;
+            for (const JsonValue& dns : v.items())
+                Sdk::Ini_AddDnsServer(d, dns.str().c_str());
+            return true; } },
+        //Home folder and RTP port are resolved by application (each module requires own ones)
+        { "homeFolder",   [](Siprix::IniData*, const JsonValue& v) { return v.isString(); } },
+        { "rtpStartPort", [](Siprix::IniData*, const JsonValue& v) { return v.isNumber(); } },
+    };
+    return applySection(ini, data, "ini", setters, err);
+}
+
+static bool isAccListKey(const std::string& key)
+{
+    return (key == "xHeaders") || (key == "xContactUriParams");
+}
+
+std::string accTemplateKey(const JsonValue& acc)
+{
+    std::string key;
+    for (const auto& m : acc.members())
+    {
+        key += m.first;
+        if (isAccListKey(m.first))
+            for (const auto& item : m.second.members())
+                key += "\n" + item.first + ":" + item.second.asString();
+        key += "\n";
+    }
+    return key;
+}
+
+bool applyAccConfig(const JsonValue& acc, Siprix::AccData* data, std::string& err, bool appendLists)
+{
+    static const std::unordered_map<std::string, ConfigSetter<Siprix::AccData>> setters = {
+        { "server", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetSipServer(d, v.str().c_str());
+            return true; } },
+        { "extension", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString() && !v.isNumber())
+                return false;
+            Sdk::Acc_SetSipExtension(d, v.asString().c_str());
+            return true; } },
+        { "authId", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetSipAuthId(d, v.str().c_str());
+            return true; } },
+        { "password", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetSipPassword(d, v.str().c_str());
+            return true; } },
+        { "expireTime", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isNumber())
+                return false;
+            Sdk::Acc_SetExpireTime(d, static_cast<uint32_t>(v.asInt()));
+            return true; } },
+        { "proxy", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetSipProxyServer(d, v.str().c_str());
+            return true; } },
+        { "stunServer", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetStunServer(d, v.str().c_str());
+            return true; } },
+        { "turnServer", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetTurnServer(d, v.str().c_str());
+            return true; } },
+        { "turnUser", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetTurnUser(d, v.str().c_str());
+            return true; } },
+        { "turnPassword", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetTurnPassword(d, v.str().c_str());
+            return true; } },
+        { "userAgent", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetUserAgent(d, v.str().c_str());
+            return true; } },
+        { "displayName", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetDisplayName(d, v.str().c_str());
+            return true; } },
+        { "instanceId", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetInstanceId(d, (v.str() == "auto") ? Sdk::Acc_GenerateInstanceId() : v.str().c_str());
+            return true; } },
+        { "ringToneFile", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetRingToneFile(d, v.str().c_str());
+            return true; } },
+        { "secureMedia", [](Siprix::AccData* d, const JsonValue& v) {
+            Siprix::SecureMedia mode;
+            if (!parseSecureMedia(v, mode))
+                return false;
+            Sdk::Acc_SetSecureMediaMode(d, mode);
+            return true; } },
+        { "useSipSchemeForTls", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Acc_SetUseSipSchemeForTls(d, v.asBool());
+            return true; } },
+        { "rtcpMux", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Acc_SetRtcpMuxEnabled(d, v.asBool());
+            return true; } },
+        { "ice", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Acc_SetIceEnabled(d, v.asBool());
+            return true; } },
+        { "keepAliveTime", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isNumber())
+                return false;
+            Sdk::Acc_SetKeepAliveTime(d, static_cast<uint32_t>(v.asInt()));
+            return true; } },
+        { "transport", [](Siprix::AccData* d, const JsonValue& v) {
+            Siprix::SipTransport transp;
+            if (!v.isString() || !parseTransport(v.str(), transp))
+                return false;
+            Sdk::Acc_SetTranspProtocol(d, transp);
+            return true; } },
+        { "port", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isNumber())
+                return false;
+            Sdk::Acc_SetTranspPort(d, static_cast<uint16_t>(v.asInt()));
+            return true; } },
+        { "tlsCaCert", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetTranspTlsCaCert(d, v.str().c_str());
+            return true; } },
+        { "bindAddr", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Acc_SetTranspBindAddr(d, v.str().c_str());
+            return true; } },
+        { "preferIPv6", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Acc_SetTranspPreferIPv6(d, v.asBool());
+            return true; } },
+        { "rewriteContactIp", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isBool())
+                return false;
+            Sdk::Acc_SetRewriteContactIp(d, v.asBool());
+            return true; } },
+        { "xHeaders", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isObject())
+                return false;
+            for (const auto& m : v.members())
+                Sdk::Acc_AddXHeader(d, m.first.c_str(), m.second.asString().c_str());
+            return true; } },
+        { "xContactUriParams", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isObject())
+                return false;
+            for (const auto& m : v.members())
+                Sdk::Acc_AddXContactUriParam(d, m.first.c_str(), m.second.asString().c_str());
+            return true; } },
+        //Replace default list of codecs
+        { "audioCodecs", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isArray())
+                return false;
+            Siprix::AudioCodec codec;
+            for (const JsonValue& item : v.items())
+                if (!parseAudioCodec(item.str(), codec))
+                    return false;
+            Sdk::Acc_ResetAudioCodecs(d);
+            for (const JsonValue& item : v.items()) {
+                parseAudioCodec(item.str(), codec);
+                Sdk::Acc_AddAudioCodec(d, codec);
+            }
+            return true; } },
+        { "videoCodecs", [](Siprix::AccData* d, const JsonValue& v) {
+            if (!v.isArray())
+                return false;
+            Siprix::VideoCodec codec;
+            for (const JsonValue& item : v.items())
+                if (!parseVideoCodec(item.str(), codec))
+                    return false;
+            Sdk::Acc_ResetVideoCodecs(d);
+            for (const JsonValue& item : v.items()) {
+                parseVideoCodec(item.str(), codec);
+                Sdk::Acc_AddVideoCodec(d, codec);
+            }
+            return true; } },
+    };
+    return applySection(acc, data, "account", setters, err, appendLists ? nullptr : &isAccListKey);
+}
+
+bool applyVideoConfig(const JsonValue& video, Siprix::VideoData* data, std::string& err)
+{
+    static const std::unordered_map<std::string, ConfigSetter<Siprix::VideoData>> setters = {
+        { "noCameraImgPath", [](Siprix::VideoData* d, const JsonValue& v) {
+            if (!v.isString())
+                return false;
+            Sdk::Vdo_SetNoCameraImgPath(d, v.str().c_str());
+            return true; } },
+        { "framerate", [](Siprix::VideoData* d, const JsonValue& v) {
+            if (!v.isNumber())
+                return false;
+            Sdk::Vdo_SetFramerate(d, static_cast<int>(v.asInt()));
+            return true; } },
+        { "bitrate", [](Siprix::VideoData* d, const JsonValue& v) {
+            if (!v.isNumber())
+                return false;
+            Sdk::Vdo_SetBitrate(d, static_cast<int>(v.asInt()));
+            return true; } },
+        { "width", [](Siprix::VideoData* d, const JsonValue& v) {
+            if (!v.isNumber())
+                return false;
+            Sdk::Vdo_SetWidth(d, static_cast<int>(v.asInt()));
+            return true; } },
+        { "height", [](Siprix::VideoData* d, const JsonValue& v) {
+            if (!v.isNumber())
+                return false;
+            Sdk::Vdo_SetHeight(d, static_cast<int>(v.asInt()));
+            return true; } },
+    };
+    return applySection(video, data, "video", setters, err);
+}
+
+bool validateConfig(const JsonValue& config, std::string& err)
+{
+    static const char* const sections[] = { "ini", "video", "devices", "accountDefaults", "accounts", "prompts", "playlists" };
+    for (const auto& member : config.members())
+    {
+        bool known = false;
+        for (const char* name : sections)
+            known = known || (member.first == name);
+        if (!known)
+        {
+            err = "Unknown section '" + member.first + "'";
+            return false;
+        }
+    }
+
+    //Scratch objects - their content is discarded
+    if (config.has("ini") && !applyIniConfig(config["ini"], SdkData<Siprix::IniData>("validate").get(), err))
+        return false;
+
+    if (config.has("video") && !applyVideoConfig(config["video"], SdkData<Siprix::VideoData>("validate").get(), err))
+        return false;
+
+    const JsonValue& devices = config["devices"];
+    for (const auto& member : devices.members())
+    {
+        if (((member.first != "playout") && (member.first != "recording") && (member.first != "video")) ||
+            !member.second.isNumber())
+        {
+            err = "Invalid key '" + member.first + "' in 'devices'";
+            return false;
+        }
+    }
+
+    //Files of prompts are checked when catalog is loaded
+    for (const char* name : { "prompts", "playlists" })
+    {
+        if (config.has(name) && !config[name].isObject())
+        {
+            err = std::string("Section '") + name + "' has to be an object";
+            return false;
+        }
+    }
+    for (const auto& member : config["prompts"].members())
+    {
+        if (!member.second.isString())
+        {
+            err = "Prompt '" + member.first + "' has to be a path of mp3 file";
+            return false;
+        }
+    }
+    for (const auto& member : config["playlists"].members())
+    {
+        bool valid = member.second.isArray();
+        for (const JsonValue& item : member.second.items())
+            valid = valid && item.isString();
+        if (!valid)
+        {
+            err = "Playlist '" + member.first + "' has to be an array of prompt names";
+            return false;
+        }
+    }
+
+    //One scratch object is enough
+    SdkData<Siprix::AccData> accData("validate");
+    Siprix::AccData* acc = accData.get();
+    if (config.has("accountDefaults") && !applyAccConfig(config["accountDefaults"], acc, err))
+        return false;
+
+    const JsonValue& accounts = config["accounts"];
+    if (!accounts.isNull() && !accounts.isArray())
+    {
+        err = "Section 'accounts' has to be an array";
+        return false;
+    }
+    for (size_t i = 0; i < accounts.items().size(); ++i)
+    {
+        const JsonValue& item = accounts[i];
+        if (!applyAccConfig(item, acc, err) || !item.has("server") || !item.has("extension"))
+        {
+            if (err.empty()) err = "Server or extension is missing";
+            err = "accounts[" + std::to_string(i) + "]: " + err;
+            return false;
+        }
+    }
+    return true;
+}
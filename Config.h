@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "Json.h"
+
+////////////////////////////////////////////////////////////////////////////
+//Configuration file
+//JSON document with sections (all optional):
+//  "ini":      { "license", "logLevelFile", "logLevelIde", "tlsVerifyServer", "homeFolder", "rtpStartPort", "dnsServers", ... }
+//  "video":    { "noCameraImgPath", "framerate", "bitrate", "width", "height" }
+//  "devices":  { "playout", "recording", "video" }
+//  "accountDefaults": { Acc_* settings applied to every added account }
+//  "accounts": [ { "server", "extension", "password", other Acc_* settings }, ... ]
+//  "prompts":  { "<name>": "<path of mp3 file>", ... }
+//  "playlists": { "<name>": [ "<prompt name>", ... ], ... }
+//See README for the full list of the keys.
+
+//Maps file into memory and parses it without extra copy of the text
+bool loadConfigFile(const std::string& path, JsonValue& config, std::string& err);
+
+//Apply settings of the section to the SDK object.
+//Return false and set 'err' when section has unknown key or invalid value.
+bool applyIniConfig(const JsonValue& ini, Siprix::IniData* data, std::string& err);
+//'appendLists' false skips lists which are appended to the object (xHeaders, xContactUriParams),
+//when object reused for the same settings already has them.
+bool applyAccConfig(const JsonValue& acc, Siprix::AccData* data, std::string& err, bool appendLists = true);
+//Accounts with the same key may share AccData: names of the keys (their values are set by
+//each account) and values of the appended lists
+std::string accTemplateKey(const JsonValue& acc);
+bool applyVideoConfig(const JsonValue& video, Siprix::VideoData* data, std::string& err);
+
+//Checks all sections by applying them to scratch SDK objects, so errors are reported
+//on start instead of failing later on each module/account
+bool validateConfig(const JsonValue& config, std::string& err);
+
+bool parseTransport(const std::string& str, Siprix::SipTransport& transp);
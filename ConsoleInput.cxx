@@ -0,0 +1,140 @@
+#include "ConsoleInput.h"
+#include "EventLoop.h"
+
+#include <cctype>
+#include <iostream>
+
+#ifdef EVENTLOOP_EPOLL
+#include <unistd.h>
+#include <cerrno>
+#else
+#include <thread>
+#endif
+
+static bool isSpace(char ch)
+{
+    return std::isspace(static_cast<unsigned char>(ch)) != 0;
+}
+
+#ifdef EVENTLOOP_EPOLL
+
+bool ConsoleInput::attach(EventLoop& loop, InputHandler handler)
+{
+    loop_ = &loop;
+    handler_ = handler;
+    if (loop.watchFd(STDIN_FILENO, EventLoop::eReadable, [this](uint32_t) { onReadable(); }))
+        return true;
+
+    //epoll doesn't accept regular files (stdin redirected from file) - they never block, read at once
+    char buf[4096];
+    ssize_t n = 0;
+    while ((n = ::read(STDIN_FILENO, buf, sizeof(buf))) > 0)
+        feed(buf, static_cast<size_t>(n));
+    setEof();
+
+    loop.post([this]() { handler_(); });
+    return true;
+}
+
+void ConsoleInput::onReadable()
+{
+    char buf[4096];
+    const ssize_t n = ::read(STDIN_FILENO, buf, sizeof(buf));
+    if (n > 0)
+    {
+        feed(buf, static_cast<size_t>(n));
+    }
+    else if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+    {
+        setEof();
+        loop_->unwatchFd(STDIN_FILENO);
+    }
+    handler_();
+}
+
+#else
+
+bool ConsoleInput::attach(EventLoop& loop, InputHandler handler)
+{
+    loop_ = &loop;
+    handler_ = handler;
+
+    //No way to poll console on all platforms - read it by separate thread
+    std::thread([this]() {
+        std::string line;
+        while (std::getline(std::cin, line))
+        {
+            line += '\n';
+            loop_->post([this, line]() { feed(line.data(), line.size()); handler_(); });
+        }
+        loop_->post([this]() { setEof(); handler_(); });
+    }).detach();
+    return true;
+}
+
+void ConsoleInput::onReadable()
+{
+}
+
+#endif
+
+void ConsoleInput::feed(const char* data, size_t size)
+{
+    //Drop consumed part of the buffer
+    if (pos_ > 0)
+    {
+        buf_.erase(0, pos_);
+        pos_ = 0;
+    }
+    buf_.append(data, size);
+}
+
+void ConsoleInput::setEof()
+{
+    eof_ = true;
+}
+
+bool ConsoleInput::eof() const
+{
+    if (!eof_)
+        return false;
+
+    for (size_t i = pos_; i < buf_.size(); ++i)
+        if (!isSpace(buf_[i])) return false;
+    return true;
+}
+
+void ConsoleInput::skipSpaces()
+{
+    while ((pos_ < buf_.size()) && isSpace(buf_[pos_]))
+        ++pos_;
+}
+
+bool ConsoleInput::nextChar(char& ch)
+{
+    skipSpaces();
+    if (pos_ >= buf_.size())
+        return false;
+
+    ch = buf_[pos_++];
+    return true;
+}
+
+bool ConsoleInput::nextToken(std::string& token)
+{
+    skipSpaces();
+    if (pos_ >= buf_.size())
+        return false;
+
+    size_t end = pos_;
+    while ((end < buf_.size()) && !isSpace(buf_[end]))
+        ++end;
+
+    //Token may continue in the next chunk of data
+    if ((end == buf_.size()) && !eof_)
+        return false;
+
+    token.assign(buf_, pos_, end - pos_);
+    pos_ = end;
+    return true;
+}
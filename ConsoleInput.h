@@ -0,0 +1,41 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+class EventLoop;
+
+////////////////////////////////////////////////////////////////////////////
+//ConsoleInput
+//Non-blocking reader of stdin. Buffers received bytes and splits them into
+//chars/tokens with the same rules as 'std::cin >>' does.
+
+class ConsoleInput
+{
+public:
+    typedef std::function<void()> InputHandler;
+
+    //Start reading stdin, 'handler' is invoked from loop thread when new data received
+    bool attach(EventLoop& loop, InputHandler handler);
+
+    void feed(const char* data, size_t size);
+    void setEof();
+
+    //Returns true when stdin closed and all buffered data consumed
+    bool eof() const;
+
+    //Returns false when there is no complete value in the buffer yet
+    bool nextChar(char& ch);
+    bool nextToken(std::string& token);
+
+protected:
+    void skipSpaces();
+    void onReadable();
+
+protected:
+    std::string buf_;
+    size_t pos_ = 0;
+    bool eof_ = false;
+    EventLoop* loop_ = nullptr;
+    InputHandler handler_;
+};
@@ -0,0 +1,861 @@
+#include <cstring>
+#include <unordered_map>
+
+#include "AllocTracker.h"
+#include "ProcStats.h"
+#include "SdkLoader.h"
+#include "SiprixUA.h"
+
+////////////////////////////////////////////////////////////////////////////
+//Helpers
+
+typedef int32_t (*ControlOpFn)(SiprixCliApp& app, const JsonValue& args, JsonWriter& result, std::string& errText);
+
+static bool getArg(const JsonValue& args, const char* name, uint32_t& value, std::string& errText)
+{
+    const JsonValue& v = args[name];
+    if (!v.isNumber() && !v.isString())
+    {
+        errText = std::string("Argument '") + name + "' is missing";
+        return false;
+    }
+    value = static_cast<uint32_t>(v.asInt());
+    return true;
+}
+
+static bool getArg(const JsonValue& args, const char* name, std::string& value, std::string& errText)
+{
+    const JsonValue& v = args[name];
+    if (!v.isString() || v.str().empty())
+    {
+        errText = std::string("Argument '") + name + "' is missing";
+        return false;
+    }
+    value = v.str();
+    return true;
+}
+
+static void writeHistogram(JsonWriter& w, const char* name, const Histogram& h)
+{
+    w.key(name).beginObject();
+    w.field("count", h.count()).field("avg", h.avg()).field("p50", h.percentile(50))
+     .field("p99", h.percentile(99)).field("max", h.max());
+    w.endObject();
+}
+
+template<typename T>
+static void writeSdkDataPool(JsonWriter& w)
+{
+    w.beginObject().field("type", SdkDataTraits<T>::name())
+     .field("created", SdkDataPool<T>::created.load()).field("reused", SdkDataPool<T>::reused.load())
+     .field("pooled", static_cast<uint64_t>(SdkDataPool<T>::pooled()))
+     .field("dropped", SdkDataPool<T>::dropped.load()).endObject();
+}
+
+typedef Siprix::ErrorCode (*DeviceCountFn)(Siprix::ISiprixModule*, uint32_t*);
+typedef Siprix::ErrorCode (*DeviceInfoFn)(Siprix::ISiprixModule*, uint16_t, char*, uint32_t, char*, uint32_t);
+
+static Siprix::ErrorCode writeDevices(JsonWriter& w, const char* name, Siprix::ISiprixModule* module,
+                                      DeviceCountFn countFn, DeviceInfoFn infoFn)
+{
+    uint32_t numberOfDevices = 0;
+    Siprix::ErrorCode err = countFn(module, &numberOfDevices);
+    if (err != Siprix::ErrorCode::EOK)
+        return err;
+
+    w.key(name).beginArray();
+    for (uint32_t i = 0; i < numberOfDevices; ++i)
+    {
+        char devName[50] = "";
+        char guid[50] = "";
+        err = infoFn(module, static_cast<uint16_t>(i), devName, sizeof(devName), guid, sizeof(guid));
+        if (err != Siprix::ErrorCode::EOK)
+            break;
+        w.beginObject().field("index", i).field("name", devName).field("guid", guid).endObject();
+    }
+    w.endArray();
+    return err;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Operations of control socket
+//Lambdas, declared inside of the member function, have access to protected members of the app
+
+int32_t SiprixCliApp::onControlOp(const std::string& op, const JsonValue& args,
+                                  JsonWriter& result, std::string& errText)
+{
+    static const std::unordered_map<std::string, ControlOpFn> ops = {
+        //Accounts
+        { "account.add", [](SiprixCliApp& app, const JsonValue& args, JsonWriter& result, std::string& errText) -> int32_t {
+            AccountParams params;
+            if (!getArg(args, "server", params.server, errText) ||
+                !getArg(args, "extension", params.extension, errText))
+                return ControlServer::ECtrlBadArgs;
+            params.password   = args["password"].asString();
+            params.expireTime = static_cast<uint32_t>(args["expireTime"].asInt(params.expireTime));
+            if (args.has("transport") && !parseTransport(args["transport"].str(), params.transport))
+            {
+                errText = "Argument 'transport' has to be one of: udp, tcp, tls";
+                return ControlServer::ECtrlBadArgs;
+            }
+
+            Siprix::AccountId accId = 0;
+            const Siprix::ErrorCode err = app.addAccount(params, accId);
+            result.field("accId", accId);
+            return err;
+        }},
+        { "account.delete", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::AccountId accId = 0;
+            if (!getArg(args, "accId", accId, errText)) return ControlServer::ECtrlBadArgs;
+            return app.deleteAccount(accId);
+        }},
+        { "account.unregister", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::AccountId accId = 0;
+            if (!getArg(args, "accId", accId, errText)) return ControlServer::ECtrlBadArgs;
+            return app.unregisterAccount(accId);
+        }},
+        { "account.register", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::AccountId accId = 0;
+            if (!getArg(args, "accId", accId, errText)) return ControlServer::ECtrlBadArgs;
+            const uint32_t expireTime = static_cast<uint32_t>(args["expireTime"].asInt(300));
+            return app.registerAccount(accId, expireTime);
+        }},
+        { "account.secureMedia", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::AccountId accId = 0;
+            uint32_t mode = 0;
+            if (!getArg(args, "accId", accId, errText) || !getArg(args, "mode", mode, errText))
+                return ControlServer::ECtrlBadArgs;
+            return app.updSecureMedia(accId, static_cast<Siprix::SecureMedia>(mode));
+        }},
+
+        //Calls
+        { "call.invite", [](SiprixCliApp& app, const JsonValue& args, JsonWriter& result, std::string& errText) -> int32_t {
+            Siprix::AccountId accId = 0;
+            std::string destExt;
+            if (!getArg(args, "accId", accId, errText) || !getArg(args, "ext", destExt, errText))
+                return ControlServer::ECtrlBadArgs;
+
+            const JsonValue& xHeaders = args["xHeaders"];
+            bool validHeaders = xHeaders.isNull() || xHeaders.isObject();
+            for (const auto& member : xHeaders.members())
+                validHeaders = validHeaders && member.second.isString();
+            if (!validHeaders)
+            {
+                errText = "Argument 'xHeaders' has to be an object with string values";
+                return ControlServer::ECtrlBadArgs;
+            }
+
+            Siprix::CallId callId = 0;
+            const Siprix::ErrorCode err = app.inviteCall(accId, destExt, args["video"].asBool(), callId,
+                                                         xHeaders.isObject() ? &xHeaders : nullptr);
+            result.field("callId", callId);
+            return err;
+        }},
+        { "call.accept", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            const Siprix::ErrorCode err = app.prepareMedia(args["video"].asBool());
+            if (err != Siprix::EOK) return err;
+            return Sdk::Call_Accept(app.sprxModule_, callId, args["video"].asBool());
+        }},
+        { "call.reject", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            const uint16_t statusCode = static_cast<uint16_t>(args["statusCode"].asInt(486));
+            return Sdk::Call_Reject(app.sprxModule_, callId, statusCode);
+        }},
+        { "call.bye", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            return Sdk::Call_Bye(app.sprxModule_, callId);
+        }},
+        { "call.dtmf", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            std::string tones;
+            if (!getArg(args, "callId", callId, errText) || !getArg(args, "tones", tones, errText))
+                return ControlServer::ECtrlBadArgs;
+            const Siprix::DtmfMethod method = (args["method"].str() == "info") ? Siprix::DtmfMethod::DTMF_INFO
+                                                                              : Siprix::DtmfMethod::DTMF_RTP;
+            const uint16_t durationMs = static_cast<uint16_t>(args["durationMs"].asInt(200));
+            const uint16_t gapMs      = static_cast<uint16_t>(args["gapMs"].asInt(50));
+            return Sdk::Call_SendDtmf(app.sprxModule_, callId, tones.c_str(), durationMs, gapMs, method);
+        }},
+        { "call.play", [](SiprixCliApp& app, const JsonValue& args, JsonWriter& result, std::string& errText) -> int32_t {
+            //'file' - prompt, playlist or path of mp3 file; 'prompts' - array of them played one by one
+            Siprix::CallId callId = 0;
+            std::vector<std::string> names;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            for (const JsonValue& item : args["prompts"].items())
+                names.push_back(item.str());
+            if (names.empty())
+            {
+                std::string file;
+                if (!getArg(args, "file", file, errText)) return ControlServer::ECtrlBadArgs;
+                names.push_back(file);
+            }
+
+            Siprix::PlayerId playerId = 0;
+            const Siprix::ErrorCode err = app.playPrompts(callId, names, args["loop"].asBool(), playerId, errText);
+            result.field("playerId", playerId);
+            return err;
+        }},
+        { "call.stopPlay", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::PlayerId playerId = 0;
+            if (!getArg(args, "playerId", playerId, errText)) return ControlServer::ECtrlBadArgs;
+            return app.stopPlay(playerId);
+        }},
+        { "prompts.stats", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            result.field("activePlayers", static_cast<uint64_t>(app.players_.activeCount()));
+            result.field("prefetchedBytes", app.prompts_.mappedBytes());
+            result.key("prompts").beginArray();
+            for (const auto& p : app.prompts_.prompts())
+            {
+                result.beginObject()
+                      .field("name", p->name)
+                      .field("path", p->path)
+                      .field("size", p->size)
+                      .field("attempts", p->attempts)
+                      .field("plays", p->plays)
+                      .field("completed", p->completed)
+                      .field("interrupted", p->interrupted)
+                      .field("failures", p->failures)
+                      .field("failureRate", p->attempts ? static_cast<double>(p->failures) / p->attempts : 0.0)
+                      .endObject();
+            }
+            result.endArray();
+            return 0;
+        }},
+        { "call.record", [](SiprixCliApp& app, const JsonValue& args, JsonWriter& result, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            std::string path;
+            const int32_t err = app.recordCall(callId, args["start"].asBool(true), path, errText);
+            if (!path.empty()) result.field("path", path);
+            return err;
+        }},
+        { "call.tap", [](SiprixCliApp& app, const JsonValue& args, JsonWriter& result, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            std::string path;
+            const int32_t err = args["start"].asBool(true) ? app.tapCall(app.findModule(app.sprxModule_)->index, callId, path, errText)
+                                                          : app.recordCall(callId, false, path, errText);
+            if (!path.empty()) result.field("path", path);
+            return err;
+        }},
+        { "tap.stats", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            const LiveTap& tap = app.tap_;
+            result.field("active", static_cast<uint64_t>(tap.activeCount())).field("total", tap.tapped());
+            for (int d = 0; d < eTapDetections; ++d)
+                result.field(getTapDetectionStr(static_cast<TapDetection>(d)), tap.detections(static_cast<TapDetection>(d)));
+            result.field("bytesRead", tap.bytesRead()).field("audioMs", tap.audioMs()).field("busyUs", tap.busyUs())
+                  .field("avgLagMs", tap.avgLagMs());
+            return 0;
+        }},
+        { "call.muteMic", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            return Sdk::Call_MuteMic(app.sprxModule_, callId, args["mute"].asBool(true));
+        }},
+        { "call.muteCam", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            return Sdk::Call_MuteCam(app.sprxModule_, callId, args["mute"].asBool(true));
+        }},
+        { "call.hold", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            return Sdk::Call_Hold(app.sprxModule_, callId);
+        }},
+        { "call.transferBlind", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            std::string toExt;
+            if (!getArg(args, "callId", callId, errText) || !getArg(args, "to", toExt, errText))
+                return ControlServer::ECtrlBadArgs;
+            return Sdk::Call_TransferBlind(app.sprxModule_, callId, toExt.c_str());
+        }},
+        { "call.transferAttended", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId fromCallId = 0, toCallId = 0;
+            if (!getArg(args, "callId", fromCallId, errText) || !getArg(args, "toCallId", toCallId, errText))
+                return ControlServer::ECtrlBadArgs;
+            return Sdk::Call_TransferAttended(app.sprxModule_, fromCallId, toCallId);
+        }},
+        { "call.switch", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            Siprix::CallId callId = 0;
+            if (!getArg(args, "callId", callId, errText)) return ControlServer::ECtrlBadArgs;
+            return app.switchToCall(callId);
+        }},
+        { "call.conference", [](SiprixCliApp& app, const JsonValue&, JsonWriter&, std::string&) -> int32_t {
+            return app.makeConference();
+        }},
+        { "conf.status", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            const ConferenceTracker& conference = app.findModule(app.sprxModule_)->conference;
+            result.field("active", conference.isActive());
+            result.key("members").beginArray();
+            for (Siprix::CallId callId : conference.members())
+                result.value(static_cast<uint64_t>(callId));
+            result.endArray();
+            result.field("connected", static_cast<uint64_t>(conference.connectedCount()))
+                  .field("switched", static_cast<uint64_t>(conference.switched()))
+                  .field("conferences", conference.conferences())
+                  .field("lastMergeMs", conference.lastMergeMs());
+            return 0;
+        }},
+
+        //Devices
+        { "devices.list", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            Siprix::ErrorCode err = writeDevices(result, "playout", app.sprxModule_, Sdk::Dvc_GetPlayoutDevices, Sdk::Dvc_GetPlayoutDevice);
+            if (err == Siprix::ErrorCode::EOK)
+                err = writeDevices(result, "recording", app.sprxModule_, Sdk::Dvc_GetRecordingDevices, Sdk::Dvc_GetRecordingDevice);
+            if (err == Siprix::ErrorCode::EOK)
+                err = writeDevices(result, "video", app.sprxModule_, Sdk::Dvc_GetVideoDevices, Sdk::Dvc_GetVideoDevice);
+            return err;
+        }},
+        { "devices.select", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            std::string type;
+            uint32_t index = 0;
+            if (!getArg(args, "type", type, errText) || !getArg(args, "index", index, errText))
+                return ControlServer::ECtrlBadArgs;
+
+            const uint16_t deviceIndex = static_cast<uint16_t>(index);
+            if (type == "playout")   return Sdk::Dvc_SetPlayoutDevice(app.sprxModule_, deviceIndex);
+            if (type == "recording") return Sdk::Dvc_SetRecordingDevice(app.sprxModule_, deviceIndex);
+            if (type == "video")     return Sdk::Dvc_SetVideoDevice(app.sprxModule_, deviceIndex);
+            errText = "Argument 'type' has to be one of: playout, recording, video";
+            return ControlServer::ECtrlBadArgs;
+        }},
+
+        //Load generator
+        { "load.start", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            LoadParams params;
+            if (!getArg(args, "target", params.target, errText))
+                return ControlServer::ECtrlBadArgs;
+            params.cps      = args["cps"].asNumber(0);
+            params.holdSec  = static_cast<uint32_t>(args["holdSec"].asInt(params.holdSec));
+            params.maxCalls = static_cast<uint32_t>(args["maxCalls"].asInt(params.maxCalls));
+            if (params.cps <= 0)
+            {
+                errText = "Argument 'cps' has to be positive";
+                return ControlServer::ECtrlBadArgs;
+            }
+            if (!app.startLoad(params))
+            {
+                errText = "No accounts to originate calls";
+                return ControlServer::ECtrlBadArgs;
+            }
+            return 0;
+        }},
+        { "load.stop", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            app.stopLoad();
+            result.field("active", static_cast<uint64_t>(app.activeLoadCalls()));
+            return 0;
+        }},
+
+        //Application
+        { "latency.start", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            LatencyParams params = app.opts_.latency;
+            if (args.has("target"))    params.target = args["target"].asString();
+            if (args.has("prompt"))    params.prompt = args["prompt"].asString();
+            if (args.has("reference")) params.reference = args["reference"].asString();
+            params.accId      = static_cast<Siprix::AccountId>(args["accId"].asInt(params.accId));
+            params.runs       = static_cast<uint32_t>(args["runs"].asInt(params.runs));
+            params.tailMs     = static_cast<uint32_t>(args["tailMs"].asInt(params.tailMs));
+            params.maxDelayMs = static_cast<uint32_t>(args["maxDelayMs"].asInt(params.maxDelayMs));
+            return app.startLatencyTest(params, errText) ? 0 : ControlServer::ECtrlBadArgs;
+        }},
+        { "latency.stop", [](SiprixCliApp& app, const JsonValue&, JsonWriter&, std::string&) -> int32_t {
+            app.latency_.stop();
+            return 0;
+        }},
+        { "latency.report", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            const LatencySummary& summary = app.latency_.summary();
+            result.field("running", app.latency_.isRunning());
+            result.field("runs", static_cast<uint64_t>(summary.count()));
+            result.field("found", static_cast<uint64_t>(summary.found()));
+            result.field("avgMs", summary.avgMs());
+            result.field("jitterMs", summary.jitterMs());
+            result.field("lossPercent", summary.lossPercent());
+            result.key("results").beginArray();
+            for (const LatencyTest::Run& run : app.latency_.runs())
+            {
+                result.beginObject().field("path", run.path);
+                if (!run.error.empty())
+                    result.field("error", run.error);
+                else
+                    result.field("found", run.result.found)
+                          .field("delayMs", run.result.delayMs)
+                          .field("peak", run.result.peak)
+                          .field("lossPercent", run.result.lossPercent);
+                result.endObject();
+            }
+            result.endArray();
+            return 0;
+        }},
+        { "confbench.start", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            ConferenceParams params = app.opts_.conference;
+            if (args.has("target"))    params.target = args["target"].asString();
+            if (args.has("prompt"))    params.prompt = args["prompt"].asString();
+            if (args.has("reference")) params.reference = args["reference"].asString();
+            if (args.has("sizes"))
+            {
+                params.sizes.clear();
+                for (const JsonValue& item : args["sizes"].items())
+                    params.sizes.push_back(static_cast<uint32_t>(item.asInt(0)));
+            }
+            params.accId   = static_cast<Siprix::AccountId>(args["accId"].asInt(params.accId));
+            params.holdSec = static_cast<uint32_t>(args["holdSec"].asInt(params.holdSec));
+            return app.startConfBench(params, errText) ? 0 : ControlServer::ECtrlBadArgs;
+        }},
+        { "confbench.stop", [](SiprixCliApp& app, const JsonValue&, JsonWriter&, std::string&) -> int32_t {
+            app.confBench_.stop();
+            return 0;
+        }},
+        { "scenario.start", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            ScenarioParams params = app.opts_.scenario;
+            if (args.has("name"))       params.name = args["name"].asString();
+            if (args.has("target"))     params.target = args["target"].asString();
+            if (args.has("transferTo")) params.transferTo = args["transferTo"].asString();
+            if (args.has("dtmf"))       params.dtmf = args["dtmf"].asString();
+            params.accId     = static_cast<Siprix::AccountId>(args["accId"].asInt(params.accId));
+            params.count     = static_cast<uint32_t>(args["count"].asInt(params.count));
+            params.rate      = args["rate"].asNumber(params.rate);
+            params.talkMs    = static_cast<uint32_t>(args["talkMs"].asInt(params.talkMs));
+            params.timeoutMs = static_cast<uint32_t>(args["timeoutMs"].asInt(params.timeoutMs));
+            return app.startScenarios(params, errText) ? 0 : ControlServer::ECtrlBadArgs;
+        }},
+        { "scenario.stop", [](SiprixCliApp& app, const JsonValue&, JsonWriter&, std::string&) -> int32_t {
+            app.scenarios_.stop();
+            return 0;
+        }},
+        { "scenario.report", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            const ScenarioScheduler& scenarios = app.scenarios_;
+            result.field("name", scenarios.params().name).field("running", scenarios.isRunning())
+                  .field("started", scenarios.started()).field("active", static_cast<uint64_t>(scenarios.active()))
+                  .field("maxActive", static_cast<uint64_t>(scenarios.maxActive()))
+                  .field("completed", scenarios.completed()).field("failed", scenarios.failed())
+                  .field("frameBytes", static_cast<uint64_t>(ScenarioFrames::maxSize()));
+            writeHistogram(result, "durationMs", scenarios.durationMs());
+            result.key("steps").beginArray();
+            for (int i = 0; i < eScnWaits; ++i)
+            {
+                const ScenarioWait wait = static_cast<ScenarioWait>(i);
+                if (!scenarios.waitMs(wait).count() && !scenarios.failures(wait))
+                    continue;
+                result.beginObject().field("step", getScenarioWaitStr(wait)).field("failed", scenarios.failures(wait));
+                writeHistogram(result, "waitMs", scenarios.waitMs(wait));
+                result.endObject();
+            }
+            result.endArray();
+            if (!scenarios.lastFailure().empty())
+                result.field("lastFailure", scenarios.lastFailure());
+            return 0;
+        }},
+        { "script.start", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            ScriptParams params;
+            params.file   = args["file"].asString(app.opts_.script);
+            params.target = app.opts_.scenario.target;
+            params.count  = app.opts_.scenario.count;
+            params.rate   = app.opts_.scenario.rate;
+            if (args.has("target"))     params.target = args["target"].asString();
+            if (args.has("transferTo")) params.transferTo = args["transferTo"].asString();
+            if (args.has("dtmf"))       params.dtmf = args["dtmf"].asString();
+            params.accId     = static_cast<Siprix::AccountId>(args["accId"].asInt(params.accId));
+            params.count     = static_cast<uint32_t>(args["count"].asInt(params.count));
+            params.rate      = args["rate"].asNumber(params.rate);
+            params.timeoutMs = static_cast<uint32_t>(args["timeoutMs"].asInt(params.timeoutMs));
+            return app.startScript(params, errText) ? 0 : ControlServer::ECtrlBadArgs;
+        }},
+        { "script.stop", [](SiprixCliApp& app, const JsonValue&, JsonWriter&, std::string&) -> int32_t {
+            app.scripts_.stop();
+            return 0;
+        }},
+        { "script.report", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            const ScriptRunner& scripts = app.scripts_;
+            const ScenarioScript& script = scripts.script();
+            result.field("file", scripts.params().file).field("running", scripts.isRunning())
+                  .field("started", scripts.started()).field("active", static_cast<uint64_t>(scripts.active()))
+                  .field("maxActive", static_cast<uint64_t>(scripts.maxActive()))
+                  .field("completed", scripts.completed()).field("failed", scripts.failed())
+                  .field("instructions", static_cast<uint64_t>(script.code().size()));
+            writeHistogram(result, "durationMs", scripts.durationMs());
+            result.key("steps").beginArray();
+            for (size_t pc = 0; pc < script.code().size(); ++pc)
+            {
+                if (!scripts.stepUs(pc).count() && !scripts.stepFailures(pc))
+                    continue;
+                result.beginObject().field("pc", static_cast<uint64_t>(pc)).field("line", script.code()[pc].line)
+                      .field("op", getScriptOpStr(script.code()[pc].op)).field("text", script.describe(pc))
+                      .field("failed", scripts.stepFailures(pc));
+                writeHistogram(result, "us", scripts.stepUs(pc));
+                result.endObject();
+            }
+            result.endArray();
+            if (!scripts.lastFailure().empty())
+                result.field("lastFailure", scripts.lastFailure());
+            return 0;
+        }},
+        { "soak.start", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            SoakParams params = app.opts_.soakParams;
+            params.durationSec   = static_cast<uint32_t>(args["durationSec"].asInt(params.durationSec));
+            params.sampleSec     = static_cast<uint32_t>(args["sampleSec"].asInt(params.sampleSec));
+            params.warmupSec     = static_cast<uint32_t>(args["warmupSec"].asInt(params.warmupSec));
+            params.reregisterSec = static_cast<uint32_t>(args["reregisterSec"].asInt(params.reregisterSec));
+            params.expireTime    = static_cast<uint32_t>(args["expireTime"].asInt(params.expireTime));
+            return app.startSoak(params, errText) ? 0 : ControlServer::ECtrlBadArgs;
+        }},
+        { "soak.stop", [](SiprixCliApp& app, const JsonValue&, JsonWriter&, std::string&) -> int32_t {
+            app.soak_.stop();
+            return 0;
+        }},
+        { "soak.report", [](SiprixCliApp& app, const JsonValue& args, JsonWriter& result, std::string&) -> int32_t {
+            const SoakMonitor& soak = app.soak_;
+            result.field("running", soak.isRunning()).field("warmupSec", soak.params().warmupSec)
+                  .field("regErrors", soak.regErrors()).field("regFailures", soak.regFailures());
+            result.key("metrics").beginObject();
+            for (int i = 0; i < eSoakMetrics; ++i)
+            {
+                const SoakMetric metric = static_cast<SoakMetric>(i);
+                const SoakFit fit = soak.fit(metric);
+                result.key(getSoakMetricStr(metric)).beginObject().field("fitted", fit.valid);
+                if (fit.valid)
+                    result.field("per1000Calls", fit.per1000Calls).field("perHour", fit.perHour).field("r2", fit.r2)
+                          .field("growth", fit.growth).field("suspectedLeak", fit.suspected);
+                if (fit.suspected)
+                    result.field("hint", getSoakLeakHint(metric));
+                result.endObject();
+            }
+            result.endObject();
+
+            //Samples are large for long run, they're returned when requested
+            if (args["samples"].asBool(false))
+            {
+                result.key("samples").beginArray();
+                for (const SoakSample& sample : soak.samples())
+                {
+                    result.beginObject().field("sec", sample.sec).field("calls", sample.calls)
+                          .field("registrations", sample.registrations);
+                    for (int i = 0; i < eSoakMetrics; ++i)
+                        result.field(getSoakMetricStr(static_cast<SoakMetric>(i)), sample.values[i]);
+                    result.endObject();
+                }
+                result.endArray();
+            }
+            return 0;
+        }},
+        { "confbench.report", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            const ConferenceBench& bench = app.confBench_;
+            double perParticipant = 0, fixedPercent = 0;
+            uint32_t maxPerCore = 0;
+            result.field("running", bench.isRunning());
+            result.field("baselineCpuPercent", bench.baselineCpuPercent());
+            if (bench.estimate(perParticipant, fixedPercent, maxPerCore))
+                result.field("cpuPerParticipant", perParticipant)
+                      .field("fixedCpuPercent", fixedPercent)
+                      .field("maxPerCore", maxPerCore);
+            result.key("steps").beginArray();
+            for (const ConferenceBench::Step& step : bench.steps())
+            {
+                result.beginObject().field("participants", step.participants);
+                if (!step.error.empty())
+                    result.field("error", step.error);
+                else
+                    result.field("connectMs", step.connectMs)
+                          .field("mergeMs", step.mergeMs)
+                          .field("cpuPercent", step.cpuPercent)
+                          .field("moduleCpuPercent", step.moduleCpuPercent)
+                          .field("cpuPerParticipant", step.perParticipant);
+                if (step.mixingMeasured)
+                    result.field("mixingFound", step.mixing.found)
+                          .field("mixingDelayMs", step.mixing.delayMs)
+                          .field("mixingLossPercent", step.mixing.lossPercent);
+                else if (!step.mixingError.empty())
+                    result.field("mixingError", step.mixingError);
+                result.endObject();
+            }
+            result.endArray();
+            return 0;
+        }},
+        { "network.status", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            const NetworkRecovery& recovery = app.recovery_;
+            result.field("lost", recovery.isNetworkLost()).field("recovering", recovery.isRecovering())
+                  .field("events", recovery.networkEvents());
+            result.key("runs").beginArray();
+            for (const RecoveryRun& run : recovery.runs())
+            {
+                result.beginObject()
+                      .field("state", getNetworkStateStr(run.state))
+                      .field("name", run.name)
+                      .field("lostMs", run.lostMs)
+                      .field("delayMs", run.delayMs)
+                      .field("accounts", static_cast<uint64_t>(run.accounts))
+                      .field("priorityAccounts", static_cast<uint64_t>(run.priorityAccounts))
+                      .field("registered", static_cast<uint64_t>(run.registered))
+                      .field("regFailed", static_cast<uint64_t>(run.regFailed))
+                      .field("calls", static_cast<uint64_t>(run.calls))
+                      .field("renegotiated", static_cast<uint64_t>(run.renegotiated))
+                      .field("renegotiateErrors", static_cast<uint64_t>(run.renegotiateErrors))
+                      .field("requests", static_cast<uint64_t>(run.registrations + run.renegotiated + run.renegotiateErrors))
+                      .field("peakPerSec", run.peakPerSec)
+                      .field("recoveryMs", run.recoveryMs)
+                      .field("completed", run.completed)
+                      .field("interrupted", run.interrupted)
+                      .endObject();
+            }
+            result.endArray();
+            return 0;
+        }},
+        { "network.recover", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string&) -> int32_t {
+            app.recovery_.recover(args["name"].asString("manual"));
+            return 0;
+        }},
+        { "network.simulate", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string& errText) -> int32_t {
+            //Event goes through the bridge of the module like one raised by SDK
+            std::string state;
+            if (!getArg(args, "state", state, errText))
+                return ControlServer::ECtrlBadArgs;
+            Siprix::NetworkState networkState;
+            if (state == "lost")          networkState = Siprix::NetworkState::NetworkLost;
+            else if (state == "restored") networkState = Siprix::NetworkState::NetworkRestored;
+            else if (state == "switched") networkState = Siprix::NetworkState::NetworkSwitched;
+            else
+            {
+                errText = "Argument 'state' must be lost, restored or switched";
+                return ControlServer::ECtrlBadArgs;
+            }
+            app.findModule(app.sprxModule_)->bridge.OnNetworkState(args["name"].asString("simulated").c_str(), networkState);
+            return 0;
+        }},
+        { "admission.status", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            const AdmissionControl& admission = app.admission_;
+            const AdmissionParams& params = admission.params();
+            result.field("enabled", admission.isEnabled()).field("overloaded", admission.isOverloaded());
+            result.key("metrics").beginArray();
+            for (int i = 0; i < eAdmitMetrics; ++i)
+            {
+                const AdmissionMetric metric = static_cast<AdmissionMetric>(i);
+                result.beginObject()
+                      .field("name", getAdmissionMetricStr(metric))
+                      .field("value", admission.value(metric))
+                      .field("limit", admission.limit(metric))
+                      .endObject();
+            }
+            result.endArray();
+            result.field("maxAccountCalls", params.maxAccountCalls)
+                  .field("resumePercent", params.resumePercent)
+                  .field("minOverloadMs", params.minOverloadMs)
+                  .field("admitted", app.stats_->callsAdmitted.load())
+                  .field("shed", app.stats_->callsShed.load())
+                  .field("shedAccount", app.stats_->callsShedAccount.load())
+                  .field("overloads", app.stats_->overloads.load())
+                  .field("overloadMs", app.stats_->overloadMs.load());
+            if (app.stats_->overloads.load())
+                result.field("lastOverloadMetric", getAdmissionMetricStr(admission.overloadMetric()));
+            return 0;
+        }},
+        { "admission.set", [](SiprixCliApp& app, const JsonValue& args, JsonWriter&, std::string&) -> int32_t {
+            //Omitted limits are kept, 0 removes limit
+            AdmissionParams params = app.admission_.params();
+            params.maxCalls        = static_cast<uint32_t>(args["maxCalls"].asInt(params.maxCalls));
+            params.maxAccountCalls = static_cast<uint32_t>(args["maxAccountCalls"].asInt(params.maxAccountCalls));
+            params.maxQueueDepth   = static_cast<uint32_t>(args["maxQueueDepth"].asInt(params.maxQueueDepth));
+            params.maxCpu          = args["maxCpu"].asNumber(params.maxCpu);
+            params.maxProcessCpu   = args["maxProcessCpu"].asNumber(params.maxProcessCpu);
+            params.resumePercent   = args["resumePercent"].asNumber(params.resumePercent);
+            params.minOverloadMs   = static_cast<uint32_t>(args["minOverloadMs"].asInt(params.minOverloadMs));
+            app.startAdmission(params);
+            return 0;
+        }},
+        { "cdr.stats", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            const CdrWriter& cdr = app.cdr_;
+            result.field("enabled", cdr.isEnabled());
+            if (!cdr.isEnabled())
+                return 0;
+            result.field("folder", cdr.params().folder)
+                  .field("fsync", getCdrSyncStr(cdr.params().sync))
+                  .field("open", static_cast<uint64_t>(cdr.openCount()))
+                  .field("written", cdr.written())
+                  .field("dropped", cdr.dropped())
+                  .field("errors", cdr.errors())
+                  .field("batches", cdr.batches())
+                  .field("maxBatch", cdr.maxBatch())
+                  .field("maxWriteUs", cdr.maxWriteUs())
+                  .field("files", cdr.files())
+                  .field("syncs", cdr.syncs())
+                  .field("repaired", cdr.repaired());
+            return 0;
+        }},
+        { "app.stats", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            result.key("events").beginObject();
+            for (int i = 0; i < AppEvent::eCount; ++i)
+                result.field(getAppEventName(static_cast<AppEvent::Type>(i)), app.stats_->events[i].load());
+            result.endObject();
+            result.field("commands", app.stats_->commands.load());
+            result.field("maxQueueDepth", app.stats_->maxQueueDepth.load());
+            result.field("queued", static_cast<uint64_t>(app.loop_.pendingTasks()));
+            result.field("controlClients", static_cast<uint64_t>(app.control_.clientsCount()));
+            result.field("droppedEvents", app.control_.droppedEvents());
+            writeHistogram(result, "eventDelayUs", app.stats_->eventDelayUs);
+            result.field("accounts", app.stats_->accounts.load());
+            result.key("calls").beginObject()
+                  .field("originated", app.stats_->callsOriginated.load())
+                  .field("connected", app.stats_->callsConnected.load())
+                  .field("failed", app.stats_->callsFailed.load())
+                  .field("completed", app.stats_->callsCompleted.load())
+                  .field("active", static_cast<uint64_t>(app.activeLoadCalls()))
+                  .endObject();
+            writeHistogram(result, "callSetupMs", app.stats_->callSetupMs);
+            result.key("admission").beginObject()
+                  .field("admitted", app.stats_->callsAdmitted.load())
+                  .field("shed", app.stats_->callsShed.load())
+                  .field("shedAccount", app.stats_->callsShedAccount.load())
+                  .field("overloads", app.stats_->overloads.load())
+                  .field("overloadMs", app.stats_->overloadMs.load())
+                  .field("overloaded", app.stats_->overloaded.load())
+                  .endObject();
+            if (app.opts_.isWorker())
+                result.field("worker", app.opts_.workerIndex);
+
+            app.updateModuleRates();
+            result.field("cpuPercent", app.processCpuPercent_);
+            result.key("recordings").beginObject()
+                  .field("active", static_cast<uint64_t>(app.recordings_.activeCount()))
+                  .field("queued", static_cast<uint64_t>(app.recordings_.queuedCount()))
+                  .field("finalized", app.recordings_.finalized())
+                  .field("failed", app.recordings_.failed())
+                  .field("refused", app.recordings_.refused())
+                  .field("preallocFailed", app.recordings_.preallocFailed())
+                  .field("preallocLost", app.recordings_.preallocLost())
+                  .field("usedBytes", app.recordings_.usedBytes())
+                  .endObject();
+            result.field("rssKb", procRssKb());
+            result.field("mediaLoaded", sdkIsMediaMapped());
+            result.key("modules").beginArray();
+            for (const auto& module : app.modules_)
+            {
+                result.beginObject()
+                      .field("index", static_cast<uint32_t>(module->index))
+                      .field("threads", static_cast<uint64_t>(module->threads.size()))
+                      .field("accounts", static_cast<uint64_t>(module->loadAccounts.size()))
+                      .field("cpuMs", module->cpuMs)
+                      .field("cpuPercent", module->cpuPercent)
+                      .field("events", module->events)
+                      .field("eventRate", module->eventRate)
+                      .endObject();
+            }
+            result.endArray();
+            return 0;
+        }},
+        { "sdk.stats", [](SiprixCliApp&, const JsonValue& args, JsonWriter& result, std::string&) -> int32_t {
+            result.field("enabled", sdkStatsEnabled());
+            result.key("functions").beginArray();
+            for (int i = 0; i < eSdkFnCount; ++i)
+            {
+                const SdkFnStats& stats = sdkFnStats(static_cast<SdkFn>(i));
+                if (!stats.latencyNs.count())
+                    continue;
+                result.beginObject().field("name", getSdkFnName(static_cast<SdkFn>(i)));
+                writeHistogram(result, "latencyNs", stats.latencyNs);
+                result.field("errors", stats.errors.load());
+                result.key("errorCodes").beginArray();
+                for (int slot = 0; slot < SdkFnStats::kErrorSlots; ++slot)
+                {
+                    const int32_t code = stats.errorCodes[slot].load();
+                    if (code)
+                        result.beginObject().field("code", code)
+                              .field("text", Sdk::GetErrorText(static_cast<Siprix::ErrorCode>(code)))
+                              .field("count", stats.errorCounts[slot].load()).endObject();
+                }
+                result.endArray();
+                if (stats.otherErrors.load())
+                    result.field("otherErrors", stats.otherErrors.load());
+                result.endObject();
+            }
+            result.endArray();
+            result.key("data").beginArray();
+            writeSdkDataPool<Siprix::AccData>(result);
+            writeSdkDataPool<Siprix::DestData>(result);
+            writeSdkDataPool<Siprix::IniData>(result);
+            writeSdkDataPool<Siprix::VideoData>(result);
+            result.endArray();
+            if (args["reset"].asBool())
+                sdkResetStats();
+            return 0;
+        }},
+        { "app.allocs", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            auto writeCounters = [&result](const AllocTracker::Counters& c) {
+                result.field("allocs", c.allocs).field("frees", c.frees).field("bytes", c.bytes);
+            };
+            result.field("enabled", AllocTracker::enabled());
+            writeCounters(AllocTracker::total());
+            result.key("threads").beginArray();
+            AllocTracker::Counters c;
+            int tid = 0;
+            for (size_t slot = 0; AllocTracker::ofThread(slot, tid, c); ++slot)
+            {
+                result.beginObject().field("tid", tid);
+                writeCounters(c);
+                result.endObject();
+            }
+            result.endArray();
+            result.key("tags").beginArray();
+            for (uint16_t tag = 1; tag < AllocTracker::tagsCount(); ++tag)
+            {
+                result.beginObject().field("name", AllocTracker::tagName(tag));
+                writeCounters(AllocTracker::ofTag(tag));
+                result.endObject();
+            }
+            result.endArray();
+            uint64_t pooled = 0;
+            for (const auto& module : app.modules_)
+                pooled += module->bridge.pooledEvents();
+            result.field("pooledEvents", pooled);
+            return 0;
+        }},
+        { "app.version", [](SiprixCliApp& app, const JsonValue&, JsonWriter& result, std::string&) -> int32_t {
+            result.field("version", Sdk::Module_Version(app.sprxModule_));
+            return 0;
+        }},
+        { "app.quit", [](SiprixCliApp& app, const JsonValue&, JsonWriter&, std::string&) -> int32_t {
+            //Let response to be sent before drain starts (it may stop loop immediately)
+            app.loop_.addTimer(0, 0, [&app]() { app.startDrain(); });
+            return 0;
+        }},
+    };
+
+    auto it = ops.find(op);
+    if (it == ops.end())
+    {
+        errText = "Unknown operation: " + op;
+        return ControlServer::ECtrlUnknownOp;
+    }
+    ALLOC_SCOPE_NAME(it->first.c_str());//Allocations of the operation are counted by its name
+
+    //Operation is applied to the module specified by 'module' argument (selected one by default)
+    const uint32_t moduleIndex = static_cast<uint32_t>(args["module"].asInt(curModule_));
+    if (moduleIndex >= modules_.size())
+    {
+        errText = "Argument 'module' is out of range";
+        return ControlServer::ECtrlBadArgs;
+    }
+
+    //New calls aren't started while application is shutting down
+    if (draining_ && ((op == "call.invite") || (op == "call.accept") ||
+                              (op == "load.start") || (op == "latency.start") ||
+                              (op == "confbench.start") || (op == "scenario.start") || (op == "script.start")))
+    {
+        errText = "Application is shutting down";
+        return ControlServer::ECtrlShuttingDown;
+    }
+
+    //Calls aren't originated while network is lost
+    if (recovery_.isNetworkLost() && ((op == "call.invite") || (op == "load.start") || (op == "latency.start") ||
+                                      (op == "confbench.start") || (op == "scenario.start") || (op == "script.start")))
+    {
+        errText = "Network is lost";
+        return ControlServer::ECtrlNetworkLost;
+    }
+
+    ++stats_->commands;
+    ModuleScope scope(*this, modules_[moduleIndex]->handle);
+    return it->second(*this, args, result, errText);
+}
@@ -0,0 +1,535 @@
+#include "ControlServer.h"
+#include "EventLoop.h"
+#include "LiveTap.h"
+#include "SdkProxy.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+static const size_t kMaxLineSize      = 16 * 1024 * 1024;//Max size of one request
+static const size_t kMaxEventBacklog  = 1 * 1024 * 1024; //Unsent data after which events are dropped
+static const size_t kMaxOutBufSize    = 64 * 1024 * 1024;//Unsent data after which client is disconnected
+static const size_t kReadChunkSize    = 64 * 1024;
+
+ControlServer::ControlServer(EventLoop& loop, IControlHandler& handler)
+    : loop_(loop), handler_(handler)
+{
+}
+
+ControlServer::~ControlServer()
+{
+    stop();
+}
+
+////////////////////////////////////////////////////////////////////////////
+//Events
+
+void ControlServer::writeEventJson(const AppEvent& ev, JsonWriter& w)
+{
+    //Convert time of the event to the wall clock
+    const auto age = std::chrono::steady_clock::now() - ev.time;
+    const auto wallTime = std::chrono::system_clock::now() - age;
+    const int64_t tsMs = std::chrono::duration_cast<std::chrono::milliseconds>(wallTime.time_since_epoch()).count();
+
+    w.beginObject();
+    w.field("event", getAppEventName(ev.type));
+    w.field("ts", tsMs);
+    w.field("module", static_cast<uint32_t>(ev.module));
+    switch (ev.type)
+    {
+        case AppEvent::eAccountRegState:
+            w.field("accId", ev.id).field("state", getAccRegStateStr(static_cast<Siprix::RegState>(ev.code)))
+             .field("response", ev.text1);
+            break;
+        case AppEvent::eNetworkState:
+            w.field("name", ev.text1).field("state", getNetworkStateStr(static_cast<Siprix::NetworkState>(ev.code)));
+            break;
+        case AppEvent::ePlayerState:
+            w.field("playerId", ev.id).field("state", getPlayerStateStr(static_cast<Siprix::PlayerState>(ev.code)));
+            break;
+        case AppEvent::eRingerState:
+            w.field("started", ev.code != 0);
+            break;
+        case AppEvent::eCallIncoming:
+            w.field("callId", ev.id).field("accId", ev.relatedId).field("withVideo", ev.withVideo)
+             .field("from", ev.text1).field("to", ev.text2);
+            break;
+        case AppEvent::eCallConnected:
+            w.field("callId", ev.id).field("from", ev.text1).field("to", ev.text2).field("withVideo", ev.withVideo);
+            break;
+        case AppEvent::eCallTerminated:
+        case AppEvent::eCallTransferred:
+            w.field("callId", ev.id).field("statusCode", ev.code);
+            break;
+        case AppEvent::eCallProceeding:
+            w.field("callId", ev.id).field("response", ev.text1);
+            break;
+        case AppEvent::eCallRedirected:
+            w.field("origCallId", ev.id).field("relatedCallId", ev.relatedId).field("referTo", ev.text1);
+            break;
+        case AppEvent::eCallDtmfReceived: {
+            const char tone[2] = { getDtmfToneChar(static_cast<uint16_t>(ev.code)), '\0' };
+            w.field("callId", ev.id).field("tone", tone);
+            break;
+        }
+        case AppEvent::eCallHeld:
+            w.field("callId", ev.id).field("holdState", ev.code);
+            break;
+        case AppEvent::eCallSwitched:
+            w.field("callId", ev.id);
+            break;
+        case AppEvent::eCallAudioDetected:
+            w.field("callId", ev.id).field("detection", getTapDetectionStr(static_cast<TapDetection>(ev.code)))
+             .field("atMs", ev.relatedId).field("reason", ev.text1).field("action", ev.text2);
+            break;
+        default:
+            break;
+    }
+    w.endObject();
+}
+
+void ControlServer::publish(const AppEvent& ev)
+{
+    const uint32_t bit = 1u << ev.type;
+    if (!(subscribedMask_ & bit))
+        return;
+
+    eventWriter_.clear();
+    writeEventJson(ev, eventWriter_);
+    const std::string& line = eventWriter_.str();
+
+    for (auto& it : clients_)
+    {
+        Client& client = *it.second;
+        if (!(client.eventsMask & bit) || client.closing)
+            continue;
+
+        //Don't let slow subscriber to grow memory and block others
+        if (client.outBuf.size() - client.outPos > kMaxEventBacklog)
+        {
+            ++client.dropped;
+            ++droppedEvents_;
+            continue;
+        }
+
+        if (client.dropped)
+        {
+            JsonWriter notice;
+            notice.beginObject().field("event", "EventsDropped").field("count", client.dropped).endObject();
+            client.outBuf += notice.str();
+            client.outBuf += '\n';
+            client.dropped = 0;
+        }
+        client.outBuf += line;
+        client.outBuf += '\n';
+        flush(client);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+//Requests
+
+void ControlServer::handleLine(Client& client, const char* line, size_t len)
+{
+    while (len && ((line[len - 1] == '\r') || (line[len - 1] == ' ')))
+        --len;
+    if (!len)
+        return;
+
+    JsonWriter& w = respWriter_;
+    w.clear();
+
+    JsonValue req;
+    std::string err;
+    if (!JsonValue::parse(line, len, req, &err) || !req.isObject())
+    {
+        w.beginObject();
+        w.key("id").null();
+        w.field("ok", false).field("error", static_cast<int32_t>(ECtrlBadJson));
+        w.field("errorText", err.empty() ? std::string("Request has to be JSON object") : err);
+        w.endObject();
+        send(client, w.str() + "\n");
+        return;
+    }
+
+    w.beginObject();
+    const JsonValue& id = req["id"];
+    w.key("id");
+    if (id.isString())      w.value(id.str());
+    else if (id.isNumber()) w.value(id.asInt());
+    else                    w.null();
+
+    const JsonValue& batch = req["batch"];
+    if (batch.isArray())
+    {
+        uint32_t failed = 0;
+        w.key("results").beginArray();
+        for (const JsonValue& item : batch.items())
+        {
+            w.beginObject();
+            if (!execOp(client, item, w)) ++failed;
+            w.endObject();
+        }
+        w.endArray();
+        w.field("ok", true).field("count", static_cast<uint32_t>(batch.size())).field("failed", failed);
+    }
+    else
+    {
+        execOp(client, req, w);
+    }
+    w.endObject();
+
+    send(client, w.str() + "\n");
+}
+
+bool ControlServer::execOp(Client& client, const JsonValue& req, JsonWriter& w)
+{
+    std::string errText;
+    int32_t err = 0;
+    resultWriter_.clear();
+
+    const std::string& op = req["op"].str();
+    if (op.empty())
+    {
+        err = ECtrlBadRequest;
+        errText = "Field 'op' is missing";
+    }
+    else if ((op == "subscribe") || (op == "unsubscribe"))
+    {
+        err = subscribe(client, req["args"], op == "subscribe");
+        if (err) errText = "Unknown event name";
+        else     resultWriter_.beginObject().endObject();
+    }
+    else
+    {
+        resultWriter_.beginObject();
+        err = handler_.onControlOp(op, req["args"], resultWriter_, errText);
+        resultWriter_.endObject();
+    }
+
+    w.field("ok", err == 0);
+    if (err == 0)
+    {
+        w.key("result").raw(resultWriter_.str());
+    }
+    else
+    {
+        w.field("error", err);
+        if (errText.empty() && (err <= -1000))
+            errText = Sdk::GetErrorText(static_cast<Siprix::ErrorCode>(err));
+        if (!errText.empty())
+            w.field("errorText", errText);
+    }
+    return err == 0;
+}
+
+int32_t ControlServer::subscribe(Client& client, const JsonValue& args, bool enable)
+{
+    uint32_t mask = 0;
+    const JsonValue& events = args["events"];
+    if (events.isArray() && events.size())
+    {
+        for (const JsonValue& name : events.items())
+        {
+            int type = 0;
+            while ((type < AppEvent::eCount) && (name.str() != getAppEventName(static_cast<AppEvent::Type>(type))))
+                ++type;
+            if (type == AppEvent::eCount)
+                return ECtrlBadArgs;
+            mask |= 1u << type;
+        }
+    }
+    else
+    {
+        mask = (1u << AppEvent::eCount) - 1;//All events
+    }
+
+    if (enable) client.eventsMask |= mask;
+    else        client.eventsMask &= ~mask;
+
+    subscribedMask_ = 0;
+    for (auto& it : clients_)
+        subscribedMask_ |= it.second->eventsMask;
+    return 0;
+}
+
+
+#ifndef _WIN32
+////////////////////////////////////////////////////////////////////////////
+//Sockets
+
+static bool setNonBlocking(int fd)
+{
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return (flags != -1) && (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0)
+        && (fcntl(fd, F_SETFD, FD_CLOEXEC) == 0);
+}
+
+bool ControlServer::start(const std::string& spec)
+{
+    std::string path = spec;
+    const bool isTcp = (spec.compare(0, 4, "tcp:") == 0);
+    if (spec.compare(0, 5, "unix:") == 0)
+        path = spec.substr(5);
+
+    if (isTcp)
+    {
+        //tcp:<ipv4>:<port>
+        const std::string addrPort = spec.substr(4);
+        const size_t colon = addrPort.rfind(':');
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(atoi(addrPort.c_str() + colon + 1)));
+        if ((colon == std::string::npos) ||
+            (inet_pton(AF_INET, addrPort.substr(0, colon).c_str(), &addr.sin_addr) != 1))
+        {
+            std::cerr << "Invalid control address: " << spec << std::endl;
+            return false;
+        }
+
+        listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+        const int yes = 1;
+        if (listenFd_ != -1)
+            setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        if ((listenFd_ == -1) || (bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0))
+        {
+            std::cerr << "Can't bind control socket " << spec << ". errno: " << errno << std::endl;
+            stop();
+            return false;
+        }
+    }
+    else
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || (path.size() >= sizeof(addr.sun_path)))
+        {
+            std::cerr << "Invalid control socket path: " << spec << std::endl;
+            return false;
+        }
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        ::unlink(path.c_str());//Remove socket left by previous run
+        listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((listenFd_ == -1) || (bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0))
+        {
+            std::cerr << "Can't bind control socket " << path << ". errno: " << errno << std::endl;
+            stop();
+            return false;
+        }
+        unixPath_ = path;
+    }
+
+    if (!setNonBlocking(listenFd_) || (listen(listenFd_, 128) != 0) ||
+        !loop_.watchFd(listenFd_, EventLoop::eReadable, [this](uint32_t) { onAccept(); }))
+    {
+        std::cerr << "Can't listen control socket " << spec << std::endl;
+        stop();
+        return false;
+    }
+
+    std::cout << "Control socket listening on " << spec << std::endl;
+    return true;
+}
+
+void ControlServer::stop()
+{
+    while (!clients_.empty())
+        closeClient(clients_.begin()->first);
+
+    if (listenFd_ != -1)
+    {
+        loop_.unwatchFd(listenFd_);
+        ::close(listenFd_);
+        listenFd_ = -1;
+    }
+
+    if (!unixPath_.empty())
+    {
+        ::unlink(unixPath_.c_str());
+        unixPath_.clear();
+    }
+}
+
+void ControlServer::onAccept()
+{
+    while (true)
+    {
+        const int fd = accept(listenFd_, nullptr, nullptr);
+        if (fd == -1)
+            break;
+
+        if (!setNonBlocking(fd) ||
+            !loop_.watchFd(fd, EventLoop::eReadable, [this, fd](uint32_t events) { onClientEvent(fd, events); }))
+        {
+            ::close(fd);
+            continue;
+        }
+
+        std::unique_ptr<Client> client(new Client);
+        client->fd = fd;
+        clients_[fd] = std::move(client);
+    }
+}
+
+void ControlServer::onClientEvent(int fd, uint32_t events)
+{
+    auto it = clients_.find(fd);
+    if (it == clients_.end())
+        return;
+
+    Client& client = *it->second;
+    if (events & EventLoop::eWritable)
+        flush(client);
+
+    if ((events & EventLoop::eReadable) && !client.closing)
+    {
+        //Read limited amount of data, let other clients to be served too
+        char buf[kReadChunkSize];
+        for (int i = 0; i < 4; ++i)
+        {
+            const ssize_t n = ::read(fd, buf, sizeof(buf));
+            if (n > 0) {
+                client.inBuf.append(buf, static_cast<size_t>(n));
+                if (static_cast<size_t>(n) < sizeof(buf)) break;
+            }
+            else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+                break;
+            }
+            else {
+                client.closing = true;//Closed by peer
+                break;
+            }
+        }
+
+        //Handle all complete lines
+        size_t start = 0;
+        while (!client.closing)
+        {
+            const size_t eol = client.inBuf.find('\n', start);
+            if (eol == std::string::npos)
+                break;
+            handleLine(client, client.inBuf.data() + start, eol - start);
+            start = eol + 1;
+        }
+        client.inBuf.erase(0, start);
+
+        if (client.inBuf.size() > kMaxLineSize)
+            client.closing = true;
+    }
+
+    if (client.closing)
+        closeClient(fd);
+}
+
+void ControlServer::send(Client& client, const std::string& data)
+{
+    if (client.outBuf.size() - client.outPos + data.size() > kMaxOutBufSize)
+    {
+        client.closing = true;//Client doesn't read responses
+        return;
+    }
+    client.outBuf += data;
+    flush(client);
+}
+
+bool ControlServer::flush(Client& client)
+{
+    while (client.outPos < client.outBuf.size())
+    {
+        const ssize_t n = ::write(client.fd, client.outBuf.data() + client.outPos, client.outBuf.size() - client.outPos);
+        if (n > 0) {
+            client.outPos += static_cast<size_t>(n);
+        }
+        else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+            break;
+        }
+        else {
+            client.closing = true;
+            return false;
+        }
+    }
+
+    if (client.outPos == client.outBuf.size())
+    {
+        client.outBuf.clear();
+        client.outPos = 0;
+    }
+    else if (client.outPos > kMaxEventBacklog)
+    {
+        client.outBuf.erase(0, client.outPos);
+        client.outPos = 0;
+    }
+
+    //Wait for writable state only while there is unsent data
+    const bool wantWrite = !client.outBuf.empty();
+    if (wantWrite != client.wantWrite)
+    {
+        client.wantWrite = wantWrite;
+        const uint32_t events = wantWrite ? (EventLoop::eReadable | EventLoop::eWritable) : EventLoop::eReadable;
+        loop_.modifyFd(client.fd, events);
+    }
+    return true;
+}
+
+void ControlServer::closeClient(int fd)
+{
+    auto it = clients_.find(fd);
+    if (it == clients_.end())
+        return;
+
+    loop_.unwatchFd(fd);
+    ::close(fd);
+    clients_.erase(it);
+
+    subscribedMask_ = 0;
+    for (auto& c : clients_)
+        subscribedMask_ |= c.second->eventsMask;
+}
+
+#else
+
+bool ControlServer::start(const std::string& spec)
+{
+    std::cerr << "Control socket isn't supported on this platform" << std::endl;
+    return false;
+}
+
+void ControlServer::stop()
+{
+}
+
+void ControlServer::onAccept()
+{
+}
+
+void ControlServer::onClientEvent(int, uint32_t)
+{
+}
+
+void ControlServer::send(Client&, const std::string&)
+{
+}
+
+bool ControlServer::flush(Client&)
+{
+    return false;
+}
+
+void ControlServer::closeClient(int)
+{
+}
+
+#endif
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "AppEvent.h"
+#include "Json.h"
+
+class EventLoop;
+
+////////////////////////////////////////////////////////////////////////////
+//IControlHandler
+//Executes operations received by ControlServer
+
+class IControlHandler
+{
+public:
+    //Handles one operation. Writes fields of the result into already opened 'result' object.
+    //Returns 0 on success, otherwise error code (Siprix::ErrorCode or ControlServer::ECtrl*)
+    //and optionally sets 'errText'.
+    virtual int32_t onControlOp(const std::string& op, const JsonValue& args,
+                                JsonWriter& result, std::string& errText) = 0;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ControlServer
+//Unix-domain (or TCP) socket which accepts line-delimited JSON requests:
+//   {"id":1, "op":"call.invite", "args":{"accId":1, "ext":"100"}}
+//   {"id":2, "batch":[{"op":"call.invite", "args":{...}}, ...]}
+//   {"id":3, "op":"subscribe", "args":{"events":["CallConnected", ...]}}
+//Responses have the same 'id', so clients may pipeline requests.
+//All sockets are non-blocking: output of each client is buffered and
+//events are dropped (and counted) for subscribers which don't read them.
+
+class ControlServer
+{
+public:
+    enum CtrlError : int32_t {
+        ECtrlBadJson    = -1,
+        ECtrlBadRequest = -2,
+        ECtrlUnknownOp  = -3,
+        ECtrlBadArgs    = -4,
+        ECtrlShuttingDown = -5,
+        ECtrlRecordRefused = -6,//Quota of recordings or free disk space
+        ECtrlNetworkLost = -7,  //Calls aren't originated until network is restored
+    };
+
+    ControlServer(EventLoop& loop, IControlHandler& handler);
+    ~ControlServer();
+
+    //'spec' format: "unix:/path/to/socket", "tcp:127.0.0.1:5060" or just path of unix socket
+    bool start(const std::string& spec);
+    void stop();
+    bool isStarted() const { return listenFd_ != -1; }
+
+    //Sends event to subscribed clients (doesn't block)
+    void publish(const AppEvent& ev);
+
+    size_t clientsCount() const { return clients_.size(); }
+    uint64_t droppedEvents() const { return droppedEvents_; }
+
+    static void writeEventJson(const AppEvent& ev, JsonWriter& w);
+
+protected:
+    struct Client {
+        int fd = -1;
+        std::string inBuf;
+        std::string outBuf;
+        size_t outPos = 0;
+        uint32_t eventsMask = 0;//Bit per AppEvent::Type
+        uint64_t dropped = 0;
+        bool wantWrite = false;
+        bool closing = false;
+    };
+
+    void onAccept();
+    void onClientEvent(int fd, uint32_t events);
+    void handleLine(Client& client, const char* line, size_t len);
+    bool execOp(Client& client, const JsonValue& req, JsonWriter& w);
+    int32_t subscribe(Client& client, const JsonValue& args, bool enable);
+    void send(Client& client, const std::string& data);
+    bool flush(Client& client);
+    void closeClient(int fd);
+
+protected:
+    EventLoop& loop_;
+    IControlHandler& handler_;
+    int listenFd_ = -1;
+    std::string unixPath_;
+    std::unordered_map<int, std::unique_ptr<Client>> clients_;
+    uint32_t subscribedMask_ = 0;//Union of clients masks
+    uint64_t droppedEvents_ = 0;
+    JsonWriter eventWriter_;
+    JsonWriter respWriter_;
+    JsonWriter resultWriter_;
+};
@@ -0,0 +1,586 @@
+#include "Dashboard.h"
+#include "CdrWriter.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/ioctl.h>
+#include <cerrno>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+static const int kMinRows = 10;
+static const int kMinCols = 40;
+static const int kAccountWidth = 36;//Width of the account in the grid
+
+//SGR sequences of the Dashboard::Attr values
+static const char* kAttrSgr[] = { "\x1b[0m", "\x1b[0;7m", "\x1b[0;1m", "\x1b[0;32m", "\x1b[0;31m", "\x1b[0;33m", "\x1b[0;2m" };
+
+#ifdef _WIN32
+static DWORD savedConsoleMode = 0;
+#else
+static struct termios savedTermios;
+#endif
+
+////////////////////////////////////////////////////////////////////////////
+//Helpers
+
+static const char* getCallStateStr(uint8_t state)
+{
+    switch (state)
+    {
+        case 0:  return "dialing";
+        case 1:  return "ringing";
+        case 2:  return "proceeding";
+        default: return "connected";
+    }
+}
+
+static const char* getHoldStateStr(Siprix::HoldState state)
+{
+    switch (state)
+    {
+        case Siprix::HoldState::Local:          return "local";
+        case Siprix::HoldState::Remote:         return "remote";
+        case Siprix::HoldState::LocalAndRemote: return "both";
+        default:                                return "";
+    }
+}
+
+//"h:mm:ss" or "m:ss"
+static void formatDuration(char* buf, size_t size, int64_t ms)
+{
+    const int64_t sec = (ms > 0) ? ms / 1000 : 0;
+    if (sec >= 3600)
+        snprintf(buf, size, "%lld:%02d:%02d", static_cast<long long>(sec / 3600), static_cast<int>(sec / 60 % 60), static_cast<int>(sec % 60));
+    else
+        snprintf(buf, size, "%d:%02d", static_cast<int>(sec / 60), static_cast<int>(sec % 60));
+}
+
+////////////////////////////////////////////////////////////////////////////
+//Dashboard
+
+bool Dashboard::start(const DashboardParams& params, const Sources& sources, const AppStats& stats, std::string& err)
+{
+#ifdef _WIN32
+    const bool tty = _isatty(_fileno(stdout)) != 0;
+#else
+    const bool tty = isatty(STDOUT_FILENO) != 0;
+#endif
+    if (!tty)
+    {
+        err = "Dashboard requires terminal (stdout isn't a terminal)";
+        return false;
+    }
+
+    params_ = params;
+    if (params_.fps < 1)  params_.fps = 1;
+    if (params_.fps > 30) params_.fps = 30;
+    sources_ = sources;
+    stats_ = &stats;
+    started_ = ratesTime_ = Clock::now();
+    fullRedraw_ = true;
+
+#ifdef _WIN32
+    HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (GetConsoleMode(handle, &savedConsoleMode))
+        SetConsoleMode(handle, savedConsoleMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#else
+    //Keys are handled without Enter and aren't echoed
+    if (isatty(STDIN_FILENO) && (tcgetattr(STDIN_FILENO, &savedTermios) == 0))
+    {
+        struct termios raw = savedTermios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        rawInput_ = (tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0);
+    }
+#endif
+
+    std::cout.flush();
+    coutBuffer_ = std::cout.rdbuf(&nullBuffer_);
+
+    //Alternate screen, hidden cursor
+    write("\x1b[?1049h\x1b[?25l");
+
+    const uint32_t periodMs = 1000 / params_.fps;
+    frameTimer_ = loop_.addTimer(0, periodMs, [this]() { render(); });
+    return true;
+}
+
+void Dashboard::stop()
+{
+    if (!frameTimer_)
+        return;
+
+    loop_.cancelTimer(frameTimer_);
+    frameTimer_ = 0;
+    write("\x1b[0m\x1b[?25h\x1b[?1049l");
+
+    std::cout.rdbuf(coutBuffer_);
+    coutBuffer_ = nullptr;
+#ifdef _WIN32
+    SetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), savedConsoleMode);
+#else
+    if (rawInput_)
+        tcsetattr(STDIN_FILENO, TCSANOW, &savedTermios);
+#endif
+    rawInput_ = false;
+}
+
+void Dashboard::print(std::ostream& os) const
+{
+    os << "Dashboard frames:" << frames_ << " bytes:" << bytes_
+       << " avgFrameBytes:" << (frames_ ? bytes_ / frames_ : 0)
+       << " accounts:" << accounts_.size() << " calls:" << calls_.size();
+}
+
+////////////////////////////////////////////////////////////////////////////
+//Model
+
+Dashboard::AccountView& Dashboard::account(uint8_t module, Siprix::AccountId accId)
+{
+    auto it = accounts_.find(key(module, accId));
+    if (it != accounts_.end())
+        return it->second;
+
+    //Account added without URI (shown by id)
+    AccountView& acc = accounts_[key(module, accId)];
+    acc.uri = "acc " + std::to_string(accId);
+    ++regStates_[acc.state];
+    return acc;
+}
+
+Dashboard::CallView& Dashboard::call(uint8_t module, Siprix::CallId callId, Siprix::AccountId accId, Clock::time_point time)
+{
+    auto result = calls_.emplace(key(module, callId), CallView());
+    CallView& view = result.first->second;
+    if (result.second)
+    {
+        view.accId = accId;
+        view.started = time;
+        if (accId)
+            ++account(module, accId).calls;
+    }
+    return view;
+}
+
+void Dashboard::setRegState(AccountView& acc, Siprix::RegState state)
+{
+    --regStates_[acc.state];
+    acc.state = state;
+    ++regStates_[acc.state];
+}
+
+void Dashboard::onAccount(uint8_t module, Siprix::AccountId accId, const std::string& uri)
+{
+    account(module, accId).uri = uri;
+}
+
+void Dashboard::onAccountDeleted(uint8_t module, Siprix::AccountId accId)
+{
+    auto it = accounts_.find(key(module, accId));
+    if (it == accounts_.end())
+        return;
+    --regStates_[it->second.state];
+    accounts_.erase(it);
+}
+
+void Dashboard::onInvite(uint8_t module, Siprix::CallId callId, Siprix::AccountId accId, const std::string& ext, bool withVideo)
+{
+    CallView& view = call(module, callId, accId, Clock::now());
+    view.video = withVideo;
+    view.to = ext;
+}
+
+void Dashboard::onAppEvent(const AppEvent& ev)
+{
+    switch (ev.type)
+    {
+        case AppEvent::eAccountRegState:
+            setRegState(account(ev.module, ev.id), static_cast<Siprix::RegState>(ev.code));
+            break;
+
+        case AppEvent::eNetworkState:
+            network_ = ev.text1 + " " + getNetworkStateStr(static_cast<Siprix::NetworkState>(ev.code));
+            break;
+
+        case AppEvent::eCallIncoming:
+        {
+            CallView& view = call(ev.module, ev.id, ev.relatedId, ev.time);
+            view.incoming = true;
+            view.video = ev.withVideo;
+            view.state = eCallRinging;
+            view.from = parseSipUri(ev.text1);
+            view.to = parseSipUri(ev.text2);
+            break;
+        }
+        case AppEvent::eCallProceeding:
+        {
+            CallView& view = call(ev.module, ev.id, 0, ev.time);
+            if (view.state != eCallConnected)
+                view.state = eCallProceeding;
+            break;
+        }
+        case AppEvent::eCallConnected:
+        {
+            CallView& view = call(ev.module, ev.id, 0, ev.time);
+            view.state = eCallConnected;
+            view.connectedAt = ev.time;
+            view.video = ev.withVideo;
+            if (!ev.text1.empty()) view.from = parseSipUri(ev.text1);
+            if (!ev.text2.empty()) view.to = parseSipUri(ev.text2);
+            break;
+        }
+        case AppEvent::eCallHeld:
+        {
+            auto it = calls_.find(key(ev.module, ev.id));
+            if (it != calls_.end())
+                it->second.hold = static_cast<Siprix::HoldState>(ev.code);
+            break;
+        }
+        case AppEvent::eCallRedirected:
+        {
+            auto it = calls_.find(key(ev.module, ev.id));
+            const Siprix::AccountId accId = (it != calls_.end()) ? it->second.accId : 0;
+            call(ev.module, ev.relatedId, accId, ev.time).to = parseSipUri(ev.text1);
+            break;
+        }
+        case AppEvent::eCallTerminated:
+        {
+            auto it = calls_.find(key(ev.module, ev.id));
+            if (it == calls_.end())
+                break;
+            if (it->second.accId)
+            {
+                auto acc = accounts_.find(key(ev.module, it->second.accId));
+                if ((acc != accounts_.end()) && acc->second.calls)
+                    --acc->second.calls;
+            }
+            calls_.erase(it);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+//Rendering
+
+void Dashboard::render()
+{
+    int rows = 0, cols = 0;
+    if (!querySize(rows, cols))
+    {
+        rows = 24;
+        cols = 80;
+    }
+    if ((rows != rows_) || (cols != cols_))
+    {
+        rows_ = rows;
+        cols_ = cols;
+        shown_.assign(static_cast<size_t>(rows_) * cols_, Cell{ ' ', eAttrNormal });
+        fullRedraw_ = true;
+    }
+
+    const Clock::time_point now = Clock::now();
+    updateRates(now);
+
+    next_.assign(static_cast<size_t>(rows_) * cols_, Cell{ ' ', eAttrNormal });
+    if ((rows_ < kMinRows) || (cols_ < kMinCols))
+        put(0, 0, "Terminal is too small for dashboard", eAttrBad);
+    else
+        compose(now);
+
+    emit();
+    ++frames_;
+}
+
+void Dashboard::updateRates(Clock::time_point now)
+{
+    const double sec = std::chrono::duration<double>(now - ratesTime_).count();
+    if (sec < 1.0)
+        return;
+
+    Counters cur;
+    cur.events     = stats_->totalEvents();
+    cur.incoming   = stats_->events[AppEvent::eCallIncoming].load(std::memory_order_relaxed);
+    cur.originated = stats_->callsOriginated.load(std::memory_order_relaxed);
+    cur.connected  = stats_->events[AppEvent::eCallConnected].load(std::memory_order_relaxed);
+    cur.terminated = stats_->events[AppEvent::eCallTerminated].load(std::memory_order_relaxed);
+    cur.failed     = stats_->callsFailed.load(std::memory_order_relaxed);
+
+    eventRate_      = (cur.events - prevCounters_.events) / sec;
+    incomingRate_   = (cur.incoming - prevCounters_.incoming) / sec;
+    originatedRate_ = (cur.originated - prevCounters_.originated) / sec;
+    connectedRate_  = (cur.connected - prevCounters_.connected) / sec;
+    terminatedRate_ = (cur.terminated - prevCounters_.terminated) / sec;
+    failedRate_     = (cur.failed - prevCounters_.failed) / sec;
+    prevCounters_ = cur;
+    ratesTime_ = now;
+}
+
+void Dashboard::compose(Clock::time_point now)
+{
+    char line[512];
+    char uptime[32];
+    formatDuration(uptime, sizeof(uptime), std::chrono::duration_cast<std::chrono::milliseconds>(now - started_).count());
+
+    uint32_t connected = 0, held = 0, video = 0;
+    for (const auto& item : calls_)
+    {
+        if (item.second.state == eCallConnected)          ++connected;
+        if (item.second.hold != Siprix::HoldState::None)  ++held;
+        if (item.second.video)                            ++video;
+    }
+
+    //Title and summary
+    fill(0, eAttrTitle);
+    snprintf(line, sizeof(line), " SiprixUA  up %s  accounts %zu  calls %zu (connected %u, held %u, video %u)",
+             uptime, accounts_.size(), calls_.size(), connected, held, video);
+    put(0, 0, line, eAttrTitle);
+    const char* status = sources_.status ? sources_.status() : nullptr;
+    if (status)
+    {
+        const int len = static_cast<int>(strlen(status));
+        put(0, cols_ - len - 1, status, eAttrTitle);
+    }
+
+    snprintf(line, sizeof(line), "rates/s   events %.1f  incoming %.1f  originated %.1f  connected %.1f  ended %.1f  failed %.1f",
+             eventRate_, incomingRate_, originatedRate_, connectedRate_, terminatedRate_, failedRate_);
+    put(1, 0, line, eAttrNormal);
+
+    const Histogram& setup = stats_->callSetupMs;
+    const Histogram& delay = stats_->eventDelayUs;
+    snprintf(line, sizeof(line), "latency   setup ms p50 %llu p90 %llu p99 %llu  |  event delay us p50 %llu p99 %llu max %llu  |  queue %zu",
+             static_cast<unsigned long long>(setup.percentile(50)), static_cast<unsigned long long>(setup.percentile(90)),
+             static_cast<unsigned long long>(setup.percentile(99)), static_cast<unsigned long long>(delay.percentile(50)),
+             static_cast<unsigned long long>(delay.percentile(99)), static_cast<unsigned long long>(delay.max()),
+             sources_.queueDepth ? sources_.queueDepth() : static_cast<size_t>(0));
+    put(2, 0, line, eAttrNormal);
+
+    //Accounts take up to third of the screen, calls the rest
+    const int lastRow = rows_ - 2;
+    int row = 4;
+    snprintf(line, sizeof(line), "ACCOUNTS %zu   registered %u  failed %u  removed %u  in progress %u%s%s",
+             accounts_.size(), regStates_[Siprix::RegState::Success], regStates_[Siprix::RegState::Failed],
+             regStates_[Siprix::RegState::Removed], regStates_[Siprix::RegState::InProgress],
+             network_.empty() ? "" : "   network ", network_.c_str());
+    put(row++, 0, line, eAttrHeader);
+    row = composeAccounts(row, row + (rows_ - 8) / 3);
+    composeCalls(row + 1, lastRow, now);
+
+    snprintf(line, sizeof(line), " q - quit  r - redraw   %u fps, last frame %llu bytes", params_.fps,
+             static_cast<unsigned long long>(lastFrameBytes_));
+    put(rows_ - 1, 0, line, eAttrDim);
+}
+
+//Grid of accounts, returns the next free row
+int Dashboard::composeAccounts(int row, int lastRow)
+{
+    char line[128];
+    const int perRow = (cols_ / kAccountWidth > 0) ? cols_ / kAccountWidth : 1;
+    const size_t capacity = static_cast<size_t>(lastRow - row) * perRow;
+    size_t index = 0;
+    for (const auto& item : accounts_)
+    {
+        const int r = row + static_cast<int>(index / perRow);
+        const int c = static_cast<int>(index % perRow) * kAccountWidth;
+        if ((index + 1 == capacity) && (accounts_.size() > capacity))
+        {
+            snprintf(line, sizeof(line), "+%zu more", accounts_.size() - index);
+            put(r, c, line, eAttrDim);
+            ++index;
+            break;
+        }
+
+        const AccountView& acc = item.second;
+        uint8_t attr = eAttrWarn;
+        const char* state = "....";
+        switch (acc.state)
+        {
+            case Siprix::RegState::Success: attr = eAttrGood; state = "REG"; break;
+            case Siprix::RegState::Failed:  attr = eAttrBad;  state = "FAIL"; break;
+            case Siprix::RegState::Removed: attr = eAttrDim;  state = "UNREG"; break;
+            default: break;
+        }
+        put(r, c, acc.uri.c_str(), eAttrNormal, kAccountWidth - 12);
+        put(r, c + kAccountWidth - 11, state, attr, 5);
+        if (acc.calls)
+        {
+            snprintf(line, sizeof(line), "%4u", acc.calls);
+            put(r, c + kAccountWidth - 6, line, eAttrNormal, 4);
+        }
+        ++index;
+    }
+    return row + static_cast<int>((index + perRow - 1) / perRow);
+}
+
+void Dashboard::composeCalls(int row, int lastRow, Clock::time_point now)
+{
+    char line[512];
+    char duration[32];
+    snprintf(line, sizeof(line), "CALLS %zu", calls_.size());
+    put(row++, 0, line, eAttrHeader);
+    snprintf(line, sizeof(line), "%3s %8s %-3s %-10s %8s %-6s %-5s %-24s %-24s %s",
+             "mod", "callId", "dir", "state", "time", "hold", "video", "account", "from", "to");
+    put(row++, 0, line, eAttrDim);
+
+    size_t index = 0;
+    for (const auto& item : calls_)
+    {
+        if (row >= lastRow)
+        {
+            snprintf(line, sizeof(line), "+%zu more", calls_.size() - index);
+            put(lastRow, 0, line, eAttrDim);
+            break;
+        }
+
+        const CallView& view = item.second;
+        const Clock::time_point since = (view.state == eCallConnected) ? view.connectedAt : view.started;
+        formatDuration(duration, sizeof(duration), std::chrono::duration_cast<std::chrono::milliseconds>(now - since).count());
+
+        const uint8_t module = static_cast<uint8_t>(item.first >> 32);
+        const auto acc = view.accId ? accounts_.find(key(module, view.accId)) : accounts_.end();
+        snprintf(line, sizeof(line), "%3u %8u %-3s ", module, static_cast<uint32_t>(item.first),
+                 view.incoming ? "in" : "out");
+        put(row, 0, line, eAttrNormal);
+        put(row, 17, getCallStateStr(view.state), (view.state == eCallConnected) ? eAttrGood : eAttrWarn, 10);
+        snprintf(line, sizeof(line), "%8s", duration);
+        put(row, 28, line, eAttrNormal);
+        put(row, 37, getHoldStateStr(view.hold), eAttrWarn, 6);
+        put(row, 44, view.video ? "video" : "", eAttrNormal, 5);
+        put(row, 50, (acc != accounts_.end()) ? acc->second.uri.c_str() : "", eAttrNormal, 24);
+        put(row, 75, view.from.c_str(), eAttrNormal, 24);
+        put(row, 100, view.to.c_str(), eAttrNormal);
+        ++row;
+        ++index;
+    }
+}
+
+//Text clipped by 'width' (-1 - till end of the row), non-printable chars replaced
+void Dashboard::put(int row, int col, const char* text, uint8_t attr, int width)
+{
+    if ((row < 0) || (row >= rows_) || (col < 0))
+        return;
+    int end = (width < 0) ? cols_ : col + width;
+    if (end > cols_) end = cols_;
+    Cell* cells = &next_[static_cast<size_t>(row) * cols_];
+    for (int c = col; (c < end) && *text; ++c, ++text)
+    {
+        const unsigned char ch = static_cast<unsigned char>(*text);
+        cells[c].ch = ((ch >= 0x20) && (ch < 0x7f)) ? static_cast<char>(ch) : '?';
+        cells[c].attr = attr;
+    }
+}
+
+void Dashboard::fill(int row, uint8_t attr)
+{
+    Cell* cells = &next_[static_cast<size_t>(row) * cols_];
+    for (int c = 0; c < cols_; ++c)
+        cells[c].attr = attr;
+}
+
+//Writes difference between 'next_' and 'shown_'. Short runs of unchanged cells between changed
+//ones are written again (cheaper than cursor move).
+void Dashboard::emit()
+{
+    out_.clear();
+    if (fullRedraw_)
+    {
+        out_ += "\x1b[0m\x1b[2J";
+        for (Cell& cell : shown_)
+            cell = Cell{ ' ', eAttrNormal };
+        fullRedraw_ = false;
+    }
+
+    char move[32];
+    uint8_t attr = eAttrs;//Unknown, set by the first written cell
+    for (int row = 0; row < rows_; ++row)
+    {
+        const Cell* next = &next_[static_cast<size_t>(row) * cols_];
+        const Cell* shown = &shown_[static_cast<size_t>(row) * cols_];
+        //Last cell of the screen isn't used: terminal would scroll
+        const int cols = (row + 1 == rows_) ? cols_ - 1 : cols_;
+        int cursor = -1;//Column of the cursor in this row (-1 - elsewhere)
+        for (int col = 0; col < cols; ++col)
+        {
+            if (next[col] == shown[col])
+                continue;
+
+            if ((cursor >= 0) && (col > cursor) && (col - cursor <= 4))
+            {
+                for (; cursor < col; ++cursor)
+                {
+                    if (next[cursor].attr != attr)
+                    {
+                        attr = next[cursor].attr;
+                        out_ += kAttrSgr[attr];
+                    }
+                    out_ += next[cursor].ch;
+                }
+            }
+            else if (cursor != col)
+            {
+                snprintf(move, sizeof(move), "\x1b[%d;%dH", row + 1, col + 1);
+                out_ += move;
+            }
+            if (next[col].attr != attr)
+            {
+                attr = next[col].attr;
+                out_ += kAttrSgr[attr];
+            }
+            out_ += next[col].ch;
+            cursor = col + 1;
+        }
+    }
+    shown_.swap(next_);
+
+    lastFrameBytes_ = out_.size();
+    if (!out_.empty())
+        write(out_);
+}
+
+bool Dashboard::querySize(int& rows, int& cols) const
+{
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info))
+        return false;
+    rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+    cols = info.srWindow.Right - info.srWindow.Left + 1;
+#else
+    struct winsize size;
+    if ((ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0) || !size.ws_row || !size.ws_col)
+        return false;
+    rows = size.ws_row;
+    cols = size.ws_col;
+#endif
+    return true;
+}
+
+void Dashboard::write(const std::string& data)
+{
+    bytes_ += data.size();
+#ifdef _WIN32
+    fwrite(data.data(), 1, data.size(), stdout);
+    fflush(stdout);
+#else
+    size_t written = 0;
+    while (written < data.size())
+    {
+        const ssize_t n = ::write(STDOUT_FILENO, data.data() + written, data.size() - written);
+        if (n > 0)
+            written += static_cast<size_t>(n);
+        else if ((n < 0) && (errno != EINTR) && (errno != EAGAIN))
+            break;
+    }
+#endif
+}
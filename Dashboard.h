@@ -0,0 +1,164 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "AppEvent.h"
+#include "EventLoop.h"
+#include "NodeAllocator.h"
+#include "Stats.h"
+
+////////////////////////////////////////////////////////////////////////////
+//DashboardParams
+
+struct DashboardParams
+{
+    bool enabled = false;
+    uint32_t fps = 4;              //Frames per second (1..30)
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//Dashboard
+//Full screen live view of accounts, calls, rates and latencies (plain ANSI escapes).
+//Events only update the model (accounts and calls) on the loop thread; timer renders it
+//with fixed frame rate: frame is composed into the grid of cells, compared with the previous
+//one and only changed cells are written (cursor moves and chars, by one write). So output
+//depends on frame rate and screen size, not on the number of events. While dashboard is
+//shown events aren't logged and std::cout is discarded (it would scroll the screen).
+
+class Dashboard
+{
+public:
+    struct Sources {
+        std::function<size_t()> queueDepth;     //Tasks waiting in the loop
+        std::function<const char*()> status;    //Shown in the title (nullptr - nothing to show)
+    };
+
+    Dashboard(EventLoop& loop) : loop_(loop) {}
+    ~Dashboard() { stop(); }
+
+    //Switches terminal to alternate screen and starts frames
+    bool start(const DashboardParams& params, const Sources& sources, const AppStats& stats, std::string& err);
+    //Restores terminal and std::cout
+    void stop();
+    bool isEnabled() const { return frameTimer_ != 0; }
+    void redraw() { fullRedraw_ = true; }
+
+    void onAccount(uint8_t module, Siprix::AccountId accId, const std::string& uri);
+    void onAccountDeleted(uint8_t module, Siprix::AccountId accId);
+    void onInvite(uint8_t module, Siprix::CallId callId, Siprix::AccountId accId, const std::string& ext, bool withVideo);
+    void onAppEvent(const AppEvent& ev);
+
+    uint64_t frames() const { return frames_; }
+    uint64_t bytes()  const { return bytes_; }//Written to terminal
+    void print(std::ostream& os) const;
+
+protected:
+    typedef std::chrono::steady_clock Clock;
+
+    enum CallState : uint8_t { eCallDialing, eCallRinging, eCallProceeding, eCallConnected };
+    enum Attr : uint8_t { eAttrNormal, eAttrTitle, eAttrHeader, eAttrGood, eAttrBad, eAttrWarn, eAttrDim, eAttrs };
+
+    struct AccountView {
+        std::string uri;
+        Siprix::RegState state = Siprix::RegState::InProgress;
+        uint32_t calls = 0;
+    };
+
+    struct CallView {
+        Siprix::AccountId accId = 0;
+        bool incoming = false;
+        bool video = false;
+        CallState state = eCallDialing;
+        Siprix::HoldState hold = Siprix::HoldState::None;
+        std::string from;
+        std::string to;
+        Clock::time_point started;
+        Clock::time_point connectedAt;
+    };
+
+    struct Cell {
+        char ch;
+        uint8_t attr;
+        bool operator==(const Cell& other) const { return (ch == other.ch) && (attr == other.attr); }
+        bool operator!=(const Cell& other) const { return !(*this == other); }
+    };
+
+    //Discards output of std::cout while screen is shown
+    struct NullBuffer : std::streambuf {
+        int overflow(int ch) override { return ch; }
+    };
+
+    static uint64_t key(uint8_t module, uint32_t id) { return (static_cast<uint64_t>(module) << 32) | id; }
+
+    AccountView& account(uint8_t module, Siprix::AccountId accId);
+    CallView& call(uint8_t module, Siprix::CallId callId, Siprix::AccountId accId, Clock::time_point time);
+    void setRegState(AccountView& acc, Siprix::RegState state);
+
+    void render();
+    void updateRates(Clock::time_point now);
+    void compose(Clock::time_point now);
+    int  composeAccounts(int row, int lastRow);
+    void composeCalls(int row, int lastRow, Clock::time_point now);
+    void put(int row, int col, const char* text, uint8_t attr, int width = -1);
+    void fill(int row, uint8_t attr);
+    void emit();
+    bool querySize(int& rows, int& cols) const;
+    void write(const std::string& data);
+
+    EventLoop& loop_;
+    DashboardParams params_;
+    Sources sources_;
+    const AppStats* stats_ = nullptr;
+    EventLoop::TimerId frameTimer_ = 0;
+    Clock::time_point started_;
+
+    //Model
+    std::map<uint64_t, AccountView> accounts_;
+    std::map<uint64_t, CallView, std::less<uint64_t>,
+             NodeAllocator<std::pair<const uint64_t, CallView>>> calls_;//Ordered by module and id (oldest first), nodes are reused
+    uint32_t regStates_[4] = {};//Accounts by RegState
+    std::string network_;//Name and state of the last network change
+
+    //Rates (per second, updated once per second)
+    struct Counters {
+        uint64_t events = 0;
+        uint64_t incoming = 0;
+        uint64_t originated = 0;
+        uint64_t connected = 0;
+        uint64_t terminated = 0;
+        uint64_t failed = 0;
+    };
+    Counters prevCounters_;
+    Clock::time_point ratesTime_;
+    double eventRate_ = 0, incomingRate_ = 0, originatedRate_ = 0;
+    double connectedRate_ = 0, terminatedRate_ = 0, failedRate_ = 0;
+
+    //Screen: frame being composed and the one shown by terminal
+    int rows_ = 0;
+    int cols_ = 0;
+    std::vector<Cell> next_;
+    std::vector<Cell> shown_;
+    bool fullRedraw_ = true;
+    std::string out_;
+    uint64_t frames_ = 0;
+    uint64_t bytes_ = 0;
+    uint64_t lastFrameBytes_ = 0;
+
+    NullBuffer nullBuffer_;
+    std::streambuf* coutBuffer_ = nullptr;
+    bool rawInput_ = false;
+};
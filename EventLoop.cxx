@@ -0,0 +1,463 @@
+#include "EventLoop.h"
+
+#include <signal.h>
+#include <algorithm>
+#include <iostream>
+
+#ifdef EVENTLOOP_EPOLL
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <cerrno>
+#endif
+
+//Max number of tasks executed in one iteration (let other sources to be handled too)
+static const size_t kMaxTasksPerBatch = 1024;
+
+EventLoop::EventLoop() : stopped_(false)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////
+//Timers (common for all platforms)
+
+EventLoop::TimerId EventLoop::addTimer(uint32_t delayMs, uint32_t periodMs, Task task)
+{
+    const TimerId id = nextTimerId_++;
+    Timer& timer = timers_[id];
+    timer.deadline = Clock::now() + std::chrono::milliseconds(delayMs);
+    timer.periodMs = periodMs;
+    timer.task = std::move(task);
+    timer.pos = deadlines_.emplace(timer.deadline, id);
+#ifdef EVENTLOOP_EPOLL
+    armTimerFd();
+#endif
+    return id;
+}
+
+void EventLoop::cancelTimer(TimerId id)
+{
+    auto it = timers_.find(id);
+    if (it == timers_.end())
+        return;
+
+    deadlines_.erase(it->second.pos);
+    timers_.erase(it);
+#ifdef EVENTLOOP_EPOLL
+    armTimerFd();
+#endif
+}
+
+void EventLoop::runTimers()
+{
+    const Clock::time_point now = Clock::now();
+    while (!deadlines_.empty() && (deadlines_.begin()->first <= now) && !stopped_)
+    {
+        const TimerId id = deadlines_.begin()->second;
+        deadlines_.erase(deadlines_.begin());
+
+        auto it = timers_.find(id);
+        if (it == timers_.end())
+            continue;
+
+        Timer& timer = it->second;
+        if (timer.periodMs)
+        {
+            //Reschedule before run, task is allowed to cancel own timer
+            timer.deadline += std::chrono::milliseconds(timer.periodMs);
+            if (timer.deadline <= now)
+                timer.deadline = now + std::chrono::milliseconds(timer.periodMs);
+            timer.pos = deadlines_.emplace(timer.deadline, id);
+
+            Task task = timer.task;
+            task();
+        }
+        else
+        {
+            Task task = std::move(timer.task);
+            timers_.erase(it);
+            task();
+        }
+    }
+#ifdef EVENTLOOP_EPOLL
+    armTimerFd();
+#endif
+}
+
+int EventLoop::msToNextTimer() const
+{
+    if (deadlines_.empty())
+        return -1;
+
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        deadlines_.begin()->first - Clock::now()).count();
+    return (left < 0) ? 0 : static_cast<int>(left);
+}
+
+////////////////////////////////////////////////////////////////////////////
+//Tasks (common for all platforms)
+
+void EventLoop::TaskQueue::push(Task&& task)
+{
+    if (count_ == items_.size())
+    {
+        std::vector<Task> items(std::max<size_t>(64, items_.size() * 2));
+        for (size_t i = 0; i < count_; ++i)
+            items[i] = std::move(items_[(head_ + i) % items_.size()]);
+        items_.swap(items);
+        head_ = 0;
+    }
+    items_[(head_ + count_) % items_.size()] = std::move(task);
+    ++count_;
+}
+
+EventLoop::Task EventLoop::TaskQueue::pop()
+{
+    Task task = std::move(items_[head_]);
+    items_[head_] = nullptr;
+    head_ = (head_ + 1) % items_.size();
+    --count_;
+    return task;
+}
+
+size_t EventLoop::pendingTasks() const
+{
+    std::lock_guard<std::mutex> lock(tasksMtx_);
+    return tasks_.size();
+}
+
+void EventLoop::runTasks()
+{
+    for (size_t i = 0; (i < kMaxTasksPerBatch) && !stopped_; ++i)
+    {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(tasksMtx_);
+            if (tasks_.empty())
+                return;
+            task = tasks_.pop();
+        }
+        task();
+    }
+
+#ifdef EVENTLOOP_EPOLL
+    //Batch limit reached - wake up next iteration to continue
+    if (pendingTasks() > 0)
+    {
+        const uint64_t one = 1;
+        if (::write(wakeFd_, &one, sizeof(one))) {}
+    }
+#endif
+}
+
+void EventLoop::handleSignal(int signo)
+{
+    if (signalHandler_)
+        signalHandler_(signo);
+}
+
+void EventLoop::run()
+{
+    while (runOnce(-1)) {}
+}
+
+
+#ifdef EVENTLOOP_EPOLL
+////////////////////////////////////////////////////////////////////////////
+//Linux: epoll + eventfd + timerfd + signalfd
+
+static sigset_t getInterceptedSignals()
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    return mask;
+}
+
+bool EventLoop::interceptSignals()
+{
+    const sigset_t mask = getInterceptedSignals();
+    return pthread_sigmask(SIG_BLOCK, &mask, nullptr) == 0;
+}
+
+EventLoop::~EventLoop()
+{
+    for (int fd : { signalFd_, timerFd_, wakeFd_, epollFd_ })
+        if (fd != -1) ::close(fd);
+}
+
+bool EventLoop::open()
+{
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    signalMask_ = getInterceptedSignals();
+    signalFd_ = signalfd(-1, &signalMask_, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    if ((epollFd_ == -1) || (wakeFd_ == -1) || (timerFd_ == -1) || (signalFd_ == -1))
+    {
+        std::cerr << "Can't create event loop descriptors. errno: " << errno << std::endl;
+        return false;
+    }
+
+    for (int fd : { wakeFd_, timerFd_, signalFd_ })
+    {
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) != 0)
+            return false;
+    }
+    return true;
+}
+
+bool EventLoop::addSignal(int signo)
+{
+    sigaddset(&signalMask_, signo);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signo);
+    return (pthread_sigmask(SIG_BLOCK, &mask, nullptr) == 0)
+        && (signalfd(signalFd_, &signalMask_, 0) != -1);
+}
+
+void EventLoop::post(Task task)
+{
+    bool wasEmpty = false;
+    {
+        std::lock_guard<std::mutex> lock(tasksMtx_);
+        wasEmpty = tasks_.empty();
+        tasks_.push(std::move(task));
+    }
+
+    if (wasEmpty)
+    {
+        const uint64_t one = 1;
+        if (::write(wakeFd_, &one, sizeof(one))) {}
+    }
+}
+
+void EventLoop::stop()
+{
+    stopped_ = true;
+    const uint64_t one = 1;
+    if (::write(wakeFd_, &one, sizeof(one))) {}
+}
+
+static uint32_t toEpollEvents(uint32_t events)
+{
+    uint32_t result = 0;
+    if (events & EventLoop::eReadable) result |= EPOLLIN;
+    if (events & EventLoop::eWritable) result |= EPOLLOUT;
+    return result;
+}
+
+bool EventLoop::watchFd(int fd, uint32_t events, FdHandler handler)
+{
+    epoll_event ev = {};
+    ev.events = toEpollEvents(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) != 0)
+        return false;
+
+    fds_[fd] = std::move(handler);
+    return true;
+}
+
+bool EventLoop::modifyFd(int fd, uint32_t events)
+{
+    epoll_event ev = {};
+    ev.events = toEpollEvents(events);
+    ev.data.fd = fd;
+    return epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::unwatchFd(int fd)
+{
+    if (fds_.erase(fd))
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EventLoop::armTimerFd()
+{
+    itimerspec spec = {};
+    if (!deadlines_.empty())
+    {
+        const Clock::time_point deadline = deadlines_.begin()->first;
+        if (deadline == armedDeadline_)
+            return;
+
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            deadline.time_since_epoch()).count();
+        spec.it_value.tv_sec  = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+        if ((spec.it_value.tv_sec == 0) && (spec.it_value.tv_nsec == 0))
+            spec.it_value.tv_nsec = 1;
+        armedDeadline_ = deadline;
+    }
+    else
+    {
+        armedDeadline_ = Clock::time_point();
+    }
+    timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void EventLoop::handleFd(int fd, uint32_t epollEvents)
+{
+    auto it = fds_.find(fd);
+    if (it == fds_.end())
+        return;//Unwatched by handler of previous event
+
+    uint32_t events = 0;
+    if (epollEvents & EPOLLIN)  events |= eReadable;
+    if (epollEvents & EPOLLOUT) events |= eWritable;
+    if (epollEvents & (EPOLLHUP | EPOLLERR)) events |= eHangup | eReadable;
+
+    FdHandler handler = it->second;
+    handler(events);
+}
+
+bool EventLoop::runOnce(int timeoutMs)
+{
+    if (stopped_)
+        return false;
+
+    epoll_event events[32];
+    const int n = epoll_wait(epollFd_, events, 32, timeoutMs);
+    if ((n < 0) && (errno != EINTR))
+    {
+        std::cerr << "epoll_wait failed. errno: " << errno << std::endl;
+        stopped_ = true;
+    }
+
+    for (int i = 0; (i < n) && !stopped_; ++i)
+    {
+        const int fd = events[i].data.fd;
+        if (fd == wakeFd_)
+        {
+            uint64_t value = 0;
+            if (::read(wakeFd_, &value, sizeof(value))) {}
+            runTasks();
+        }
+        else if (fd == timerFd_)
+        {
+            uint64_t expirations = 0;
+            if (::read(timerFd_, &expirations, sizeof(expirations))) {}
+            armedDeadline_ = Clock::time_point();
+            runTimers();
+        }
+        else if (fd == signalFd_)
+        {
+            signalfd_siginfo info;
+            while (::read(signalFd_, &info, sizeof(info)) == sizeof(info))
+                handleSignal(static_cast<int>(info.ssi_signo));
+        }
+        else
+        {
+            handleFd(fd, events[i].events);
+        }
+    }
+    return !stopped_;
+}
+
+#else
+////////////////////////////////////////////////////////////////////////////
+//Other platforms: condition variable with timed wait
+
+static std::atomic<int> g_pendingSignal(0);
+
+static void interceptedSignalHandler(int signo)
+{
+    g_pendingSignal = signo;
+}
+
+bool EventLoop::interceptSignals()
+{
+    bool result = (signal(SIGINT,  interceptedSignalHandler) != SIG_ERR)
+               && (signal(SIGTERM, interceptedSignalHandler) != SIG_ERR);
+#ifdef SIGUSR1
+    result = result && (signal(SIGUSR1, interceptedSignalHandler) != SIG_ERR);
+#endif
+    return result;
+}
+
+EventLoop::~EventLoop()
+{
+}
+
+bool EventLoop::open()
+{
+    return true;
+}
+
+void EventLoop::post(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(tasksMtx_);
+        tasks_.push(std::move(task));
+    }
+    cond_.notify_one();
+}
+
+void EventLoop::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(tasksMtx_);
+        stopped_ = true;
+    }
+    cond_.notify_one();
+}
+
+bool EventLoop::addSignal(int signo)
+{
+    return signal(signo, interceptedSignalHandler) != SIG_ERR;
+}
+
+bool EventLoop::watchFd(int, uint32_t, FdHandler)
+{
+    return false;
+}
+
+bool EventLoop::modifyFd(int, uint32_t)
+{
+    return false;
+}
+
+void EventLoop::unwatchFd(int)
+{
+}
+
+bool EventLoop::runOnce(int timeoutMs)
+{
+    if (stopped_)
+        return false;
+
+    //Signals are checked by polling, so wait not longer than 100ms
+    int waitMs = 100;
+    const int timerMs = msToNextTimer();
+    if ((timerMs >= 0) && (timerMs < waitMs)) waitMs = timerMs;
+    if ((timeoutMs >= 0) && (timeoutMs < waitMs)) waitMs = timeoutMs;
+
+    {
+        std::unique_lock<std::mutex> lock(tasksMtx_);
+        cond_.wait_for(lock, std::chrono::milliseconds(waitMs),
+            [this]() { return !tasks_.empty() || stopped_ || g_pendingSignal; });
+    }
+
+    const int signo = g_pendingSignal.exchange(0);
+    if (signo)
+        handleSignal(signo);
+
+    runTimers();
+    runTasks();
+    return !stopped_;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "NodeAllocator.h"
+
+#if defined(__linux__) && !defined(EVENTLOOP_PORTABLE)
+#define EVENTLOOP_EPOLL 1
+#include <signal.h>
+#else
+#include <condition_variable>
+#endif
+
+////////////////////////////////////////////////////////////////////////////
+//EventLoop
+//Single threaded loop which multiplexes posted tasks, timers, signals and
+//(on Linux) file descriptors.
+//On Linux it's built on epoll + eventfd + timerfd + signalfd, on other
+//platforms falls back to condition variable with timed wait.
+//All methods except 'post', 'stop' and 'pendingTasks' must be called
+//from the thread which runs the loop.
+
+class EventLoop
+{
+public:
+    typedef std::function<void()> Task;
+    typedef std::function<void(uint32_t events)> FdHandler;
+    typedef std::function<void(int signo)> SignalHandler;
+    typedef uint32_t TimerId;
+    typedef std::chrono::steady_clock Clock;
+
+    enum FdEvents : uint32_t { eReadable = 1, eWritable = 2, eHangup = 4 };
+
+    EventLoop();
+    ~EventLoop();
+
+    //Block (Linux) or intercept (other platforms) SIGINT/SIGTERM/SIGUSR1.
+    //Has to be called before any thread is created, so SDK threads inherit the mask.
+    static bool interceptSignals();
+
+    bool open();
+
+    //Thread safe
+    void post(Task task);
+    void stop();
+    bool isStopped() const { return stopped_; }
+    size_t pendingTasks() const;
+
+    //Timers (delayMs - first shot, periodMs - 0 for one-shot timer)
+    TimerId addTimer(uint32_t delayMs, uint32_t periodMs, Task task);
+    void cancelTimer(TimerId id);
+    size_t timersCount() const { return timers_.size(); }
+
+    //Descriptors (returns false when platform doesn't support it)
+    bool watchFd(int fd, uint32_t events, FdHandler handler);
+    bool modifyFd(int fd, uint32_t events);
+    void unwatchFd(int fd);
+
+    void setSignalHandler(SignalHandler handler) { signalHandler_ = handler; }
+
+    //Deliver one more signal (for example SIGCHLD) to the signal handler
+    bool addSignal(int signo);
+
+    //Run until 'stop' called
+    void run();
+
+    //Wait for and handle one batch of events. Returns false when loop stopped.
+    //May be called recursively (from task or handler), which allows to wait
+    //for user input without blocking events processing.
+    bool runOnce(int timeoutMs);
+
+protected:
+    //Ring buffer of posted tasks. Grows by doubling and keeps capacity, so steady flow of
+    //tasks doesn't allocate memory (std::deque allocates and frees blocks as it moves).
+    class TaskQueue {
+    public:
+        bool empty() const { return count_ == 0; }
+        size_t size() const { return count_; }
+        void push(Task&& task);
+        Task pop();
+
+    protected:
+        std::vector<Task> items_;
+        size_t head_ = 0;
+        size_t count_ = 0;
+    };
+
+    typedef std::multimap<Clock::time_point, TimerId, std::less<Clock::time_point>,
+                          NodeAllocator<std::pair<const Clock::time_point, TimerId>>> Deadlines;
+
+    struct Timer {
+        Clock::time_point deadline;
+        uint32_t periodMs;
+        Task task;
+        Deadlines::iterator pos;
+    };
+
+    void runTasks();
+    void runTimers();
+    int  msToNextTimer() const;
+    void handleSignal(int signo);
+
+#ifdef EVENTLOOP_EPOLL
+    void armTimerFd();
+    void handleFd(int fd, uint32_t epollEvents);
+
+    int epollFd_ = -1;
+    int wakeFd_  = -1;
+    int timerFd_ = -1;
+    int signalFd_= -1;
+    sigset_t signalMask_;
+    Clock::time_point armedDeadline_;
+    std::unordered_map<int, FdHandler> fds_;
+#else
+    std::condition_variable cond_;
+#endif
+
+    mutable std::mutex tasksMtx_;
+    TaskQueue tasks_;
+    std::atomic<bool> stopped_;
+
+    TimerId nextTimerId_ = 1;
+    //Nodes are reused, so timers of calls don't allocate
+    std::unordered_map<TimerId, Timer, std::hash<TimerId>, std::equal_to<TimerId>,
+                       NodeAllocator<std::pair<const TimerId, Timer>>> timers_;
+    Deadlines deadlines_;
+
+    SignalHandler signalHandler_;
+};
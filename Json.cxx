@@ -0,0 +1,476 @@
+#include "Json.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const JsonValue kNullValue;
+
+////////////////////////////////////////////////////////////////////////////
+//JsonValue
+
+bool JsonValue::asBool(bool def) const
+{
+    if (type_ == eBool)   return bool_;
+    if (type_ == eNumber) return num_ != 0;
+    return def;
+}
+
+double JsonValue::asNumber(double def) const
+{
+    if (type_ == eNumber) return num_;
+    if (type_ == eString) return atof(str_.c_str());
+    return def;
+}
+
+int64_t JsonValue::asInt(int64_t def) const
+{
+    if (type_ == eNumber) return static_cast<int64_t>(num_);
+    if (type_ == eString) return strtoll(str_.c_str(), nullptr, 10);
+    if (type_ == eBool)   return bool_ ? 1 : 0;
+    return def;
+}
+
+std::string JsonValue::asString(const std::string& def) const
+{
+    if (type_ == eString) return str_;
+    if (type_ == eNumber)
+    {
+        char buf[32];
+        if (num_ == static_cast<double>(static_cast<int64_t>(num_)))
+            snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(num_));
+        else
+            snprintf(buf, sizeof(buf), "%g", num_);
+        return buf;
+    }
+    if (type_ == eBool) return bool_ ? "true" : "false";
+    return def;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+    return ((type_ == eArray) && (index < items_.size())) ? items_[index] : kNullValue;
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+    if (type_ == eObject)
+    {
+        for (const auto& m : members_)
+            if (m.first == key) return m.second;
+    }
+    return kNullValue;
+}
+
+bool JsonValue::has(const char* key) const
+{
+    return !(*this)[key].isNull();
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//JsonParser
+
+class JsonParser
+{
+public:
+    JsonParser(const char* data, size_t size) : cur_(data), end_(data + size) {}
+
+    bool parseDocument(JsonValue& out)
+    {
+        if (!parseValue(out, 0))
+            return false;
+        skipSpaces();
+        return (cur_ == end_) || fail("Unexpected data after value");
+    }
+
+    std::string err_;
+
+protected:
+    enum { kMaxDepth = 64 };
+
+    bool fail(const char* msg)
+    {
+        if (err_.empty()) err_ = msg;
+        return false;
+    }
+
+    void skipSpaces()
+    {
+        while ((cur_ < end_) && ((*cur_ == ' ') || (*cur_ == '\t') || (*cur_ == '\r') || (*cur_ == '\n')))
+            ++cur_;
+    }
+
+    bool consume(const char* word)
+    {
+        const size_t len = strlen(word);
+        if ((static_cast<size_t>(end_ - cur_) < len) || (memcmp(cur_, word, len) != 0))
+            return fail("Unexpected token");
+        cur_ += len;
+        return true;
+    }
+
+    bool parseValue(JsonValue& out, int depth)
+    {
+        if (depth > kMaxDepth)
+            return fail("Too deep nesting");
+
+        skipSpaces();
+        if (cur_ >= end_)
+            return fail("Unexpected end of data");
+
+        switch (*cur_)
+        {
+            case '{': return parseObject(out, depth);
+            case '[': return parseArray(out, depth);
+            case '"': out.type_ = JsonValue::eString; return parseString(out.str_);
+            case 't': out.type_ = JsonValue::eBool; out.bool_ = true;  return consume("true");
+            case 'f': out.type_ = JsonValue::eBool; out.bool_ = false; return consume("false");
+            case 'n': out.type_ = JsonValue::eNull; return consume("null");
+            default:  return parseNumber(out);
+        }
+    }
+
+    bool parseNumber(JsonValue& out)
+    {
+        const char* start = cur_;
+        while ((cur_ < end_) && (strchr("+-0123456789.eE", *cur_) != nullptr))
+            ++cur_;
+
+        const size_t len = static_cast<size_t>(cur_ - start);
+        if ((len == 0) || (len > 63))
+            return fail("Invalid number");
+
+        char buf[64];
+        memcpy(buf, start, len);
+        buf[len] = '\0';
+
+        char* numEnd = nullptr;
+        out.type_ = JsonValue::eNumber;
+        out.num_ = strtod(buf, &numEnd);
+        return (numEnd == buf + len) || fail("Invalid number");
+    }
+
+    static void appendUtf8(uint32_t cp, std::string& out)
+    {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool parseHex4(uint32_t& cp)
+    {
+        if (end_ - cur_ < 4)
+            return fail("Invalid escape");
+        cp = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            const char ch = *cur_++;
+            cp <<= 4;
+            if ((ch >= '0') && (ch <= '9'))      cp |= ch - '0';
+            else if ((ch >= 'a') && (ch <= 'f')) cp |= ch - 'a' + 10;
+            else if ((ch >= 'A') && (ch <= 'F')) cp |= ch - 'A' + 10;
+            else return fail("Invalid escape");
+        }
+        return true;
+    }
+
+    bool parseString(std::string& out)
+    {
+        ++cur_;//skip quote
+        out.clear();
+        while (cur_ < end_)
+        {
+            //Copy run of plain chars at once
+            const char* run = cur_;
+            while ((cur_ < end_) && (*cur_ != '"') && (*cur_ != '\\'))
+                ++cur_;
+            out.append(run, cur_ - run);
+
+            if (cur_ >= end_)
+                break;
+
+            if (*cur_ == '"')
+            {
+                ++cur_;
+                return true;
+            }
+
+            //Escape sequence
+            if (++cur_ >= end_)
+                break;
+            const char ch = *cur_++;
+            switch (ch)
+            {
+                case '"':  out += '"';  break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/';  break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u': {
+                    uint32_t cp = 0;
+                    if (!parseHex4(cp))
+                        return false;
+                    //Surrogates are valid only as pair: high (D800-DBFF) followed by low (DC00-DFFF)
+                    if ((cp >= 0xDC00) && (cp < 0xE000))
+                        return fail("Unpaired surrogate");
+                    if ((cp >= 0xD800) && (cp < 0xDC00))
+                    {
+                        uint32_t low = 0;
+                        if ((end_ - cur_ < 6) || (cur_[0] != '\\') || (cur_[1] != 'u'))
+                            return fail("Unpaired surrogate");
+                        cur_ += 2;
+                        if (!parseHex4(low))
+                            return false;
+                        if ((low < 0xDC00) || (low >= 0xE000))
+                            return fail("Unpaired surrogate");
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(cp, out);
+                    break;
+                }
+                default: return fail("Invalid escape");
+            }
+        }
+        return fail("Unterminated string");
+    }
+
+    bool parseArray(JsonValue& out, int depth)
+    {
+        ++cur_;//skip '['
+        out.type_ = JsonValue::eArray;
+        skipSpaces();
+        if ((cur_ < end_) && (*cur_ == ']'))
+        {
+            ++cur_;
+            return true;
+        }
+
+        while (true)
+        {
+            out.items_.emplace_back();
+            if (!parseValue(out.items_.back(), depth + 1))
+                return false;
+
+            skipSpaces();
+            if (cur_ >= end_)
+                return fail("Unterminated array");
+            if (*cur_ == ',') { ++cur_; continue; }
+            if (*cur_ == ']') { ++cur_; return true; }
+            return fail("Expected ',' or ']'");
+        }
+    }
+
+    bool parseObject(JsonValue& out, int depth)
+    {
+        ++cur_;//skip '{'
+        out.type_ = JsonValue::eObject;
+        skipSpaces();
+        if ((cur_ < end_) && (*cur_ == '}'))
+        {
+            ++cur_;
+            return true;
+        }
+
+        while (true)
+        {
+            skipSpaces();
+            if ((cur_ >= end_) || (*cur_ != '"'))
+                return fail("Expected member name");
+
+            out.members_.emplace_back();
+            if (!parseString(out.members_.back().first))
+                return false;
+
+            skipSpaces();
+            if ((cur_ >= end_) || (*cur_ != ':'))
+                return fail("Expected ':'");
+            ++cur_;
+
+            if (!parseValue(out.members_.back().second, depth + 1))
+                return false;
+
+            skipSpaces();
+            if (cur_ >= end_)
+                return fail("Unterminated object");
+            if (*cur_ == ',') { ++cur_; continue; }
+            if (*cur_ == '}') { ++cur_; return true; }
+            return fail("Expected ',' or '}'");
+        }
+    }
+
+    const char* cur_;
+    const char* end_;
+};
+
+bool JsonValue::parse(const char* data, size_t size, JsonValue& out, std::string* err)
+{
+    out = JsonValue();
+    JsonParser parser(data, size);
+    if (parser.parseDocument(out))
+        return true;
+
+    if (err) *err = parser.err_;
+    return false;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//JsonWriter
+
+void JsonWriter::escape(const char* str, size_t len, std::string& out)
+{
+    out += '"';
+    for (size_t i = 0; i < len; ++i)
+    {
+        const unsigned char ch = static_cast<unsigned char>(str[i]);
+        switch (ch)
+        {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default:
+                if (ch < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", ch);
+                    out += buf;
+                } else {
+                    out += static_cast<char>(ch);
+                }
+        }
+    }
+    out += '"';
+}
+
+void JsonWriter::separate()
+{
+    if (afterKey_)
+    {
+        afterKey_ = false;
+        return;
+    }
+    if (!first_.empty())
+    {
+        if (!first_.back()) buf_ += ',';
+        first_.back() = false;
+    }
+}
+
+JsonWriter& JsonWriter::beginObject()
+{
+    separate();
+    buf_ += '{';
+    first_.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject()
+{
+    buf_ += '}';
+    first_.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray()
+{
+    separate();
+    buf_ += '[';
+    first_.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray()
+{
+    buf_ += ']';
+    first_.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const char* name)
+{
+    separate();
+    escape(name, strlen(name), buf_);
+    buf_ += ':';
+    afterKey_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* str)
+{
+    separate();
+    if (str) escape(str, strlen(str), buf_);
+    else     buf_ += "null";
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const std::string& str)
+{
+    separate();
+    escape(str.data(), str.size(), buf_);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool b)
+{
+    separate();
+    buf_ += b ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(int64_t n)
+{
+    separate();
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(n));
+    buf_ += buf;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(uint64_t n)
+{
+    separate();
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(n));
+    buf_ += buf;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double n)
+{
+    separate();
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6g", n);
+    buf_ += buf;
+    return *this;
+}
+
+JsonWriter& JsonWriter::null()
+{
+    separate();
+    buf_ += "null";
+    return *this;
+}
+
+JsonWriter& JsonWriter::raw(const std::string& json)
+{
+    separate();
+    buf_ += json;
+    return *this;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////
+//JsonValue
+//Minimal JSON document model with recursive descent parser.
+//Parser works directly on memory buffer (doesn't require null terminated string).
+
+class JsonValue
+{
+public:
+    enum Type : uint8_t { eNull, eBool, eNumber, eString, eArray, eObject };
+    typedef std::vector<std::pair<std::string, JsonValue>> Members;
+    typedef std::vector<JsonValue> Items;
+
+    JsonValue() {}
+
+    Type type() const      { return type_; }
+    bool isNull() const    { return type_ == eNull; }
+    bool isBool() const    { return type_ == eBool; }
+    bool isNumber() const  { return type_ == eNumber; }
+    bool isString() const  { return type_ == eString; }
+    bool isArray() const   { return type_ == eArray; }
+    bool isObject() const  { return type_ == eObject; }
+
+    bool        asBool(bool def = false) const;
+    double      asNumber(double def = 0) const;
+    int64_t     asInt(int64_t def = 0) const;
+    std::string asString(const std::string& def = std::string()) const;
+    const std::string& str() const { return str_; }
+
+    //Array
+    size_t size() const { return (type_ == eArray) ? items_.size() : members_.size(); }
+    const JsonValue& operator[](size_t index) const;
+    const Items& items() const { return items_; }
+
+    //Object (returns null value when key not found)
+    const JsonValue& operator[](const char* key) const;
+    bool has(const char* key) const;
+    const Members& members() const { return members_; }
+
+    //Parse 'size' bytes of 'data'. On failure returns false and sets 'err' (when not null)
+    static bool parse(const char* data, size_t size, JsonValue& out, std::string* err = nullptr);
+
+protected:
+    friend class JsonParser;
+
+    Type type_ = eNull;
+    bool bool_ = false;
+    double num_ = 0;
+    std::string str_;
+    Items items_;
+    Members members_;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//JsonWriter
+//Appends compact JSON text to the string buffer, tracks commas automatically.
+
+class JsonWriter
+{
+public:
+    JsonWriter& beginObject();
+    JsonWriter& endObject();
+    JsonWriter& beginArray();
+    JsonWriter& endArray();
+
+    JsonWriter& key(const char* name);
+
+    JsonWriter& value(const char* str);
+    JsonWriter& value(const std::string& str);
+    JsonWriter& value(bool b);
+    JsonWriter& value(int32_t n)  { return value(static_cast<int64_t>(n)); }
+    JsonWriter& value(uint32_t n) { return value(static_cast<uint64_t>(n)); }
+    JsonWriter& value(int64_t n);
+    JsonWriter& value(uint64_t n);
+    JsonWriter& value(double n);
+    JsonWriter& null();
+
+    template<typename T>
+    JsonWriter& field(const char* name, const T& val) { key(name); return value(val); }
+
+    //Append already serialized JSON value
+    JsonWriter& raw(const std::string& json);
+
+    const std::string& str() const { return buf_; }
+    void clear() { buf_.clear(); first_.clear(); afterKey_ = false; }
+
+    static void escape(const char* str, size_t len, std::string& out);
+
+protected:
+    void separate();
+
+    std::string buf_;
+    std::vector<bool> first_;//Per nesting level: no elements written yet
+    bool afterKey_ = false;
+};
@@ -0,0 +1,299 @@
+#include "LatencyTest.h"
+
+#include <sys/stat.h>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+//Time given to SDK to close recording after calls ended
+static const uint32_t kCloseDelayMs = 200;
+
+//Max time of waiting for termination of both legs after BYE
+static const uint32_t kEndTimeoutMs = 5000;
+
+LatencyTest::~LatencyTest()
+{
+    cancelTimers();
+    if (worker_.joinable())
+        worker_.join();
+}
+
+bool LatencyTest::start(uint8_t module, const LatencyParams& params, const Actions& actions, std::string& err)
+{
+    if (isRunning())
+    {
+        err = "Latency test is already running";
+        return false;
+    }
+    if (params.target.empty() || params.prompt.empty() || params.reference.empty() || !params.runs)
+    {
+        err = "Latency test requires target, prompt, reference and runs";
+        return false;
+    }
+    if (!readWav(params.reference, reference_, err))
+        return false;
+
+    mkdir(params.folder.c_str(), 0755);
+    struct stat st;
+    if ((stat(params.folder.c_str(), &st) != 0) || ((st.st_mode & S_IFMT) != S_IFDIR))
+    {
+        err = "Can't create folder '" + params.folder + "'";
+        return false;
+    }
+
+    char stamp[32];
+    const time_t now = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    stamp_ = stamp;
+
+    params_ = params;
+    actions_ = actions;
+    module_ = module;
+    analyzer_.reset();
+    runs_.clear();
+    summary_ = LatencySummary();
+    std::cout << "\nLatency test started: " << params_.runs << " runs to " << params_.target << std::endl;
+    startRun();
+    return true;
+}
+
+void LatencyTest::stop()
+{
+    if (!isRunning())
+        return;
+
+    if (state_ < eEnding)
+        endCalls("stopped");
+    cancelTimers();
+    if (worker_.joinable())
+        worker_.join();
+    finish();
+}
+
+void LatencyTest::startRun()
+{
+    state_ = eCalling;
+    caller_ = callee_ = 0;
+    callerConnected_ = calleeConnected_ = false;
+    player_ = 0;
+    error_.clear();
+
+    Run run;
+    run.path = params_.folder + "/latency-" + stamp_ + "-" + std::to_string(runs_.size() + 1) + ".wav";
+    runs_.push_back(run);
+
+    runTimer_ = loop_.addTimer(params_.runTimeoutSec * 1000, 0, [this]() {
+        runTimer_ = 0;
+        endCalls("timeout");
+    });
+
+    const Siprix::ErrorCode err = actions_.invite(caller_);
+    if (err != Siprix::ErrorCode::EOK)
+        endCalls("invite failed: " + std::to_string(err));
+}
+
+bool LatencyTest::onCallIncoming(Siprix::CallId callId)
+{
+    if ((state_ != eCalling) || callee_)
+        return false;
+
+    callee_ = callId;
+    const Siprix::ErrorCode err = actions_.accept(callId);
+    if (err != Siprix::ErrorCode::EOK)
+        endCalls("accept failed: " + std::to_string(err));
+    return true;
+}
+
+bool LatencyTest::onCallConnected(Siprix::CallId callId)
+{
+    if (!isRunning())
+        return false;
+    if (callId == caller_)      callerConnected_ = true;
+    else if (callId == callee_) calleeConnected_ = true;
+    else return false;
+
+    if ((state_ == eCalling) && callerConnected_ && calleeConnected_)
+        startPlayback();
+    return true;
+}
+
+void LatencyTest::startPlayback()
+{
+    //Recording starts first, so it contains whole signal
+    Siprix::ErrorCode err = actions_.record(callee_, runs_.back().path);
+    if (err != Siprix::ErrorCode::EOK)
+    {
+        endCalls("record failed: " + std::to_string(err));
+        return;
+    }
+    state_ = ePlaying;
+
+    err = actions_.play(caller_, player_);
+    if (err != Siprix::ErrorCode::EOK)
+        endCalls("play failed: " + std::to_string(err));
+}
+
+void LatencyTest::onPlayerState(Siprix::PlayerId playerId, Siprix::PlayerState state)
+{
+    if ((state_ != ePlaying) || (playerId != player_) || (state == Siprix::PlayerState::PlayerStarted))
+        return;
+
+    if (state == Siprix::PlayerState::PlayerFailed)
+    {
+        endCalls("playback failed");
+        return;
+    }
+
+    //Delayed signal is still coming to the callee
+    state_ = eTail;
+    timer_ = loop_.addTimer(params_.tailMs, 0, [this]() {
+        timer_ = 0;
+        endCalls("");
+    });
+}
+
+bool LatencyTest::onCallTerminated(Siprix::CallId callId)
+{
+    if (!isRunning() || !callId || ((callId != caller_) && (callId != callee_)))
+        return false;
+
+    if (callId == caller_) caller_ = 0;
+    else                   callee_ = 0;
+
+    //Call ended during tail still has the signal recorded
+    if (state_ < eEnding)
+        endCalls((state_ == eTail) ? "" : "call terminated");
+    if ((state_ == eEnding) && !caller_ && !callee_)
+        callsEnded();
+    return true;
+}
+
+void LatencyTest::endCalls(const std::string& error)
+{
+    if (state_ >= eEnding)
+        return;
+
+    if ((state_ == ePlaying) || (state_ == eTail))
+        actions_.stopRecord(callee_);
+    error_ = error;
+    state_ = eEnding;
+    cancelTimers();
+
+    //Both legs are ended, as peer may not get BYE of the other one
+    if (caller_) actions_.bye(caller_);
+    if (callee_) actions_.bye(callee_);
+    if (!caller_ && !callee_)
+    {
+        callsEnded();
+        return;
+    }
+    runTimer_ = loop_.addTimer(kEndTimeoutMs, 0, [this]() {
+        runTimer_ = 0;
+        callsEnded();
+    });
+}
+
+void LatencyTest::callsEnded()
+{
+    cancelTimers();
+    if (!error_.empty())
+    {
+        state_ = eAnalyzing;
+        onAnalyzed(LatencyResult(), error_);
+        return;
+    }
+
+    state_ = eAnalyzing;
+    timer_ = loop_.addTimer(kCloseDelayMs, 0, [this]() {
+        timer_ = 0;
+        analyze();
+    });
+}
+
+void LatencyTest::analyze()
+{
+    //Recordings may be long, so FFT is computed by separate thread
+    const std::string path = runs_.back().path;
+    const size_t maxSamples = static_cast<size_t>(reference_.samples.size() * 48000.0 / reference_.sampleRate) +
+                              params_.maxDelayMs * 48;
+    worker_ = std::thread([this, path, maxSamples]() {
+        WavAudio audio;
+        std::string err;
+        LatencyResult result;
+        if (readWav(path, audio, err, maxSamples))
+        {
+            if (!analyzer_ || (analyzer_->sampleRate() != audio.sampleRate))
+                analyzer_ = std::make_shared<LatencyAnalyzer>(reference_.samples, reference_.sampleRate,
+                                                              audio.sampleRate, params_.maxDelayMs);
+            LatencyAnalyzer::Scratch scratch;
+            result = analyzer_->analyze(audio.samples, scratch);
+        }
+        loop_.post([this, result, err]() { onAnalyzed(result, err); });
+    });
+}
+
+void LatencyTest::onAnalyzed(const LatencyResult& result, const std::string& error)
+{
+    if (worker_.joinable())
+        worker_.join();
+    if (state_ != eAnalyzing)
+        return;
+
+    Run& run = runs_.back();
+    run.result = result;
+    run.error = error;
+    if (error.empty())
+        summary_.add(result);
+
+    const std::ios::fmtflags flags = std::cout.flags();
+    std::cout << "\n--- Latency run " << runs_.size() << "/" << params_.runs << ": " << std::fixed << std::setprecision(1);
+    if (!error.empty())        std::cout << "failed (" << error << ")";
+    else if (!result.found)    std::cout << "signal not found (peak:" << result.peak << ")";
+    else                       std::cout << "delay:" << result.delayMs << "ms peak:" << result.peak << " loss:" << result.lossPercent << "%";
+    std::cout << std::endl;
+    std::cout.flags(flags);
+    nextRun();
+}
+
+void LatencyTest::nextRun()
+{
+    if (runs_.size() >= params_.runs)
+    {
+        finish();
+        return;
+    }
+    state_ = ePause;
+    timer_ = loop_.addTimer(params_.intervalMs, 0, [this]() {
+        timer_ = 0;
+        startRun();
+    });
+}
+
+void LatencyTest::finish()
+{
+    cancelTimers();
+    state_ = eIdle;
+    std::cout << "\n--- Latency test completed\n    ";
+    print(std::cout);
+    std::cout << std::endl;
+}
+
+void LatencyTest::cancelTimers()
+{
+    if (timer_)    { loop_.cancelTimer(timer_);    timer_ = 0; }
+    if (runTimer_) { loop_.cancelTimer(runTimer_); runTimer_ = 0; }
+}
+
+void LatencyTest::print(std::ostream& os) const
+{
+    summary_.print(os);
+    size_t failed = 0;
+    for (const Run& run : runs_)
+        if (!run.error.empty()) ++failed;
+    os << " failedRuns:" << failed;
+}
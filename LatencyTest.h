@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "AudioAnalysis.h"
+#include "EventLoop.h"
+#include "Wav.h"
+
+////////////////////////////////////////////////////////////////////////////
+//LatencyParams
+
+struct LatencyParams
+{
+    std::string target;            //Extension called by test (registered by another account of this app)
+    Siprix::AccountId accId = 0;   //Account which originates calls
+    std::string prompt;            //Test signal (prompt name or path of mp3 file)
+    std::string reference;         //Same signal as WAV (decoded from mp3, so encoder delay is excluded)
+    std::string folder;            //Where recordings are written
+    uint32_t runs = 10;
+    uint32_t tailMs = 1000;        //Recording continues after playback stopped
+    uint32_t maxDelayMs = 2000;    //Max searched delay
+    uint32_t intervalMs = 500;     //Pause between runs
+    uint32_t runTimeoutSec = 30;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//LatencyTest
+//Measures mouth-to-ear latency by calling itself: caller leg plays test signal (Call_PlayFile),
+//callee leg (first incoming call while test waits for it) is recorded (Call_RecordFile).
+//Recording is cross-correlated with reference in background thread.
+//Repeated runs give jitter of the latency. Invoked on the loop thread.
+
+class LatencyTest
+{
+public:
+    struct Actions {
+        std::function<Siprix::ErrorCode(Siprix::CallId& callId)> invite;
+        std::function<Siprix::ErrorCode(Siprix::CallId callId)> accept;
+        std::function<Siprix::ErrorCode(Siprix::CallId callId, Siprix::PlayerId& playerId)> play;
+        std::function<Siprix::ErrorCode(Siprix::CallId callId, const std::string& path)> record;
+        std::function<Siprix::ErrorCode(Siprix::CallId callId)> stopRecord;
+        std::function<Siprix::ErrorCode(Siprix::CallId callId)> bye;
+    };
+
+    struct Run {
+        std::string path;
+        std::string error;  //Call or analysis failed
+        LatencyResult result;
+    };
+
+    LatencyTest(EventLoop& loop) : loop_(loop) {}
+    ~LatencyTest();
+
+    bool start(uint8_t module, const LatencyParams& params, const Actions& actions, std::string& err);
+    void stop();
+    bool isRunning() const { return state_ != eIdle; }
+    uint8_t module() const { return module_; }
+
+    //Events of the module where test runs. Return true when call belongs to the test.
+    bool onCallIncoming(Siprix::CallId callId);
+    bool onCallConnected(Siprix::CallId callId);
+    bool onCallTerminated(Siprix::CallId callId);
+    void onPlayerState(Siprix::PlayerId playerId, Siprix::PlayerState state);
+
+    const std::vector<Run>& runs() const { return runs_; }
+    const LatencySummary& summary() const { return summary_; }
+    void print(std::ostream& os) const;
+
+protected:
+    enum State { eIdle, eCalling, ePlaying, eTail, eEnding, eAnalyzing, ePause };
+
+    void startRun();
+    void startPlayback();
+    void endCalls(const std::string& error);
+    void callsEnded();
+    void analyze();
+    void onAnalyzed(const LatencyResult& result, const std::string& error);
+    void nextRun();
+    void finish();
+    void cancelTimers();
+
+    EventLoop& loop_;
+    LatencyParams params_;
+    Actions actions_;
+    uint8_t module_ = 0;
+    State state_ = eIdle;
+    WavAudio reference_;
+    std::shared_ptr<const LatencyAnalyzer> analyzer_;//Created for sample rate of recordings
+    std::thread worker_;
+
+    //Current run
+    Siprix::CallId caller_ = 0;
+    Siprix::CallId callee_ = 0;
+    bool callerConnected_ = false;
+    bool calleeConnected_ = false;
+    Siprix::PlayerId player_ = 0;
+    std::string error_;
+    std::string stamp_;                //Part of recordings names
+    EventLoop::TimerId timer_ = 0;     //Tail, pause between runs
+    EventLoop::TimerId runTimer_ = 0;  //Timeout of the run
+
+    std::vector<Run> runs_;
+    LatencySummary summary_;
+};
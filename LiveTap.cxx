@@ -0,0 +1,409 @@
+#include "LiveTap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+//Modified files are read in batches (SDK writes every 20ms), not yet created files are opened
+static const uint32_t kPollMs = 100;
+
+//Header which isn't parsed from this amount of bytes is invalid
+static const uint64_t kMaxHeaderSize = 64 * 1024;
+
+static const size_t kReadChunk = 64 * 1024;
+
+const char* getTapDetectionStr(TapDetection detection)
+{
+    switch (detection)
+    {
+        case eTapHuman:   return "human";
+        case eTapMachine: return "machine";
+        case eTapNotSure: return "notSure";
+        case eTapDeadAir: return "deadAir";
+        default:          return "?";
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//CallAudioAnalyzer
+
+CallAudioAnalyzer::CallAudioAnalyzer(const TapParams& params, uint32_t sampleRate)
+    : params_(params), frameSize_(std::max<size_t>(1, sampleRate * kFrameMs / 1000))
+{
+    silenceSumSq_ = 32768.0 * 32768.0 * pow(10, params.silenceDb / 10) * frameSize_;
+    partial_.reserve(frameSize_);
+}
+
+void CallAudioAnalyzer::feed(const int16_t* x, size_t n, std::vector<TapResult>& results)
+{
+    const auto energy = [](const int16_t* s, size_t count) {
+        int64_t sumSq = 0;
+        for (size_t i = 0; i < count; ++i)
+            sumSq += static_cast<int32_t>(s[i]) * s[i];
+        return static_cast<double>(sumSq);
+    };
+
+    //Completes frame started by previous call
+    if (!partial_.empty())
+    {
+        const size_t take = std::min(n, frameSize_ - partial_.size());
+        partial_.insert(partial_.end(), x, x + take);
+        x += take;
+        n -= take;
+        if (partial_.size() < frameSize_)
+            return;
+        onFrame(energy(partial_.data(), frameSize_) >= silenceSumSq_, results);
+        partial_.clear();
+    }
+
+    for (; n >= frameSize_; x += frameSize_, n -= frameSize_)
+        onFrame(energy(x, frameSize_) >= silenceSumSq_, results);
+    partial_.assign(x, x + n);
+}
+
+void CallAudioAnalyzer::onFrame(bool voice, std::vector<TapResult>& results)
+{
+    ++frames_;
+    const uint32_t nowMs = frames_ * kFrameMs;
+    if (voice)
+    {
+        silenceMs_ = 0;
+        deadAirReported_ = false;
+        if (!inWord_)
+        {
+            inWord_ = true;
+            voiceMs_ = 0;
+        }
+        voiceMs_ += kFrameMs;
+        if (!wordCounted_ && (voiceMs_ >= params_.minWordMs))
+        {
+            wordCounted_ = true;
+            if (!words_++)
+                greetingStartMs_ = nowMs - voiceMs_;
+        }
+    }
+    else
+    {
+        silenceMs_ += kFrameMs;
+        if (inWord_ && (silenceMs_ >= params_.betweenWordsMs))
+            inWord_ = wordCounted_ = false;
+    }
+
+    if (params_.amd && !amdDone_)
+    {
+        if (!words_)
+        {
+            if (nowMs >= params_.initialSilenceMs)
+                amdResult(eTapNotSure, "no speech", results);
+        }
+        else if (words_ > params_.maxWords)
+            amdResult(eTapMachine, "too many words", results);
+        else if (silenceMs_ >= params_.afterGreetingSilenceMs)
+            amdResult(eTapHuman, "silence after greeting", results);
+        else if (nowMs - greetingStartMs_ - silenceMs_ > params_.greetingMs)
+            amdResult(eTapMachine, "long greeting", results);
+        else if (nowMs >= params_.totalAnalysisMs)
+            amdResult(eTapNotSure, "max analysis time", results);
+    }
+
+    if (params_.deadAirMs && !deadAirReported_ && (silenceMs_ >= params_.deadAirMs))
+    {
+        deadAirReported_ = true;
+        TapResult r;
+        r.detection = eTapDeadAir;
+        r.atMs = nowMs;
+        r.reason = "silence";
+        results.push_back(r);
+    }
+}
+
+void CallAudioAnalyzer::amdResult(TapDetection detection, const char* reason, std::vector<TapResult>& results)
+{
+    amdDone_ = true;
+    TapResult r;
+    r.detection = detection;
+    r.atMs = frames_ * kFrameMs;
+    r.reason = reason;
+    r.words = words_;
+    r.greetingMs = words_ ? (r.atMs - greetingStartMs_ - silenceMs_) : 0;
+    results.push_back(r);
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//LiveTap
+
+bool LiveTap::start(const TapParams& params, Handler handler, std::string& err)
+{
+    params_ = params;
+    handler_ = handler;
+    readBuf_.resize(kReadChunk);
+
+#ifdef __linux__
+    //Queue is drained by timer: one read for all taps instead of wake up on every write of SDK
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ < 0)
+    {
+        err = "Can't create inotify instance";
+        return false;
+    }
+#else
+    (void)err;
+#endif
+    pollTimer_ = loop_.addTimer(kPollMs, kPollMs, [this]() { onPollTimer(); });
+    return true;
+}
+
+void LiveTap::stop()
+{
+    for (auto& it : taps_)
+        closeTap(*it.second);
+    taps_.clear();
+    watches_.clear();
+
+    if (pollTimer_)
+    {
+        loop_.cancelTimer(pollTimer_);
+        pollTimer_ = 0;
+    }
+#ifdef __linux__
+    if (inotifyFd_ >= 0)
+    {
+        close(inotifyFd_);
+        inotifyFd_ = -1;
+    }
+#endif
+}
+
+bool LiveTap::add(uint8_t module, Siprix::CallId callId, const std::string& path)
+{
+    std::unique_ptr<Tap>& tap = taps_[key(module, callId)];
+    if (tap)
+        return false;
+
+    tap.reset(new Tap);
+    tap->module = module;
+    tap->callId = callId;
+    tap->path = path;
+    tap->added = std::chrono::steady_clock::now();
+    ++tapped_;
+    openTap(*tap);
+    return true;
+}
+
+void LiveTap::remove(uint8_t module, Siprix::CallId callId)
+{
+    auto it = taps_.find(key(module, callId));
+    if (it == taps_.end())
+        return;
+
+    //Rest of the file isn't analyzed, call is over
+    closeTap(*it->second);
+    taps_.erase(it);
+}
+
+bool LiveTap::openTap(Tap& tap)
+{
+    tap.file = fopen(tap.path.c_str(), "rb");
+    if (!tap.file)
+        return false;
+#ifdef __linux__
+    if (inotifyFd_ >= 0)
+    {
+        tap.watch = inotify_add_watch(inotifyFd_, tap.path.c_str(), IN_MODIFY);
+        if (tap.watch >= 0)
+            watches_[tap.watch] = key(tap.module, tap.callId);
+    }
+#endif
+    readTap(tap);
+    return true;
+}
+
+void LiveTap::closeTap(Tap& tap)
+{
+#ifdef __linux__
+    if (tap.watch >= 0)
+    {
+        inotify_rm_watch(inotifyFd_, tap.watch);
+        watches_.erase(tap.watch);
+        tap.watch = -1;
+    }
+#endif
+    if (tap.file)
+    {
+        fclose(tap.file);
+        tap.file = nullptr;
+    }
+}
+
+void LiveTap::readTap(Tap& tap)
+{
+    if (!tap.file)
+        return;
+
+    if (!tap.headerParsed)
+    {
+        fseek(tap.file, 0, SEEK_END);
+        const uint64_t size = static_cast<uint64_t>(ftell(tap.file));
+        fseek(tap.file, 0, SEEK_SET);
+        const bool parsed = readWavInfo(tap.file, size, tap.info);
+        const WavInfo& info = tap.info;
+        const bool supported = parsed && info.sampleRate &&
+            (((info.format == eWavPcm) && (info.bitsPerSample == 16)) || (info.format == eWavAlaw) || (info.format == eWavMulaw));
+        if (!supported)
+        {
+            //Header may be not written yet
+            if (parsed || (size > kMaxHeaderSize))
+            {
+                std::cerr << "Live tap of call " << tap.callId << ": unsupported recording '" << tap.path << "'" << std::endl;
+                closeTap(tap);
+                tap.done = true;
+            }
+            return;
+        }
+        tap.headerParsed = true;
+        tap.offset = info.dataOffset;
+        fseek(tap.file, static_cast<long>(tap.offset), SEEK_SET);
+        if (info.format != eWavPcm)
+            makeWavDecodeTable(info.format, tap.table);
+        tap.analyzer.reset(new CallAudioAnalyzer(params_, info.sampleRate));
+    }
+
+    const size_t bytesPerSample = (tap.info.format == eWavPcm) ? 2 : 1;
+    const size_t frameSize = bytesPerSample * tap.info.channels;
+    results_.clear();
+    for (;;)
+    {
+        //Incomplete frame of previous read is moved to the beginning of the buffer
+        const size_t kept = tap.partial.size();
+        std::copy(tap.partial.begin(), tap.partial.end(), readBuf_.begin());
+        const size_t read = fread(readBuf_.data() + kept, 1, readBuf_.size() - kept, tap.file);
+        ++reads_;
+        if (!read)
+            break;
+        tap.offset += read;
+        bytesRead_ += read;
+
+        const size_t total = kept + read;
+        const size_t frames = total / frameSize;
+        samples_.resize(frames);
+        for (size_t i = 0; i < frames; ++i)
+        {
+            const uint8_t* frame = readBuf_.data() + i * frameSize;
+            if (bytesPerSample == 2)
+                memcpy(&samples_[i], frame, 2);
+            else
+                samples_[i] = tap.table[frame[0]];
+        }
+        tap.partial.assign(readBuf_.begin() + frames * frameSize, readBuf_.begin() + total);
+        tap.analyzer->feed(samples_.data(), frames, results_);
+        audioMs_ += 1000 * frames / tap.info.sampleRate;
+        if (read < readBuf_.size() - kept)
+            break;
+    }
+    clearerr(tap.file);
+
+    if (tap.analyzer->amdDone() && !params_.deadAirMs)
+    {
+        closeTap(tap);
+        tap.done = true;
+    }
+
+    if (results_.empty())
+        return;
+
+    //Handler may end the call, so tap isn't used after it
+    const uint8_t module = tap.module;
+    const Siprix::CallId callId = tap.callId;
+    const auto lag = std::chrono::steady_clock::now() - tap.added;
+    const int64_t lagMs = std::chrono::duration_cast<std::chrono::milliseconds>(lag).count();
+    for (const TapResult& r : results_)
+    {
+        ++detections_[r.detection];
+        lagMsTotal_ += static_cast<uint64_t>(std::max<int64_t>(0, lagMs - r.atMs));
+        ++lagCount_;
+    }
+    const std::vector<TapResult> results = results_;
+    for (const TapResult& r : results)
+        handler_(module, callId, r);
+}
+
+void LiveTap::readInotify()
+{
+#ifdef __linux__
+    if (inotifyFd_ < 0)
+        return;
+    alignas(inotify_event) char buf[16 * 1024];
+    ssize_t len;
+    while ((len = read(inotifyFd_, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t pos = 0; pos < len; )
+        {
+            const inotify_event* ev = reinterpret_cast<const inotify_event*>(buf + pos);
+            if (ev->mask & IN_Q_OVERFLOW)
+            {
+                for (auto& tap : taps_)
+                    tap.second->modified = true;
+            }
+            auto it = watches_.find(ev->wd);
+            if (it != watches_.end())
+            {
+                auto tap = taps_.find(it->second);
+                if (tap != taps_.end())
+                    tap->second->modified = true;
+            }
+            pos += sizeof(inotify_event) + ev->len;
+        }
+    }
+#endif
+}
+
+void LiveTap::onPollTimer()
+{
+    if (taps_.empty())
+        return;
+    const auto began = std::chrono::steady_clock::now();
+    readInotify();
+
+    //Without inotify all files are read
+    std::vector<uint64_t> keys;
+    for (const auto& it : taps_)
+    {
+        const Tap& tap = *it.second;
+        if ((!tap.file && !tap.done) || (tap.file && (tap.modified || (tap.watch < 0))))
+            keys.push_back(it.first);
+    }
+    for (uint64_t k : keys)
+    {
+        auto it = taps_.find(k);
+        if (it == taps_.end())
+            continue;
+        Tap& tap = *it->second;
+        tap.modified = false;
+        if (tap.file)       readTap(tap);
+        else if (!tap.done) openTap(tap);
+    }
+    busyUs_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - began).count();
+}
+
+void LiveTap::print(std::ostream& os) const
+{
+    const std::ios::fmtflags flags = os.flags();
+    os << "taps active:" << taps_.size() << " total:" << tapped_;
+    for (int d = 0; d < eTapDetections; ++d)
+        os << " " << getTapDetectionStr(static_cast<TapDetection>(d)) << ":" << detections_[d];
+    os << std::fixed << std::setprecision(1)
+       << " readMb:" << bytesRead_ / 1048576.0 << " reads:" << reads_
+       << " audioSec:" << audioMs_ / 1000.0 << " busyMs:" << busyUs_ / 1000.0
+       << " usPerAudioSec:" << (audioMs_ ? 1000.0 * busyUs_ / audioMs_ : 0)
+       << " avgLagMs:" << avgLagMs();
+    os.flags(flags);
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "EventLoop.h"
+#include "Wav.h"
+
+////////////////////////////////////////////////////////////////////////////
+//TapParams
+
+struct TapParams
+{
+    bool tapAll = false;            //Record and tap every connected call
+    bool amd = true;                //Answering machine detection
+    double silenceDb = -45;         //Frame (20ms) with lower level is silence
+    uint32_t deadAirMs = 5000;      //Silence reported as dead air (0 - disabled)
+
+    //AMD heuristics (durations since call answered)
+    uint32_t initialSilenceMs = 2500;      //No speech at all - not sure
+    uint32_t greetingMs = 1500;            //Longer greeting - machine
+    uint32_t afterGreetingSilenceMs = 800; //Silence after short greeting - human
+    uint32_t minWordMs = 100;              //Shorter voice is noise
+    uint32_t betweenWordsMs = 50;          //Silence which ends the word
+    uint32_t maxWords = 3;                 //More words - machine
+    uint32_t totalAnalysisMs = 5000;       //Not decided - not sure
+
+    //Actions: "none", "bye", "play:<prompt or playlist>"
+    std::string humanAction;
+    std::string machineAction;
+    std::string deadAirAction;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//CallAudioAnalyzer
+//Streaming analysis of call audio in 20ms frames: energy VAD, AMD (human/machine greeting
+//by length of the greeting, number of words and silence after it) and dead air.
+//Costs one pass over samples and a few comparisons per frame.
+
+enum TapDetection : uint8_t
+{
+    eTapHuman,
+    eTapMachine,
+    eTapNotSure,
+    eTapDeadAir,
+    eTapDetections
+};
+
+const char* getTapDetectionStr(TapDetection detection);
+
+struct TapResult
+{
+    TapDetection detection = eTapNotSure;
+    uint32_t atMs = 0;          //Audio time when detected
+    const char* reason = "";
+    uint32_t words = 0;
+    uint32_t greetingMs = 0;
+};
+
+class CallAudioAnalyzer
+{
+public:
+    CallAudioAnalyzer(const TapParams& params, uint32_t sampleRate);
+
+    //Appends detections found in the samples
+    void feed(const int16_t* x, size_t n, std::vector<TapResult>& results);
+
+    bool amdDone() const { return amdDone_; }
+    uint32_t audioMs() const { return frames_ * kFrameMs; }
+
+    static const uint32_t kFrameMs = 20;
+
+protected:
+    void onFrame(bool voice, std::vector<TapResult>& results);
+    void amdResult(TapDetection detection, const char* reason, std::vector<TapResult>& results);
+
+    const TapParams& params_;
+    size_t frameSize_;
+    double silenceSumSq_;      //Threshold of frame energy
+    std::vector<int16_t> partial_;
+
+    uint32_t frames_ = 0;
+    uint32_t silenceMs_ = 0;   //Current silence
+    uint32_t voiceMs_ = 0;     //Current word
+    bool inWord_ = false;
+    bool wordCounted_ = false; //Current voice is long enough to be a word
+    uint32_t words_ = 0;
+    uint32_t greetingStartMs_ = 0;
+    bool amdDone_ = false;
+    bool deadAirReported_ = false;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//LiveTap
+//Follows growing recordings of calls (written by Call_RecordFile). Every 100ms queue
+//of inotify is drained, new bytes of modified files are read and analyzed on the loop
+//thread (other platforms read all files). Detections are passed to the handler.
+
+class LiveTap
+{
+public:
+    typedef std::function<void(uint8_t module, Siprix::CallId callId, const TapResult& result)> Handler;
+
+    LiveTap(EventLoop& loop) : loop_(loop) {}
+    ~LiveTap() { stop(); }
+
+    bool start(const TapParams& params, Handler handler, std::string& err);
+    void stop();
+
+    //Starts following recording (file may not exist yet)
+    bool add(uint8_t module, Siprix::CallId callId, const std::string& path);
+
+    //Recording stopped or call ended
+    void remove(uint8_t module, Siprix::CallId callId);
+
+    const TapParams& params() const { return params_; }
+    size_t activeCount() const { return taps_.size(); }
+    void print(std::ostream& os) const;
+
+    uint64_t tapped()    const { return tapped_; }
+    uint64_t detections(TapDetection d) const { return detections_[d]; }
+    uint64_t bytesRead() const { return bytesRead_; }
+    uint64_t audioMs()   const { return audioMs_; }
+    uint64_t busyUs()    const { return busyUs_; }
+    double   avgLagMs()  const { return lagCount_ ? static_cast<double>(lagMsTotal_) / lagCount_ : 0; }
+
+protected:
+    struct Tap {
+        uint8_t module = 0;
+        Siprix::CallId callId = 0;
+        std::string path;
+        FILE* file = nullptr;
+        int watch = -1;              //inotify watch descriptor
+        bool modified = false;       //Reported by inotify since last read
+        WavInfo info;
+        bool headerParsed = false;
+        bool done = false;           //Not followed anymore (invalid file or nothing to detect)
+        uint64_t offset = 0;         //Next byte to read
+        std::vector<uint8_t> partial;//Incomplete sample frame
+        std::unique_ptr<CallAudioAnalyzer> analyzer;
+        int16_t table[256];          //Decoding of A-law/mu-law
+        std::chrono::steady_clock::time_point added;
+    };
+
+    static uint64_t key(uint8_t module, Siprix::CallId callId) { return (static_cast<uint64_t>(module) << 32) | callId; }
+
+    bool openTap(Tap& tap);
+    void closeTap(Tap& tap);
+    void readTap(Tap& tap);
+    void readInotify();
+    void onPollTimer();
+
+    EventLoop& loop_;
+    TapParams params_;
+    Handler handler_;
+    int inotifyFd_ = -1;
+    EventLoop::TimerId pollTimer_ = 0;
+    std::unordered_map<uint64_t, std::unique_ptr<Tap>> taps_;
+    std::unordered_map<int, uint64_t> watches_;//Watch descriptor -> key of tap
+    std::vector<uint8_t> readBuf_;
+    std::vector<int16_t> samples_;
+    std::vector<TapResult> results_;
+
+    //Counters
+    uint64_t tapped_ = 0;
+    uint64_t detections_[eTapDetections] = {};
+    uint64_t bytesRead_ = 0;
+    uint64_t reads_ = 0;
+    uint64_t busyUs_ = 0;          //Time spent reading and analyzing
+    uint64_t audioMs_ = 0;         //Analyzed audio of all calls
+    uint64_t lagMsTotal_ = 0;      //Delay of detections after audio was recorded (for average)
+    uint64_t lagCount_ = 0;
+};
@@ -0,0 +1,102 @@
+#include "LoadGenerator.h"
+
+//Originate calls each 20ms (spreads load evenly and keeps timer overhead low)
+static const uint32_t kTickMs = 20;
+
+void LoadGenerator::start(const LoadParams& params, InviteFn invite, ByeFn bye)
+{
+    stop();
+    params_ = params;
+    invite_ = invite;
+    bye_ = bye;
+    credit_ = 0;
+    lastTick_ = std::chrono::steady_clock::now();
+    if (params_.cps > 0)
+        tickTimer_ = loop_.addTimer(kTickMs, kTickMs, [this]() { tick(); });
+}
+
+void LoadGenerator::stop()
+{
+    //Calls, which are already established, are completed by their own timers
+    if (tickTimer_)
+    {
+        loop_.cancelTimer(tickTimer_);
+        tickTimer_ = 0;
+    }
+}
+
+void LoadGenerator::tick()
+{
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsedSec = std::chrono::duration<double>(now - lastTick_).count();
+    lastTick_ = now;
+    if (held_)
+    {
+        credit_ = 0;
+        return;
+    }
+
+    //Don't try to catch up more than 100ms of stalled time
+    credit_ += params_.cps * elapsedSec;
+    const double maxCredit = (params_.cps / 10 > 1) ? params_.cps / 10 : 1;
+    if (credit_ > maxCredit)
+        credit_ = maxCredit;
+
+    while (credit_ >= 1)
+    {
+        if (params_.maxCalls && (calls_.size() >= params_.maxCalls))
+        {
+            credit_ = 0;
+            break;
+        }
+
+        credit_ -= 1;
+        Siprix::CallId callId = 0;
+        const Siprix::ErrorCode err = invite_(callId);
+        if (err != Siprix::ErrorCode::EOK)
+        {
+            ++stats_.callsFailed;
+            continue;
+        }
+
+        ++stats_.callsOriginated;
+        calls_[callId].started = now;
+    }
+}
+
+bool LoadGenerator::onCallConnected(Siprix::CallId callId)
+{
+    auto it = calls_.find(callId);
+    if ((it == calls_.end()) || it->second.connected)
+        return false;
+
+    Call& call = it->second;
+    call.connected = true;
+    ++stats_.callsConnected;
+    stats_.callSetupMs.add(std::chrono::duration_cast<std::chrono::milliseconds>(
+                              std::chrono::steady_clock::now() - call.started).count());
+
+    call.byeTimer = loop_.addTimer(params_.holdSec * 1000, 0, [this, callId]() {
+        auto it = calls_.find(callId);
+        if (it == calls_.end())
+            return;
+        it->second.byeTimer = 0;
+        bye_(callId);
+    });
+    return true;
+}
+
+bool LoadGenerator::onCallTerminated(Siprix::CallId callId)
+{
+    auto it = calls_.find(callId);
+    if (it == calls_.end())
+        return false;
+
+    if (it->second.connected) ++stats_.callsCompleted;
+    else                      ++stats_.callsFailed;
+
+    if (it->second.byeTimer)
+        loop_.cancelTimer(it->second.byeTimer);
+    calls_.erase(it);
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include "EventLoop.h"
+#include "Stats.h"
+
+////////////////////////////////////////////////////////////////////////////
+//LoadParams
+
+struct LoadParams
+{
+    std::string target;     //Destination extension of generated calls
+    double   cps = 0;       //Calls per second
+    uint32_t holdSec = 10;  //Duration of connected call
+    uint32_t maxCalls = 0;  //Max number of concurrent calls (0 - unlimited)
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//LoadGenerator
+//Originates calls with constant rate and hangs them up after 'holdSec'.
+//Updates call counters of AppStats.
+
+class LoadGenerator
+{
+public:
+    typedef std::function<Siprix::ErrorCode(Siprix::CallId& callId)> InviteFn;
+    typedef std::function<Siprix::ErrorCode(Siprix::CallId callId)> ByeFn;
+
+    LoadGenerator(EventLoop& loop, AppStats& stats) : loop_(loop), stats_(stats) {}
+    ~LoadGenerator() { stop(); }
+
+    void start(const LoadParams& params, InviteFn invite, ByeFn bye);
+    void stop();
+    bool isRunning() const { return tickTimer_ != 0; }
+
+    //Held generator doesn't originate calls and doesn't accumulate them (network is lost)
+    void hold(bool held) { held_ = held; }
+    bool isHeld() const { return held_; }
+    const LoadParams& params() const { return params_; }
+
+    //Returns true when call was originated by generator
+    bool onCallConnected(Siprix::CallId callId);
+    bool onCallTerminated(Siprix::CallId callId);
+
+    size_t activeCalls() const { return calls_.size(); }
+
+protected:
+    void tick();
+
+    struct Call {
+        std::chrono::steady_clock::time_point started;
+        bool connected = false;
+        EventLoop::TimerId byeTimer = 0;
+    };
+
+    EventLoop& loop_;
+    AppStats& stats_;
+    LoadParams params_;
+    InviteFn invite_;
+    ByeFn bye_;
+
+    EventLoop::TimerId tickTimer_ = 0;
+    std::chrono::steady_clock::time_point lastTick_;
+    double credit_ = 0;//Number of calls which have to be originated
+    bool held_ = false;
+    std::unordered_map<Siprix::CallId, Call> calls_;
+};
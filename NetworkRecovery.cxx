@@ -0,0 +1,247 @@
+#include "NetworkRecovery.h"
+
+#include <algorithm>
+#include <iostream>
+
+//Send requests each 20ms (same granularity as load generator and drain)
+static const uint32_t kTickMs = 20;
+
+//Number of runs kept (flapping network adds one run per change) and printed with stats
+static const size_t kMaxRuns = 100;
+static const size_t kMaxPrintedRuns = 5;
+
+static uint64_t elapsedMs(EventLoop::Clock::time_point from, EventLoop::Clock::time_point to)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count());
+}
+
+static const char* getRecoveryTriggerStr(Siprix::NetworkState state)
+{
+    switch (state)
+    {
+        case Siprix::NetworkState::NetworkRestored: return "restored";
+        case Siprix::NetworkState::NetworkSwitched: return "switched";
+        default:                                    return "lost";
+    }
+}
+
+void NetworkRecovery::onNetworkState(const char* name, Siprix::NetworkState state)
+{
+    ++networkEvents_;
+    const auto now = EventLoop::Clock::now();
+    if (state == Siprix::NetworkState::NetworkLost)
+    {
+        //Requests of the unfinished run would fail anyway, it's started again when network is back
+        if (running_)
+            finish(true);
+        if (!lost_)
+        {
+            lost_ = true;
+            lostAt_ = now;
+            if (actions_.holdOriginations)
+                actions_.holdOriginations(true);
+            std::cout << "\nNetwork lost: originations are held off until it's restored" << std::endl;
+        }
+        return;
+    }
+
+    uint64_t lostMs = 0;
+    if (lost_)
+    {
+        lost_ = false;
+        lostMs = elapsedMs(lostAt_, now);
+        if (actions_.holdOriginations)
+            actions_.holdOriginations(false);
+    }
+    if (running_)
+        finish(true);
+    start(state, name ? name : "", lostMs);
+}
+
+void NetworkRecovery::recover(const std::string& name)
+{
+    if (running_)
+        finish(true);
+    start(Siprix::NetworkState::NetworkSwitched, name, 0);
+}
+
+void NetworkRecovery::stop()
+{
+    if (running_)
+        finish(true);
+}
+
+void NetworkRecovery::start(Siprix::NetworkState state, const std::string& name, uint64_t lostMs)
+{
+    RecoveryRun run;
+    run.state = state;
+    run.name = name;
+    run.lostMs = lostMs;
+    if (params_.jitterMs)
+        run.delayMs = std::uniform_int_distribution<uint32_t>(0, params_.jitterMs)(random_);
+    if (runs_.size() == kMaxRuns)
+        runs_.erase(runs_.begin());
+    runs_.push_back(run);
+
+    running_ = true;
+    restoredAt_ = EventLoop::Clock::now();
+    calls_.clear();
+    accounts_.clear();
+    pendingAccounts_.clear();
+    nextAccount_ = 0;
+
+    if (!run.delayMs)
+    {
+        begin();
+        return;
+    }
+    delayTimer_ = loop_.addTimer(run.delayMs, 0, [this]() {
+        delayTimer_ = 0;
+        begin();
+    });
+}
+
+void NetworkRecovery::begin()
+{
+    RecoveryRun& run = runs_.back();
+    size_t priority = 0;
+    if (actions_.collect)
+        actions_.collect(accounts_, priority, calls_);
+    priority = std::min(priority, accounts_.size());
+    if (!params_.renegotiate || !actions_.renegotiate)
+        calls_.clear();
+
+    //Same accounts don't always come first
+    std::shuffle(accounts_.begin(), accounts_.begin() + priority, random_);
+    std::shuffle(accounts_.begin() + priority, accounts_.end(), random_);
+
+    run.accounts = accounts_.size();
+    run.priorityAccounts = priority;
+    run.calls = calls_.size();
+    std::cout << "\nNetwork " << getRecoveryTriggerStr(run.state) << " (" << run.name << "): renegotiating "
+              << calls_.size() << " calls, registering " << accounts_.size() << " accounts (" << priority
+              << " with calls first) at " << params_.registerRate << "/s" << std::endl;
+
+    const auto now = EventLoop::Clock::now();
+    lastTick_ = secondStarted_ = now;
+    sentInSecond_ = 0;
+
+    //Media of each call is broken until it's renegotiated, so calls don't wait for the queue
+    for (const Item& call : calls_)
+    {
+        if (actions_.renegotiate(call) == Siprix::ErrorCode::EOK)
+            ++run.renegotiated;
+        else
+            ++run.renegotiateErrors;
+        ++sentInSecond_;
+    }
+    run.peakPerSec = sentInSecond_;
+
+    credit_ = 1;
+    tick();
+    if (running_ && (nextAccount_ < accounts_.size()))
+        tickTimer_ = loop_.addTimer(kTickMs, kTickMs, [this]() { tick(); });
+}
+
+void NetworkRecovery::tick()
+{
+    const auto now = EventLoop::Clock::now();
+    const double maxCredit = (params_.registerRate / 10 > 1) ? params_.registerRate / 10 : 1;
+    credit_ += params_.registerRate * std::chrono::duration<double>(now - lastTick_).count();
+    if (credit_ > maxCredit)
+        credit_ = maxCredit;
+    lastTick_ = now;
+    if (now - secondStarted_ >= std::chrono::seconds(1))
+    {
+        secondStarted_ = now;
+        sentInSecond_ = 0;
+    }
+
+    RecoveryRun& run = runs_.back();
+    for (; (credit_ >= 1) && (nextAccount_ < accounts_.size()); credit_ -= 1)
+    {
+        const Item& acc = accounts_[nextAccount_++];
+        ++run.registrations;
+        if (actions_.registration(acc) == Siprix::ErrorCode::EOK)
+            pendingAccounts_.insert(key(acc.module, acc.id));
+        else
+            ++run.regFailed;
+        run.peakPerSec = std::max(run.peakPerSec, ++sentInSecond_);
+    }
+
+    if (nextAccount_ < accounts_.size())
+        return;
+
+    //All requests sent - wait for confirmations
+    cancelTimers();
+    if (pendingAccounts_.empty())
+    {
+        finish(false);
+        return;
+    }
+    deadlineTimer_ = loop_.addTimer(params_.timeoutSec * 1000, 0, [this]() {
+        deadlineTimer_ = 0;
+        finish(false);
+    });
+}
+
+void NetworkRecovery::onAccountRegState(uint8_t module, Siprix::AccountId accId, Siprix::RegState state)
+{
+    if (!running_ || (state == Siprix::RegState::InProgress) || !pendingAccounts_.erase(key(module, accId)))
+        return;
+
+    RecoveryRun& run = runs_.back();
+    if (state == Siprix::RegState::Success)
+        ++run.registered;
+    else
+        ++run.regFailed;
+
+    if (pendingAccounts_.empty() && (nextAccount_ == accounts_.size()))
+        finish(false);
+}
+
+void NetworkRecovery::finish(bool interrupted)
+{
+    cancelTimers();
+    running_ = false;
+
+    RecoveryRun& run = runs_.back();
+    run.recoveryMs = elapsedMs(restoredAt_, EventLoop::Clock::now());
+    run.interrupted = interrupted;
+    run.completed = !interrupted && pendingAccounts_.empty() && (run.registered == run.accounts);
+    pendingAccounts_.clear();
+
+    std::cout << "\n--- Network recovery " << (run.completed ? "completed" : (interrupted ? "interrupted" : "incomplete"))
+              << " in " << run.recoveryMs << "ms: registered " << run.registered << " of " << run.accounts
+              << " accounts (failed " << run.regFailed << "), renegotiated " << run.renegotiated << " of " << run.calls
+              << " calls, storm " << run.registrations + run.renegotiated + run.renegotiateErrors << " requests (peak "
+              << run.peakPerSec << "/s)" << std::endl;
+}
+
+void NetworkRecovery::cancelTimers()
+{
+    if (delayTimer_)    { loop_.cancelTimer(delayTimer_);    delayTimer_ = 0; }
+    if (tickTimer_)     { loop_.cancelTimer(tickTimer_);     tickTimer_ = 0; }
+    if (deadlineTimer_) { loop_.cancelTimer(deadlineTimer_); deadlineTimer_ = 0; }
+}
+
+void NetworkRecovery::print(std::ostream& os) const
+{
+    os << "network " << (lost_ ? "lost" : "up") << " events:" << networkEvents_ << " recoveries:" << runs_.size()
+       << (running_ ? " (running)" : "");
+
+    const size_t first = (runs_.size() > kMaxPrintedRuns) ? runs_.size() - kMaxPrintedRuns : 0;
+    for (size_t i = first; i < runs_.size(); ++i)
+    {
+        const RecoveryRun& run = runs_[i];
+        os << "\n      " << getRecoveryTriggerStr(run.state) << " " << run.name << " lostMs:" << run.lostMs
+           << " delayMs:" << run.delayMs << " accounts:" << run.registered << "/" << run.accounts
+           << " (priority " << run.priorityAccounts << ", failed " << run.regFailed << ")"
+           << " calls:" << run.renegotiated << "/" << run.calls << " requests:" << run.registrations + run.renegotiated + run.renegotiateErrors
+           << " peakPerSec:" << run.peakPerSec;
+        if (running_ && (i + 1 == runs_.size()))
+            os << " running";
+        else
+            os << " recoveryMs:" << run.recoveryMs << (run.completed ? "" : (run.interrupted ? " interrupted" : " incomplete"));
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "EventLoop.h"
+
+////////////////////////////////////////////////////////////////////////////
+//RecoveryParams
+
+struct RecoveryParams
+{
+    uint32_t registerRate = 100;   //Registrations per second
+    uint32_t jitterMs = 1000;      //Random delay before recovery starts (0 - none)
+    uint32_t timeoutSec = 60;      //Time given to registrations to be confirmed after the last one sent
+    bool renegotiate = true;       //Re-INVITE connected calls
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//NetworkRecovery
+//Coordinates recovery after change of network reported by OnNetworkState. While network is
+//lost originations are held off (see 'holdOriginations'). When it's restored or switched,
+//after random delay (processes and hosts don't start at once) connected calls are
+//renegotiated at once and all accounts are registered again with 'registerRate': accounts
+//which have calls first, order inside of each group is shuffled. Recovery completes when each
+//registration is confirmed or failed; time since network came back and size of the storm
+//(requests sent, peak per second) are reported. Invoked on the loop thread.
+
+struct RecoveryRun
+{
+    Siprix::NetworkState state = Siprix::NetworkState::NetworkRestored;//Which started recovery
+    std::string name;              //Of network
+    uint64_t lostMs = 0;           //Network was lost before (0 - switched without loss)
+    uint32_t delayMs = 0;          //Jitter
+    size_t accounts = 0;
+    size_t priorityAccounts = 0;   //Accounts with calls, registered first
+    size_t calls = 0;              //Connected calls
+    size_t registrations = 0;      //Requests sent
+    size_t registered = 0;         //Confirmed
+    size_t regFailed = 0;          //Request returned error or registration failed
+    size_t renegotiated = 0;
+    size_t renegotiateErrors = 0;
+    uint32_t peakPerSec = 0;       //Requests (registrations and re-INVITEs) sent in the busiest second
+    uint64_t recoveryMs = 0;       //Since network came back till the last registration confirmed
+    bool completed = false;        //All confirmed
+    bool interrupted = false;      //Network lost/changed again or recovery stopped
+};
+
+class NetworkRecovery
+{
+public:
+    //Call or account of the module (ids are unique only inside of module)
+    struct Item {
+        uint8_t module;
+        uint32_t id;
+    };
+
+    struct Actions {
+        //Accounts with calls first ('priority' of them) and connected calls
+        std::function<void(std::vector<Item>& accounts, size_t& priority, std::vector<Item>& calls)> collect;
+        std::function<Siprix::ErrorCode(const Item& account)> registration;//With own expire time of the account
+        std::function<Siprix::ErrorCode(const Item& call)> renegotiate;
+        std::function<void(bool hold)> holdOriginations;
+    };
+
+    NetworkRecovery(EventLoop& loop) : loop_(loop), random_(std::random_device()()) {}
+    ~NetworkRecovery() { cancelTimers(); }
+
+    void setup(const RecoveryParams& params, const Actions& actions) { params_ = params; actions_ = actions; }
+    const RecoveryParams& params() const { return params_; }
+
+    void onNetworkState(const char* name, Siprix::NetworkState state);
+    void onAccountRegState(uint8_t module, Siprix::AccountId accId, Siprix::RegState state);
+
+    //Starts recovery without network change (as if network was switched)
+    void recover(const std::string& name);
+    void stop();
+
+    bool isNetworkLost() const { return lost_; }
+    bool isRecovering() const { return running_; }
+    uint64_t networkEvents() const { return networkEvents_; }
+    const std::vector<RecoveryRun>& runs() const { return runs_; }
+    void print(std::ostream& os) const;
+
+protected:
+    static uint64_t key(uint8_t module, uint32_t id) { return (static_cast<uint64_t>(module) << 32) | id; }
+
+    void start(Siprix::NetworkState state, const std::string& name, uint64_t lostMs);
+    void begin();
+    void tick();
+    void finish(bool interrupted);
+    void cancelTimers();
+
+    EventLoop& loop_;
+    RecoveryParams params_;
+    Actions actions_;
+    std::mt19937 random_;
+
+    bool lost_ = false;
+    EventLoop::Clock::time_point lostAt_;
+    uint64_t networkEvents_ = 0;
+
+    //Current run
+    bool running_ = false;
+    EventLoop::Clock::time_point restoredAt_;
+    EventLoop::TimerId delayTimer_ = 0;
+    EventLoop::TimerId tickTimer_ = 0;
+    EventLoop::TimerId deadlineTimer_ = 0;
+    std::vector<Item> calls_;
+    std::vector<Item> accounts_;
+    size_t nextAccount_ = 0;
+    double credit_ = 0;
+    EventLoop::Clock::time_point lastTick_;
+    EventLoop::Clock::time_point secondStarted_;
+    uint32_t sentInSecond_ = 0;
+    std::unordered_set<uint64_t> pendingAccounts_;//Request sent, waiting for confirmation
+
+    std::vector<RecoveryRun> runs_;
+};
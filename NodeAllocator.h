@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+////////////////////////////////////////////////////////////////////////////
+//NodeAllocator
+//Allocator of node based containers (set, map, unordered_*) which keeps freed nodes in the
+//list of the thread and gives them to the next insert, so container which is filled and
+//emptied by each call doesn't allocate once it reached its peak size. Arrays (buckets) are
+//allocated as usual. List is per node type and thread, nodes are kept until process exits.
+
+template<typename T>
+class NodeAllocator
+{
+public:
+    typedef T value_type;
+
+    NodeAllocator() noexcept {}
+    template<typename U> NodeAllocator(const NodeAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        if ((n == 1) && freeNodes)
+        {
+            FreeNode* node = freeNodes;
+            freeNodes = node->next;
+            return reinterpret_cast<T*>(node);
+        }
+        return static_cast<T*>(::operator new(((n == 1) ? kNodeSize : n * sizeof(T))));
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept
+    {
+        if (n != 1)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+        FreeNode* node = reinterpret_cast<FreeNode*>(ptr);
+        node->next = freeNodes;
+        freeNodes = node;
+    }
+
+    template<typename U> bool operator==(const NodeAllocator<U>&) const noexcept { return true; }
+    template<typename U> bool operator!=(const NodeAllocator<U>&) const noexcept { return false; }
+
+protected:
+    struct FreeNode {
+        FreeNode* next;
+    };
+    static constexpr size_t kNodeSize = (sizeof(T) < sizeof(FreeNode)) ? sizeof(FreeNode) : sizeof(T);
+
+    static thread_local FreeNode* freeNodes;
+};
+
+template<typename T>
+thread_local typename NodeAllocator<T>::FreeNode* NodeAllocator<T>::freeNodes = nullptr;
@@ -0,0 +1,155 @@
+#include "ProcStats.h"
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//Parses 'utime' and 'stime' fields of /proc/.../stat
+static uint64_t readStatCpuMs(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return 0;
+
+    char buf[1024];
+    const size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    //Name of the thread may contain spaces - skip it by the last ')'
+    const char* p = strrchr(buf, ')');
+    if (!p)
+        return 0;
+
+    //Fields after name start from 'state' (3rd), utime/stime are 14th and 15th
+    unsigned long long utime = 0, stime = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+        return 0;
+
+    static const long ticksPerSec = sysconf(_SC_CLK_TCK);
+    return (utime + stime) * 1000 / static_cast<uint64_t>(ticksPerSec > 0 ? ticksPerSec : 100);
+}
+
+std::vector<int> procListThreads()
+{
+    std::vector<int> tids;
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir)
+        return tids;
+
+    while (const dirent* entry = readdir(dir))
+    {
+        const int tid = atoi(entry->d_name);
+        if (tid > 0) tids.push_back(tid);
+    }
+    closedir(dir);
+    return tids;
+}
+
+uint64_t procThreadCpuMs(int tid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    return readStatCpuMs(path);
+}
+
+uint64_t procCpuMs()
+{
+    return readStatCpuMs("/proc/self/stat");
+}
+
+bool procSystemCpu(uint64_t& busy, uint64_t& total)
+{
+    FILE* f = fopen("/proc/stat", "r");
+    if (!f)
+        return false;
+
+    //First line sums all cores: user nice system idle iowait irq softirq steal
+    unsigned long long v[8] = {};
+    const int n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+    fclose(f);
+    if (n < 4)
+        return false;
+
+    total = 0;
+    for (unsigned long long value : v)
+        total += value;
+    busy = total - v[3] - v[4];//Without idle and iowait
+    return true;
+}
+
+//Value of the field of /proc/self/status ('format' is like "VmRSS: %llu kB")
+static uint64_t readStatusField(const char* format)
+{
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f)
+        return 0;
+
+    unsigned long long value = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, format, &value) == 1)
+            break;
+    }
+    fclose(f);
+    return value;
+}
+
+uint64_t procRssKb()
+{
+    return readStatusField("VmRSS: %llu kB");
+}
+
+uint64_t procThreadsCount()
+{
+    return readStatusField("Threads: %llu");
+}
+
+uint64_t procOpenFds()
+{
+    DIR* dir = opendir("/proc/self/fd");
+    if (!dir)
+        return 0;
+
+    uint64_t count = 0;
+    while (const dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.') ++count;
+    }
+    closedir(dir);
+    return (count > 0) ? count - 1 : 0;//Without descriptor of 'dir'
+}
+
+uint64_t procHeapKb()
+{
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+    const struct mallinfo2 info = mallinfo2();
+    return (info.uordblks + info.hblkhd) / 1024;
+#elif defined(__GLIBC__)
+    const struct mallinfo info = mallinfo();//Fields wrap above 2GB
+    return (static_cast<uint64_t>(static_cast<unsigned>(info.uordblks)) + static_cast<unsigned>(info.hblkhd)) / 1024;
+#else
+    return 0;
+#endif
+}
+
+#else
+
+std::vector<int> procListThreads() { return std::vector<int>(); }
+uint64_t procThreadCpuMs(int)      { return 0; }
+uint64_t procCpuMs()               { return 0; }
+bool procSystemCpu(uint64_t&, uint64_t&) { return false; }
+uint64_t procRssKb()               { return 0; }
+uint64_t procThreadsCount()        { return 0; }
+uint64_t procOpenFds()             { return 0; }
+uint64_t procHeapKb()              { return 0; }
+
+#endif
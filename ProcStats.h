@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////
+//ProcStats
+//Resource usage of the current process, read from /proc.
+//On platforms without /proc functions return empty values.
+
+//Ids of the threads of the process
+std::vector<int> procListThreads();
+
+//CPU time (user + system) consumed by thread/process in milliseconds
+uint64_t procThreadCpuMs(int tid);
+uint64_t procCpuMs();
+
+//CPU time of all cores (busy and total, in ticks of /proc/stat), false - not available
+bool procSystemCpu(uint64_t& busy, uint64_t& total);
+
+//Resident set size of the process in kilobytes
+uint64_t procRssKb();
+
+//Number of threads and open file descriptors of the process
+uint64_t procThreadsCount();
+uint64_t procOpenFds();
+
+//Memory allocated by malloc (in use, including mmap-ed blocks) in kilobytes, 0 - not glibc
+uint64_t procHeapKb();
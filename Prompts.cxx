@@ -0,0 +1,391 @@
+#include "Prompts.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////
+//File helpers
+
+static bool hasMp3Ext(const std::string& path)
+{
+    if (path.size() < 4)
+        return false;
+    std::string ext = path.substr(path.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(::tolower(c)); });
+    return ext == ".mp3";
+}
+
+//ID3v2 tag or MPEG audio frame sync (11 bits set)
+static bool hasMp3Magic(const unsigned char* hdr, size_t len)
+{
+    if ((len >= 3) && !memcmp(hdr, "ID3", 3))
+        return true;
+    return (len >= 2) && (hdr[0] == 0xFF) && ((hdr[1] & 0xE0) == 0xE0);
+}
+
+static std::string fileStem(const std::string& name)
+{
+    const size_t dot = name.rfind('.');
+    return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+//Maps file and asks kernel to read it ahead. Mapping is kept while catalog exists.
+static void* prefetchFile(const std::string& path, uint64_t size)
+{
+#ifdef _WIN32
+    (void)path; (void)size;
+    return nullptr;
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+    madvise(data, size, MADV_WILLNEED);
+    return data;
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//PromptCatalog
+
+PromptCatalog::~PromptCatalog()
+{
+#ifndef _WIN32
+    for (const auto& p : prompts_)
+    {
+        if (p->mapping)
+            munmap(p->mapping, p->size);
+    }
+#endif
+}
+
+Siprix::ErrorCode PromptCatalog::validate(const std::string& path, std::string& err)
+{
+    if (!hasMp3Ext(path))
+    {
+        err = "file '" + path + "' has to have '.mp3' extension";
+        return Siprix::EFileExtMp3Expected;
+    }
+
+    struct stat st;
+    if ((stat(path.c_str(), &st) != 0) || !((st.st_mode & S_IFMT) == S_IFREG))
+    {
+        err = "file '" + path + "' doesn't exist";
+        return Siprix::EFileDoesntExists;
+    }
+
+    unsigned char hdr[4] = { 0 };
+    size_t len = 0;
+    if (FILE* f = fopen(path.c_str(), "rb"))
+    {
+        len = fread(hdr, 1, sizeof(hdr), f);
+        fclose(f);
+    }
+    else
+    {
+        err = "can't open file '" + path + "': " + strerror(errno);
+        return Siprix::EFileDoesntExists;
+    }
+
+    if (!hasMp3Magic(hdr, len))
+    {
+        err = "file '" + path + "' isn't mp3 (no ID3 tag or frame header)";
+        return Siprix::EFileExtMp3Expected;
+    }
+    return Siprix::EOK;
+}
+
+bool PromptCatalog::add(const std::string& name, const std::string& path, std::string& err)
+{
+    if (name.empty())
+    {
+        err = "empty name of prompt '" + path + "'";
+        return false;
+    }
+    if (byName_.count(name) || playlists_.count(name))
+    {
+        err = "duplicate prompt name '" + name + "'";
+        return false;
+    }
+    if (validate(path, err) != Siprix::EOK)
+        return false;
+
+    struct stat st;
+    stat(path.c_str(), &st);
+
+    std::unique_ptr<Prompt> prompt(new Prompt);
+    prompt->name = name;
+    prompt->path = path;
+    prompt->size = static_cast<uint64_t>(st.st_size);
+    prompt->mapping = prefetchFile(path, prompt->size);
+    if (prompt->mapping)
+        mappedBytes_ += prompt->size;
+
+    byName_[name] = prompt.get();
+    prompts_.push_back(std::move(prompt));
+    return true;
+}
+
+bool PromptCatalog::addFolder(const std::string& folder, std::string& err)
+{
+    std::vector<std::string> files;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileA((folder + "\\*.mp3").c_str(), &data);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        err = "can't read folder '" + folder + "'";
+        return false;
+    }
+    do {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            files.push_back(data.cFileName);
+    } while (FindNextFileA(h, &data));
+    FindClose(h);
+#else
+    DIR* dir = opendir(folder.c_str());
+    if (!dir)
+    {
+        err = "can't read folder '" + folder + "': " + strerror(errno);
+        return false;
+    }
+    while (const dirent* entry = readdir(dir))
+    {
+        if ((entry->d_name[0] != '.') && hasMp3Ext(entry->d_name))
+            files.push_back(entry->d_name);
+    }
+    closedir(dir);
+#endif
+
+    //Same order on all platforms/filesystems
+    std::sort(files.begin(), files.end());
+    for (const std::string& file : files)
+    {
+        if (!add(fileStem(file), folder + "/" + file, err))
+            return false;
+    }
+    return true;
+}
+
+bool PromptCatalog::addPlaylist(const std::string& name, const std::vector<std::string>& prompts, std::string& err)
+{
+    if (name.empty() || prompts.empty())
+    {
+        err = "playlist '" + name + "' has no name or prompts";
+        return false;
+    }
+    if (byName_.count(name) || playlists_.count(name))
+    {
+        err = "duplicate playlist name '" + name + "'";
+        return false;
+    }
+
+    std::vector<Prompt*> items;
+    for (const std::string& p : prompts)
+    {
+        Prompt* prompt = find(p);
+        if (!prompt)
+        {
+            err = "playlist '" + name + "' refers unknown prompt '" + p + "'";
+            return false;
+        }
+        items.push_back(prompt);
+    }
+    playlists_[name] = std::move(items);
+    return true;
+}
+
+Prompt* PromptCatalog::find(const std::string& name) const
+{
+    auto it = byName_.find(name);
+    return (it != byName_.end()) ? it->second : nullptr;
+}
+
+const std::vector<Prompt*>* PromptCatalog::findPlaylist(const std::string& name) const
+{
+    auto it = playlists_.find(name);
+    return (it != playlists_.end()) ? &it->second : nullptr;
+}
+
+Siprix::ErrorCode PromptCatalog::resolve(const std::string& nameOrPath, std::vector<Prompt*>& items, std::string& err)
+{
+    items.clear();
+    if (Prompt* prompt = find(nameOrPath))
+    {
+        items.push_back(prompt);
+        return Siprix::EOK;
+    }
+    if (const std::vector<Prompt*>* playlist = findPlaylist(nameOrPath))
+    {
+        items = *playlist;
+        return Siprix::EOK;
+    }
+
+    //Path of the file, which isn't in catalog yet - it's name is the path
+    const Siprix::ErrorCode result = validate(nameOrPath, err);
+    if ((result == Siprix::EFileExtMp3Expected) && !hasMp3Ext(nameOrPath))
+        err = "unknown prompt or playlist '" + nameOrPath + "'";
+    if (result != Siprix::EOK)
+        return result;
+    if (!add(nameOrPath, nameOrPath, err))
+        return Siprix::EFileDoesntExists;
+    items.push_back(prompts_.back().get());
+    return Siprix::EOK;
+}
+
+void PromptCatalog::print(std::ostream& os) const
+{
+    os << "prompts:" << prompts_.size() << " playlists:" << playlists_.size()
+       << " prefetchedKb:" << mappedBytes_ / 1024;
+
+    for (const auto& p : prompts_)
+    {
+        if (!p->attempts)
+            continue;
+        os << "\n      " << p->name << " attempts:" << p->attempts << " plays:" << p->plays
+           << " completed:" << p->completed << " interrupted:" << p->interrupted << " failures:" << p->failures
+           << " (" << (100 * p->failures / p->attempts) << "%)";
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//PlayerRegistry
+
+Siprix::ErrorCode PlayerRegistry::play(uint8_t module, Siprix::CallId callId, const std::vector<Prompt*>& items,
+                                       bool loop, Siprix::PlayerId& playbackId)
+{
+    if (items.empty())
+        return Siprix::EArgumentNull;
+
+    Playback pb;
+    pb.module = module;
+    pb.callId = callId;
+    pb.items = items;
+    pb.loop = loop;
+
+    Siprix::ErrorCode err = Siprix::EOK;
+    if (!startCurrent(pb, err))
+        return err;
+
+    pb.id = pb.player;
+    playbackId = pb.id;
+    const uint64_t k = key(module, pb.id);
+    players_[k] = k;
+    playbacks_[k] = std::move(pb);
+    return Siprix::EOK;
+}
+
+bool PlayerRegistry::startCurrent(Playback& pb, Siprix::ErrorCode& err)
+{
+    Prompt& prompt = *pb.items[pb.current];
+
+    //Single prompt is looped by SDK itself
+    const bool sdkLoop = pb.loop && (pb.items.size() == 1);
+    ++prompt.attempts;
+    err = play_(pb.module, pb.callId, prompt, sdkLoop, pb.player);
+    if (err != Siprix::EOK)
+    {
+        ++prompt.failures;
+        return false;
+    }
+    ++prompt.plays;
+    return true;
+}
+
+Siprix::ErrorCode PlayerRegistry::stop(uint8_t module, Siprix::PlayerId playbackId)
+{
+    auto it = playbacks_.find(key(module, playbackId));
+    if (it == playbacks_.end())
+        return stop_(module, playbackId);//Not started by registry
+
+    const Playback& pb = it->second;
+    ++pb.items[pb.current]->interrupted;
+    const Siprix::ErrorCode err = stop_(module, pb.player);
+    remove(it->first);
+    return err;
+}
+
+void PlayerRegistry::onPlayerState(uint8_t module, Siprix::PlayerId playerId, Siprix::PlayerState state)
+{
+    if (state == Siprix::PlayerState::PlayerStarted)
+        return;
+
+    auto pit = players_.find(key(module, playerId));
+    if (pit == players_.end())
+        return;
+
+    const uint64_t pbKey = pit->second;
+    players_.erase(pit);
+    Playback& pb = playbacks_[pbKey];
+
+    if (state == Siprix::PlayerState::PlayerFailed)
+    {
+        ++pb.items[pb.current]->failures;
+        playbacks_.erase(pbKey);
+        return;
+    }
+
+    ++pb.items[pb.current]->completed;
+    if (++pb.current == pb.items.size())
+    {
+        if (!pb.loop || (pb.items.size() == 1))
+        {
+            playbacks_.erase(pbKey);
+            return;
+        }
+        pb.current = 0;
+    }
+
+    Siprix::ErrorCode err = Siprix::EOK;
+    if (!startCurrent(pb, err))
+    {
+        playbacks_.erase(pbKey);
+        return;
+    }
+    players_[key(module, pb.player)] = pbKey;
+}
+
+void PlayerRegistry::onCallTerminated(uint8_t module, Siprix::CallId callId)
+{
+    std::vector<uint64_t> keys;
+    for (const auto& it : playbacks_)
+    {
+        if ((it.second.module == module) && (it.second.callId == callId))
+            keys.push_back(it.first);
+    }
+
+    for (uint64_t k : keys)
+    {
+        const Playback& pb = playbacks_[k];
+        ++pb.items[pb.current]->interrupted;
+        stop_(module, pb.player);
+        remove(k);
+    }
+}
+
+void PlayerRegistry::remove(uint64_t playbackKey)
+{
+    auto it = playbacks_.find(playbackKey);
+    if (it == playbacks_.end())
+        return;
+    players_.erase(key(it->second.module, it->second.player));
+    playbacks_.erase(it);
+}
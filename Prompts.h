@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+////////////////////////////////////////////////////////////////////////////
+//Prompt
+//Mp3 file which is played to calls. Counters are updated on the loop thread.
+
+struct Prompt
+{
+    std::string name;
+    std::string path;
+    uint64_t size = 0;
+    void* mapping = nullptr;//Content mapped on load, so it's in the page cache before the first call
+
+    uint64_t attempts = 0;   //Call_PlayFile invoked
+    uint64_t plays = 0;      //Started by SDK
+    uint64_t failures = 0;   //Rejected by SDK or PlayerFailed
+    uint64_t completed = 0;  //Played till the end
+    uint64_t interrupted = 0;//Stopped by command or call termination
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//PromptCatalog
+//Named prompts and playlists. Files are validated when added (SDK requires existing file
+//with '.mp3' extension), so bad files are reported on start instead of failing calls.
+
+class PromptCatalog
+{
+public:
+    PromptCatalog() {}
+    ~PromptCatalog();
+    PromptCatalog(const PromptCatalog&) = delete;
+    PromptCatalog& operator=(const PromptCatalog&) = delete;
+
+    //Returns EOK or SDK error which Call_PlayFile would return for this file (details in 'err')
+    static Siprix::ErrorCode validate(const std::string& path, std::string& err);
+
+    //Validates file and prefetches its content (mmap + MADV_WILLNEED)
+    bool add(const std::string& name, const std::string& path, std::string& err);
+
+    //Adds all *.mp3 files of the folder, name of prompt is file name without extension
+    bool addFolder(const std::string& folder, std::string& err);
+
+    //Playlist refers to the prompts, which have to be added before
+    bool addPlaylist(const std::string& name, const std::vector<std::string>& prompts, std::string& err);
+
+    Prompt* find(const std::string& name) const;
+    const std::vector<Prompt*>* findPlaylist(const std::string& name) const;
+
+    //Resolves name of prompt/playlist or path of file (added to catalog on the first use)
+    Siprix::ErrorCode resolve(const std::string& nameOrPath, std::vector<Prompt*>& items, std::string& err);
+
+    const std::vector<std::unique_ptr<Prompt>>& prompts() const { return prompts_; }
+    size_t playlistsCount() const { return playlists_.size(); }
+    uint64_t mappedBytes() const { return mappedBytes_; }
+
+    void print(std::ostream& os) const;
+
+protected:
+    std::vector<std::unique_ptr<Prompt>> prompts_;
+    std::unordered_map<std::string, Prompt*> byName_;
+    std::unordered_map<std::string, std::vector<Prompt*>> playlists_;
+    uint64_t mappedBytes_ = 0;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//PlayerRegistry
+//Tracks players started by SDK: which call and prompt each PlayerId belongs to.
+//Plays playlists (next prompt is started when previous one stopped) and stops
+//all players of the call when it's terminated. Invoked on the loop thread.
+
+class PlayerRegistry
+{
+public:
+    typedef std::function<Siprix::ErrorCode(uint8_t module, Siprix::CallId callId, const Prompt& prompt,
+                                            bool loop, Siprix::PlayerId& playerId)> PlayFn;
+    typedef std::function<Siprix::ErrorCode(uint8_t module, Siprix::PlayerId playerId)> StopFn;
+
+    PlayerRegistry(PlayFn play, StopFn stop) : play_(play), stop_(stop) {}
+
+    //Plays prompts one by one ('loop' - repeat them till stopped).
+    //Returns id of the playback (PlayerId of the first prompt), which is accepted by 'stop'.
+    Siprix::ErrorCode play(uint8_t module, Siprix::CallId callId, const std::vector<Prompt*>& items,
+                           bool loop, Siprix::PlayerId& playbackId);
+
+    //Stops playback and cancels remaining prompts of its playlist
+    Siprix::ErrorCode stop(uint8_t module, Siprix::PlayerId playbackId);
+
+    void onPlayerState(uint8_t module, Siprix::PlayerId playerId, Siprix::PlayerState state);
+    void onCallTerminated(uint8_t module, Siprix::CallId callId);
+
+    size_t activeCount() const { return playbacks_.size(); }
+
+protected:
+    struct Playback {
+        uint8_t module = 0;
+        Siprix::CallId callId = 0;
+        Siprix::PlayerId id = 0;    //PlayerId of the first prompt
+        Siprix::PlayerId player = 0;//PlayerId of the current prompt
+        std::vector<Prompt*> items;
+        size_t current = 0;
+        bool loop = false;
+    };
+
+    static uint64_t key(uint8_t module, uint32_t id) { return (static_cast<uint64_t>(module) << 32) | id; }
+
+    bool startCurrent(Playback& pb, Siprix::ErrorCode& err);
+    void remove(uint64_t playbackKey);
+
+    PlayFn play_;
+    StopFn stop_;
+    std::unordered_map<uint64_t, Playback> playbacks_;//By module and playback id
+    std::unordered_map<uint64_t, uint64_t> players_;  //Current PlayerId -> key of playback
+};
@@ -0,0 +1,471 @@
+#include "RecordingManager.h"
+#include "Wav.h"
+
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define mkdir(path, mode) _mkdir(path)
+#define getpid _getpid
+#else
+#include <sys/statvfs.h>
+#include <unistd.h>
+#endif
+
+//Space accounted for active recording when preallocation is disabled
+static const uint64_t kMinReserveBytes = 1024 * 1024;
+
+static const uint64_t kMb = 1024 * 1024;
+
+////////////////////////////////////////////////////////////////////////////
+//WAV helpers
+
+//Updates sizes in header to match file size
+static void fixWavHeader(FILE* f, uint64_t fileSize, const WavInfo& info)
+{
+    const uint32_t riffSize = static_cast<uint32_t>(fileSize - 8);
+    const uint32_t dataSize = static_cast<uint32_t>(info.dataSize);
+    if (info.riffSizeField != riffSize)
+    {
+        fseek(f, 4, SEEK_SET);
+        fwrite(&riffSize, 4, 1, f);
+    }
+    if (info.dataSizeField != dataSize)
+    {
+        fseek(f, static_cast<long>(info.dataOffset - 4), SEEK_SET);
+        fwrite(&dataSize, 4, 1, f);
+    }
+}
+
+static uint8_t linearToUlaw(int16_t pcm)
+{
+    const int kBias = 0x84;
+    const int kClip = 32635;
+    const int sign = (pcm < 0) ? 0x80 : 0;
+    int sample = sign ? -static_cast<int>(pcm) : pcm;
+    if (sample > kClip) sample = kClip;
+    sample += kBias;
+
+    int exponent = 7;
+    for (int mask = 0x4000; !(sample & mask) && (exponent > 0); mask >>= 1)
+        --exponent;
+    const int mantissa = (sample >> (exponent + 3)) & 0x0F;
+    return static_cast<uint8_t>(~(sign | (exponent << 4) | mantissa));
+}
+
+//Writes mu-law copy of PCM16 file to 'dstPath'. Returns size of the new file (0 - failed).
+static uint64_t compressWav(FILE* src, const WavInfo& info, const std::string& dstPath)
+{
+    FILE* dst = fopen(dstPath.c_str(), "wb");
+    if (!dst)
+        return 0;
+
+    const uint32_t samples  = static_cast<uint32_t>(info.dataSize / 2);
+    const uint32_t frames   = samples / info.channels;
+    const uint16_t format   = eWavMulaw;
+    const uint16_t bits     = 8;
+    const uint16_t cbSize   = 0;
+    const uint32_t byteRate = info.sampleRate * info.channels;
+    const uint32_t fmtSize  = 18;
+    const uint32_t factSize = 4;
+    const uint32_t riffSize = 4 + (8 + fmtSize) + (8 + factSize) + (8 + samples) + (samples & 1);
+
+    fwrite("RIFF", 1, 4, dst); fwrite(&riffSize, 4, 1, dst); fwrite("WAVE", 1, 4, dst);
+    fwrite("fmt ", 1, 4, dst); fwrite(&fmtSize, 4, 1, dst);
+    fwrite(&format, 2, 1, dst); fwrite(&info.channels, 2, 1, dst); fwrite(&info.sampleRate, 4, 1, dst);
+    fwrite(&byteRate, 4, 1, dst); fwrite(&info.channels, 2, 1, dst); fwrite(&bits, 2, 1, dst); fwrite(&cbSize, 2, 1, dst);
+    fwrite("fact", 1, 4, dst); fwrite(&factSize, 4, 1, dst); fwrite(&frames, 4, 1, dst);
+    fwrite("data", 1, 4, dst); fwrite(&samples, 4, 1, dst);
+
+    fseek(src, static_cast<long>(info.dataOffset), SEEK_SET);
+    int16_t in[4096];
+    uint8_t out[4096];
+    size_t left = samples;
+    while (left > 0)
+    {
+        const size_t n = fread(in, 2, (left < 4096) ? left : 4096, src);
+        if (n == 0)
+            break;
+        for (size_t i = 0; i < n; ++i)
+            out[i] = linearToUlaw(in[i]);
+        fwrite(out, 1, n, dst);
+        left -= n;
+    }
+    if (samples & 1)
+        fputc(0, dst);
+
+    const bool ok = (left == 0) && !ferror(dst);
+    const long size = ftell(dst);
+    if ((fclose(dst) != 0) || !ok)
+    {
+        remove(dstPath.c_str());
+        return 0;
+    }
+    return static_cast<uint64_t>(size);
+}
+
+static uint32_t hashName(const std::string& name)
+{
+    uint32_t h = 2166136261u;//FNV-1a
+    for (char ch : name)
+        h = (h ^ static_cast<uint8_t>(ch)) * 16777619u;
+    return h;
+}
+
+static uint64_t fileSize(const std::string& path)
+{
+    struct stat st;
+    return (stat(path.c_str(), &st) == 0) ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//RecordingManager
+
+bool RecordingManager::start(const RecordingParams& params, std::string& err)
+{
+    params_ = params;
+    if (!makeFolder(params_.folder))
+    {
+        err = "Can't create folder of recordings '" + params_.folder + "': " + strerror(errno);
+        return false;
+    }
+
+    indexPath_ = params_.folder + "/index.tsv";
+    readIndex();
+
+    stopping_ = false;
+    for (uint32_t i = 0; i < (params_.workers ? params_.workers : 1); ++i)
+        workers_.emplace_back([this]() { runWorker(); });
+    return true;
+}
+
+void RecordingManager::stop()
+{
+    if (workers_.empty())
+        return;
+
+    //SDK has already closed files, so remaining recordings are finalized without delay
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& item : active_)
+        {
+            markStopped(item.second);
+            queue_.push_back(item.second);
+        }
+        stopping_ = true;
+    }
+    active_.clear();
+    cond_.notify_all();
+
+    for (std::thread& worker : workers_)
+        worker.join();
+    workers_.clear();
+}
+
+bool RecordingManager::makeFolder(const std::string& path)
+{
+    if (path.empty() || folders_.count(path))
+        return true;
+
+    //Create parents first
+    const size_t pos = path.find_last_of("/\\");
+    if ((pos != std::string::npos) && (pos > 0) && !makeFolder(path.substr(0, pos)))
+        return false;
+
+    if ((mkdir(path.c_str(), 0755) != 0) && (errno != EEXIST))
+        return false;
+
+    folders_.insert(path);
+    return true;
+}
+
+//Index is appended by workers, so it contains sizes of all finalized recordings
+//(files removed manually are still counted till index is cleaned up).
+void RecordingManager::readIndex()
+{
+    FILE* f = fopen(indexPath_.c_str(), "r");
+    if (!f)
+        return;
+
+    char line[4096];
+    uint64_t used = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        //Columns: time, module, callId, durationMs, bytes, compressed, path
+        unsigned long long bytes = 0;
+        if (sscanf(line, "%*s %*u %*u %*u %llu", &bytes) == 1)
+            used += bytes;
+    }
+    fclose(f);
+    usedBytes_ = used;
+}
+
+bool RecordingManager::begin(uint8_t module, Siprix::CallId callId, std::string& path, std::string& err)
+{
+    if (active_.count(key(module, callId)))
+    {
+        err = "Call is already recorded";
+        return false;
+    }
+
+    //Back-pressure: refuse before disk fills, not when writing fails in the middle of call
+    const uint64_t reserve = params_.preallocateMb ? params_.preallocateMb * kMb : kMinReserveBytes;
+    if (params_.quotaMb && (usedBytes_ + reservedBytes_ + reserve > params_.quotaMb * kMb))
+    {
+        ++refused_;
+        err = "Quota of recordings exceeded";
+        return false;
+    }
+#ifndef _WIN32
+    struct statvfs vfs;
+    if ((statvfs(params_.folder.c_str(), &vfs) == 0) &&
+        (static_cast<uint64_t>(vfs.f_bavail) * vfs.f_frsize < params_.minFreeMb * kMb + reserve))
+    {
+        ++refused_;
+        err = "Not enough free disk space for recording";
+        return false;
+    }
+#endif
+
+    //Unique name (survives restarts and works for several processes writing to the same folder)
+    const auto now = std::chrono::system_clock::now();
+    const time_t t = std::chrono::system_clock::to_time_t(now);
+    struct tm tm;
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    char day[16], hour[4], stamp[32];
+    strftime(day,   sizeof(day),   "%Y-%m-%d", &tm);
+    strftime(hour,  sizeof(hour),  "%H", &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+    const std::string name = std::string(stamp) + "-" + std::to_string(getpid()) + "-m" + std::to_string(module)
+                           + "-c" + std::to_string(callId) + "-" + std::to_string(++seq_) + ".wav";
+    char shard[4];
+    snprintf(shard, sizeof(shard), "%02x", hashName(name) & 0xFF);
+
+    const std::string folder = params_.folder + "/" + day + "/" + hour + "/" + shard;
+    if (!makeFolder(folder))
+    {
+        ++failed_;
+        err = "Can't create folder '" + folder + "': " + strerror(errno);
+        return false;
+    }
+    path = folder + "/" + name;
+
+    FILE* f = fopen(path.c_str(), "wbx");
+    if (!f)
+    {
+        ++failed_;
+        err = "Can't create file '" + path + "': " + strerror(errno);
+        return false;
+    }
+    bool preallocated = false;
+    uint64_t reserved = reserve;
+#ifdef __linux__
+    //Reserve space without changing file size, so data is written from the beginning of the file.
+    //When it fails recording is counted like without preallocation.
+    if (params_.preallocateMb)
+    {
+        preallocated = (fallocate(fileno(f), FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(reserve)) == 0);
+        if (!preallocated)
+        {
+            ++preallocFailed_;
+            reserved = kMinReserveBytes;
+        }
+    }
+#endif
+    fclose(f);
+
+    Recording& rec = active_[key(module, callId)];
+    rec.module = module;
+    rec.callId = callId;
+    rec.path = path;
+    rec.reservedBytes = reserved;
+    rec.preallocated = preallocated;
+    rec.started = now;
+    reservedBytes_ += reserved;
+    return true;
+}
+
+void RecordingManager::cancel(uint8_t module, Siprix::CallId callId)
+{
+    auto it = active_.find(key(module, callId));
+    if (it == active_.end())
+        return;
+
+    remove(it->second.path.c_str());
+    reservedBytes_ -= it->second.reservedBytes;
+    active_.erase(it);
+}
+
+bool RecordingManager::finish(uint8_t module, Siprix::CallId callId)
+{
+    auto it = active_.find(key(module, callId));
+    if (it == active_.end())
+        return false;
+
+    markStopped(it->second);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(it->second);
+    }
+    cond_.notify_one();
+    active_.erase(it);
+    return true;
+}
+
+void RecordingManager::markStopped(Recording& rec)
+{
+    rec.stopped = std::chrono::steady_clock::now();
+    rec.durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - rec.started).count();
+}
+
+size_t RecordingManager::queuedCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+void RecordingManager::runWorker()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        if (queue_.empty())
+        {
+            if (stopping_)
+                return;
+            cond_.wait(lock);
+            continue;
+        }
+
+        //Recordings are queued in order of stopping, so the first one is ready first
+        const auto ready = queue_.front().stopped + std::chrono::milliseconds(params_.finalizeDelayMs);
+        if (!stopping_ && (std::chrono::steady_clock::now() < ready))
+        {
+            cond_.wait_until(lock, ready);
+            continue;
+        }
+
+        const Recording rec = queue_.front();
+        queue_.pop_front();
+        lock.unlock();
+        finalize(rec);
+        lock.lock();
+    }
+}
+
+void RecordingManager::finalize(const Recording& rec)
+{
+    reservedBytes_ -= rec.reservedBytes;
+
+    uint64_t size = fileSize(rec.path);
+    if (size == 0)
+    {
+        //SDK didn't write anything (call ended before media started)
+        remove(rec.path.c_str());
+        ++failed_;
+        return;
+    }
+
+#ifdef __linux__
+    //Release preallocated space after the end of data. SDK opens the file itself and its flags
+    //can't be checked: if it truncated the file (O_TRUNC), space beyond the end was freed then
+    //and reservation didn't protect recording. It's detected by allocated blocks and counted
+    //('preallocLost' - preallocation has no effect with this SDK, disable it).
+    if (rec.preallocated && (size < rec.reservedBytes))
+    {
+        struct stat st;
+        if ((stat(rec.path.c_str(), &st) == 0) && (static_cast<uint64_t>(st.st_blocks) * 512 < rec.reservedBytes))
+        {
+            ++preallocLost_;
+        }
+        else
+        {
+            const int fd = open(rec.path.c_str(), O_WRONLY);
+            if (fd >= 0)
+            {
+                fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(size),
+                          static_cast<off_t>(rec.reservedBytes - size));
+                close(fd);
+            }
+        }
+    }
+#endif
+
+    bool compressed = false;
+    FILE* f = fopen(rec.path.c_str(), "r+b");
+    if (f)
+    {
+        WavInfo info;
+        if (readWavInfo(f, size, info))
+        {
+            fixWavHeader(f, size, info);
+            if (params_.compress && (info.format == eWavPcm) && (info.bitsPerSample == 16))
+            {
+                const std::string tmpPath = rec.path + ".tmp";
+                const uint64_t newSize = compressWav(f, info, tmpPath);
+                if (newSize && (rename(tmpPath.c_str(), rec.path.c_str()) == 0))
+                {
+                    savedBytes_ += size - newSize;
+                    size = newSize;
+                    compressed = true;
+                }
+            }
+        }
+        fclose(f);
+    }
+
+    usedBytes_ += size;
+    ++finalized_;
+    appendIndex(rec, size, compressed);
+}
+
+void RecordingManager::appendIndex(const Recording& rec, uint64_t bytes, bool compressed)
+{
+    const time_t t = std::chrono::system_clock::to_time_t(rec.started);
+    struct tm tm;
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    //Path is relative to the root folder. Line is flushed by one write in append mode,
+    //so lines of several processes sharing the folder don't mix.
+    char line[4096];
+    const int len = snprintf(line, sizeof(line), "%s\t%u\t%u\t%lld\t%llu\t%d\t%s\n",
+                             stamp, static_cast<uint32_t>(rec.module), rec.callId, static_cast<long long>(rec.durationMs),
+                             static_cast<unsigned long long>(bytes), compressed ? 1 : 0,
+                             rec.path.c_str() + params_.folder.size() + 1);
+    if (len <= 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    FILE* f = fopen(indexPath_.c_str(), "a");
+    if (!f)
+        return;
+    fwrite(line, 1, (static_cast<size_t>(len) < sizeof(line)) ? len : sizeof(line) - 1, f);
+    fclose(f);
+}
+
+void RecordingManager::print(std::ostream& os) const
+{
+    os << "recordings active:" << activeCount() << " queued:" << queuedCount()
+       << " finalized:" << finalized_ << " failed:" << failed_ << " refused:" << refused_
+       << " usedMb:" << usedBytes_ / kMb << " savedMb:" << savedBytes_ / kMb;
+    if (params_.preallocateMb)
+        os << " preallocFailed:" << preallocFailed_ << " preallocLost:" << preallocLost_;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+////////////////////////////////////////////////////////////////////////////
+//RecordingParams
+
+struct RecordingParams
+{
+    std::string folder;              //Root folder of recordings (empty - 'recordings' in the home folder)
+    uint64_t quotaMb = 0;            //Max total size of recordings (0 - unlimited)
+    uint64_t minFreeMb = 1024;       //Refuse new recordings when disk has less free space
+    uint64_t preallocateMb = 0;      //Disk space reserved for each recording by 'fallocate' (0 - disabled)
+    bool compress = false;           //Convert PCM16 WAV to G.711 mu-law when finalized (halves size)
+    uint32_t workers = 2;            //Threads which finalize recordings
+    uint32_t finalizeDelayMs = 1000; //Time given to SDK to close file after recording stopped
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//RecordingManager
+//Allocates unique paths for call recordings in sharded folders:
+//  <folder>/<YYYY-MM-DD>/<HH>/<xx>/<YYYYMMDD-HHMMSS>-<pid>-m<module>-c<callId>-<seq>.wav
+//where 'xx' is hash of the name (limits number of entries in one folder).
+//Applies back-pressure: new recording is refused when quota would be exceeded or disk is almost full.
+//Stopped recordings are finalized by worker threads: unused preallocated space released,
+//WAV header fixed (or file compressed), entry appended to '<folder>/index.tsv'.
+//'begin/cancel/finish' are invoked on the loop thread.
+
+class RecordingManager
+{
+public:
+    RecordingManager() {}
+    ~RecordingManager() { stop(); }
+
+    //Creates root folder, reads size of existing recordings from index and starts workers
+    bool start(const RecordingParams& params, std::string& err);
+
+    //Finalizes all recordings (including active ones) and waits for workers
+    void stop();
+
+    //Returns path where SDK has to write recording of the call.
+    //Returns false and sets 'err' when recording isn't allowed by quota or free disk space.
+    bool begin(uint8_t module, Siprix::CallId callId, std::string& path, std::string& err);
+
+    //SDK failed to start recording
+    void cancel(uint8_t module, Siprix::CallId callId);
+
+    //Recording stopped by command or call terminated. Returns false when call isn't recorded.
+    bool finish(uint8_t module, Siprix::CallId callId);
+
+    void print(std::ostream& os) const;
+
+    size_t   activeCount() const { return active_.size(); }
+    size_t   queuedCount() const;
+    uint64_t usedBytes()   const { return usedBytes_; }
+    uint64_t finalized()   const { return finalized_; }
+    uint64_t failed()      const { return failed_; }
+    uint64_t refused()     const { return refused_; }
+    uint64_t preallocFailed() const { return preallocFailed_; }
+    uint64_t preallocLost()   const { return preallocLost_; }
+
+protected:
+    struct Recording {
+        uint8_t module = 0;
+        Siprix::CallId callId = 0;
+        std::string path;
+        uint64_t reservedBytes = 0;
+        bool preallocated = false;//Space was reserved by 'fallocate'
+        std::chrono::system_clock::time_point started;
+        std::chrono::steady_clock::time_point stopped;
+        int64_t durationMs = 0;
+    };
+
+    static uint64_t key(uint8_t module, Siprix::CallId callId) { return (static_cast<uint64_t>(module) << 32) | callId; }
+    static void markStopped(Recording& rec);
+
+    bool makeFolder(const std::string& path);
+    void readIndex();
+    void runWorker();
+    void finalize(const Recording& rec);
+    void appendIndex(const Recording& rec, uint64_t bytes, bool compressed);
+
+    RecordingParams params_;
+    std::string indexPath_;
+    uint64_t seq_ = 0;
+    std::unordered_map<uint64_t, Recording> active_;
+    std::unordered_set<std::string> folders_;//Already created shard folders
+
+    //Queue of stopped recordings, processed by workers
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Recording> queue_;
+    std::vector<std::thread> workers_;
+    bool stopping_ = false;
+    std::mutex indexMutex_;
+
+    std::atomic<uint64_t> usedBytes_{ 0 };    //Finalized recordings
+    std::atomic<uint64_t> reservedBytes_{ 0 };//Active and not finalized recordings
+    std::atomic<uint64_t> finalized_{ 0 };
+    std::atomic<uint64_t> failed_{ 0 };
+    std::atomic<uint64_t> refused_{ 0 };
+    std::atomic<uint64_t> savedBytes_{ 0 };   //By compression
+    std::atomic<uint64_t> preallocFailed_{ 0 };//'fallocate' failed (file system doesn't support it, disk full)
+    std::atomic<uint64_t> preallocLost_{ 0 };  //Reserved space was freed before finalize (SDK truncated file)
+};
@@ -0,0 +1,540 @@
+#include "Scenario.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioFrames
+
+static const size_t kFrameAlign = 64;
+static const size_t kFrameClasses = 64;   //Frames up to 4KB are kept in free lists
+
+static std::vector<void*> freeFrames[kFrameClasses];
+static size_t liveFrames = 0;
+static size_t maxFrameSize = 0;
+
+void* ScenarioFrames::allocate(size_t size)
+{
+    ++liveFrames;
+    maxFrameSize = std::max(maxFrameSize, size);
+
+    const size_t sizeClass = (size + kFrameAlign - 1) / kFrameAlign;
+    if (sizeClass >= kFrameClasses)
+        return ::operator new(size);
+
+    std::vector<void*>& frames = freeFrames[sizeClass];
+    if (frames.empty())
+        return ::operator new(sizeClass * kFrameAlign);
+
+    void* ptr = frames.back();
+    frames.pop_back();
+    return ptr;
+}
+
+void ScenarioFrames::release(void* ptr, size_t size)
+{
+    --liveFrames;
+    const size_t sizeClass = (size + kFrameAlign - 1) / kFrameAlign;
+    if (sizeClass >= kFrameClasses)
+        ::operator delete(ptr);
+    else
+        freeFrames[sizeClass].push_back(ptr);
+}
+
+size_t ScenarioFrames::live()    { return liveFrames; }
+size_t ScenarioFrames::maxSize() { return maxFrameSize; }
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioTask
+
+ScenarioTask& ScenarioTask::operator=(ScenarioTask&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (handle_) handle_.destroy();
+        handle_ = other.handle_;
+        other.handle_ = nullptr;
+    }
+    return *this;
+}
+
+std::coroutine_handle<> ScenarioTask::await_suspend(std::coroutine_handle<> caller) noexcept
+{
+    handle_.promise().continuation = caller;
+    return handle_;
+}
+
+std::coroutine_handle<> ScenarioTask::FinalAwaiter::await_suspend(Handle handle) noexcept
+{
+    promise_type& promise = handle.promise();
+    if (promise.continuation)
+        return promise.continuation;
+
+    //Root task: scheduler destroys the frame (allowed while it's suspended at final point)
+    if (promise.scenario)
+        promise.scenario->scheduler_->finished(*promise.scenario);
+    return std::noop_coroutine();
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioAwaiter
+
+bool ScenarioAwaiter::await_ready()
+{
+    return scn.scheduler_->ready(*this);
+}
+
+void ScenarioAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    scn.scheduler_->suspend(*this, handle);
+}
+
+int32_t ScenarioAwaiter::await_resume() const
+{
+    return scn.result_;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Scenario, ScenarioCall
+
+const ScenarioParams& Scenario::params() const
+{
+    return scheduler_->params();
+}
+
+ScenarioCall::~ScenarioCall()
+{
+    scn_.scheduler_->endCall(*this);
+}
+
+const char* getScenarioWaitStr(ScenarioWait wait)
+{
+    switch (wait)
+    {
+        case eScnSleep:        return "sleep";
+        case eScnInvite:       return "invite";
+        case eScnConnected:    return "connected";
+        case eScnDtmfSent:     return "dtmf";
+        case eScnDtmfReceived: return "dtmfReceived";
+        case eScnHeld:         return "held";
+        case eScnTransferred:  return "transferred";
+        case eScnTerminated:   return "terminated";
+        default:               return "?";
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Built-in flows
+
+//Originates call and waits until it's answered
+static ScenarioTask answered(Scenario& scn, ScenarioCall& call)
+{
+    const ScenarioParams& params = scn.params();
+    co_await call.invite(params.accId, params.target.c_str());
+    co_await call.connected();
+}
+
+static ScenarioTask flowCall(Scenario& scn)
+{
+    ScenarioCall call(scn);
+    co_await answered(scn, call);
+    co_await scn.sleep(scn.params().talkMs);
+    co_await call.bye();
+}
+
+static ScenarioTask flowIvr(Scenario& scn)
+{
+    ScenarioCall call(scn);
+    co_await answered(scn, call);
+    co_await scn.sleep(500);//Greeting starts
+    co_await call.dtmf(scn.params().dtmf.c_str());
+    co_await scn.sleep(scn.params().talkMs);
+    co_await call.bye();
+}
+
+static ScenarioTask flowHold(Scenario& scn)
+{
+    ScenarioCall call(scn);
+    co_await answered(scn, call);
+    co_await call.hold();
+    co_await scn.sleep(scn.params().talkMs);
+    co_await call.hold();
+    co_await call.bye();
+}
+
+static ScenarioTask flowTransfer(Scenario& scn)
+{
+    ScenarioCall call(scn);
+    co_await answered(scn, call);
+    co_await scn.sleep(scn.params().talkMs);
+    co_await call.transferBlind(scn.params().transferTo.c_str());
+    co_await call.terminated();
+}
+
+ScenarioScheduler::Flow ScenarioScheduler::findFlow(const std::string& name)
+{
+    if (name == "call")     return &flowCall;
+    if (name == "ivr")      return &flowIvr;
+    if (name == "hold")     return &flowHold;
+    if (name == "transfer") return &flowTransfer;
+    return nullptr;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioScheduler
+
+ScenarioScheduler::~ScenarioScheduler()
+{
+    stop();
+}
+
+bool ScenarioScheduler::start(const ScenarioParams& params, const Actions& actions, std::string& err)
+{
+    if (active_ || isRunning())
+    {
+        err = "Scenarios are already running";
+        return false;
+    }
+    flow_ = findFlow(params.name);
+    if (!flow_)
+    {
+        err = "Unknown scenario '" + params.name + "' (call, ivr, hold, transfer)";
+        return false;
+    }
+    if (params.target.empty() || !params.count)
+    {
+        err = "Scenario requires target and count";
+        return false;
+    }
+    if ((params.name == "transfer") && params.transferTo.empty())
+    {
+        err = "Scenario 'transfer' requires transferTo";
+        return false;
+    }
+
+    params_  = params;
+    actions_ = actions;
+    started_ = completed_ = failed_ = 0;
+    maxActive_ = 0;
+    std::fill(std::begin(failures_), std::end(failures_), 0);
+    lastFailure_.clear();
+    durationMs_.reset();
+    for (Histogram& h : waitMs_)
+        h.reset();
+
+    startedAt_ = EventLoop::Clock::now();
+    timer_ = loop_.addTimer(10, 10, [this]() { onTimer(); });
+    std::cout << "Scenarios '" << params_.name << "' started: " << params_.count << " to " << params_.target << std::endl;
+    onTimer();
+    return true;
+}
+
+void ScenarioScheduler::stop()
+{
+    for (Scenario& scn : slots_)
+        if (scn.active_)
+            abort(scn, "stopped");
+
+    if (timer_)
+    {
+        loop_.cancelTimer(timer_);
+        timer_ = 0;
+    }
+    deadlines_ = decltype(deadlines_)();
+}
+
+void ScenarioScheduler::startScenario()
+{
+    uint32_t slot = 0;
+    if (freeSlots_.empty())
+    {
+        slot = static_cast<uint32_t>(slots_.size());
+        slots_.emplace_back();
+    }
+    else
+    {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+    }
+
+    Scenario& scn = slots_[slot];
+    scn.scheduler_ = this;
+    scn.slot_ = slot;
+    scn.index_ = static_cast<uint32_t>(started_++);
+    scn.active_ = true;
+    scn.failure_ = nullptr;
+    scn.failureCode_ = 0;
+    scn.started_ = EventLoop::Clock::now();
+    scn.task_ = flow_(scn);
+    scn.task_.handle().promise().scenario = &scn;
+
+    ++active_;
+    maxActive_ = std::max(maxActive_, active_);
+
+    //Runs until the first step which waits
+    scn.task_.handle().resume();
+}
+
+void ScenarioScheduler::onTimer()
+{
+    const auto now = EventLoop::Clock::now();
+
+    //Start scenarios due by rate
+    uint64_t due = params_.count;
+    if (params_.rate > 0)
+    {
+        const double sec = std::chrono::duration<double>(now - startedAt_).count();
+        due = std::min<uint64_t>(params_.count, static_cast<uint64_t>(sec * params_.rate) + 1);
+    }
+    while (started_ < due)
+        startScenario();
+
+    while (!deadlines_.empty() && (deadlines_.top().time <= now))
+    {
+        const Deadline deadline = deadlines_.top();
+        deadlines_.pop();
+
+        Scenario& scn = slots_[deadline.slot];
+        if (!scn.active_ || !scn.waiting_ || (scn.waitSeq_ != deadline.seq))
+            continue;
+
+        if (scn.failure_)
+            abort(scn, scn.failure_);
+        else if ((scn.wait_ == eScnSleep) || (scn.wait_ == eScnDtmfSent))
+            resume(scn, 0);
+        else
+        {
+            ++failures_[scn.wait_];
+            abort(scn, "timeout");
+        }
+    }
+
+    if ((started_ == params_.count) && !active_ && timer_)
+    {
+        loop_.cancelTimer(timer_);
+        timer_ = 0;
+        deadlines_ = decltype(deadlines_)();
+        std::cout << "Scenarios '" << params_.name << "' done: completed " << completed_ << ", failed " << failed_ << std::endl;
+    }
+}
+
+bool ScenarioScheduler::fail(Scenario& scn, ScenarioWait wait, const char* failure, int32_t code)
+{
+    ++failures_[wait];
+    scn.failure_ = failure;
+    scn.failureCode_ = code;
+    return false;
+}
+
+bool ScenarioScheduler::ready(ScenarioAwaiter& aw)
+{
+    Scenario& scn = aw.scn;
+    ScenarioCall* call = aw.call;
+    scn.result_ = 0;
+    scn.waitStarted_ = EventLoop::Clock::now();
+
+    if (aw.wait == eScnSleep)
+        return aw.arg == 0;
+
+    if (aw.wait == eScnInvite)
+    {
+        if (call->id_)
+            return fail(scn, aw.wait, "call already made", 0);
+
+        Siprix::CallId callId = 0;
+        uint8_t module = 0;
+        const Siprix::ErrorCode err = actions_.invite(module, aw.arg, aw.text, callId);
+        if (err != Siprix::ErrorCode::EOK)
+            return fail(scn, aw.wait, "invite failed", err);
+
+        call->id_ = callId;
+        call->module_ = module;
+        calls_[key(module, callId)] = call;
+        scn.result_ = static_cast<int32_t>(callId);
+        return true;
+    }
+
+    //Buffered events
+    if (!call->id_)
+        return fail(scn, aw.wait, "call not made", 0);
+    if ((aw.wait == eScnConnected) && call->connected_)
+        return true;
+    if ((aw.wait == eScnDtmfReceived) && call->dtmfCount_)
+    {
+        scn.result_ = call->dtmf_[0];
+        memmove(call->dtmf_, call->dtmf_ + 1, --call->dtmfCount_);
+        return true;
+    }
+    if (call->terminated_)
+    {
+        if (aw.wait != eScnTerminated)
+            return fail(scn, aw.wait, "call terminated", static_cast<int32_t>(call->status_));
+        scn.result_ = static_cast<int32_t>(call->status_);
+        return true;
+    }
+
+    //Actions, which complete by event or time
+    Siprix::ErrorCode err = Siprix::ErrorCode::EOK;
+    switch (aw.wait)
+    {
+        case eScnDtmfSent:
+            err = actions_.dtmf(call->module_, call->id_, aw.text, ScenarioCall::kDtmfDurationMs, ScenarioCall::kDtmfGapMs);
+            aw.arg = static_cast<uint32_t>(strlen(aw.text)) * (ScenarioCall::kDtmfDurationMs + ScenarioCall::kDtmfGapMs);
+            break;
+        case eScnHeld:
+            err = actions_.hold(call->module_, call->id_);
+            break;
+        case eScnTransferred:
+            err = aw.text ? actions_.transferBlind(call->module_, call->id_, aw.text)
+                          : actions_.transferAttended(call->module_, call->id_, aw.arg);
+            break;
+        case eScnTerminated:
+            if (aw.arg) err = actions_.bye(call->module_, call->id_);
+            break;
+        default:
+            break;
+    }
+    if (err != Siprix::ErrorCode::EOK)
+        return fail(scn, aw.wait, "request failed", err);
+    return false;
+}
+
+void ScenarioScheduler::suspend(ScenarioAwaiter& aw, std::coroutine_handle<> handle)
+{
+    Scenario& scn = aw.scn;
+    scn.waiting_ = handle;
+    scn.waitCall_ = aw.call;
+    scn.wait_ = aw.wait;
+    ++scn.waitSeq_;
+
+    //Failed step is aborted by the timer (not inside of the coroutine)
+    uint32_t ms = params_.timeoutMs;
+    if (scn.failure_)
+        ms = 0;
+    else if ((aw.wait == eScnSleep) || (aw.wait == eScnDtmfSent))
+        ms = aw.arg;
+    deadlines_.push(Deadline{ scn.waitStarted_ + std::chrono::milliseconds(ms), scn.slot_, scn.waitSeq_ });
+}
+
+void ScenarioScheduler::resume(Scenario& scn, int32_t result)
+{
+    const auto waited = EventLoop::Clock::now() - scn.waitStarted_;
+    waitMs_[scn.wait_].add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(waited).count()));
+
+    const std::coroutine_handle<> handle = scn.waiting_;
+    scn.result_ = result;
+    scn.waiting_ = nullptr;
+    scn.waitCall_ = nullptr;
+    handle.resume();
+}
+
+void ScenarioScheduler::onAppEvent(const AppEvent& ev)
+{
+    auto it = calls_.find(key(ev.module, ev.id));
+    if (it == calls_.end())
+        return;
+
+    ScenarioCall& call = *it->second;
+    Scenario& scn = call.scn_;
+    const bool awaited = scn.waiting_ && (scn.waitCall_ == &call);
+    switch (ev.type)
+    {
+        case AppEvent::eCallConnected:
+            call.connected_ = true;
+            if (awaited && (scn.wait_ == eScnConnected)) resume(scn, 0);
+            break;
+
+        case AppEvent::eCallDtmfReceived:
+        {
+            const char tone = getDtmfToneChar(static_cast<uint16_t>(ev.code));
+            if (awaited && (scn.wait_ == eScnDtmfReceived)) resume(scn, tone);
+            else if (call.dtmfCount_ < sizeof(call.dtmf_)) call.dtmf_[call.dtmfCount_++] = tone;
+            break;
+        }
+
+        case AppEvent::eCallHeld:
+            call.holdState_ = static_cast<Siprix::HoldState>(ev.code);
+            if (awaited && (scn.wait_ == eScnHeld)) resume(scn, static_cast<int32_t>(ev.code));
+            break;
+
+        case AppEvent::eCallTransferred:
+            if (awaited && (scn.wait_ == eScnTransferred)) resume(scn, static_cast<int32_t>(ev.code));
+            break;
+
+        case AppEvent::eCallTerminated:
+            call.terminated_ = true;
+            call.status_ = ev.code;
+            calls_.erase(it);
+            if (awaited && (scn.wait_ == eScnTerminated))
+                resume(scn, static_cast<int32_t>(ev.code));
+            else if (awaited)
+            {
+                ++failures_[scn.wait_];
+                abort(scn, "call terminated");
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void ScenarioScheduler::finished(Scenario& scn)
+{
+    ++completed_;
+    const auto duration = EventLoop::Clock::now() - scn.started_;
+    durationMs_.add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count()));
+    release(scn);
+}
+
+void ScenarioScheduler::abort(Scenario& scn, const char* reason)
+{
+    ++failed_;
+    lastFailure_ = "#" + std::to_string(scn.index_) + " " + getScenarioWaitStr(scn.wait_) + ": " + reason;
+    if (scn.failureCode_)
+        lastFailure_ += " (" + std::to_string(scn.failureCode_) + ")";
+    release(scn);
+}
+
+void ScenarioScheduler::release(Scenario& scn)
+{
+    scn.waiting_ = nullptr;
+    scn.waitCall_ = nullptr;
+    scn.task_ = ScenarioTask();//Destroys frames, calls are ended by their destructors
+    scn.active_ = false;
+    freeSlots_.push_back(scn.slot_);
+    --active_;
+}
+
+void ScenarioScheduler::endCall(ScenarioCall& call)
+{
+    if (!call.id_ || call.terminated_)
+        return;
+    calls_.erase(key(call.module_, call.id_));
+    actions_.bye(call.module_, call.id_);
+}
+
+void ScenarioScheduler::print(std::ostream& os) const
+{
+    os << "scenarios '" << params_.name << "': started:" << started_ << " active:" << active_
+       << " (max " << maxActive_ << ") completed:" << completed_ << " failed:" << failed_
+       << " frames:" << ScenarioFrames::live() << " (max " << ScenarioFrames::maxSize() << "B) duration(ms) ";
+    durationMs_.print(os);
+    for (int i = 0; i < eScnWaits; ++i)
+    {
+        if (!waitMs_[i].count() && !failures_[i])
+            continue;
+        os << "\n      " << getScenarioWaitStr(static_cast<ScenarioWait>(i)) << "(ms) ";
+        waitMs_[i].print(os);
+        if (failures_[i])
+            os << " failed:" << failures_[i];
+    }
+    if (!lastFailure_.empty())
+        os << "\n      last failure: " << lastFailure_;
+}
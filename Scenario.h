@@ -0,0 +1,362 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "AppEvent.h"
+#include "EventLoop.h"
+#include "Stats.h"
+
+////////////////////////////////////////////////////////////////////////////
+//Scenarios
+//Call flows written as C++20 coroutines, for example:
+//
+//    ScenarioTask flow(Scenario& scn)
+//    {
+//        ScenarioCall call(scn);
+//        co_await call.invite(0, "200");
+//        co_await call.connected();
+//        co_await call.dtmf("1#");
+//        co_await scn.sleep(2000);
+//        co_await call.bye();
+//    }
+//
+//Coroutines are resumed by ScenarioScheduler on the loop thread, when event of the call
+//arrives or time expires. Step which fails (SDK error, timeout, call terminated while other
+//event is awaited) ends the scenario: frame is destroyed, calls which are still active are
+//ended by destructor of ScenarioCall and failure is counted.
+
+class Scenario;
+class ScenarioCall;
+class ScenarioScheduler;
+
+enum ScenarioWait : uint8_t
+{
+    eScnSleep,
+    eScnInvite,
+    eScnConnected,
+    eScnDtmfSent,      //Tones are sent, waits their duration
+    eScnDtmfReceived,
+    eScnHeld,
+    eScnTransferred,
+    eScnTerminated,
+    eScnWaits
+};
+
+const char* getScenarioWaitStr(ScenarioWait wait);
+
+//Frames of coroutines are kept in free lists by size (loop thread only),
+//so scenarios started in steady state don't allocate memory
+class ScenarioFrames
+{
+public:
+    static void* allocate(size_t size);
+    static void release(void* ptr, size_t size);
+
+    static size_t live();      //Frames in use
+    static size_t maxSize();   //Largest frame
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioTask
+//Coroutine of the scenario or of its part (awaited by the caller). Starts suspended,
+//frame is destroyed by the owning task object.
+
+class ScenarioTask
+{
+public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept;
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type {
+        std::coroutine_handle<> continuation;//Caller of awaited part
+        Scenario* scenario = nullptr;       //Set for the root task
+
+        ScenarioTask get_return_object() { return ScenarioTask(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        static void* operator new(size_t size) { return ScenarioFrames::allocate(size); }
+        static void operator delete(void* ptr, size_t size) { ScenarioFrames::release(ptr, size); }
+    };
+
+    ScenarioTask() = default;
+    explicit ScenarioTask(Handle handle) : handle_(handle) {}
+    ScenarioTask(ScenarioTask&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    ScenarioTask& operator=(ScenarioTask&& other) noexcept;
+    ScenarioTask(const ScenarioTask&) = delete;
+    ScenarioTask& operator=(const ScenarioTask&) = delete;
+    ~ScenarioTask() { if (handle_) handle_.destroy(); }
+
+    Handle handle() const { return handle_; }
+
+    //Awaiting part of the scenario
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept;
+    void await_resume() noexcept {}
+
+protected:
+    Handle handle_;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioAwaiter
+//One step: action (SDK call) is made by await_ready, which completes the step
+//when its event was already received. Result of await depends on the step:
+//callId (invite), tone char (received DTMF), HoldState (hold), status code
+//(transfer, bye, terminated), otherwise 0.
+
+struct ScenarioAwaiter
+{
+    Scenario& scn;
+    ScenarioCall* call;
+    ScenarioWait wait;
+    uint32_t arg;           //Duration of sleep, accId, callId of transfer target
+    const char* text;       //Extension or tones (valid until await completes)
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle);
+    int32_t await_resume() const;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioParams
+
+struct ScenarioParams
+{
+    std::string name = "call";     //Built-in flow: call, ivr, hold, transfer
+    Siprix::AccountId accId = 0;   //0 - accounts added by --accounts/config are used in turn
+    std::string target;
+    std::string transferTo;        //Flow 'transfer'
+    std::string dtmf = "1#";       //Flow 'ivr'
+    uint32_t talkMs = 2000;
+    uint32_t timeoutMs = 30000;    //Max wait for one event
+    uint32_t count = 1;            //Scenarios to run
+    double rate = 0;               //Started per second (0 - all at once)
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//Scenario
+//State of one running scenario (slot of the scheduler)
+
+class Scenario
+{
+public:
+    ScenarioAwaiter sleep(uint32_t ms) { return ScenarioAwaiter{ *this, nullptr, eScnSleep, ms, nullptr }; }
+
+    const ScenarioParams& params() const;
+    uint32_t index() const { return index_; }//Order of start (0..count-1)
+
+protected:
+    friend class ScenarioScheduler;
+    friend class ScenarioTask;
+    friend class ScenarioCall;
+    friend struct ScenarioAwaiter;
+
+    ScenarioScheduler* scheduler_ = nullptr;
+    ScenarioTask task_;
+    uint32_t index_ = 0;
+    uint32_t slot_ = 0;
+    bool active_ = false;
+
+    //Current wait
+    std::coroutine_handle<> waiting_;
+    ScenarioCall* waitCall_ = nullptr;
+    ScenarioWait wait_ = eScnSleep;
+    uint32_t waitSeq_ = 0;             //Deadlines of previous waits are ignored
+    EventLoop::Clock::time_point waitStarted_;
+    int32_t result_ = 0;
+
+    //Set by failed step, scenario is aborted when it suspends
+    const char* failure_ = nullptr;
+    int32_t failureCode_ = 0;
+
+    EventLoop::Clock::time_point started_;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioCall
+//Call made by the scenario. Events of the call are buffered, so step doesn't miss event
+//which arrived while scenario awaited something else. Call still active when object
+//is destroyed (scenario ended or aborted) is ended by Call_Bye.
+
+class ScenarioCall
+{
+public:
+    explicit ScenarioCall(Scenario& scn) : scn_(scn) {}
+    ~ScenarioCall();
+    ScenarioCall(const ScenarioCall&) = delete;
+    ScenarioCall& operator=(const ScenarioCall&) = delete;
+
+    Siprix::CallId id() const { return id_; }
+    uint8_t module() const { return module_; }
+    bool isConnected() const { return connected_; }
+    bool isTerminated() const { return terminated_; }
+
+    ScenarioAwaiter invite(Siprix::AccountId accId, const char* ext) { return step(eScnInvite, accId, ext); }
+    ScenarioAwaiter connected()                 { return step(eScnConnected); }
+    ScenarioAwaiter dtmf(const char* tones)     { return step(eScnDtmfSent, 0, tones); }
+    ScenarioAwaiter receivedDtmf()              { return step(eScnDtmfReceived); }
+    ScenarioAwaiter hold()                      { return step(eScnHeld); }//Toggles hold
+    ScenarioAwaiter transferBlind(const char* ext)   { return step(eScnTransferred, 0, ext); }
+    ScenarioAwaiter transferAttended(ScenarioCall& to) { return step(eScnTransferred, to.id_); }
+    ScenarioAwaiter bye()                       { return step(eScnTerminated, 1); }
+    ScenarioAwaiter terminated()                { return step(eScnTerminated); }
+
+    static const uint16_t kDtmfDurationMs = 200;
+    static const uint16_t kDtmfGapMs = 50;
+
+protected:
+    friend class ScenarioScheduler;
+    friend struct ScenarioAwaiter;
+
+    ScenarioAwaiter step(ScenarioWait wait, uint32_t arg = 0, const char* text = nullptr) {
+        return ScenarioAwaiter{ scn_, this, wait, arg, text };
+    }
+
+    Scenario& scn_;
+    Siprix::CallId id_ = 0;
+    uint8_t module_ = 0;
+    bool connected_ = false;
+    bool terminated_ = false;
+    uint32_t status_ = 0;           //Of termination
+    Siprix::HoldState holdState_ = Siprix::HoldState::None;
+    char dtmf_[16];                 //Received and not awaited yet
+    uint8_t dtmfCount_ = 0;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioActions
+//Requests of scenarios to the SDK, made by application (it knows modules and accounts)
+
+struct ScenarioActions
+{
+    //Account 0 - choose one (and its module)
+    std::function<Siprix::ErrorCode(uint8_t& module, Siprix::AccountId accId, const char* ext, Siprix::CallId& callId)> invite;
+    std::function<Siprix::ErrorCode(uint8_t module, Siprix::CallId callId)> accept;
+    std::function<Siprix::ErrorCode(uint8_t module, Siprix::CallId callId, uint16_t statusCode)> reject;
+    std::function<Siprix::ErrorCode(uint8_t module, Siprix::CallId callId)> bye;
+    std::function<Siprix::ErrorCode(uint8_t module, Siprix::CallId callId, const char* tones, uint16_t durationMs, uint16_t gapMs)> dtmf;
+    std::function<Siprix::ErrorCode(uint8_t module, Siprix::CallId callId)> hold;
+    std::function<Siprix::ErrorCode(uint8_t module, Siprix::CallId callId, const char* ext)> transferBlind;
+    std::function<Siprix::ErrorCode(uint8_t module, Siprix::CallId fromCallId, Siprix::CallId toCallId)> transferAttended;
+    std::function<Siprix::ErrorCode(uint8_t module, Siprix::CallId callId, const char* prompt, Siprix::PlayerId& playerId)> play;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioScheduler
+//Runs scenarios on the loop thread: starts them at requested rate, resumes coroutines by
+//events of their calls and by deadlines (one timer of 10ms for all scenarios).
+
+class ScenarioScheduler
+{
+public:
+    typedef ScenarioTask (*Flow)(Scenario& scn);
+
+    typedef ScenarioActions Actions;
+
+    ScenarioScheduler(EventLoop& loop) : loop_(loop) {}
+    ~ScenarioScheduler();
+
+    //Returns built-in flow or nullptr
+    static Flow findFlow(const std::string& name);
+
+    bool start(const ScenarioParams& params, const Actions& actions, std::string& err);
+    void stop();
+    bool isRunning() const { return timer_ != 0; }
+    const ScenarioParams& params() const { return params_; }
+
+    void onAppEvent(const AppEvent& ev);
+
+    size_t active() const { return active_; }
+    void print(std::ostream& os) const;
+
+    //Counters of the last start
+    uint64_t started() const   { return started_; }
+    uint64_t completed() const { return completed_; }
+    uint64_t failed() const    { return failed_; }
+    size_t   maxActive() const { return maxActive_; }
+    const Histogram& durationMs() const { return durationMs_; }
+    const Histogram& waitMs(ScenarioWait wait) const { return waitMs_[wait]; }
+    uint64_t failures(ScenarioWait wait) const { return failures_[wait]; }
+    const std::string& lastFailure() const { return lastFailure_; }
+
+protected:
+    friend class ScenarioTask;
+    friend class ScenarioCall;
+    friend struct ScenarioAwaiter;
+
+    struct Deadline {
+        EventLoop::Clock::time_point time;
+        uint32_t slot;
+        uint32_t seq;
+        bool operator>(const Deadline& other) const { return time > other.time; }
+    };
+
+    static uint64_t key(uint8_t module, Siprix::CallId callId) { return (static_cast<uint64_t>(module) << 32) | callId; }
+
+    void startScenario();
+    void onTimer();
+
+    //Steps
+    bool ready(ScenarioAwaiter& aw);
+    void suspend(ScenarioAwaiter& aw, std::coroutine_handle<> handle);
+    void resume(Scenario& scn, int32_t result);
+    bool fail(Scenario& scn, ScenarioWait wait, const char* failure, int32_t code);
+
+    void finished(Scenario& scn);                     //Root coroutine completed
+    void abort(Scenario& scn, const char* reason);    //Destroys frame
+    void release(Scenario& scn);
+    void endCall(ScenarioCall& call);                 //Destructor of the call
+
+    EventLoop& loop_;
+    ScenarioParams params_;
+    Actions actions_;
+    Flow flow_ = nullptr;
+    EventLoop::TimerId timer_ = 0;
+    EventLoop::Clock::time_point startedAt_;
+
+    std::deque<Scenario> slots_;        //Addresses are stable
+    std::vector<uint32_t> freeSlots_;
+    std::unordered_map<uint64_t, ScenarioCall*> calls_;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines_;
+
+    size_t active_ = 0;
+    size_t maxActive_ = 0;
+    uint64_t started_ = 0;
+    uint64_t completed_ = 0;
+    uint64_t failed_ = 0;
+    uint64_t failures_[eScnWaits] = {};//By step which failed
+    std::string lastFailure_;
+    Histogram durationMs_;
+    Histogram waitMs_[eScnWaits];      //Time until step completed
+};
@@ -0,0 +1,957 @@
+#include "ScenarioScript.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioScript
+
+struct ScriptOpInfo
+{
+    const char* name;
+    uint8_t args;          //Positional arguments
+    const char* options;   //Allowed 'key=value' options and flags
+};
+
+//Indexed by ScriptOp
+static const ScriptOpInfo kScriptOps[eScrOps] = {
+    { "invite",            1, " call acc " },
+    { "accept",            0, " call " },
+    { "reject",            0, " call code " },
+    { "dtmf",              1, " call " },
+    { "hold",              0, " call " },
+    { "transfer",          1, " call " },
+    { "transfer-attended", 1, " call " },
+    { "play",              1, " call " },
+    { "bye",               0, " call " },
+    { "expect",            1, " call timeout code store optional " },
+    { "pause",             1, " " },
+    { "set",               2, " " },
+    { "add",               2, " " },
+    { "if",                5, " " },
+    { "goto",              1, " " },
+    { "fail",              0, " " },
+    { "end",               0, " " },
+};
+
+static const char* const kScriptEvents[eScrEvents] = {
+    "incoming", "proceeding", "connected", "terminated", "transferred",
+    "redirected", "dtmf", "held", "switched", "played"
+};
+
+static const char* const kScriptCmps[] = { "==", "!=", "<", "<=", ">", ">=" };
+
+const char* getScriptOpStr(ScriptOp op)
+{
+    return (op < eScrOps) ? kScriptOps[op].name : "???";
+}
+
+const char* getScriptEventStr(ScriptEvent event)
+{
+    return (event < eScrEvents) ? kScriptEvents[event] : "???";
+}
+
+static bool parseScriptInt(const std::string& str, int32_t& value)
+{
+    if (str.empty())
+        return false;
+    char* end = nullptr;
+    errno = 0;
+    const long result = strtol(str.c_str(), &end, 10);
+    if ((*end != '\0') || (errno == ERANGE) || (result < INT32_MIN) || (result > INT32_MAX))
+        return false;
+    value = static_cast<int32_t>(result);
+    return true;
+}
+
+//Tone code (as raised by OnCallDtmfReceived) of the number or symbol
+static bool parseScriptTone(const std::string& str, int32_t& tone)
+{
+    if (str.size() == 1)
+    {
+        const char c = str[0];
+        if ((c >= '0') && (c <= '9')) { tone = c - '0'; return true; }
+        if (c == '*') { tone = 10; return true; }
+        if (c == '#') { tone = 11; return true; }
+        if ((c >= 'A') && (c <= 'D')) { tone = 12 + (c - 'A'); return true; }
+    }
+    return parseScriptInt(str, tone) && (tone >= 0) && (tone <= 15);
+}
+
+//Splits line by spaces, "quoted" token may contain spaces and '#'.
+//Token which starts with '#' begins comment.
+static bool tokenizeScriptLine(const std::string& line, std::vector<std::string>& tokens, std::string& err)
+{
+    tokens.clear();
+    size_t pos = 0;
+    while (pos < line.size())
+    {
+        if ((line[pos] == ' ') || (line[pos] == '\t') || (line[pos] == '\r'))
+        {
+            ++pos;
+            continue;
+        }
+        if (line[pos] == '#')
+            break;
+
+        if (line[pos] == '"')
+        {
+            const size_t end = line.find('"', pos + 1);
+            if (end == std::string::npos)
+            {
+                err = "unterminated quote";
+                return false;
+            }
+            tokens.push_back(line.substr(pos + 1, end - pos - 1));
+            pos = end + 1;
+            continue;
+        }
+
+        const size_t end = line.find_first_of(" \t\r", pos);
+        tokens.push_back(line.substr(pos, (end == std::string::npos) ? std::string::npos : end - pos));
+        pos = end;
+    }
+    return true;
+}
+
+static bool isScriptName(const std::string& name)
+{
+    if (name.empty() || !(isalpha(static_cast<unsigned char>(name[0])) || (name[0] == '_')))
+        return false;
+    for (const char c : name)
+        if (!isalnum(static_cast<unsigned char>(c)) && (c != '_'))
+            return false;
+    return true;
+}
+
+uint32_t ScenarioScript::addString(const std::string& value)
+{
+    const uint32_t offset = static_cast<uint32_t>(pool_.size());
+    pool_.append(value);
+    pool_.push_back('\0');
+    return offset;
+}
+
+int ScenarioScript::findVar(const std::string& name, bool create)
+{
+    for (size_t i = 0; i < vars_.size(); ++i)
+        if (vars_[i] == name)
+            return static_cast<int>(i);
+
+    if (!create || (vars_.size() >= kMaxVars))
+        return -1;
+    vars_.push_back(name);
+    return static_cast<int>(vars_.size() - 1);
+}
+
+bool ScenarioScript::load(const ScriptParams& params, std::string& err)
+{
+    std::ifstream file(params.file, std::ios::binary);
+    if (!file)
+    {
+        err = "Can't open " + params.file;
+        return false;
+    }
+    const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!compile(text, params, err))
+    {
+        err = params.file + ": " + err;
+        return false;
+    }
+    return true;
+}
+
+bool ScenarioScript::compile(const std::string& text, const ScriptParams& params, std::string& err)
+{
+    struct Fixup {
+        size_t pc;
+        std::string label;
+        uint32_t line;
+    };
+    struct Loop {
+        uint8_t var;
+        uint32_t body;
+        uint32_t line;
+    };
+
+    code_.clear();
+    pool_.assign(1, '\0');//Offset 0 - empty string
+    vars_.clear();
+    lines_.clear();
+
+    std::map<std::string, uint32_t> labels;
+    std::vector<Fixup> fixups;
+    std::vector<Loop> loops;
+    std::vector<std::string> tokens, args;
+    uint32_t timeoutMs = params.timeoutMs;
+
+    std::istringstream input(text);
+    std::string line;
+    uint32_t lineNo = 0;
+    while (std::getline(input, line))
+    {
+        ++lineNo;
+        if (!line.empty() && (line.back() == '\r'))
+            line.pop_back();
+        lines_.push_back(line.substr(std::min(line.find_first_not_of(" \t"), line.size())));
+
+        const auto fail = [&err, lineNo](const std::string& msg) {
+            err = "line " + std::to_string(lineNo) + ": " + msg;
+            return false;
+        };
+
+        std::string tokenErr;
+        if (!tokenizeScriptLine(line, tokens, tokenErr))
+            return fail(tokenErr);
+        if (tokens.empty())
+            continue;
+
+        const std::string& cmd = tokens[0];
+
+        //Directives
+        if ((cmd == "label") || (cmd == "timeout") || (cmd == "loop") || (cmd == "endloop"))
+        {
+            const size_t expected = (cmd == "endloop") ? 1 : 2;
+            if (tokens.size() != expected)
+                return fail("'" + cmd + "' requires " + std::to_string(expected - 1) + " argument(s)");
+
+            int32_t value = 0;
+            if (cmd == "label")
+            {
+                if (!isScriptName(tokens[1]))
+                    return fail("invalid label '" + tokens[1] + "'");
+                if (!labels.emplace(tokens[1], static_cast<uint32_t>(code_.size())).second)
+                    return fail("duplicate label '" + tokens[1] + "'");
+            }
+            else if (cmd == "timeout")
+            {
+                if (!parseScriptInt(tokens[1], value) || (value <= 0))
+                    return fail("invalid timeout '" + tokens[1] + "'");
+                timeoutMs = static_cast<uint32_t>(value);
+            }
+            else if (cmd == "loop")
+            {
+                if (!parseScriptInt(tokens[1], value) || (value <= 0))
+                    return fail("invalid loop count '" + tokens[1] + "'");
+
+                //Hidden counter: 'set' before the body, 'add -1' and 'if > 0' after it
+                const int var = findVar("#loop" + std::to_string(lineNo), true);
+                if (var < 0)
+                    return fail("too many variables (max " + std::to_string(kMaxVars) + ")");
+                ScriptInstr in{};
+                in.op = eScrSet;
+                in.var = static_cast<uint8_t>(var);
+                in.a = value;
+                in.line = lineNo;
+                code_.push_back(in);
+                loops.push_back({ static_cast<uint8_t>(var), static_cast<uint32_t>(code_.size()), lineNo });
+            }
+            else
+            {
+                if (loops.empty())
+                    return fail("'endloop' without 'loop'");
+                const Loop loop = loops.back();
+                loops.pop_back();
+
+                ScriptInstr in{};
+                in.op = eScrAdd;
+                in.var = loop.var;
+                in.a = -1;
+                in.line = lineNo;
+                code_.push_back(in);
+
+                in.op = eScrIf;
+                in.event = eScrGt;
+                in.a = 0;
+                in.b = static_cast<int32_t>(loop.body);
+                code_.push_back(in);
+            }
+            continue;
+        }
+
+        int op = 0;
+        while ((op < eScrOps) && (cmd != kScriptOps[op].name))
+            ++op;
+        if (op == eScrOps)
+            return fail("unknown instruction '" + cmd + "'");
+        const ScriptOpInfo& info = kScriptOps[op];
+
+        ScriptInstr in{};
+        in.op = static_cast<ScriptOp>(op);
+        in.var = kNoVar;
+        in.line = lineNo;
+
+        //Positional arguments (with substituted parameters) and options
+        args.clear();
+        std::string store;
+        bool hasCode = false;
+        for (size_t i = 1; i < tokens.size(); ++i)
+        {
+            const std::string& token = tokens[i];
+            const size_t eq = token.find('=');
+            const std::string key = (token == "optional") ? token : token.substr(0, eq);
+            const bool isOption = (token == "optional") || ((eq != std::string::npos) && isScriptName(key) &&
+                                  (std::string(" call acc timeout code store ").find(" " + key + " ") != std::string::npos));
+            if (!isOption)
+            {
+                if (token.empty() || (token[0] != '$'))
+                    args.push_back(token);
+                else if (token == "$target")     args.push_back(params.target);
+                else if (token == "$transferTo") args.push_back(params.transferTo);
+                else if (token == "$dtmf")       args.push_back(params.dtmf);
+                else
+                    return fail("unknown parameter '" + token + "'");
+
+                if (args.back().empty())
+                    return fail("parameter '" + token + "' isn't set");
+                continue;
+            }
+
+            if (std::string(info.options).find(" " + key + " ") == std::string::npos)
+                return fail("'" + cmd + "' doesn't support '" + key + "'");
+
+            int32_t value = 0;
+            const std::string valueStr = (eq == std::string::npos) ? std::string() : token.substr(eq + 1);
+            if (key == "optional")
+                in.flags |= eScrOptional;
+            else if (key == "store")
+                store = valueStr;
+            else if (key == "code")
+            {
+                hasCode = true;
+                if (!parseScriptInt(valueStr, in.b) && !parseScriptTone(valueStr, in.b))
+                    return fail("invalid code '" + valueStr + "'");
+            }
+            else if (!parseScriptInt(valueStr, value) || (value < 0))
+                return fail("invalid " + key + " '" + valueStr + "'");
+            else if (key == "call")
+            {
+                if (value >= kMaxCalls)
+                    return fail("call index has to be less than " + std::to_string(kMaxCalls));
+                in.call = static_cast<uint8_t>(value);
+            }
+            else if (key == "acc")     in.a = value;
+            else if (key == "timeout") in.a = value;
+        }
+        if (args.size() != info.args)
+            return fail("'" + cmd + "' requires " + std::to_string(info.args) + " argument(s)");
+
+        int32_t value = 0;
+        switch (in.op)
+        {
+            case eScrInvite:
+            case eScrDtmf:
+            case eScrTransfer:
+            case eScrPlay:
+                in.str = addString(args[0]);
+                break;
+
+            case eScrReject:
+                if (!hasCode) in.b = 486;
+                in.a = in.b;
+                in.b = 0;
+                break;
+
+            case eScrTransferAttended:
+                if (!parseScriptInt(args[0], value) || (value < 0) || (value >= kMaxCalls) || (value == in.call))
+                    return fail("invalid call index '" + args[0] + "'");
+                in.a = value;
+                break;
+
+            case eScrExpect:
+            {
+                int event = 0;
+                while ((event < eScrEvents) && (args[0] != kScriptEvents[event]))
+                    ++event;
+                if (event == eScrEvents)
+                    return fail("unknown event '" + args[0] + "'");
+                if ((event == eScrEvIncoming) && (!code_.empty() || in.call || (in.flags & eScrOptional)))
+                    return fail("'expect incoming' has to be the first instruction");
+                if ((event == eScrEvIncoming) && (hasCode || !store.empty()))
+                    return fail("'expect incoming' doesn't accept code or store");
+
+                in.event = static_cast<uint8_t>(event);
+                if (!hasCode) in.b = -1;
+                if (event == eScrEvDtmf && hasCode && (in.b > 15))
+                    return fail("invalid tone");
+                if (!in.a) in.a = static_cast<int32_t>(timeoutMs);
+                if (!store.empty())
+                {
+                    const int var = isScriptName(store) ? findVar(store, true) : -1;
+                    if (var < 0)
+                        return fail("invalid variable '" + store + "'");
+                    in.var = static_cast<uint8_t>(var);
+                }
+                break;
+            }
+
+            case eScrPause:
+                if (!parseScriptInt(args[0], in.a) || (in.a < 0))
+                    return fail("invalid pause '" + args[0] + "'");
+                break;
+
+            case eScrSet:
+            case eScrAdd:
+            case eScrIf:
+            {
+                const int var = isScriptName(args[0]) ? findVar(args[0], true) : -1;
+                if (var < 0)
+                    return fail("invalid variable '" + args[0] + "'");
+                in.var = static_cast<uint8_t>(var);
+
+                const std::string& valueStr = (in.op == eScrIf) ? args[2] : args[1];
+                if (!parseScriptInt(valueStr, in.a))
+                    return fail("invalid number '" + valueStr + "'");
+                if (in.op != eScrIf)
+                    break;
+
+                int cmp = 0;
+                while ((cmp <= eScrGe) && (args[1] != kScriptCmps[cmp]))
+                    ++cmp;
+                if (cmp > eScrGe)
+                    return fail("invalid comparison '" + args[1] + "'");
+                if (args[3] != "goto")
+                    return fail("'if' requires: if <var> <cmp> <number> goto <label>");
+                in.event = static_cast<uint8_t>(cmp);
+                fixups.push_back({ code_.size(), args[4], lineNo });
+                break;
+            }
+
+            case eScrGoto:
+                fixups.push_back({ code_.size(), args[0], lineNo });
+                break;
+
+            default:
+                break;
+        }
+        code_.push_back(in);
+    }
+
+    if (!loops.empty())
+    {
+        err = "line " + std::to_string(loops.back().line) + ": 'loop' without 'endloop'";
+        return false;
+    }
+    if (code_.empty())
+    {
+        err = "script has no instructions";
+        return false;
+    }
+
+    //Script ends by 'end' when the last instruction continues or label points past it
+    const ScriptOp last = code_.back().op;
+    const bool labelAtEnd = std::any_of(labels.begin(), labels.end(),
+                                        [this](const auto& label) { return label.second == code_.size(); });
+    if (labelAtEnd || ((last != eScrEnd) && (last != eScrFail) && (last != eScrGoto)))
+    {
+        ScriptInstr in{};
+        in.op = eScrEnd;
+        in.var = kNoVar;
+        code_.push_back(in);
+    }
+
+    for (const Fixup& fixup : fixups)
+    {
+        auto it = labels.find(fixup.label);
+        if (it == labels.end())
+        {
+            err = "line " + std::to_string(fixup.line) + ": unknown label '" + fixup.label + "'";
+            return false;
+        }
+        code_[fixup.pc].b = static_cast<int32_t>(it->second);
+    }
+    return true;
+}
+
+std::string ScenarioScript::describe(size_t pc) const
+{
+    const uint32_t line = code_[pc].line;
+    if (!line || (line > lines_.size()))
+        return "end of script";
+    return "line " + std::to_string(line) + ": " + lines_[line - 1];
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScriptRunner
+
+//Instructions executed by instance at once, before it's failed as stuck in a loop
+static const uint32_t kScriptSlice = 10000;
+
+ScriptRunner::~ScriptRunner()
+{
+    stop();
+}
+
+bool ScriptRunner::start(const ScriptParams& params, const ScenarioActions& actions, std::string& err)
+{
+    if (active_ || isRunning())
+    {
+        err = "Script is already running";
+        return false;
+    }
+    if (!params.count)
+    {
+        err = "Script requires count";
+        return false;
+    }
+    ScenarioScript script;
+    if (!script.load(params, err))
+        return false;
+
+    params_  = params;
+    actions_ = actions;
+    script_  = std::move(script);
+    steps_.reset(new Step[script_.code().size()]);
+    started_ = completed_ = failed_ = 0;
+    maxActive_ = 0;
+    lastFailure_.clear();
+    durationMs_.reset();
+
+    startedAt_ = EventLoop::Clock::now();
+    timer_ = loop_.addTimer(10, 10, [this]() { onTimer(); });
+    std::cout << "Script '" << params_.file << "' started: " << script_.code().size() << " instructions, "
+              << params_.count << (script_.incoming() ? " incoming calls" : " instances") << std::endl;
+    onTimer();
+    return true;
+}
+
+void ScriptRunner::stop()
+{
+    for (Instance& inst : slots_)
+        if (inst.active)
+            finish(inst, "stopped");
+
+    if (timer_)
+    {
+        loop_.cancelTimer(timer_);
+        timer_ = 0;
+    }
+    deadlines_ = decltype(deadlines_)();
+}
+
+ScriptRunner::Instance& ScriptRunner::newInstance()
+{
+    uint32_t slot = 0;
+    if (freeSlots_.empty())
+    {
+        slot = static_cast<uint32_t>(slots_.size());
+        slots_.emplace_back();
+    }
+    else
+    {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+    }
+
+    Instance& inst = slots_[slot];
+    inst.active = true;
+    inst.index = static_cast<uint32_t>(started_++);
+    inst.slot = slot;
+    inst.pc = 0;
+    inst.waiting = false;
+    std::fill(std::begin(inst.vars), std::end(inst.vars), 0);
+    std::fill(std::begin(inst.calls), std::end(inst.calls), 0);
+    std::fill(std::begin(inst.modules), std::end(inst.modules), 0);
+    std::fill(std::begin(inst.terminated), std::end(inst.terminated), false);
+    std::fill(std::begin(inst.players), std::end(inst.players), 0);
+    inst.pendingCount = 0;
+    inst.started = inst.stepStarted = EventLoop::Clock::now();
+
+    ++active_;
+    maxActive_ = std::max(maxActive_, active_);
+    return inst;
+}
+
+void ScriptRunner::run(Instance& inst)
+{
+    const std::vector<ScriptInstr>& code = script_.code();
+    for (uint32_t i = 0; i < kScriptSlice; ++i)
+        if (!execute(inst, code[inst.pc]))
+            return;
+    finish(inst, "too many instructions without wait");
+}
+
+bool ScriptRunner::execute(Instance& inst, const ScriptInstr& in)
+{
+    Siprix::CallId& callId = inst.calls[in.call];
+    const uint8_t module = inst.modules[in.call];
+    if ((in.op > eScrInvite) && (in.op <= eScrBye))
+    {
+        if (!callId)
+        {
+            finish(inst, "no call");
+            return false;
+        }
+        if (inst.terminated[in.call])
+        {
+            finish(inst, "call terminated");
+            return false;
+        }
+    }
+
+    Siprix::ErrorCode err = Siprix::ErrorCode::EOK;
+    switch (in.op)
+    {
+        case eScrInvite:
+        {
+            if (callId && !inst.terminated[in.call])
+            {
+                finish(inst, "call is active");
+                return false;
+            }
+            uint8_t callModule = inst.modules[0];
+            Siprix::CallId newCallId = 0;
+            err = actions_.invite(callModule, in.a ? static_cast<Siprix::AccountId>(in.a) : params_.accId,
+                                  script_.str(in.str), newCallId);
+            if (err == Siprix::ErrorCode::EOK)
+            {
+                callId = newCallId;
+                inst.modules[in.call] = callModule;
+                inst.terminated[in.call] = false;
+                calls_[key(callModule, newCallId)] = ref(inst, in.call);
+            }
+            break;
+        }
+
+        case eScrAccept:           err = actions_.accept(module, callId); break;
+        case eScrReject:           err = actions_.reject(module, callId, static_cast<uint16_t>(in.a)); break;
+        case eScrDtmf:             err = actions_.dtmf(module, callId, script_.str(in.str), 200, 50); break;
+        case eScrHold:             err = actions_.hold(module, callId); break;
+        case eScrTransfer:         err = actions_.transferBlind(module, callId, script_.str(in.str)); break;
+        case eScrBye:              err = actions_.bye(module, callId); break;
+
+        case eScrTransferAttended:
+            if (!inst.calls[in.a] || inst.terminated[in.a])
+            {
+                finish(inst, "no call to transfer to");
+                return false;
+            }
+            err = actions_.transferAttended(module, callId, inst.calls[in.a]);
+            break;
+
+        case eScrPlay:
+        {
+            Siprix::PlayerId playerId = 0;
+            err = actions_.play(module, callId, script_.str(in.str), playerId);
+            if (err == Siprix::ErrorCode::EOK)
+            {
+                if (inst.players[in.call])
+                    players_.erase(key(module, inst.players[in.call]));
+                inst.players[in.call] = playerId;
+                players_[key(module, playerId)] = ref(inst, in.call);
+            }
+            break;
+        }
+
+        case eScrExpect:
+        {
+            //Events received earlier, in order of arrival
+            for (uint8_t i = 0; i < inst.pendingCount; ++i)
+            {
+                const Pending pending = inst.pending[i];
+                if (!matchExpect(inst, pending.event, pending.call, pending.code))
+                    continue;
+                std::copy(inst.pending + i + 1, inst.pending + inst.pendingCount, inst.pending + i);
+                --inst.pendingCount;
+                return true;
+            }
+
+            //Group of optional expectations, which ends by mandatory one
+            const std::vector<ScriptInstr>& code = script_.code();
+            uint32_t last = inst.pc;
+            while ((code[last].op == eScrExpect) && (code[last].flags & ScenarioScript::eScrOptional))
+                ++last;
+            if (code[last].op != eScrExpect)
+            {
+                //Nothing mandatory to wait for
+                stepDone(inst, last);
+                return true;
+            }
+            if (inst.terminated[code[last].call] && (code[last].event != eScrEvTerminated))
+            {
+                inst.pc = last;
+                finish(inst, "call terminated");
+                return false;
+            }
+            wait(inst, static_cast<uint32_t>(code[last].a));
+            return false;
+        }
+
+        case eScrPause:
+            wait(inst, static_cast<uint32_t>(in.a));
+            return false;
+
+        case eScrSet:
+            inst.vars[in.var] = in.a;
+            break;
+
+        case eScrAdd:
+            inst.vars[in.var] += in.a;
+            break;
+
+        case eScrIf:
+        {
+            const int32_t v = inst.vars[in.var];
+            bool jump = false;
+            switch (static_cast<ScriptCmp>(in.event))
+            {
+                case eScrEq: jump = (v == in.a); break;
+                case eScrNe: jump = (v != in.a); break;
+                case eScrLt: jump = (v <  in.a); break;
+                case eScrLe: jump = (v <= in.a); break;
+                case eScrGt: jump = (v >  in.a); break;
+                case eScrGe: jump = (v >= in.a); break;
+            }
+            stepDone(inst, jump ? static_cast<uint32_t>(in.b) : inst.pc + 1);
+            return true;
+        }
+
+        case eScrGoto:
+            stepDone(inst, static_cast<uint32_t>(in.b));
+            return true;
+
+        case eScrFail:
+            finish(inst, "fail");
+            return false;
+
+        case eScrEnd:
+            finish(inst, nullptr);
+            return false;
+
+        default:
+            break;
+    }
+
+    if (err != Siprix::ErrorCode::EOK)
+    {
+        finish(inst, "request failed", err);
+        return false;
+    }
+    stepDone(inst, inst.pc + 1);
+    return true;
+}
+
+bool ScriptRunner::matchExpect(Instance& inst, ScriptEvent event, uint8_t call, int32_t code)
+{
+    const std::vector<ScriptInstr>& instrs = script_.code();
+    for (uint32_t pc = inst.pc; instrs[pc].op == eScrExpect; ++pc)
+    {
+        const ScriptInstr& in = instrs[pc];
+        if ((in.event == event) && (in.call == call) && ((in.b < 0) || (in.b == code)))
+        {
+            if (in.var != ScenarioScript::kNoVar)
+                inst.vars[in.var] = code;
+            inst.pc = pc;
+            stepDone(inst, pc + 1);
+            return true;
+        }
+        if (!(in.flags & ScenarioScript::eScrOptional))
+            break;
+    }
+    return false;
+}
+
+void ScriptRunner::onEvent(Instance& inst, ScriptEvent event, uint8_t call, int32_t code)
+{
+    const ScriptInstr& in = script_.code()[inst.pc];
+    const bool expecting = inst.waiting && (in.op == eScrExpect);
+    if (expecting && matchExpect(inst, event, call, code))
+    {
+        inst.waiting = false;
+        run(inst);
+        return;
+    }
+
+    if ((event == eScrEvTerminated) && expecting)
+    {
+        finish(inst, "call terminated", code);
+        return;
+    }
+
+    //Kept for the next 'expect' (the oldest is dropped when buffer is full)
+    if (inst.pendingCount == std::size(inst.pending))
+    {
+        std::copy(inst.pending + 1, inst.pending + inst.pendingCount, inst.pending);
+        --inst.pendingCount;
+    }
+    inst.pending[inst.pendingCount++] = Pending{ event, call, code };
+}
+
+void ScriptRunner::wait(Instance& inst, uint32_t ms)
+{
+    inst.waiting = true;
+    ++inst.waitSeq;
+    deadlines_.push(Deadline{ EventLoop::Clock::now() + std::chrono::milliseconds(ms), inst.slot, inst.waitSeq });
+}
+
+void ScriptRunner::stepDone(Instance& inst, uint32_t nextPc)
+{
+    const auto now = EventLoop::Clock::now();
+    steps_[inst.pc].us.add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - inst.stepStarted).count()));
+    inst.pc = nextPc;
+    inst.stepStarted = now;
+}
+
+void ScriptRunner::finish(Instance& inst, const char* failure, int32_t code)
+{
+    if (failure)
+    {
+        ++failed_;
+        ++steps_[inst.pc].failures;
+        lastFailure_ = "#" + std::to_string(inst.index) + " " + script_.describe(inst.pc) + ": " + failure;
+        if (code)
+            lastFailure_ += " (" + std::to_string(code) + ")";
+    }
+    else
+    {
+        ++completed_;
+        const auto duration = EventLoop::Clock::now() - inst.started;
+        durationMs_.add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count()));
+    }
+
+    //Calls which are still active are ended
+    for (uint8_t i = 0; i < ScenarioScript::kMaxCalls; ++i)
+    {
+        if (inst.players[i])
+            players_.erase(key(inst.modules[i], inst.players[i]));
+        if (!inst.calls[i] || inst.terminated[i])
+            continue;
+        calls_.erase(key(inst.modules[i], inst.calls[i]));
+        actions_.bye(inst.modules[i], inst.calls[i]);
+    }
+
+    inst.active = false;
+    inst.waiting = false;
+    freeSlots_.push_back(inst.slot);
+    --active_;
+}
+
+void ScriptRunner::onAppEvent(const AppEvent& ev)
+{
+    if (ev.type == AppEvent::eCallIncoming)
+    {
+        //Each incoming call (up to 'count') starts instance of incoming script
+        if (!isRunning() || !script_.incoming() || (started_ >= params_.count))
+            return;
+        Instance& inst = newInstance();
+        inst.calls[0] = ev.id;
+        inst.modules[0] = ev.module;
+        calls_[key(ev.module, ev.id)] = ref(inst, 0);
+        if (matchExpect(inst, eScrEvIncoming, 0, 0))
+            run(inst);
+        else
+            finish(inst, "incoming call doesn't match");
+        return;
+    }
+
+    if (ev.type == AppEvent::ePlayerState)
+    {
+        const Siprix::PlayerState state = static_cast<Siprix::PlayerState>(ev.code);
+        auto it = players_.find(key(ev.module, ev.id));
+        if ((state == Siprix::PlayerState::PlayerStarted) || (it == players_.end()))
+            return;
+        Instance& inst = slots_[it->second / ScenarioScript::kMaxCalls];
+        const uint8_t call = static_cast<uint8_t>(it->second % ScenarioScript::kMaxCalls);
+        inst.players[call] = 0;
+        players_.erase(it);
+        onEvent(inst, eScrEvPlayed, call, static_cast<int32_t>(ev.code));
+        return;
+    }
+
+    ScriptEvent event = eScrEvents;
+    switch (ev.type)
+    {
+        case AppEvent::eCallProceeding:   event = eScrEvProceeding;  break;
+        case AppEvent::eCallConnected:    event = eScrEvConnected;   break;
+        case AppEvent::eCallTerminated:   event = eScrEvTerminated;  break;
+        case AppEvent::eCallTransferred:  event = eScrEvTransferred; break;
+        case AppEvent::eCallRedirected:   event = eScrEvRedirected;  break;
+        case AppEvent::eCallDtmfReceived: event = eScrEvDtmf;        break;
+        case AppEvent::eCallHeld:         event = eScrEvHeld;        break;
+        case AppEvent::eCallSwitched:     event = eScrEvSwitched;    break;
+        default: return;
+    }
+
+    auto it = calls_.find(key(ev.module, ev.id));
+    if (it == calls_.end())
+        return;
+    Instance& inst = slots_[it->second / ScenarioScript::kMaxCalls];
+    const uint8_t call = static_cast<uint8_t>(it->second % ScenarioScript::kMaxCalls);
+    if (event == eScrEvTerminated)
+    {
+        inst.terminated[call] = true;
+        calls_.erase(it);
+    }
+    onEvent(inst, event, call, static_cast<int32_t>(ev.code));
+}
+
+void ScriptRunner::onTimer()
+{
+    const auto now = EventLoop::Clock::now();
+
+    //Start instances due by rate (incoming script is started by calls)
+    if (!script_.incoming())
+    {
+        uint64_t due = params_.count;
+        if (params_.rate > 0)
+        {
+            const double sec = std::chrono::duration<double>(now - startedAt_).count();
+            due = std::min<uint64_t>(params_.count, static_cast<uint64_t>(sec * params_.rate) + 1);
+        }
+        while (started_ < due)
+            run(newInstance());
+    }
+
+    while (!deadlines_.empty() && (deadlines_.top().time <= now))
+    {
+        const Deadline deadline = deadlines_.top();
+        deadlines_.pop();
+
+        Instance& inst = slots_[deadline.slot];
+        if (!inst.active || !inst.waiting || (inst.waitSeq != deadline.seq))
+            continue;
+
+        inst.waiting = false;
+        if (script_.code()[inst.pc].op == eScrPause)
+        {
+            stepDone(inst, inst.pc + 1);
+            run(inst);
+        }
+        else
+            finish(inst, "timeout");
+    }
+
+    if ((started_ == params_.count) && !active_ && timer_)
+    {
+        loop_.cancelTimer(timer_);
+        timer_ = 0;
+        deadlines_ = decltype(deadlines_)();
+        std::cout << "Script '" << params_.file << "' done: completed " << completed_ << ", failed " << failed_ << std::endl;
+    }
+}
+
+void ScriptRunner::print(std::ostream& os) const
+{
+    os << "script '" << params_.file << "': started:" << started_ << " active:" << active_
+       << " (max " << maxActive_ << ") completed:" << completed_ << " failed:" << failed_ << " duration(ms) ";
+    durationMs_.print(os);
+    for (size_t pc = 0; pc < script_.code().size(); ++pc)
+    {
+        if (!steps_[pc].us.count() && !steps_[pc].failures)
+            continue;
+        os << "\n      " << script_.describe(pc) << " (us) ";
+        steps_[pc].us.print(os);
+        if (steps_[pc].failures)
+            os << " failed:" << steps_[pc].failures;
+    }
+    if (!lastFailure_.empty())
+        os << "\n      last failure: " << lastFailure_;
+}
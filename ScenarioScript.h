@@ -0,0 +1,256 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "AppEvent.h"
+#include "EventLoop.h"
+#include "NodeAllocator.h"
+#include "Scenario.h"
+#include "Stats.h"
+
+////////////////////////////////////////////////////////////////////////////
+//ScenarioScript
+//Call flow described by text file, compiled once into bytecode:
+//
+//    timeout 10000                  #Default timeout of 'expect' (ms)
+//    invite $target                 #Call 0 (other calls: 'call=1')
+//    expect proceeding optional
+//    expect connected
+//    loop 3
+//      dtmf 1#
+//      expect dtmf timeout=3000 store=tone
+//      if tone != 5 goto wrong
+//    endloop
+//    hold
+//    expect held
+//    pause 1000
+//    bye
+//    expect terminated
+//    end
+//    label wrong
+//    fail
+//
+//Script which starts with 'expect incoming' handles incoming calls. See README for
+//all instructions. Strings are kept in one pool, instruction is 24 bytes.
+
+enum ScriptOp : uint8_t
+{
+    eScrInvite,        //str - extension, a - accId
+    eScrAccept,
+    eScrReject,        //a - status code
+    eScrDtmf,          //str - tones
+    eScrHold,
+    eScrTransfer,      //str - extension
+    eScrTransferAttended,//a - call index of the target
+    eScrPlay,          //str - prompt
+    eScrBye,
+    eScrExpect,        //event, a - timeout, b - code (-1 any), var - store
+    eScrPause,         //a - ms
+    eScrSet,           //var = a
+    eScrAdd,           //var += a
+    eScrIf,            //if (var <cmp> a) goto b
+    eScrGoto,          //b - target
+    eScrFail,
+    eScrEnd,
+    eScrOps
+};
+
+enum ScriptEvent : uint8_t
+{
+    eScrEvIncoming,
+    eScrEvProceeding,
+    eScrEvConnected,
+    eScrEvTerminated,
+    eScrEvTransferred,
+    eScrEvRedirected,
+    eScrEvDtmf,
+    eScrEvHeld,
+    eScrEvSwitched,
+    eScrEvPlayed,      //Player of the call stopped or finished
+    eScrEvents
+};
+
+enum ScriptCmp : uint8_t { eScrEq, eScrNe, eScrLt, eScrLe, eScrGt, eScrGe };
+
+struct ScriptInstr
+{
+    ScriptOp op;
+    uint8_t call;      //Index of the call of instance (0..kMaxCalls-1)
+    uint8_t event;     //ScriptEvent of 'expect', ScriptCmp of 'if'
+    uint8_t flags;     //eScrOptional
+    uint8_t var;       //Index of variable (0xFF - none)
+    uint8_t reserved[3];
+    int32_t a;
+    int32_t b;
+    uint32_t str;      //Offset in the pool of strings
+    uint32_t line;     //Of the script file
+};
+
+const char* getScriptOpStr(ScriptOp op);
+const char* getScriptEventStr(ScriptEvent event);
+
+//Values of $target, $transferTo, $dtmf are substituted when script is compiled
+struct ScriptParams
+{
+    std::string file;
+    Siprix::AccountId accId = 0;   //0 - accounts added by --accounts/config are used in turn
+    std::string target;
+    std::string transferTo;
+    std::string dtmf = "1#";
+    uint32_t timeoutMs = 30000;    //Default timeout of 'expect'
+    uint32_t count = 1;            //Script instances (calls handled by incoming script)
+    double rate = 0;               //Started per second (0 - all at once)
+};
+
+class ScenarioScript
+{
+public:
+    enum { kMaxCalls = 4, kMaxVars = 16, eScrOptional = 1 };
+    static const uint8_t kNoVar = 0xFF;
+
+    bool compile(const std::string& text, const ScriptParams& params, std::string& err);
+    bool load(const ScriptParams& params, std::string& err);
+
+    const std::vector<ScriptInstr>& code() const { return code_; }
+    const char* str(uint32_t offset) const { return pool_.data() + offset; }
+    const std::string& varName(uint8_t var) const { return vars_[var]; }
+    bool incoming() const { return !code_.empty() && (code_[0].op == eScrExpect) && (code_[0].event == eScrEvIncoming); }
+
+    //Text of the instruction (for reports)
+    std::string describe(size_t pc) const;
+
+protected:
+    uint32_t addString(const std::string& value);
+    int findVar(const std::string& name, bool create);
+
+    std::vector<ScriptInstr> code_;
+    std::string pool_;
+    std::vector<std::string> vars_;
+    std::vector<std::string> lines_;   //Source, for reports
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ScriptRunner
+//Executes instances of the compiled script on the loop thread. Instance is a fixed slot
+//(program counter, variables, calls, buffered events), so steps don't allocate memory.
+//Instance runs until 'expect' or 'pause', it's resumed by events of its calls and by
+//deadlines of one 10ms timer. Events which arrive before they are expected are buffered
+//(up to 8). Instance fails when expectation times out, call is terminated unexpectedly,
+//request is refused by SDK or 'fail' is executed; its calls are ended then.
+
+class ScriptRunner
+{
+public:
+    ScriptRunner(EventLoop& loop) : loop_(loop) {}
+    ~ScriptRunner();
+
+    bool start(const ScriptParams& params, const ScenarioActions& actions, std::string& err);
+    void stop();
+    bool isRunning() const { return timer_ != 0; }
+    size_t active() const { return active_; }
+
+    void onAppEvent(const AppEvent& ev);
+
+    //Report
+    const ScriptParams& params() const { return params_; }
+    const ScenarioScript& script() const { return script_; }
+    uint64_t started() const   { return started_; }
+    uint64_t completed() const { return completed_; }
+    uint64_t failed() const    { return failed_; }
+    size_t maxActive() const   { return maxActive_; }
+    const Histogram& durationMs() const { return durationMs_; }
+    const Histogram& stepUs(size_t pc) const { return steps_[pc].us; }
+    uint64_t stepFailures(size_t pc) const { return steps_[pc].failures; }
+    const std::string& lastFailure() const { return lastFailure_; }
+    void print(std::ostream& os) const;
+
+protected:
+    struct Pending {
+        ScriptEvent event;
+        uint8_t call;
+        int32_t code;
+    };
+
+    struct Instance {
+        bool active = false;
+        uint32_t index = 0;
+        uint32_t slot = 0;
+        uint32_t pc = 0;
+        bool waiting = false;      //On 'expect' or 'pause'
+        uint32_t waitSeq = 0;
+        int32_t vars[ScenarioScript::kMaxVars];
+        Siprix::CallId calls[ScenarioScript::kMaxCalls];
+        uint8_t modules[ScenarioScript::kMaxCalls];
+        bool terminated[ScenarioScript::kMaxCalls];
+        Siprix::PlayerId players[ScenarioScript::kMaxCalls];
+        Pending pending[8];
+        uint8_t pendingCount = 0;
+        EventLoop::Clock::time_point started;
+        EventLoop::Clock::time_point stepStarted;
+    };
+
+    struct Step {
+        Histogram us;
+        uint64_t failures = 0;
+    };
+
+    struct Deadline {
+        EventLoop::Clock::time_point time;
+        uint32_t slot;
+        uint32_t seq;
+        bool operator>(const Deadline& other) const { return time > other.time; }
+    };
+
+    static uint64_t key(uint8_t module, uint32_t id) { return (static_cast<uint64_t>(module) << 32) | id; }
+    static uint32_t ref(const Instance& inst, uint8_t call) { return inst.slot * ScenarioScript::kMaxCalls + call; }
+
+    Instance& newInstance();
+    void run(Instance& inst);
+    bool execute(Instance& inst, const ScriptInstr& in);
+    bool matchExpect(Instance& inst, ScriptEvent event, uint8_t call, int32_t code);
+    void onEvent(Instance& inst, ScriptEvent event, uint8_t call, int32_t code);
+    void wait(Instance& inst, uint32_t ms);
+    void stepDone(Instance& inst, uint32_t nextPc);
+    void finish(Instance& inst, const char* failure, int32_t code = 0);
+    void onTimer();
+
+    EventLoop& loop_;
+    ScriptParams params_;
+    ScenarioActions actions_;
+    ScenarioScript script_;
+    std::unique_ptr<Step[]> steps_;
+    EventLoop::TimerId timer_ = 0;
+    EventLoop::Clock::time_point startedAt_;
+
+    std::deque<Instance> slots_;
+    std::vector<uint32_t> freeSlots_;
+    //Nodes are reused (entries are added and removed by each call), buckets stay at peak size
+    typedef std::unordered_map<uint64_t, uint32_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               NodeAllocator<std::pair<const uint64_t, uint32_t>>> IdMap;
+    IdMap calls_;   //module+callId -> slot * kMaxCalls + call index
+    IdMap players_; //module+playerId -> slot * kMaxCalls + call index
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines_;
+
+    size_t active_ = 0;
+    size_t maxActive_ = 0;
+    uint64_t started_ = 0;
+    uint64_t completed_ = 0;
+    uint64_t failed_ = 0;
+    std::string lastFailure_;
+    Histogram durationMs_;
+};
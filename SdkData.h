@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "SdkProxy.h"
+
+////////////////////////////////////////////////////////////////////////////
+//SdkData
+//Owners of data objects of the SDK (AccData, DestData, IniData, VideoData). *_GetDefault
+//allocates new object and SDK exports no function which frees it, so owner doesn't delete
+//object: destructor returns it to the pool of the type, where next owner of the same profile
+//takes it. Profile names the set of settings which users of the object apply. Settings which
+//are appended (x-headers, DNS servers, ...) can't be removed, so they are applied once, while
+//object isn't configured; settings which overwrite value are set by each user.
+//Objects created by the process are bounded by max number of owners existing at once.
+
+template<typename T> struct SdkDataTraits;
+
+template<> struct SdkDataTraits<Siprix::AccData> {
+    static Siprix::AccData* create() { return Sdk::Acc_GetDefault(); }
+    static const char* name() { return "AccData"; }
+};
+template<> struct SdkDataTraits<Siprix::DestData> {
+    static Siprix::DestData* create() { return Sdk::Dest_GetDefault(); }
+    static const char* name() { return "DestData"; }
+};
+template<> struct SdkDataTraits<Siprix::IniData> {
+    static Siprix::IniData* create() { return Sdk::Ini_GetDefault(); }
+    static const char* name() { return "IniData"; }
+};
+template<> struct SdkDataTraits<Siprix::VideoData> {
+    static Siprix::VideoData* create() { return Sdk::Vdo_GetDefault(); }
+    static const char* name() { return "VideoData"; }
+};
+
+//Objects of one type which have no owner (one pool in the process, as static members of template)
+template<typename T>
+struct SdkDataPool
+{
+    struct Item {
+        T* data;
+        bool configured;
+    };
+
+    //Returns object of the profile or creates new one
+    static Item take(const std::string& profile)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = items.find(profile);
+            if (it != items.end())
+            {
+                const Item item = it->second;
+                items.erase(it);
+                reused.fetch_add(1, std::memory_order_relaxed);
+                return item;
+            }
+        }
+        created.fetch_add(1, std::memory_order_relaxed);
+        return Item{ SdkDataTraits<T>::create(), false };
+    }
+
+    static void give(const std::string& profile, const Item& item)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        items.emplace(profile, item);
+    }
+
+    static size_t pooled()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    static std::mutex mutex;
+    static std::unordered_multimap<std::string, Item> items;
+    static std::atomic<uint64_t> created;
+    static std::atomic<uint64_t> reused;
+    static std::atomic<uint64_t> dropped;//Taken out of use by SdkDataCache (not freed, SDK can't)
+};
+template<typename T> std::mutex SdkDataPool<T>::mutex;
+template<typename T> std::unordered_multimap<std::string, typename SdkDataPool<T>::Item> SdkDataPool<T>::items;
+template<typename T> std::atomic<uint64_t> SdkDataPool<T>::created(0);
+template<typename T> std::atomic<uint64_t> SdkDataPool<T>::reused(0);
+template<typename T> std::atomic<uint64_t> SdkDataPool<T>::dropped(0);
+
+//Owner of one object, used by one thread at a time
+template<typename T>
+class SdkData
+{
+public:
+    explicit SdkData(std::string profile) : profile_(std::move(profile)), item_(SdkDataPool<T>::take(profile_)) {}
+    ~SdkData() { if (item_.data) SdkDataPool<T>::give(profile_, item_); }
+
+    SdkData(const SdkData&) = delete;
+    SdkData& operator=(const SdkData&) = delete;
+    SdkData(SdkData&& other) noexcept : profile_(std::move(other.profile_)), item_(other.item_) { other.item_.data = nullptr; }
+
+    T* get() const { return item_.data; }
+    const std::string& profile() const { return profile_; }
+
+    //Object won't be returned to the pool
+    void drop()
+    {
+        if (item_.data)
+            SdkDataPool<T>::dropped.fetch_add(1, std::memory_order_relaxed);
+        item_.data = nullptr;
+    }
+
+    //Appended settings of the profile were applied (by this or previous owner)
+    bool configured() const { return item_.configured; }
+    void setConfigured() { item_.configured = true; }
+
+protected:
+    std::string profile_;
+    typename SdkDataPool<T>::Item item_;
+};
+
+//Owners of the profiles made of per-use values (x-headers of the call), used by one thread.
+//Profile is kept while it's among 'capacity' most recently used ones, so repeated values reuse
+//object; least recently used one is dropped instead of being pooled (its values are unlikely
+//to repeat). Unique value per use still costs one SDK object each (see SdkDataPool::dropped),
+//but app's memory for them stays bounded.
+template<typename T>
+class SdkDataCache
+{
+public:
+    explicit SdkDataCache(size_t capacity) : capacity_(capacity) {}
+
+    SdkData<T>& get(const std::string& profile)
+    {
+        auto it = index_.find(profile);
+        if (it != index_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return *it->second;
+        }
+        if (!lru_.empty() && (lru_.size() >= capacity_))
+        {
+            lru_.back().drop();
+            index_.erase(lru_.back().profile());
+            lru_.pop_back();
+        }
+        lru_.emplace_front(profile);
+        index_.emplace(profile, lru_.begin());
+        return lru_.front();
+    }
+
+    size_t size() const { return lru_.size(); }
+
+protected:
+    size_t capacity_;
+    std::list<SdkData<T>> lru_;//Most recently used first
+    std::unordered_map<std::string, typename std::list<SdkData<T>>::iterator> index_;
+};
+
+template<typename T>
+void printSdkDataPool(std::ostream& os)
+{
+    os << SdkDataTraits<T>::name() << " created:" << SdkDataPool<T>::created.load(std::memory_order_relaxed)
+       << " reused:" << SdkDataPool<T>::reused.load(std::memory_order_relaxed)
+       << " pooled:" << SdkDataPool<T>::pooled()
+       << " dropped:" << SdkDataPool<T>::dropped.load(std::memory_order_relaxed);
+}
+
+inline void printSdkDataStats(std::ostream& os)
+{
+    os << "sdk data: ";
+    printSdkDataPool<Siprix::AccData>(os);   os << "  ";
+    printSdkDataPool<Siprix::DestData>(os);  os << "  ";
+    printSdkDataPool<Siprix::IniData>(os);   os << "  ";
+    printSdkDataPool<Siprix::VideoData>(os);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////
+//Functions exported by the SDK (declared in Siprix.h): F(return type, name, parameters, arguments).
+//Expanded by SdkLoader (pointers resolved by 'dlsym') and SdkProxy (instrumented wrappers).
+//Types are used without namespace, so list is expanded inside of namespace Siprix or with 'using' it.
+
+#define SIPRIX_FUNCTIONS(F) \
+    SIPRIX_API_FUNCTIONS(F) \
+    F(const char*,    GetErrorText,                    (ErrorCode code), (code))
+
+#define SIPRIX_API_FUNCTIONS(F) \
+    F(ISiprixModule*, Module_Create,                   (), ()) \
+    F(ErrorCode,      Module_Initialize,               (ISiprixModule* module, IniData* ini), (module, ini)) \
+    F(ErrorCode,      Module_UnInitialize,             (ISiprixModule* module), (module)) \
+    F(bool,           Module_IsInitialized,            (ISiprixModule* module), (module)) \
+    F(const char*,    Module_Version,                  (ISiprixModule* module), (module)) \
+    F(uint32_t,       Module_VersionCode,              (ISiprixModule* module), (module)) \
+    F(ErrorCode,      Account_Add,                     (ISiprixModule* module, AccData* acc, AccountId* accId), (module, acc, accId)) \
+    F(ErrorCode,      Account_Update,                  (ISiprixModule* module, AccData* acc, AccountId accId), (module, acc, accId)) \
+    F(ErrorCode,      Account_GetRegState,             (ISiprixModule* module, AccountId accId, RegState* state), (module, accId, state)) \
+    F(ErrorCode,      Account_Register,                (ISiprixModule* module, AccountId accId, uint32_t expireTime), (module, accId, expireTime)) \
+    F(ErrorCode,      Account_Unregister,              (ISiprixModule* module, AccountId accId), (module, accId)) \
+    F(ErrorCode,      Account_Delete,                  (ISiprixModule* module, AccountId accId), (module, accId)) \
+    F(ErrorCode,      Call_Invite,                     (ISiprixModule* module, DestData* destination, CallId* callId), (module, destination, callId)) \
+    F(ErrorCode,      Call_Reject,                     (ISiprixModule* module, CallId callId, uint16_t statusCode), (module, callId, statusCode)) \
+    F(ErrorCode,      Call_Accept,                     (ISiprixModule* module, CallId callId, bool withVideo), (module, callId, withVideo)) \
+    F(ErrorCode,      Call_Hold,                       (ISiprixModule* module, CallId callId), (module, callId)) \
+    F(ErrorCode,      Call_GetHoldState,               (ISiprixModule* module, CallId callId, HoldState* state), (module, callId, state)) \
+    F(ErrorCode,      Call_GetVideoState,              (ISiprixModule* module, CallId callId, bool* hasVideo), (module, callId, hasVideo)) \
+    F(ErrorCode,      Call_MuteMic,                    (ISiprixModule* module, CallId callId, bool mute), (module, callId, mute)) \
+    F(ErrorCode,      Call_MuteCam,                    (ISiprixModule* module, CallId callId, bool mute), (module, callId, mute)) \
+    F(ErrorCode,      Call_SendDtmf,                   (ISiprixModule* module, CallId callId, const char* dtmfs, uint16_t durationMs, uint16_t intertoneGapMs, DtmfMethod method), (module, callId, dtmfs, durationMs, intertoneGapMs, method)) \
+    F(ErrorCode,      Call_PlayFile,                   (ISiprixModule* module, CallId callId, const char* pathToMp3File, bool loop, PlayerId* playerId), (module, callId, pathToMp3File, loop, playerId)) \
+    F(ErrorCode,      Call_StopPlayFile,               (ISiprixModule* module, PlayerId playerId), (module, playerId)) \
+    F(ErrorCode,      Call_RecordFile,                 (ISiprixModule* module, CallId callId, const char* pathToMp3File), (module, callId, pathToMp3File)) \
+    F(ErrorCode,      Call_StopRecordFile,             (ISiprixModule* module, CallId callId), (module, callId)) \
+    F(ErrorCode,      Call_TransferBlind,              (ISiprixModule* module, CallId callId, const char* toExt), (module, callId, toExt)) \
+    F(ErrorCode,      Call_TransferAttended,           (ISiprixModule* module, CallId fromCallId, CallId toCallId), (module, fromCallId, toCallId)) \
+    F(ErrorCode,      Call_SetVideoWindow,             (ISiprixModule* module, CallId callId, void* wnd), (module, callId, wnd)) \
+    F(ErrorCode,      Call_SetVideoRenderer,           (ISiprixModule* module, CallId callId, IVideoRenderer* r), (module, callId, r)) \
+    F(ErrorCode,      Call_Renegotiate,                (ISiprixModule* module, CallId callId), (module, callId)) \
+    F(ErrorCode,      Call_Bye,                        (ISiprixModule* module, CallId callId), (module, callId)) \
+    F(ErrorCode,      Mixer_SwitchToCall,              (ISiprixModule* module, CallId callId), (module, callId)) \
+    F(ErrorCode,      Mixer_MakeConference,            (ISiprixModule* module), (module)) \
+    F(ErrorCode,      Dvc_GetPlayoutDevices,           (ISiprixModule* module, uint32_t* numberOfDevices), (module, numberOfDevices)) \
+    F(ErrorCode,      Dvc_GetRecordingDevices,         (ISiprixModule* module, uint32_t* numberOfDevices), (module, numberOfDevices)) \
+    F(ErrorCode,      Dvc_GetVideoDevices,             (ISiprixModule* module, uint32_t* numberOfDevices), (module, numberOfDevices)) \
+    F(ErrorCode,      Dvc_GetPlayoutDevice,            (ISiprixModule* module, uint16_t index, char* name, uint32_t nameLength, char* guid, uint32_t guidLength), (module, index, name, nameLength, guid, guidLength)) \
+    F(ErrorCode,      Dvc_GetRecordingDevice,          (ISiprixModule* module, uint16_t index, char* name, uint32_t nameLength, char* guid, uint32_t guidLength), (module, index, name, nameLength, guid, guidLength)) \
+    F(ErrorCode,      Dvc_GetVideoDevice,              (ISiprixModule* module, uint16_t index, char* name, uint32_t nameLength, char* guid, uint32_t guidLength), (module, index, name, nameLength, guid, guidLength)) \
+    F(ErrorCode,      Dvc_SetPlayoutDevice,            (ISiprixModule* module, uint16_t index), (module, index)) \
+    F(ErrorCode,      Dvc_SetRecordingDevice,          (ISiprixModule* module, uint16_t index), (module, index)) \
+    F(ErrorCode,      Dvc_SetVideoDevice,              (ISiprixModule* module, uint16_t index), (module, index)) \
+    F(ErrorCode,      Dvc_SetVideoParams,              (ISiprixModule* module, VideoData* params), (module, params)) \
+    F(ErrorCode,      Callback_SetTrialModeNotified,   (ISiprixModule* module, OnTrialModeNotified callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetDevicesAudioChanged, (ISiprixModule* module, OnDevicesAudioChanged callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetAccountRegState,     (ISiprixModule* module, OnAccountRegState callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetNetworkState,        (ISiprixModule* module, OnNetworkState callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetPlayerState,         (ISiprixModule* module, OnPlayerState callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetRingerState,         (ISiprixModule* module, OnRingerState callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetCallProceeding,      (ISiprixModule* module, OnCallProceeding callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetCallTerminated,      (ISiprixModule* module, OnCallTerminated callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetCallConnected,       (ISiprixModule* module, OnCallConnected callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetCallIncoming,        (ISiprixModule* module, OnCallIncoming callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetCallDtmfReceived,    (ISiprixModule* module, OnCallDtmfReceived callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetCallTransferred,     (ISiprixModule* module, OnCallTransferred callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetCallRedirected,      (ISiprixModule* module, OnCallRedirected callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetCallSwitched,        (ISiprixModule* module, OnCallSwitched callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetCallHeld,            (ISiprixModule* module, OnCallHeld callback), (module, callback)) \
+    F(ErrorCode,      Callback_SetEventHandler,        (ISiprixModule* module, ISiprixEventHandler* handler), (module, handler)) \
+    F(AccData*,       Acc_GetDefault,                  (), ()) \
+    F(void,           Acc_SetSipServer,                (AccData* acc, const char* sipServer), (acc, sipServer)) \
+    F(void,           Acc_SetSipExtension,             (AccData* acc, const char* sipExtension), (acc, sipExtension)) \
+    F(void,           Acc_SetSipAuthId,                (AccData* acc, const char* sipAuthId), (acc, sipAuthId)) \
+    F(void,           Acc_SetSipPassword,              (AccData* acc, const char* sipPassword), (acc, sipPassword)) \
+    F(void,           Acc_SetExpireTime,               (AccData* acc, uint32_t expireTime), (acc, expireTime)) \
+    F(void,           Acc_SetSipProxyServer,           (AccData* acc, const char* sipProxyServer), (acc, sipProxyServer)) \
+    F(void,           Acc_SetStunServer,               (AccData* acc, const char* stunServer), (acc, stunServer)) \
+    F(void,           Acc_SetTurnServer,               (AccData* acc, const char* turnServer), (acc, turnServer)) \
+    F(void,           Acc_SetTurnUser,                 (AccData* acc, const char* turnUser), (acc, turnUser)) \
+    F(void,           Acc_SetTurnPassword,             (AccData* acc, const char* turnPassword), (acc, turnPassword)) \
+    F(void,           Acc_SetUserAgent,                (AccData* acc, const char* userAgent), (acc, userAgent)) \
+    F(void,           Acc_SetDisplayName,              (AccData* acc, const char* displayName), (acc, displayName)) \
+    F(void,           Acc_SetInstanceId,               (AccData* acc, const char* instanceId), (acc, instanceId)) \
+    F(void,           Acc_SetRingToneFile,             (AccData* acc, const char* ringTonePath), (acc, ringTonePath)) \
+    F(void,           Acc_SetSecureMediaMode,          (AccData* acc, SecureMedia mode), (acc, mode)) \
+    F(void,           Acc_SetUseSipSchemeForTls,       (AccData* acc, bool useSipSchemeForTls), (acc, useSipSchemeForTls)) \
+    F(void,           Acc_SetRtcpMuxEnabled,           (AccData* acc, bool rtcpMuxEnabled), (acc, rtcpMuxEnabled)) \
+    F(void,           Acc_SetIceEnabled,               (AccData* acc, bool iceEnabled), (acc, iceEnabled)) \
+    F(void,           Acc_SetKeepAliveTime,            (AccData* acc, uint32_t keepAliveTimeSec), (acc, keepAliveTimeSec)) \
+    F(void,           Acc_SetTranspProtocol,           (AccData* acc, SipTransport transp), (acc, transp)) \
+    F(void,           Acc_SetTranspPort,               (AccData* acc, uint16_t transpPort), (acc, transpPort)) \
+    F(void,           Acc_SetTranspTlsCaCert,          (AccData* acc, const char* pathToCaCertPem), (acc, pathToCaCertPem)) \
+    F(void,           Acc_SetTranspBindAddr,           (AccData* acc, const char* ipAddr), (acc, ipAddr)) \
+    F(void,           Acc_SetTranspPreferIPv6,         (AccData* acc, bool prefer), (acc, prefer)) \
+    F(void,           Acc_AddXHeader,                  (AccData* acc, const char* header, const char* value), (acc, header, value)) \
+    F(void,           Acc_AddXContactUriParam,         (AccData* acc, const char* param, const char* value), (acc, param, value)) \
+    F(void,           Acc_SetRewriteContactIp,         (AccData* acc, bool enabled), (acc, enabled)) \
+    F(void,           Acc_AddAudioCodec,               (AccData* acc, AudioCodec codec), (acc, codec)) \
+    F(void,           Acc_AddVideoCodec,               (AccData* acc, VideoCodec codec), (acc, codec)) \
+    F(void,           Acc_ResetAudioCodecs,            (AccData* acc), (acc)) \
+    F(void,           Acc_ResetVideoCodecs,            (AccData* acc), (acc)) \
+    F(const char*,    Acc_GenerateInstanceId,          (), ()) \
+    F(IniData*,       Ini_GetDefault,                  (), ()) \
+    F(void,           Ini_SetLicense,                  (IniData* ini, const char* license), (ini, license)) \
+    F(void,           Ini_SetLogLevelFile,             (IniData* ini, uint8_t logLevel), (ini, logLevel)) \
+    F(void,           Ini_SetLogLevelIde,              (IniData* ini, uint8_t logLevel), (ini, logLevel)) \
+    F(void,           Ini_SetShareUdpTransport,        (IniData* ini, bool shareUdpTransport), (ini, shareUdpTransport)) \
+    F(void,           Ini_SetUseExternalRinger,        (IniData* ini, bool useExternalRinger), (ini, useExternalRinger)) \
+    F(void,           Ini_SetDmpOnUnhandledExc,        (IniData* ini, bool writeDmpUnhandledExc), (ini, writeDmpUnhandledExc)) \
+    F(void,           Ini_SetTlsVerifyServer,          (IniData* ini, bool tlsVerifyServer), (ini, tlsVerifyServer)) \
+    F(void,           Ini_SetSingleCallMode,           (IniData* ini, bool singleCallMode), (ini, singleCallMode)) \
+    F(void,           Ini_SetRtpStartPort,             (IniData* ini, uint16_t rtpStartPort), (ini, rtpStartPort)) \
+    F(void,           Ini_SetHomeFolder,               (IniData* ini, const char* homeFolder), (ini, homeFolder)) \
+    F(void,           Ini_AddDnsServer,                (IniData* ini, const char* dns), (ini, dns)) \
+    F(DestData*,      Dest_GetDefault,                 (), ()) \
+    F(void,           Dest_SetExtension,               (DestData* dest, const char* extension), (dest, extension)) \
+    F(void,           Dest_SetAccountId,               (DestData* dest, AccountId accId), (dest, accId)) \
+    F(void,           Dest_SetVideoCall,               (DestData* dest, bool video), (dest, video)) \
+    F(void,           Dest_SetInviteTimeout,           (DestData* dest, int inviteTimeoutSec), (dest, inviteTimeoutSec)) \
+    F(void,           Dest_AddXHeader,                 (DestData* dest, const char* header, const char* value), (dest, header, value)) \
+    F(VideoData*,     Vdo_GetDefault,                  (), ()) \
+    F(void,           Vdo_SetNoCameraImgPath,          (VideoData* vdo, const char* pathToJpg), (vdo, pathToJpg)) \
+    F(void,           Vdo_SetFramerate,                (VideoData* vdo, int fps), (vdo, fps)) \
+    F(void,           Vdo_SetBitrate,                  (VideoData* vdo, int bitrateKbps), (vdo, bitrateKbps)) \
+    F(void,           Vdo_SetHeight,                   (VideoData* vdo, int height), (vdo, height)) \
+    F(void,           Vdo_SetWidth,                    (VideoData* vdo, int width), (vdo, width))
@@ -0,0 +1,139 @@
+#include "SdkLoader.h"
+
+#ifdef SIPRIX_DYNAMIC_LOAD
+
+#include <dlfcn.h>
+#include <unistd.h>
+#include <climits>
+
+#include "Siprix.h"
+#include "SdkFunctions.h"
+
+static const char* kCoreLibName  = "libsiprix.so";
+static const char* kMediaLibName = "libsiprixMedia.so";
+
+static SdkLibInfo g_core;
+static SdkLibInfo g_media;
+
+namespace Siprix {
+
+//Pointers resolved by 'sdkLoad'
+struct SdkFunctions
+{
+#define SDK_FN_POINTER(ret, name, params, args) ret (*name) params = nullptr;
+    SIPRIX_FUNCTIONS(SDK_FN_POINTER)
+#undef SDK_FN_POINTER
+};
+static SdkFunctions g_fn;
+
+//Wrappers with the names and signatures of the exported functions, so code which uses SDK
+//doesn't depend on how it's loaded. Must not be invoked before 'sdkLoad' succeeded.
+extern "C" {
+#define SDK_FN_WRAPPER(ret, name, params, args) ret name params { return g_fn.name args; }
+    SIPRIX_FUNCTIONS(SDK_FN_WRAPPER)
+#undef SDK_FN_WRAPPER
+}//extern "C"
+
+}//namespace Siprix
+
+
+//Libraries are searched near the executable first (CMake copies them there),
+//then by the system rules (LD_LIBRARY_PATH, ld.so.cache)
+static void* openLibrary(const char* name, int flags, SdkLibInfo& info, std::string& err)
+{
+    info.began = std::chrono::steady_clock::now();
+
+    void* handle = nullptr;
+    char exePath[PATH_MAX];
+    const ssize_t len = readlink("/proc/self/exe", exePath, sizeof(exePath) - 1);
+    if (len > 0)
+    {
+        std::string path(exePath, static_cast<size_t>(len));
+        path.resize(path.rfind('/') + 1);
+        path += name;
+        if (access(path.c_str(), F_OK) == 0)
+        {
+            info.path = path;
+            handle = dlopen(path.c_str(), flags);
+        }
+    }
+    if (info.path.empty())
+    {
+        info.path = name;
+        handle = dlopen(name, flags);
+    }
+
+    info.ended = std::chrono::steady_clock::now();
+    info.loaded = (handle != nullptr);
+    if (!handle)
+    {
+        const char* text = dlerror();
+        err = std::string("Can't load ") + name + ": " + (text ? text : "unknown error");
+    }
+    return handle;
+}
+
+bool sdkLoadMedia(std::string& err)
+{
+    if (g_media.loaded)
+        return true;
+
+    //Global - makes symbols available to the SDK library, which depends on it
+    return openLibrary(kMediaLibName, RTLD_NOW | RTLD_GLOBAL, g_media, err) != nullptr;
+}
+
+bool sdkLoad(bool withMedia, std::string& err)
+{
+    if (g_core.loaded)
+        return true;
+
+    if (withMedia && !sdkLoadMedia(err))
+        return false;
+
+    //Lazy binding - only functions which are really invoked get resolved by the dynamic linker
+    void* handle = openLibrary(kCoreLibName, RTLD_LAZY | RTLD_LOCAL, g_core, err);
+    if (!handle)
+        return false;
+
+#define SDK_FN_RESOLVE(ret, name, params, args) \
+    g_fn.name = reinterpret_cast<ret (*) params>(dlsym(handle, #name)); \
+    if (!g_fn.name) { err = std::string("Can't resolve function ") + #name + " in " + g_core.path; return false; }
+
+    using namespace Siprix;
+    SIPRIX_FUNCTIONS(SDK_FN_RESOLVE)
+#undef SDK_FN_RESOLVE
+
+    g_core.ended = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool sdkIsDynamic()
+{
+    return true;
+}
+
+bool sdkIsMediaMapped()
+{
+    void* handle = dlopen(kMediaLibName, RTLD_LAZY | RTLD_NOLOAD);
+    if (handle)
+        dlclose(handle);
+    return g_media.loaded || (handle != nullptr);
+}
+
+const SdkLibInfo& sdkCoreInfo()  { return g_core;  }
+const SdkLibInfo& sdkMediaInfo() { return g_media; }
+
+#else
+
+//SDK is linked to the executable
+static SdkLibInfo g_none;
+
+bool sdkLoad(bool, std::string&)    { return true;  }
+bool sdkLoadMedia(std::string&)     { return true;  }
+bool sdkIsDynamic()                 { return false; }
+bool sdkIsMediaMapped()             { return true;  }
+
+const SdkLibInfo& sdkCoreInfo()     { return g_none; }
+const SdkLibInfo& sdkMediaInfo()    { return g_none; }
+
+#endif //SIPRIX_DYNAMIC_LOAD
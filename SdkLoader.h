@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////
+//SdkLoader
+//By default SDK libraries are linked to the executable and loaded by the system loader.
+//When built with SIPRIX_DYNAMIC_LOAD (CMake option of the same name) libraries are opened
+//by 'dlopen' and functions declared in Siprix.h are thin wrappers, which call pointers
+//resolved by 'dlsym'. Media library is opened only when it's required, so signaling-only
+//runs don't pay for its loading, memory and threads.
+
+struct SdkLibInfo
+{
+    std::string path;    //Path which library was opened by
+    bool loaded = false;
+    std::chrono::steady_clock::time_point began;
+    std::chrono::steady_clock::time_point ended;
+};
+
+//Opens SDK library and resolves its functions. Media library is opened before it when 'withMedia'.
+//Does nothing in the build which links SDK to the executable.
+bool sdkLoad(bool withMedia, std::string& err);
+
+//Opens media library, when it isn't loaded yet
+bool sdkLoadMedia(std::string& err);
+
+//True when SDK is loaded by 'dlopen'
+bool sdkIsDynamic();
+
+//True when media library is mapped into the process (also when SDK pulled it as own dependency)
+bool sdkIsMediaMapped();
+
+const SdkLibInfo& sdkCoreInfo();
+const SdkLibInfo& sdkMediaInfo();
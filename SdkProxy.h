@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "SdkFunctions.h"
+#include "Stats.h"
+
+////////////////////////////////////////////////////////////////////////////
+//SdkProxy
+//Functions of namespace Sdk have names and signatures of the SDK exports, application invokes
+//them instead of functions of namespace Siprix. When built with SIPRIX_API_STATS (CMake option)
+//each call is counted with its duration (ns) and returned error code. Otherwise wrappers are
+//inline forwards, which compile to direct calls of the SDK.
+
+enum SdkFn : uint16_t
+{
+#define SDK_FN_ID(ret, name, params, args) eSdk_##name,
+    SIPRIX_FUNCTIONS(SDK_FN_ID)
+#undef SDK_FN_ID
+    eSdkFnCount
+};
+
+inline const char* getSdkFnName(SdkFn fn)
+{
+#define SDK_FN_NAME(ret, name, params, args) #name,
+    static const char* const names[] = { SIPRIX_FUNCTIONS(SDK_FN_NAME) };
+#undef SDK_FN_NAME
+    return (fn < eSdkFnCount) ? names[fn] : "";
+}
+
+//Counters of one function, updated by any thread without locks
+struct SdkFnStats
+{
+    enum { kErrorSlots = 8 };
+
+    Histogram latencyNs;                        //Counts calls too
+    std::atomic<uint64_t> errors;
+    std::atomic<int32_t>  errorCodes[kErrorSlots];//Slot is taken by the first error with this code (0 - free)
+    std::atomic<uint64_t> errorCounts[kErrorSlots];
+    std::atomic<uint64_t> otherErrors;          //Codes which didn't get a slot
+
+    SdkFnStats() { reset(); }
+
+    void addError(int32_t code)
+    {
+        errors.fetch_add(1, std::memory_order_relaxed);
+        for (int i = 0; i < kErrorSlots; ++i)
+        {
+            int32_t slotCode = errorCodes[i].load(std::memory_order_relaxed);
+            if (!slotCode && errorCodes[i].compare_exchange_strong(slotCode, code, std::memory_order_relaxed))
+                slotCode = code;
+            if (slotCode == code)
+            {
+                errorCounts[i].fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        otherErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        latencyNs.reset();
+        errors.store(0, std::memory_order_relaxed);
+        otherErrors.store(0, std::memory_order_relaxed);
+        for (int i = 0; i < kErrorSlots; ++i)
+        {
+            errorCodes[i].store(0, std::memory_order_relaxed);
+            errorCounts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+//Counters of all functions (one instance in the process, as static member of template)
+template<typename T = void>
+struct SdkStatsTable
+{
+    static SdkFnStats fns[eSdkFnCount];
+};
+template<typename T> SdkFnStats SdkStatsTable<T>::fns[eSdkFnCount];
+
+inline SdkFnStats& sdkFnStats(SdkFn fn) { return SdkStatsTable<>::fns[fn]; }
+
+inline void sdkResetStats()
+{
+    for (int i = 0; i < eSdkFnCount; ++i)
+        sdkFnStats(static_cast<SdkFn>(i)).reset();
+}
+
+inline bool sdkStatsEnabled()
+{
+#ifdef SIPRIX_API_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+//Measures duration of the call, also of the one which returns void
+struct SdkCallTimer
+{
+    explicit SdkCallTimer(SdkFnStats& stats) : stats_(stats), began_(std::chrono::steady_clock::now()) {}
+    ~SdkCallTimer()
+    {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - began_).count();
+        stats_.latencyNs.add(static_cast<uint64_t>(ns));
+    }
+    SdkFnStats& stats_;
+    std::chrono::steady_clock::time_point began_;
+};
+
+template<typename Ret>
+struct SdkCall
+{
+    template<typename Fn>
+    static Ret invoke(SdkFnStats& stats, Fn fn)
+    {
+        SdkCallTimer timer(stats);
+        return fn();
+    }
+};
+
+template<>
+struct SdkCall<Siprix::ErrorCode>
+{
+    template<typename Fn>
+    static Siprix::ErrorCode invoke(SdkFnStats& stats, Fn fn)
+    {
+        SdkCallTimer timer(stats);
+        const Siprix::ErrorCode err = fn();
+        if (err != Siprix::ErrorCode::EOK)
+            stats.addError(err);
+        return err;
+    }
+};
+
+
+namespace Sdk {
+
+using namespace Siprix;
+
+#ifdef SIPRIX_API_STATS
+#define SDK_FN_PROXY(ret, name, params, args) \
+    inline ret name params { return SdkCall<ret>::invoke(sdkFnStats(eSdk_##name), [&]() { return Siprix::name args; }); }
+#else
+#define SDK_FN_PROXY(ret, name, params, args) \
+    inline ret name params { return Siprix::name args; }
+#endif
+    SIPRIX_API_FUNCTIONS(SDK_FN_PROXY)
+#undef SDK_FN_PROXY
+
+//Texts of the SDK codes (-1000..-1127) are static strings, so each one is requested once
+inline const char* GetErrorText(ErrorCode code)
+{
+    static std::atomic<const char*> texts[128];
+    const int32_t index = -1000 - static_cast<int32_t>(code);
+    if ((index < 0) || (index >= 128))
+        return Siprix::GetErrorText(code);
+
+    const char* text = texts[index].load(std::memory_order_acquire);
+    if (!text)
+    {
+        text = Siprix::GetErrorText(code);
+        texts[index].store(text, std::memory_order_release);
+    }
+    return text;
+}
+
+}//namespace Sdk
+
+
+//Prints functions which were invoked, ordered by total time spent in them
+inline void printSdkStats(std::ostream& os, size_t top)
+{
+    std::vector<SdkFn> fns;
+    for (int i = 0; i < eSdkFnCount; ++i)
+        if (sdkFnStats(static_cast<SdkFn>(i)).latencyNs.count()) fns.push_back(static_cast<SdkFn>(i));
+    std::sort(fns.begin(), fns.end(), [](SdkFn a, SdkFn b) {
+        return sdkFnStats(a).latencyNs.sum() > sdkFnStats(b).latencyNs.sum(); });
+    if (fns.size() > top)
+        fns.resize(top);
+
+    os << "sdk calls (ns):";
+    for (SdkFn fn : fns)
+    {
+        const SdkFnStats& stats = sdkFnStats(fn);
+        os << "\n      " << getSdkFnName(fn) << " ";
+        stats.latencyNs.print(os);
+        if (!stats.errors.load(std::memory_order_relaxed))
+            continue;
+        os << " errors:";
+        for (int i = 0; i < SdkFnStats::kErrorSlots; ++i)
+        {
+            const int32_t code = stats.errorCodes[i].load(std::memory_order_relaxed);
+            if (code)
+                os << " " << code << "(" << Sdk::GetErrorText(static_cast<Siprix::ErrorCode>(code)) << "):"
+                   << stats.errorCounts[i].load(std::memory_order_relaxed);
+        }
+        if (stats.otherErrors.load(std::memory_order_relaxed))
+            os << " other:" << stats.otherErrors.load(std::memory_order_relaxed);
+    }
+}
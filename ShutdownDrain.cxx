@@ -0,0 +1,177 @@
+#include "ShutdownDrain.h"
+
+#include <iostream>
+
+//Send unregister requests each 20ms (same granularity as load generator)
+static const uint32_t kTickMs = 20;
+
+//Max number of stragglers printed in report
+static const size_t kMaxPrintedItems = 20;
+
+void ShutdownDrain::start(const DrainParams& params, const std::vector<Item>& calls, const std::vector<Item>& accounts,
+                          ByeFn bye, UnregisterFn unregister, DoneFn done)
+{
+    if (isActive())
+        return;
+
+    params_ = params;
+    bye_ = bye;
+    unregister_ = unregister;
+    done_ = done;
+    accounts_ = accounts;
+    began_ = std::chrono::steady_clock::now();
+    phase_ = eCalls;
+
+    //All calls are ended in parallel
+    callsTotal_ = calls.size();
+    for (const Item& call : calls)
+    {
+        if (bye_(call) == Siprix::ErrorCode::EOK)
+            pendingCalls_.insert(key(call.module, call.id));
+        else
+            failedCalls_.insert(key(call.module, call.id));
+    }
+
+    if (pendingCalls_.empty())
+    {
+        startUnregister();
+        return;
+    }
+    deadlineTimer_ = loop_.addTimer(params_.callsTimeoutSec * 1000, 0, [this]() {
+        deadlineTimer_ = 0;
+        startUnregister();
+    });
+}
+
+void ShutdownDrain::abort()
+{
+    if (isActive())
+        finish();
+}
+
+void ShutdownDrain::onCallTerminated(uint8_t module, Siprix::CallId callId)
+{
+    if ((phase_ != eCalls) || !pendingCalls_.erase(key(module, callId)) || !pendingCalls_.empty())
+        return;
+
+    cancelTimers();
+    startUnregister();
+}
+
+void ShutdownDrain::onAccountRegState(uint8_t module, Siprix::AccountId accId, Siprix::RegState state)
+{
+    if ((phase_ != eUnregister) || (state == Siprix::RegState::InProgress) || (state == Siprix::RegState::Success))
+        return;
+
+    const uint64_t k = key(module, accId);
+    if (!pendingAccounts_.erase(k))
+        return;
+
+    if (state == Siprix::RegState::Removed)
+        ++unregistered_;
+    else
+        failedAccounts_.insert(k);
+
+    if (pendingAccounts_.empty() && (nextAccount_ == accounts_.size()))
+        finish();
+}
+
+void ShutdownDrain::startUnregister()
+{
+    phase_ = eUnregister;
+    callsEnded_ = std::chrono::steady_clock::now();
+    lastTick_ = callsEnded_;
+    credit_ = 1;
+    unregisterTick();
+    if (nextAccount_ < accounts_.size())
+        tickTimer_ = loop_.addTimer(kTickMs, kTickMs, [this]() { unregisterTick(); });
+}
+
+void ShutdownDrain::unregisterTick()
+{
+    const auto now = std::chrono::steady_clock::now();
+    const double maxCredit = (params_.unregisterRate / 10 > 1) ? params_.unregisterRate / 10 : 1;
+    credit_ += params_.unregisterRate * std::chrono::duration<double>(now - lastTick_).count();
+    if (credit_ > maxCredit)
+        credit_ = maxCredit;
+    lastTick_ = now;
+
+    for (; (credit_ >= 1) && (nextAccount_ < accounts_.size()); credit_ -= 1)
+    {
+        const Item& acc = accounts_[nextAccount_++];
+        if (unregister_(acc) == Siprix::ErrorCode::EOK)
+            pendingAccounts_.insert(key(acc.module, acc.id));
+        else
+            failedAccounts_.insert(key(acc.module, acc.id));
+    }
+
+    if (nextAccount_ < accounts_.size())
+        return;
+
+    //All requests sent - wait for confirmations
+    cancelTimers();
+    if (pendingAccounts_.empty())
+    {
+        finish();
+        return;
+    }
+    deadlineTimer_ = loop_.addTimer(params_.unregisterTimeoutSec * 1000, 0, [this]() {
+        deadlineTimer_ = 0;
+        finish();
+    });
+}
+
+void ShutdownDrain::finish()
+{
+    cancelTimers();
+    if (phase_ == eCalls)
+        callsEnded_ = std::chrono::steady_clock::now();
+    ended_ = std::chrono::steady_clock::now();
+    phase_ = eDone;
+
+    printReport(std::cout);
+    if (done_)
+        done_();
+}
+
+void ShutdownDrain::cancelTimers()
+{
+    if (deadlineTimer_) { loop_.cancelTimer(deadlineTimer_); deadlineTimer_ = 0; }
+    if (tickTimer_)     { loop_.cancelTimer(tickTimer_);     tickTimer_ = 0; }
+}
+
+void ShutdownDrain::printKeys(std::ostream& os, const std::unordered_set<uint64_t>& keys)
+{
+    size_t printed = 0;
+    for (uint64_t k : keys)
+    {
+        if (printed++ == kMaxPrintedItems)
+        {
+            os << " ...";
+            break;
+        }
+        os << " " << (k >> 32) << ":" << (k & 0xFFFFFFFF);
+    }
+}
+
+void ShutdownDrain::printReport(std::ostream& os) const
+{
+    const auto toMs = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+    const size_t notSent = accounts_.size() - nextAccount_;
+
+    os << "\n--- Drain " << ((pendingCalls_.empty() && pendingAccounts_.empty() && !notSent) ? "completed" : "stopped")
+       << " in " << toMs(ended_ - began_) << "ms"
+       << " (calls: " << toMs(callsEnded_ - began_) << "ms, accounts: " << toMs(ended_ - callsEnded_) << "ms)\n";
+
+    os << "    calls: " << callsTotal_ - pendingCalls_.size() - failedCalls_.size() << " ended";
+    if (!failedCalls_.empty())  { os << ", " << failedCalls_.size() << " failed [module:callId]:";      printKeys(os, failedCalls_); }
+    if (!pendingCalls_.empty()) { os << ", " << pendingCalls_.size() << " stragglers [module:callId]:"; printKeys(os, pendingCalls_); }
+
+    os << "\n    accounts: " << unregistered_ << " unregistered";
+    if (!failedAccounts_.empty())  { os << ", " << failedAccounts_.size() << " failed [module:accId]:";      printKeys(os, failedAccounts_); }
+    if (!pendingAccounts_.empty()) { os << ", " << pendingAccounts_.size() << " stragglers [module:accId]:"; printKeys(os, pendingAccounts_); }
+    if (notSent)                     os << ", " << notSent << " not sent";
+    os << std::endl;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "EventLoop.h"
+
+////////////////////////////////////////////////////////////////////////////
+//DrainParams
+
+struct DrainParams
+{
+    uint32_t callsTimeoutSec = 10;     //Time given to calls to terminate after BYE sent
+    uint32_t unregisterRate = 200;     //Unregister requests per second
+    uint32_t unregisterTimeoutSec = 5; //Time given to confirm unregistration after the last request sent
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//ShutdownDrain
+//Completes calls and registrations before application quits:
+//1. sends BYE to all calls at once and waits for OnCallTerminated (till 'callsTimeoutSec');
+//2. unregisters accounts with 'unregisterRate' and waits for RegState::Removed.
+//Reports total time and items which didn't complete ('stragglers').
+//Rejecting of new calls during drain is up to the owner (see 'isActive').
+
+class ShutdownDrain
+{
+public:
+    //Call or account of the module (ids are unique only inside of module)
+    struct Item {
+        uint8_t module;
+        uint32_t id;
+    };
+    typedef std::function<Siprix::ErrorCode(const Item& call)> ByeFn;
+    typedef std::function<Siprix::ErrorCode(const Item& account)> UnregisterFn;
+    typedef std::function<void()> DoneFn;
+
+    ShutdownDrain(EventLoop& loop) : loop_(loop) {}
+    ~ShutdownDrain() { cancelTimers(); }
+
+    void start(const DrainParams& params, const std::vector<Item>& calls, const std::vector<Item>& accounts,
+               ByeFn bye, UnregisterFn unregister, DoneFn done);
+
+    //Stops waiting, remaining calls/accounts are reported as stragglers
+    void abort();
+    bool isActive() const { return (phase_ == eCalls) || (phase_ == eUnregister); }
+
+    void onCallTerminated(uint8_t module, Siprix::CallId callId);
+    void onAccountRegState(uint8_t module, Siprix::AccountId accId, Siprix::RegState state);
+
+    void printReport(std::ostream& os) const;
+
+protected:
+    enum Phase { eIdle, eCalls, eUnregister, eDone };
+
+    static uint64_t key(uint8_t module, uint32_t id) { return (static_cast<uint64_t>(module) << 32) | id; }
+    static void printKeys(std::ostream& os, const std::unordered_set<uint64_t>& keys);
+
+    void startUnregister();
+    void unregisterTick();
+    void finish();
+    void cancelTimers();
+
+    EventLoop& loop_;
+    DrainParams params_;
+    ByeFn bye_;
+    UnregisterFn unregister_;
+    DoneFn done_;
+    Phase phase_ = eIdle;
+
+    std::chrono::steady_clock::time_point began_;
+    std::chrono::steady_clock::time_point callsEnded_;
+    std::chrono::steady_clock::time_point ended_;
+    EventLoop::TimerId deadlineTimer_ = 0;
+    EventLoop::TimerId tickTimer_ = 0;
+
+    //Calls
+    size_t callsTotal_ = 0;
+    std::unordered_set<uint64_t> pendingCalls_;//BYE sent, waiting for termination
+    std::unordered_set<uint64_t> failedCalls_; //BYE/reject returned error
+
+    //Accounts
+    std::vector<Item> accounts_;
+    size_t nextAccount_ = 0;
+    double credit_ = 0;
+    std::chrono::steady_clock::time_point lastTick_;
+    size_t unregistered_ = 0;
+    std::unordered_set<uint64_t> pendingAccounts_;//Request sent, waiting for confirmation
+    std::unordered_set<uint64_t> failedAccounts_; //Request returned error or failed
+};
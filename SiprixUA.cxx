@@ -1,95 +1,343 @@
 #include <signal.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <limits>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
 
-#ifdef __APPLE__
-#include "SiprixCpp.h"
+#include "AllocTracker.h"
+#include "ProcStats.h"
+#include "SdkLoader.h"
+#include "SiprixUA.h"
+#include "Supervisor.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
 #else
-#include "Siprix.h"
+#include <sys/stat.h>
 #endif
 
 #define NOMINMAX
 
-static void signalHandler(int signo)
+////////////////////////////////////////////////////////////////////////////
+//AppOptions
+
+static void printUsage(const char* appName)
 {
-    std::cerr << "Shutting down" << std::endl;
+    std::cout << "Usage: " << appName << " [options]\n"
+              << "  --stats-interval=<sec>  Print statistics periodically (also printed on SIGUSR1)\n"
+              << "  --control=<addr>        Open control socket: unix:<path> or tcp:<ip>:<port>\n"
+              << "  --home-folder=<path>    Home folder of the SDK (logs, recordings)\n"
+              << "  --rtp-port=<port>       First RTP port\n"
+              << "  --config=<file>         Load SDK settings and accounts from JSON file\n"
+              << "  --accounts=<file>       Add accounts listed in file (lines: server extension password [udp|tcp|tls])\n"
+              << "  --load-target=<ext>     Generate calls to this extension from the added accounts\n"
+              << "  --load-cps=<n>          Calls per second (default 0 - disabled)\n"
+              << "  --load-hold=<sec>       Duration of the generated call (default 10)\n"
+              << "  --load-max=<n>          Max number of concurrent generated calls (default 0 - unlimited)\n"
+              << "  --modules=<n>           Create <n> Siprix modules in the process (accounts and load split between them)\n"
+              << "  --workers=<n>           Run supervisor with <n> worker processes (accounts and load split between them)\n"
+              << "  --cpu-affinity=<cpus>   Pin workers to CPUs: 'auto' or list like '0,2,4-7'\n"
+              << "  --rtp-port-range=<n>    Number of RTP ports reserved for each module (default 1000)\n"
+              << "  --record-folder=<path>  Root folder of call recordings (default <home folder>/recordings)\n"
+              << "  --record-quota-mb=<n>   Max total size of recordings (default 0 - unlimited)\n"
+              << "  --record-min-free-mb=<n> Refuse recording when disk has less free space (default 1024)\n"
+              << "  --record-prealloc-mb=<n> Preallocate disk space for each recording (default 0 - disabled)\n"
+              << "  --record-compress       Convert finished PCM16 WAV recordings to G.711 mu-law\n"
+              << "  --record-workers=<n>    Threads which finalize recordings (default 2)\n"
+              << "  --cdr                   Write call detail records to <home folder>/cdr\n"
+              << "  --cdr-folder=<path>     Write call detail records to this folder\n"
+              << "  --cdr-rotate-mb=<n>     Close CDR file when it reaches this size (default 64)\n"
+              << "  --cdr-rotate-sec=<n>    Close CDR file when it's open this time (default 3600)\n"
+              << "  --cdr-fsync=<policy>    When CDRs are flushed to disk: none, rotate, batch or interval in ms (default 1000)\n"
+              << "  --cdr-batch=<n>         Writer of CDRs is woken when this many records are waiting (default 512)\n"
+              << "  --cdr-flush-ms=<n>      Max time CDR waits for the writer (default 200)\n"
+              << "  --prompts=<path>        Folder with mp3 prompts, played by name (file name without extension)\n"
+              << "  --latency-target=<ext>  Measure audio latency by calls to this extension (registered by another account)\n"
+              << "  --latency-prompt=<name> Test signal played to calls (prompt name or path of mp3 file)\n"
+              << "  --latency-ref=<wav>     Test signal decoded to WAV (reference for cross-correlation)\n"
+              << "  --latency-runs=<n>      Number of measurements (default 10)\n"
+              << "  --latency-tail=<ms>     Recording continues after playback stopped (default 1000)\n"
+              << "  --latency-max-delay=<ms> Max measured delay (default 2000)\n"
+              << "  --latency-gen=<wav>     Write test signal to WAV file and exit (--latency-signal=chirp|mls)\n"
+              << "  --latency-analyze=<path> Analyze recordings (file or folder) against --latency-ref and exit\n"
+              << "  --conf-target=<ext>     Benchmark conference mixing by calls to this extension (answers automatically)\n"
+              << "  --conf-sizes=<n,n,..>   Participants of the benchmark steps (default 2,4,8,16)\n"
+              << "  --conf-hold=<sec>       CPU measurement of each step (default 10)\n"
+              << "  --conf-prompt=<name>    Measure mixing latency: prompt played to the first participant\n"
+              << "  --conf-ref=<wav>        Prompt decoded to WAV (searched in recording of the last participant)\n"
+              << "  --scenario=<name>       Run scenarios: call, ivr, hold, transfer (default call)\n"
+              << "  --scenario-target=<ext> Extension called by scenarios (starts them when accounts added)\n"
+              << "  --scenario-count=<n>    Number of scenarios (default 1)\n"
+              << "  --scenario-rate=<n>     Scenarios started per second (default 0 - all at once)\n"
+              << "  --scenario-talk=<ms>    Pause of scenario while call is connected (default 2000)\n"
+              << "  --script=<file>         Run scenario script (with --scenario-target/count/rate)\n"
+              << "  --soak                  Track memory, fds and threads of long run (calls cycled by --load-*)\n"
+              << "  --soak-duration=<sec>   Quit after this time (default 0 - run until quit)\n"
+              << "  --soak-sample=<sec>     Interval of samples (default 60)\n"
+              << "  --soak-warmup=<sec>     Samples of this first period aren't fitted (default 300)\n"
+              << "  --soak-reregister=<sec> Period of unregistering and registering each account (default 300, 0 - off)\n"
+              << "  --admit-max-calls=<n>   Reject incoming calls with 503 while process has this many calls\n"
+              << "  --admit-max-account-calls=<n> Reject incoming calls of account which has this many calls with 486\n"
+              << "  --admit-max-queue=<n>   Reject incoming calls with 503 while this many tasks wait in the loop\n"
+              << "  --admit-max-cpu=<%>     Reject incoming calls with 503 while CPU of the host (all cores) is above\n"
+              << "  --admit-max-process-cpu=<%> Reject incoming calls with 503 while CPU of the process (one core - 100) is above\n"
+              << "  --admit-resume=<%>      Overload ends when all metrics fall below this percent of limits (default 80)\n"
+              << "  --admit-min-overload=<ms> Min duration of overload state (default 2000)\n"
+              << "  --alloc-check=<calls>   Count heap allocations of simulated calls and exit (build with ALLOC_TRACKING)\n"
+              << "  --recovery-rate=<n>     Registrations per second after network restored/switched (default 100)\n"
+              << "  --recovery-jitter=<ms>  Max random delay before recovery starts (default 1000)\n"
+              << "  --recovery-timeout=<sec> Time given to registrations of recovery to be confirmed (default 60)\n"
+              << "  --recovery-renegotiate=<0|1> Re-INVITE connected calls after network change (default 1)\n"
+              << "  --quality-analyze=<path> Check level, clipping, dead air and DTMF of recordings (file or folder) and exit\n"
+              << "  --quality-dtmf=<digits> Digits which must be detected in each recording\n"
+              << "  --quality-silence-db=<dB> Level of silent frames (default -50)\n"
+              << "  --quality-dead-air=<ms> Silence reported as dead air (default 2000)\n"
+              << "  --tap                   Record every connected call and analyze it live (answering machine, dead air)\n"
+              << "  --tap-human=<action>    Action when human answered: none, bye, play:<prompt> (default none)\n"
+              << "  --tap-machine=<action>  Action when answering machine detected (default none)\n"
+              << "  --tap-dead-air=<ms>     Silence reported as dead air (default 5000, 0 - disabled)\n"
+              << "  --tap-dead-air-action=<action> Action on dead air (default none)\n"
+              << "  --tap-silence-db=<dB>   Level of silence for live analysis (default -45)\n"
+              << "  --drain-timeout=<sec>   Time given to calls to end on quit (default 10)\n"
+              << "  --unregister-rate=<n>   Unregister requests per second on quit (default 200)\n"
+              << "  --unregister-timeout=<sec> Time given to confirm unregistration on quit (default 5)\n"
+              << "  --dashboard             Show live view of accounts, calls, rates and latencies instead of menu\n"
+              << "  --dashboard-fps=<n>     Frames per second of the dashboard (default 4)\n"
+              << "  --startup-report        Print durations of the startup phases\n"
+              << "  --signaling-only        Don't load media library until the first call (build with SIPRIX_DYNAMIC_LOAD)\n"
+              << "  --help                  Display this help\n";
 }
 
-////////////////////////////////////////////////////////////////////////////
-//SiprixCliApp
+//List like '2,4,8'
+static std::vector<uint32_t> parseSizes(const char* value)
+{
+    std::vector<uint32_t> sizes;
+    for (char* end = nullptr; *value; value = (*end == ',') ? end + 1 : end)
+    {
+        sizes.push_back(static_cast<uint32_t>(strtoul(value, &end, 10)));
+        if (end == value) break;
+    }
+    return sizes;
+}
 
-class SiprixCliApp : public Siprix::ISiprixEventHandler
+static bool parseOptions(int argc, char** argv, AppOptions& opts)
 {
-public:
-    int run();
-    
-    enum MenuId { eMain, eAccounts, eDevices, eCalls };
-
-protected:
-    //Menu    
-    void handleCmds();
-    bool handleCmdMain(MenuId& menuId, char cmd);
-    bool handleCmdAccounts(char cmd);
-    bool handleCmdCalls(char cmd);
-    bool handleCmdDevices(char cmd);
-
-    //Accounts
-    void AddAccount();
-    void DelAccount();
-    void UnregAccount();
-    void RegAccount();
-    void UpdSecureMediaAccount();
-
-    //Calls
-    void InitiateCall();
-    void EndCall();
-    void RejectCall();
-    void AcceptCall();
-    void SendDtmfToCall();
-    void TransferCallBlind();
-    void TransferCallAttended();
-    void PlayFileToCall();
-    void RecordCallToFile();
-    void MuteMicOfCall();
-    void MuteCamOfCall();
-    void ToggleHoldCall();
-    void SwitchToCall();
-    void MakeConfCall();
-
-    //Devices
-    void DisplayPlayoutDevices();
-    void DisplayRecordDevices();
-    void DisplayVideoDevices();
-    void SelectDevice();
-
-    //Callbacks
-    void OnTrialModeNotified();
-    void OnDevicesAudioChanged();
-
-    void OnAccountRegState(Siprix::AccountId accId, Siprix::RegState state, const char* response);
-    void OnNetworkState(const char* name, Siprix::NetworkState state);
-    void OnPlayerState(Siprix::PlayerId playerId, Siprix::PlayerState state);
-    void OnRingerState(bool started) {}
-    
-    void OnCallIncoming(Siprix::CallId callId, Siprix::AccountId accId, bool withVideo, const char* hdrFrom, const char* hdrTo);
-    void OnCallConnected(Siprix::CallId callId, const char* hdrFrom, const char* hdrTo, bool withVideo);
-    void OnCallTerminated(Siprix::CallId callId, uint32_t statusCode);
-    void OnCallProceeding(Siprix::CallId callId, const char* response);
-    void OnCallTransferred(Siprix::CallId callId, uint32_t statusCode);
-    void OnCallRedirected(Siprix::CallId origCallId, Siprix::CallId relatedCallId, const char* referTo);
-    void OnCallDtmfReceived(Siprix::CallId callId, uint16_t tone);    
-    void OnCallHeld(Siprix::CallId callId, Siprix::HoldState state);
-    void OnCallSwitched(Siprix::CallId callId);
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const char* eq  = strchr(arg, '=');
+        const std::string name = eq ? std::string(arg, eq - arg) : std::string(arg);
+        const char* value = eq ? eq + 1 : "";
+
+        if (name == "--stats-interval") opts.statsIntervalSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--control")   opts.controlSpec = value;
+        else if (name == "--startup-report") opts.startupReport = true;
+        else if (name == "--signaling-only") opts.signalingOnly = true;
+        else if (name == "--home-folder") opts.homeFolder = value;
+        else if (name == "--rtp-port")    opts.rtpStartPort = static_cast<uint16_t>(atoi(value));
+        else if (name == "--accounts")    opts.accountsFile = value;
+        else if (name == "--config")      opts.configFile = value;
+        else if (name == "--load-target") opts.load.target = value;
+        else if (name == "--load-cps")    opts.load.cps = atof(value);
+        else if (name == "--load-hold")   opts.load.holdSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--load-max")    opts.load.maxCalls = static_cast<uint32_t>(atoi(value));
+        else if (name == "--modules")     opts.modules = static_cast<uint32_t>(atoi(value));
+        else if (name == "--workers")     opts.workers = static_cast<uint32_t>(atoi(value));
+        else if (name == "--cpu-affinity")   opts.cpuAffinity = value;
+        else if (name == "--rtp-port-range") opts.rtpPortRange = static_cast<uint16_t>(atoi(value));
+        else if (name == "--record-folder")       opts.recording.folder = value;
+        else if (name == "--record-quota-mb")     opts.recording.quotaMb = strtoull(value, nullptr, 10);
+        else if (name == "--record-min-free-mb")  opts.recording.minFreeMb = strtoull(value, nullptr, 10);
+        else if (name == "--record-prealloc-mb")  opts.recording.preallocateMb = strtoull(value, nullptr, 10);
+        else if (name == "--record-compress")     opts.recording.compress = true;
+        else if (name == "--record-workers")      opts.recording.workers = static_cast<uint32_t>(atoi(value));
+        else if (name == "--cdr")                 opts.cdr.folder = "-";
+        else if (name == "--cdr-folder")          opts.cdr.folder = value;
+        else if (name == "--cdr-rotate-mb")       opts.cdr.rotateMb = strtoull(value, nullptr, 10);
+        else if (name == "--cdr-rotate-sec")      opts.cdr.rotateSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--cdr-batch")           opts.cdr.batchSize = static_cast<uint32_t>(atoi(value));
+        else if (name == "--cdr-flush-ms")        opts.cdr.flushMs = static_cast<uint32_t>(atoi(value));
+        else if (name == "--cdr-fsync") {
+            if (!parseCdrSync(value, opts.cdr))
+            {
+                std::cerr << "Option --cdr-fsync has to be none, rotate, batch or interval in ms" << std::endl;
+                return false;
+            }
+        }
+        else if (name == "--prompts")             opts.promptsFolder = value;
+        else if (name == "--latency-target")    opts.latency.target = value;
+        else if (name == "--latency-prompt")    opts.latency.prompt = value;
+        else if (name == "--latency-ref")       opts.latency.reference = value;
+        else if (name == "--latency-runs")      opts.latency.runs = static_cast<uint32_t>(atoi(value));
+        else if (name == "--latency-tail")      opts.latency.tailMs = static_cast<uint32_t>(atoi(value));
+        else if (name == "--latency-max-delay") opts.latency.maxDelayMs = static_cast<uint32_t>(atoi(value));
+        else if (name == "--latency-gen")       opts.latencyGenerate = value;
+        else if (name == "--latency-signal")    opts.latencySignal = value;
+        else if (name == "--latency-analyze")   opts.latencyAnalyze = value;
+        else if (name == "--conf-target")       opts.conference.target = value;
+        else if (name == "--conf-sizes")        opts.conference.sizes = parseSizes(value);
+        else if (name == "--conf-hold")         opts.conference.holdSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--conf-prompt")       opts.conference.prompt = value;
+        else if (name == "--conf-ref")          opts.conference.reference = value;
+        else if (name == "--scenario")          opts.scenario.name = value;
+        else if (name == "--scenario-target")   opts.scenario.target = value;
+        else if (name == "--scenario-count")    opts.scenario.count = static_cast<uint32_t>(atoi(value));
+        else if (name == "--scenario-rate")     opts.scenario.rate = atof(value);
+        else if (name == "--scenario-talk")     opts.scenario.talkMs = static_cast<uint32_t>(atoi(value));
+        else if (name == "--script")            opts.script = value;
+        else if (name == "--soak")              opts.soak = true;
+        else if (name == "--soak-duration")     opts.soakParams.durationSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--soak-sample")       opts.soakParams.sampleSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--soak-warmup")       opts.soakParams.warmupSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--soak-reregister")   opts.soakParams.reregisterSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--recovery-rate") {
+            opts.recovery.registerRate = static_cast<uint32_t>(atoi(value));
+            if (!opts.recovery.registerRate)
+            {
+                std::cerr << "Option --recovery-rate has to be greater than 0" << std::endl;
+                return false;
+            }
+        }
+        else if (name == "--recovery-jitter")   opts.recovery.jitterMs = static_cast<uint32_t>(atoi(value));
+        else if (name == "--recovery-timeout")  opts.recovery.timeoutSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--recovery-renegotiate") opts.recovery.renegotiate = atoi(value) != 0;
+        else if (name == "--admit-max-calls")   opts.admission.maxCalls = static_cast<uint32_t>(atoi(value));
+        else if (name == "--admit-max-account-calls") opts.admission.maxAccountCalls = static_cast<uint32_t>(atoi(value));
+        else if (name == "--admit-max-queue")   opts.admission.maxQueueDepth = static_cast<uint32_t>(atoi(value));
+        else if (name == "--admit-max-cpu")     opts.admission.maxCpu = atof(value);
+        else if (name == "--admit-max-process-cpu") opts.admission.maxProcessCpu = atof(value);
+        else if (name == "--admit-resume")      opts.admission.resumePercent = atof(value);
+        else if (name == "--admit-min-overload") opts.admission.minOverloadMs = static_cast<uint32_t>(atoi(value));
+        else if (name == "--alloc-check")       opts.allocCheck = static_cast<uint32_t>(atoi(value));
+        else if (name == "--dashboard")         opts.dashboard.enabled = true;
+        else if (name == "--dashboard-fps")     opts.dashboard.fps = static_cast<uint32_t>(atoi(value));
+        else if (name == "--quality-analyze")   opts.qualityAnalyze = value;
+        else if (name == "--quality-dtmf")      opts.quality.expectDtmf = value;
+        else if (name == "--quality-silence-db") opts.quality.silenceDb = atof(value);
+        else if (name == "--quality-dead-air")  opts.quality.deadAirMs = static_cast<uint32_t>(atoi(value));
+        else if (name == "--tap")               opts.tap.tapAll = true;
+        else if (name == "--tap-human")         opts.tap.humanAction = value;
+        else if (name == "--tap-machine")       opts.tap.machineAction = value;
+        else if (name == "--tap-dead-air")      opts.tap.deadAirMs = static_cast<uint32_t>(atoi(value));
+        else if (name == "--tap-dead-air-action") opts.tap.deadAirAction = value;
+        else if (name == "--tap-silence-db")    opts.tap.silenceDb = atof(value);
+        else if (name == "--drain-timeout")  opts.drain.callsTimeoutSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--unregister-rate")    opts.drain.unregisterRate = static_cast<uint32_t>(atoi(value));
+        else if (name == "--unregister-timeout") opts.drain.unregisterTimeoutSec = static_cast<uint32_t>(atoi(value));
+        else if (name == "--help") {
+            printUsage(argv[0]);
+            exit(0);
+        }
+        else {
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if ((opts.modules == 0) || (opts.modules > 255))
+    {
+        std::cerr << "Number of modules has to be in range 1..255" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//Loads config file once (before workers forked), command line options override its settings
+static bool loadConfig(AppOptions& opts)
+{
+    if (opts.configFile.empty())
+        return true;
+
+    std::shared_ptr<JsonValue> config = std::make_shared<JsonValue>();
+    std::string err;
+    if (!loadConfigFile(opts.configFile, *config, err) || !validateConfig(*config, err))
+    {
+        std::cerr << "Invalid config: " << err << std::endl;
+        return false;
+    }
+
+    const JsonValue& ini = (*config)["ini"];
+    if (opts.homeFolder.empty()) opts.homeFolder = ini["homeFolder"].asString();
+    if (!opts.rtpStartPort)      opts.rtpStartPort = static_cast<uint16_t>(ini["rtpStartPort"].asInt());
+
+    opts.config = config;
+    return true;
+}
+
+//Reads lines "server extension password [udp|tcp|tls]", skips empty lines and comments.
+static bool loadAccountsFile(const std::string& path, std::vector<AccountParams>& accounts)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "Can't open accounts file: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        AccountParams params;
+        std::string transport;
+        std::stringstream ss(line);
+        if (!(ss >> params.server) || (params.server[0] == '#'))
+            continue;
+
+        if (!(ss >> params.extension >> params.password))
+        {
+            std::cout << "Invalid line in accounts file: " << line << std::endl;
+            continue;
+        }
+
+        if ((ss >> transport) && !parseTransport(transport, params.transport))
+        {
+            std::cout << "Invalid transport in accounts file: " << line << std::endl;
+            continue;
+        }
 
-    //Create and init siprix module
-    bool initializeSiprixModule();
-    void configureVideo();
+        accounts.push_back(params);
+    }
+    return true;
+}
 
-protected:    
-    Siprix::ISiprixModule* sprxModule_ = nullptr;
-};
+#ifndef _WIN32
+//Each worker gets own home folder, RTP ports range, control socket and part of the load
+static int runSupervisor(const AppOptions& opts)
+{
+    SupervisorParams params;
+    params.workers          = opts.workers;
+    params.cpuAffinity      = opts.cpuAffinity;
+    params.homeFolder       = opts.homeFolder;
+    params.statsIntervalSec = opts.statsIntervalSec;
+    //Workers drain on SIGTERM, duration of sending unregister requests isn't known in advance
+    params.stopTimeoutSec   = opts.drain.callsTimeoutSec + opts.drain.unregisterTimeoutSec + 30;
+
+    Supervisor supervisor(params, [&opts](uint32_t index, AppStats* stats) -> int {
+        AppOptions workerOpts = opts;
+        workerOpts.workers     = 0;
+        workerOpts.workerIndex = static_cast<int32_t>(index);
+        workerOpts.workerCount = opts.workers;
+        workerOpts.statsIntervalSec = 0;
+        workerOpts.homeFolder  = Supervisor::workerHome(opts.homeFolder, index);
+        workerOpts.rtpStartPort = static_cast<uint16_t>((opts.rtpStartPort ? opts.rtpStartPort : 10000) +
+                                                        index * opts.modules * opts.rtpPortRange);
+        if (!opts.controlSpec.empty())
+            workerOpts.controlSpec = opts.controlSpec + "." + std::to_string(index);
+        workerOpts.load.cps      = opts.load.cps / opts.workers;
+        workerOpts.load.maxCalls = (opts.load.maxCalls + opts.workers - 1) / opts.workers;
+
+        SiprixCliApp app(workerOpts, stats);
+        return app.run();
+    });
+    return supervisor.run();
+}
+#endif
 
 
 ////////////////////////////////////////////////////////////////////////////
@@ -97,6 +345,8 @@ protected:
 
 int main(int argc, char** argv)
 {
+    StartupProfiler::processStart();
+
 #ifndef _WIN32
     if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
     {
@@ -105,19 +355,65 @@ int main(int argc, char** argv)
     }
 #endif
 
-    if (signal(SIGINT, signalHandler) == SIG_ERR)
+    //SIGINT/SIGTERM/SIGUSR1 are delivered to the event loop
+    if (!EventLoop::interceptSignals())
     {
-        std::cerr << "Couldn't install signal handler for SIGINT" << std::endl;
+        std::cerr << "Couldn't install signal handlers" << std::endl;
         exit(-1);
     }
 
-    if (signal(SIGTERM, signalHandler) == SIG_ERR)
+    AppOptions opts;
+    if (!parseOptions(argc, argv, opts))
+        return 1;
+
+    //Offline latency tools don't require SDK
+    if (!opts.latencyGenerate.empty())
     {
-        std::cerr << "Couldn't install signal handler for SIGTERM" << std::endl;
-        exit(-1);
+        std::string err;
+        if (!writeTestSignal(opts.latencyGenerate, opts.latencySignal, err))
+        {
+            std::cerr << err << std::endl;
+            return 1;
+        }
+        std::cout << "Test signal written to " << opts.latencyGenerate << ". Encode it to mp3 (played by calls) and decode back\n"
+                  << "to WAV (reference), so delay of the codec isn't measured: ffmpeg -i signal.wav signal.mp3 && ffmpeg -i signal.mp3 ref.wav"
+                  << std::endl;
+        return 0;
+    }
+    if (!opts.latencyAnalyze.empty())
+        return runLatencyAnalysis(opts.latency.reference, opts.latencyAnalyze, opts.latency.maxDelayMs);
+    if (!opts.qualityAnalyze.empty())
+        return runQualityAnalysis(opts.qualityAnalyze, opts.quality);
+
+    //SDK is required by config validation, so it's loaded before workers forked
+    std::string err;
+    if (!sdkLoad(!opts.signalingOnly, err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
     }
-        
-    SiprixCliApp app;
+    if (opts.signalingOnly && !sdkIsDynamic())
+        std::cerr << "SDK is linked to the executable, option --signaling-only has no effect" << std::endl;
+
+    if (!loadConfig(opts))
+        return 1;
+
+    if (opts.workers > 0)
+    {
+        if (opts.dashboard.enabled)
+        {
+            std::cerr << "Option --dashboard isn't supported with --workers (workers are headless)" << std::endl;
+            return 1;
+        }
+#ifndef _WIN32
+        return runSupervisor(opts);
+#else
+        std::cerr << "Option --workers isn't supported on this platform" << std::endl;
+        return 1;
+#endif
+    }
+
+    SiprixCliApp app(opts);
     return app.run();
 }
 
@@ -130,7 +426,7 @@ void displayAccErr(Siprix::ErrorCode code, Siprix::AccountId accId, const char*
     if (code == Siprix::ErrorCode::EOK)
         std::cout << success << ". AccId:" << accId << std::endl;
     else
-        std::cout << err << ". Err: " << code << " " << Siprix::GetErrorText(code) << std::endl;
+        std::cout << err << ". Err: " << code << " " << Sdk::GetErrorText(code) << std::endl;
 }
 
 
@@ -139,72 +435,311 @@ void displayCallErr(Siprix::ErrorCode code, Siprix::CallId callId, const char* s
     if (code == Siprix::ErrorCode::EOK)
         std::cout << success << ". CallId: ~~~ " << callId << " ~~~"<< std::endl;
     else
-        std::cout << err << ". Err: " << code << " " << Siprix::GetErrorText(code) << std::endl;
+        std::cout << err << ". Err: " << code << " " << Sdk::GetErrorText(code) << std::endl;
 }
 
-const char* getAccRegStateStr(Siprix::RegState state)
+////////////////////////////////////////////////////////////////////////////
+//Accounts
+
+Siprix::ErrorCode SiprixCliApp::addAccount(const AccountParams& params, Siprix::AccountId& accId)
 {
-    switch (state)
+    const Siprix::ErrorCode err = Sdk::Account_Add(sprxModule_, makeAccData(params, accTemplates_), &accId);
+    if (err == Siprix::ErrorCode::EOK)
     {
-        case Siprix::RegState::Success: return "Success";    
-        case Siprix::RegState::Removed: return "Removed";
-        default:                        return "Failed";
+        SipModule* module = findModule(sprxModule_);
+        module->accounts[accId].expireTime = expireTimeOf(params);
+        if (cdr_.isEnabled())
+            cdr_.onAccount(module->index, accId, params.extension + "@" + params.server);
+        if (dashboard_.isEnabled())
+            dashboard_.onAccount(module->index, accId, params.extension + "@" + params.server);
     }
+    return err;
 }
 
-const char* getNetworkStateStr(Siprix::NetworkState state)
+Siprix::ErrorCode SiprixCliApp::deleteAccount(Siprix::AccountId accId)
 {
-    switch (state)
+    const Siprix::ErrorCode err = Sdk::Account_Delete(sprxModule_, accId);
+    if (err == Siprix::ErrorCode::EOK)
     {
-        case Siprix::NetworkState::NetworkRestored: return "Restored";
-        case Siprix::NetworkState::NetworkSwitched: return "Switched";
-        default:                                    return "Lost";
+        SipModule* module = findModule(sprxModule_);
+        module->accounts.erase(accId);
+        if (dashboard_.isEnabled())
+            dashboard_.onAccountDeleted(module->index, accId);
     }
+    return err;
 }
 
-const char* getPlayerStateStr(Siprix::PlayerState state)
+Siprix::ErrorCode SiprixCliApp::registerAccount(Siprix::AccountId accId, uint32_t expireTime)
 {
-    switch (state)
+    const Siprix::ErrorCode err = Sdk::Account_Register(sprxModule_, accId, expireTime);
+    if (err == Siprix::ErrorCode::EOK)
     {
-        case Siprix::PlayerState::PlayerStarted: return "PlayerStarted";
-        case Siprix::PlayerState::PlayerStopped: return "PlayerStopped";
-        default:                                 return "PlayerFailed";
+        SipModule* module = findModule(sprxModule_);
+        auto it = module->accounts.find(accId);
+        if (it != module->accounts.end())
+        {
+            it->second.expireTime = expireTime;
+            it->second.unregistered = false;
+        }
     }
+    return err;
 }
 
-////////////////////////////////////////////////////////////////////////////
-//Accounts
+Siprix::ErrorCode SiprixCliApp::unregisterAccount(Siprix::AccountId accId)
+{
+    const Siprix::ErrorCode err = Sdk::Account_Unregister(sprxModule_, accId);
+    if (err == Siprix::ErrorCode::EOK)
+    {
+        SipModule* module = findModule(sprxModule_);
+        auto it = module->accounts.find(accId);
+        if (it != module->accounts.end())
+            it->second.unregistered = true;
+    }
+    return err;
+}
 
-void SiprixCliApp::AddAccount()
+//Expire time which makeAccData sets: settings of the account override defaults of the config
+uint32_t SiprixCliApp::expireTimeOf(const AccountParams& params) const
+{
+    if (params.settings && (*params.settings)["expireTime"].isNumber())
+        return static_cast<uint32_t>((*params.settings)["expireTime"].asInt());
+    if (config("accountDefaults")["expireTime"].isNumber())
+        return static_cast<uint32_t>(config("accountDefaults")["expireTime"].asInt());
+    return params.expireTime;
+}
+
+//Doesn't modify app state, so may be called by provisioning thread (with own templates).
+//Template of the settings is reused: values of the account overwrite ones of the previous
+//account, lists (x-headers, contact params) are appended only to new object.
+Siprix::AccData* SiprixCliApp::makeAccData(const AccountParams& params, AccTemplates& templates) const
 {
-    std::string server, extension, password;
-    std::cout << "Enter server domain name or IP address: "; std::cin >> server;
-    std::cout << "Enter extension: ";                        std::cin >> extension;
-    std::cout << "Enter password: ";                         std::cin >> password;
-
-    Siprix::AccData* acc = Siprix::Acc_GetDefault();    
-    Siprix::Acc_SetSipServer(acc,    server.c_str());
-    Siprix::Acc_SetSipExtension(acc, extension.c_str());
-    Siprix::Acc_SetSipPassword(acc,  password.c_str());    
-    Siprix::Acc_SetTranspProtocol(acc, Siprix::SipTransport::TCP);
-    Siprix::Acc_SetExpireTime(acc, 300);
+    const std::string key = params.settings ? accTemplateKey(*params.settings) : std::string();
+    auto it = templates.find(key);
+    if (it == templates.end())
+        it = templates.emplace(key, SdkData<Siprix::AccData>("account:" + key)).first;
+    SdkData<Siprix::AccData>& data = it->second;
+    Siprix::AccData* acc = data.get();
+    Sdk::Acc_SetSipServer(acc,    params.server.c_str());
+    Sdk::Acc_SetSipExtension(acc, params.extension.c_str());
+    Sdk::Acc_SetSipPassword(acc,  params.password.c_str());    
+    Sdk::Acc_SetTranspProtocol(acc, params.transport);
+    Sdk::Acc_SetExpireTime(acc, params.expireTime);
+
+    //Settings were validated when config loaded
+    std::string err;
+    const bool appendLists = !data.configured();
+    if (config("accountDefaults").isObject()) applyAccConfig(config("accountDefaults"), acc, err, appendLists);
+    if (params.settings)                      applyAccConfig(*params.settings, acc, err, appendLists);
+    data.setConfigured();
     
-    //Siprix::Acc_SetRewriteContactIp(acc, true);
-    //Siprix::Acc_SetDisplayName(acc, "%%%");
-    //Siprix::Acc_SetUserAgent(acc, "-%-");
-    //Siprix::Acc_SetKeepAliveTime(acc, 0);
+    //Sdk::Acc_SetRewriteContactIp(acc, true);
+    //Sdk::Acc_SetDisplayName(acc, "%%%");
+    //Sdk::Acc_SetUserAgent(acc, "-%-");
+    //Sdk::Acc_SetKeepAliveTime(acc, 0);
     
-    //Siprix::Acc_ResetAudioCodecs(acc);
-    //Siprix::Acc_AddAudioCodec(acc, Siprix::AudioCodec::PCMA);
-    //Siprix::Acc_AddAudioCodec(acc, Siprix::AudioCodec::DTMF);
+    //Sdk::Acc_ResetAudioCodecs(acc);
+    //Sdk::Acc_AddAudioCodec(acc, Siprix::AudioCodec::PCMA);
+    //Sdk::Acc_AddAudioCodec(acc, Siprix::AudioCodec::DTMF);
     
-    //Siprix::Acc_SetSecureMediaMode(acc, Siprix::SecureMedia::SdesSrtp);
-    //Siprix::Acc_SetInstanceId(acc, Siprix::Acc_GenerateInstanceId());
-    //Siprix::Acc_AddXContactUriParam(acc, "pn-prid", "ASDFSDFDSFDS1");
-    //Siprix::Acc_SetRingToneFile(acc, "ringtone.mp3");
+    //Sdk::Acc_SetSecureMediaMode(acc, Siprix::SecureMedia::SdesSrtp);
+    //Sdk::Acc_SetInstanceId(acc, Sdk::Acc_GenerateInstanceId());
+    //Sdk::Acc_AddXContactUriParam(acc, "pn-prid", "ASDFSDFDSFDS1");
+    //Sdk::Acc_SetRingToneFile(acc, "ringtone.mp3");
     
+    return acc;
+}
+
+void SiprixCliApp::provisionAccounts()
+{
+    std::vector<AccountParams> accounts;
+    if (!opts_.accountsFile.empty())
+        loadAccountsFile(opts_.accountsFile, accounts);
+
+    for (const JsonValue& item : config("accounts").items())
+    {
+        AccountParams params;
+        params.server    = item["server"].asString();
+        params.extension = item["extension"].asString();
+        params.settings  = &item;
+        accounts.push_back(params);
+    }
+
+    //Worker adds only own part of accounts
+    if (opts_.isWorker())
+    {
+        std::vector<AccountParams> own;
+        for (size_t i = opts_.workerIndex; i < accounts.size(); i += opts_.workerCount)
+            own.push_back(accounts[i]);
+        accounts.swap(own);
+    }
+
+    if (accounts.empty())
+    {
+        onAccountsProvisioned(0, 0, StartupProfiler::Clock::now());
+        return;
+    }
+
+    stats_->accounts = 0;//Slot of the restarted worker keeps value of the previous run
+
+    //Accounts are spread over modules. Added ones are passed to the loop by batches,
+    //so first registrations are handled while remaining accounts are still being added.
+    const auto began = StartupProfiler::Clock::now();
+    std::vector<Siprix::ISiprixModule*> handles;
+    for (const auto& module : modules_)
+        handles.push_back(module->handle);
+
+    const bool needUris = cdr_.isEnabled() || dashboard_.isEnabled();
+    provisioner_ = std::thread([this, accounts, handles, began, needUris]() {
+        const size_t kBatchSize = 64;
+        AccTemplates templates;
+        std::vector<std::pair<size_t, Siprix::AccountId>> batch;//module index, accId
+        std::vector<std::string> uris;//extension@server of batch items (CDRs or dashboard enabled)
+        std::vector<uint32_t> expireTimes;//Of batch items
+        size_t added = 0;
+        for (size_t i = 0; (i < accounts.size()) && !stopProvisioning_; ++i)
+        {
+            const size_t moduleIndex = i % handles.size();
+            Siprix::AccountId accId = 0;
+            const Siprix::ErrorCode err = Sdk::Account_Add(handles[moduleIndex], makeAccData(accounts[i], templates), &accId);
+            if (err == Siprix::ErrorCode::EOK)
+            {
+                batch.emplace_back(moduleIndex, accId);
+                expireTimes.push_back(expireTimeOf(accounts[i]));
+                if (needUris)
+                    uris.push_back(accounts[i].extension + "@" + accounts[i].server);
+                ++added;
+            }
+            else
+            {
+                const std::string ext = accounts[i].extension;
+                loop_.post([err, accId, ext]() { displayAccErr(err, accId, "", ("Can't add account " + ext).c_str()); });
+            }
+
+            if ((batch.size() == kBatchSize) || (i + 1 == accounts.size()))
+            {
+                loop_.post([this, batch, uris, expireTimes]() {
+                    for (size_t j = 0; j < batch.size(); ++j)
+                    {
+                        const auto& item = batch[j];
+                        modules_[item.first]->loadAccounts.push_back(item.second);
+                        modules_[item.first]->accounts[item.second].expireTime = expireTimes[j];
+                        if (j >= uris.size())
+                            continue;
+                        if (cdr_.isEnabled())
+                            cdr_.onAccount(static_cast<uint8_t>(item.first), item.second, uris[j]);
+                        if (dashboard_.isEnabled())
+                            dashboard_.onAccount(static_cast<uint8_t>(item.first), item.second, uris[j]);
+                    }
+                    stats_->accounts += batch.size();
+                });
+                batch.clear();
+                uris.clear();
+                expireTimes.clear();
+            }
+        }
+
+        const size_t total = accounts.size();
+        loop_.post([this, added, total, began]() { onAccountsProvisioned(added, total, began); });
+    });
+}
+
+void SiprixCliApp::onAccountsProvisioned(size_t added, size_t total, StartupProfiler::Clock::time_point began)
+{
+    accountsProvisioned_ = true;
+    if (total)
+    {
+        profiler_.phase("accounts provisioning (" + std::to_string(added) + ")", began);
+        std::cout << "Added " << added << " of " << total << " accounts in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(StartupProfiler::Clock::now() - began).count()
+                  << "ms" << std::endl;
+    }
+
+    if (opts_.load.cps > 0)
+        startLoad(opts_.load);
+
+    if (opts_.soak)
+    {
+        std::string err;
+        if (!startSoak(opts_.soakParams, err))
+            std::cout << "Can't start soak: " << err << std::endl;
+        else if (opts_.load.cps <= 0)
+            std::cout << "Soak: calls aren't cycled without --load-cps" << std::endl;
+    }
+
+    if (opts_.allocCheck)
+    {
+        std::string err;
+        if (!startAllocCheck(opts_.allocCheck, err))
+        {
+            std::cout << "Can't start allocation check: " << err << std::endl;
+            exitCode_ = 1;
+            startDrain();
+        }
+    }
+
+    if (!opts_.latency.target.empty())
+    {
+        std::string err;
+        if (!startLatencyTest(opts_.latency, err))
+            std::cout << "Can't start latency test: " << err << std::endl;
+    }
+
+    if (!opts_.conference.target.empty())
+    {
+        std::string err;
+        if (!startConfBench(opts_.conference, err))
+            std::cout << "Can't start conference benchmark: " << err << std::endl;
+    }
+
+    if (!opts_.script.empty())
+    {
+        ScriptParams params;
+        params.file   = opts_.script;
+        params.target = opts_.scenario.target;
+        params.count  = opts_.scenario.count;
+        params.rate   = opts_.scenario.rate;
+        std::string err;
+        if (!startScript(params, err))
+            std::cout << "Can't start script: " << err << std::endl;
+    }
+    else if (!opts_.scenario.target.empty())
+    {
+        std::string err;
+        if (!startScenarios(opts_.scenario, err))
+            std::cout << "Can't start scenarios: " << err << std::endl;
+    }
+
+    //Without accounts there is nothing to wait for
+    if (!total || firstRegistration_)
+        reportStartup();
+}
+
+void SiprixCliApp::stopProvisioning()
+{
+    stopProvisioning_ = true;
+    if (provisioner_.joinable())
+        provisioner_.join();
+}
+
+void SiprixCliApp::reportStartup()
+{
+    if (!opts_.startupReport || startupReported_)
+        return;
+    startupReported_ = true;
+    profiler_.print(std::cout);
+    std::cout << "--- RSS: " << procRssKb() << "kB, media library: "
+              << (sdkIsMediaMapped() ? "loaded" : "not loaded") << std::endl;
+}
+
+void SiprixCliApp::AddAccount()
+{
+    AccountParams params;
+    std::cout << "Enter server domain name or IP address: "; if (!readArg(params.server)) return;
+    std::cout << "Enter extension: ";                        if (!readArg(params.extension)) return;
+    std::cout << "Enter password: ";                         if (!readArg(params.password)) return;
+
     Siprix::AccountId accId=0;
-    const Siprix::ErrorCode err = Siprix::Account_Add(sprxModule_, acc, &accId);
+    const Siprix::ErrorCode err = addAccount(params, accId);
     displayAccErr(err, accId, "Accound added", "Can't add account");
 }
 
@@ -212,9 +747,9 @@ void SiprixCliApp::DelAccount()
 {
     Siprix::AccountId accId = 0;
     std::cout << "Enter accId to delete: ";
-    std::cin >> accId;
+    if (!readArg(accId)) return;
 
-    const Siprix::ErrorCode err = Siprix::Account_Delete(sprxModule_, accId);
+    const Siprix::ErrorCode err = deleteAccount(accId);
     displayAccErr(err, accId, "Accound deleted successfully", "Can't delete  account");
 }
 
@@ -222,9 +757,9 @@ void SiprixCliApp::UnregAccount()
 {
     Siprix::AccountId accId = 0;
     std::cout << "Enter accId to unregister: ";
-    std::cin >> accId;
+    if (!readArg(accId)) return;
 
-    const Siprix::ErrorCode err = Siprix::Account_Unregister(sprxModule_, accId);
+    const Siprix::ErrorCode err = unregisterAccount(accId);
     displayAccErr(err, accId, "Unregister request sent", "Can't unregister account");
 }
 
@@ -232,10 +767,10 @@ void SiprixCliApp::RegAccount()
 {
     int expireSec=300;
     Siprix::AccountId accId = 0;
-    std::cout << "Enter accId to update registration: ";     std::cin >> accId;
-    std::cout << "Enter expire time (seconds): ";    std::cin >> expireSec;    
+    std::cout << "Enter accId to update registration: ";     if (!readArg(accId)) return;
+    std::cout << "Enter expire time (seconds): ";    if (!readArg(expireSec)) return;    
 
-    const Siprix::ErrorCode err = Siprix::Account_Register(sprxModule_, accId, expireSec);
+    const Siprix::ErrorCode err = registerAccount(accId, static_cast<uint32_t>(expireSec));
     displayAccErr(err, accId, "Register request sent", "Can't register account");
 }
 
@@ -244,61 +779,177 @@ void SiprixCliApp::UpdSecureMediaAccount()
     int sMedia = 0;
     Siprix::AccountId accId = 0;
     std::cout << "Enter accId to update: ";
-    std::cin >> accId;
+    if (!readArg(accId)) return;
 
     std::cout << "Enter secure media setting [0(Disabled), 1(SDES SRTP), 2(DTLS SRTP)]: ";
-    std::cin >> sMedia;
-
-    Siprix::AccData* acc = Siprix::Acc_GetDefault();
-    Siprix::Acc_SetSecureMediaMode(acc, static_cast<Siprix::SecureMedia>(sMedia));
+    if (!readArg(sMedia)) return;
 
-    const Siprix::ErrorCode err = Siprix::Account_Update(sprxModule_, acc, accId);
+    const Siprix::ErrorCode err = updSecureMedia(accId, static_cast<Siprix::SecureMedia>(sMedia));
     displayAccErr(err, accId, "Account updated", "Can't update account");
 }
 
+Siprix::ErrorCode SiprixCliApp::updSecureMedia(Siprix::AccountId accId, Siprix::SecureMedia mode)
+{
+    SdkData<Siprix::AccData> acc("secureMedia");
+    Sdk::Acc_SetSecureMediaMode(acc.get(), mode);
+
+    return Sdk::Account_Update(sprxModule_, acc.get(), accId);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////
 //Calls
 
 void SiprixCliApp::InitiateCall()
 {
+    if (draining_)
+    {
+        std::cout << "Application is shutting down" << std::endl;
+        return;
+    }
+    if (recovery_.isNetworkLost())
+    {
+        std::cout << "Network is lost, calls are held off until it's restored" << std::endl;
+        return;
+    }
+
     //Ask details
     char withVideo=0;
     std::string destExt;
     Siprix::AccountId accId = 0;
-    std::cout << "Enter accId where to initiate call: ";   std::cin >> accId;
-    std::cout << "Enter destination number (extension): "; std::cin >> destExt;
-    std::cout << "Make call with video (y/n): ";           std::cin >> withVideo;
-
-    //Prepare dest
-    Siprix::DestData* dest = Siprix::Dest_GetDefault();
-    Dest_SetExtension(dest, destExt.c_str());
-    Dest_SetAccountId(dest, accId);
-    Dest_SetVideoCall(dest, (withVideo=='v')||(withVideo == 'y'));
-    //Dest_AddXHeader(dest, "XTest", "invHeaderVal1");
-    //Dest_AddXHeader(dest, "XTest", "invHeaderVal2");
+    std::cout << "Enter accId where to initiate call: ";   if (!readArg(accId)) return;
+    std::cout << "Enter destination number (extension): "; if (!readArg(destExt)) return;
+    std::cout << "Make call with video (y/n): ";           if (!readArg(withVideo)) return;
 
-    //Start call
     Siprix::CallId callId = 0;
-    const Siprix::ErrorCode err = Siprix::Call_Invite(sprxModule_, dest, &callId);
+    const Siprix::ErrorCode err = inviteCall(accId, destExt, (withVideo=='v')||(withVideo == 'y'), callId);
     displayCallErr(err, callId, "Starting...", "Can't initiate call");
 }
 
+bool SiprixCliApp::startLoad(const LoadParams& params)
+{
+    uint32_t loadModules = 0;
+    for (const auto& module : modules_)
+        if (!module->loadAccounts.empty()) ++loadModules;
+
+    if (params.target.empty() || !loadModules)
+    {
+        std::cout << "Load generator requires target and accounts (--load-target, --accounts)" << std::endl;
+        return false;
+    }
+
+    //Each module generates its part of load, spreading calls over own accounts
+    LoadParams moduleParams = params;
+    moduleParams.cps      = params.cps / loadModules;
+    moduleParams.maxCalls = (params.maxCalls + loadModules - 1) / loadModules;
+    for (const auto& ptr : modules_)
+    {
+        SipModule* module = ptr.get();
+        if (module->loadAccounts.empty())
+            continue;
+
+        module->load.start(moduleParams,
+            [this, module](Siprix::CallId& callId) {
+                ModuleScope scope(*this, module->handle);
+                const Siprix::AccountId accId = module->loadAccounts[module->nextLoadAccount++ % module->loadAccounts.size()];
+                return inviteCall(accId, module->load.params().target, false, callId);
+            },
+            [module](Siprix::CallId callId) {
+                return Sdk::Call_Bye(module->handle, callId);
+            });
+    }
+    std::cout << "Load started: " << params.cps << " cps to " << params.target << std::endl;
+    return true;
+}
+
+void SiprixCliApp::stopLoad()
+{
+    for (const auto& module : modules_)
+        module->load.stop();
+}
+
+size_t SiprixCliApp::activeLoadCalls() const
+{
+    size_t calls = 0;
+    for (const auto& module : modules_)
+        calls += module->load.activeCalls();
+    return calls;
+}
+
+Siprix::ErrorCode SiprixCliApp::inviteCall(Siprix::AccountId accId, const std::string& destExt, bool withVideo, Siprix::CallId& callId,
+                                           const JsonValue* xHeaders)
+{
+    const Siprix::ErrorCode err = prepareMedia(withVideo);
+    if (err != Siprix::EOK)
+        return err;
+
+    //Prepare dest: template of the profile is configured once, call sets only extension.
+    //X-headers can't be removed from DestData, so object with them serves only invites with
+    //the same headers: it's kept in the cache of recently used header sets. Header values
+    //unique per call (correlation ids, ...) cost new SDK object per invite, which SDK can't
+    //free; cache drops the least recently used ones (counted as 'dropped' of DestData).
+    std::string headers;//"name:value\n" lines
+    if (xHeaders)
+        for (const auto& member : xHeaders->members())
+            headers += member.first + ":" + member.second.asString() + "\n";
+
+    SdkData<Siprix::DestData>* owner = nullptr;
+    if (headers.empty())
+    {
+        DestProfile profile;
+        profile.accId = accId;
+        profile.video = withVideo;
+        auto it = destTemplates_.find(profile);
+        if (it == destTemplates_.end())
+            it = destTemplates_.emplace(profile, SdkData<Siprix::DestData>("dest:" + std::to_string(accId) + (withVideo ? ":video" : ":audio"))).first;
+        owner = &it->second;
+    }
+    else
+    {
+        owner = &headerDests_.get("dest:" + std::to_string(accId) + (withVideo ? ":video:" : ":audio:") + headers);
+    }
+    SdkData<Siprix::DestData>& data = *owner;
+    Siprix::DestData* dest = data.get();
+    if (!data.configured())
+    {
+        Sdk::Dest_SetAccountId(dest, accId);
+        Sdk::Dest_SetVideoCall(dest, withVideo);
+        if (xHeaders)
+            for (const auto& member : xHeaders->members())
+                Sdk::Dest_AddXHeader(dest, member.first.c_str(), member.second.asString().c_str());
+        data.setConfigured();
+    }
+    Sdk::Dest_SetExtension(dest, destExt.c_str());
+
+    //Start call
+    const Siprix::ErrorCode inviteErr = Sdk::Call_Invite(sprxModule_, dest, &callId);
+    if (inviteErr == Siprix::ErrorCode::EOK)
+    {
+        SipModule* module = findModule(sprxModule_);
+        module->addCall(callId, accId);
+        if (cdr_.isEnabled())
+            cdr_.onInvite(module->index, callId, accId, destExt, withVideo);
+        if (dashboard_.isEnabled())
+            dashboard_.onInvite(module->index, callId, accId, destExt, withVideo);
+    }
+    return inviteErr;
+}
+
 void SiprixCliApp::EndCall()
 {
     Siprix::CallId callId = 0;
-    std::cout << "Enter callId to end: ";   std::cin >> callId;
+    std::cout << "Enter callId to end: ";   if (!readArg(callId)) return;
     
-    const Siprix::ErrorCode err = Siprix::Call_Bye(sprxModule_, callId);
+    const Siprix::ErrorCode err = Sdk::Call_Bye(sprxModule_, callId);
     displayCallErr(err, callId, "End call request has sent", "Can't end call");
 }
 
 void SiprixCliApp::RejectCall()
 {
     Siprix::CallId callId = 0;
-    std::cout << "Enter callId to reject: ";   std::cin >> callId;
+    std::cout << "Enter callId to reject: ";   if (!readArg(callId)) return;
 
-    const Siprix::ErrorCode err = Siprix::Call_Reject(sprxModule_, callId, 486);
+    const Siprix::ErrorCode err = Sdk::Call_Reject(sprxModule_, callId, 486);
     displayCallErr(err, callId, "Call rejected", "Can't reject call");
 }
 
@@ -306,10 +957,17 @@ void SiprixCliApp::AcceptCall()
 {
     char withVideo = false;
     Siprix::CallId callId = 0;
-    std::cout << "Enter callId to accept: ";        std::cin >> callId;
-    std::cout << "Accept call with video (y/n): ";  std::cin >> withVideo;
+    std::cout << "Enter callId to accept: ";        if (!readArg(callId)) return;
+    std::cout << "Accept call with video (y/n): ";  if (!readArg(withVideo)) return;
+    if (draining_)
+    {
+        std::cout << "Application is shutting down" << std::endl;
+        return;
+    }
 
-    const Siprix::ErrorCode err = Siprix::Call_Accept(sprxModule_, callId, (withVideo == 'v') || (withVideo == 'y'));
+    Siprix::ErrorCode err = prepareMedia((withVideo == 'v') || (withVideo == 'y'));
+    if (err == Siprix::EOK)
+        err = Sdk::Call_Accept(sprxModule_, callId, (withVideo == 'v') || (withVideo == 'y'));
     displayCallErr(err, callId, "Call accepting... ", "Can't accept call");
 }
 
@@ -319,10 +977,10 @@ void SiprixCliApp::SendDtmfToCall()
     std::string tones;
     Siprix::CallId callId = 0;
     Siprix::DtmfMethod method = Siprix::DtmfMethod::DTMF_RTP;//DTMF_INFO;
-    std::cout << "Enter callId where to send tones: ";   std::cin >> callId;
-    std::cout << "Enter DTMF tone(s): ";   std::cin >> tones;
+    std::cout << "Enter callId where to send tones: ";   if (!readArg(callId)) return;
+    std::cout << "Enter DTMF tone(s): ";   if (!readArg(tones)) return;
 
-    const Siprix::ErrorCode err = Siprix::Call_SendDtmf(sprxModule_, callId, tones.c_str(), 200, 50, method);
+    const Siprix::ErrorCode err = Sdk::Call_SendDtmf(sprxModule_, callId, tones.c_str(), 200, 50, method);
     displayCallErr(err, callId, "Sending tones started successfully", "Can't send tones");
 }
 
@@ -330,20 +988,20 @@ void SiprixCliApp::TransferCallBlind()
 {
     std::string toAddr;
     Siprix::CallId callId = 0;
-    std::cout << "Enter callId to transfer: ";  std::cin >> callId;
-    std::cout << "Enter destination addr: ";   std::cin >> toAddr;
+    std::cout << "Enter callId to transfer: ";  if (!readArg(callId)) return;
+    std::cout << "Enter destination addr: ";   if (!readArg(toAddr)) return;
 
-    const Siprix::ErrorCode err = Siprix::Call_TransferBlind(sprxModule_, callId, toAddr.c_str());
+    const Siprix::ErrorCode err = Sdk::Call_TransferBlind(sprxModule_, callId, toAddr.c_str());
     displayCallErr(err, callId, "Transfer request sent", "Can't transfer");
 }
 
 void SiprixCliApp::TransferCallAttended()
 {
     Siprix::CallId srcCallId = 0, destCallId = 0;
-    std::cout << "Enter callId to transfer: ";  std::cin >> srcCallId;
-    std::cout << "Enter destination callId: ";   std::cin >> destCallId;
+    std::cout << "Enter callId to transfer: ";  if (!readArg(srcCallId)) return;
+    std::cout << "Enter destination callId: ";   if (!readArg(destCallId)) return;
 
-    const Siprix::ErrorCode err = Siprix::Call_TransferAttended(sprxModule_, srcCallId, destCallId);
+    const Siprix::ErrorCode err = Sdk::Call_TransferAttended(sprxModule_, srcCallId, destCallId);
     displayCallErr(err, srcCallId, "Transfer request sent", "Can't transfer");
 }
 
@@ -352,35 +1010,495 @@ void SiprixCliApp::PlayFileToCall()
 {
     std::string mp3File;
     Siprix::CallId callId = 0;
-    std::cout << "Enter callId where to play mp3 file: ";   std::cin >> callId;
-    std::cout << "Enter path(name) of mp3 file: ";         std::cin >> mp3File;
+    std::cout << "Enter callId where to play mp3 file: ";   if (!readArg(callId)) return;
+    std::cout << "Enter prompt, playlist or path of mp3 file: "; if (!readArg(mp3File)) return;
     
     Siprix::PlayerId playerId=0;
-    const Siprix::ErrorCode err = Siprix::Call_PlayFile(sprxModule_, callId, mp3File.c_str(), false, &playerId);
-    displayCallErr(err, callId, "Play file started successfully", "Can't play file");
+    std::string errText;
+    const Siprix::ErrorCode err = playPrompts(callId, { mp3File }, false, playerId, errText);
+    if (!errText.empty())
+        std::cout << errText << std::endl;
+    displayCallErr(err, callId, ("Play file started successfully playerId:" + std::to_string(playerId)).c_str(), "Can't play file");
+}
+
+Siprix::ErrorCode SiprixCliApp::playPrompts(Siprix::CallId callId, const std::vector<std::string>& names, bool loop,
+                                            Siprix::PlayerId& playerId, std::string& errText)
+{
+    //Files are checked before SDK invoked, failure is counted in stats of the prompt
+    std::vector<Prompt*> items, resolved;
+    for (const std::string& name : names)
+    {
+        const Siprix::ErrorCode err = prompts_.resolve(name, resolved, errText);
+        if (err != Siprix::ErrorCode::EOK)
+            return err;
+        items.insert(items.end(), resolved.begin(), resolved.end());
+    }
+    return players_.play(findModule(sprxModule_)->index, callId, items, loop, playerId);
+}
+
+Siprix::ErrorCode SiprixCliApp::stopPlay(Siprix::PlayerId playerId)
+{
+    return players_.stop(findModule(sprxModule_)->index, playerId);
+}
+
+int32_t SiprixCliApp::tapCall(uint8_t module, Siprix::CallId callId, std::string& path, std::string& errText)
+{
+    ModuleScope scope(*this, modules_[module]->handle);
+    const int32_t err = recordCall(callId, true, path, errText);
+    if (err == Siprix::ErrorCode::EOK)
+        tap_.add(module, callId, path);
+    return err;
+}
+
+bool SiprixCliApp::checkTapActions()
+{
+    for (const std::string* action : { &opts_.tap.humanAction, &opts_.tap.machineAction, &opts_.tap.deadAirAction })
+    {
+        if (action->empty() || (*action == "none") || (*action == "bye"))
+            continue;
+
+        std::vector<Prompt*> items;
+        std::string err = "unknown action";
+        if ((action->compare(0, 5, "play:") != 0) || (prompts_.resolve(action->substr(5), items, err) != Siprix::ErrorCode::EOK))
+        {
+            std::cerr << "Invalid tap action '" << *action << "': " << err << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void SiprixCliApp::onTapResult(uint8_t module, Siprix::CallId callId, const TapResult& result)
+{
+    const std::string& action = (result.detection == eTapHuman)   ? opts_.tap.humanAction :
+                                (result.detection == eTapMachine) ? opts_.tap.machineAction :
+                                (result.detection == eTapDeadAir) ? opts_.tap.deadAirAction : std::string();
+
+    //Detection is delivered to console and control socket subscribers as other events
+    AppEvent ev;
+    ev.type = AppEvent::eCallAudioDetected;
+    ev.module = module;
+    ev.id = callId;
+    ev.code = result.detection;
+    ev.relatedId = result.atMs;
+    ev.text1 = result.reason;
+    ev.text2 = action.empty() ? "none" : action;
+    ev.time = std::chrono::steady_clock::now();
+    onAppEvent(ev);
+
+    if (action == "bye")
+    {
+        Sdk::Call_Bye(modules_[module]->handle, callId);
+    }
+    else if (action.compare(0, 5, "play:") == 0)
+    {
+        ModuleScope scope(*this, modules_[module]->handle);
+        Siprix::PlayerId playerId = 0;
+        std::string errText;
+        const Siprix::ErrorCode err = playPrompts(callId, { action.substr(5) }, false, playerId, errText);
+        if (err != Siprix::ErrorCode::EOK)
+            std::cerr << "Can't play '" << action.substr(5) << "' to call " << callId << ": " << err << std::endl;
+    }
+}
+
+bool SiprixCliApp::startLatencyTest(const LatencyParams& params, std::string& err)
+{
+    //Calls of the test are made by the selected module
+    SipModule* module = findModule(sprxModule_);
+    LatencyParams moduleParams = params;
+    if (!moduleParams.accId)
+        moduleParams.accId = module->loadAccounts.empty() ? 1 : module->loadAccounts.front();
+    if (moduleParams.folder.empty())
+        moduleParams.folder = opts_.recording.folder + "/latency";
+
+    LatencyTest::Actions actions;
+    actions.invite = [this, module, moduleParams](Siprix::CallId& callId) {
+        ModuleScope scope(*this, module->handle);
+        return inviteCall(moduleParams.accId, moduleParams.target, false, callId);
+    };
+    actions.accept = [module](Siprix::CallId callId) {
+        return Sdk::Call_Accept(module->handle, callId, false);
+    };
+    actions.play = [this, module, moduleParams](Siprix::CallId callId, Siprix::PlayerId& playerId) {
+        ModuleScope scope(*this, module->handle);
+        std::string errText;
+        return playPrompts(callId, { moduleParams.prompt }, false, playerId, errText);
+    };
+    actions.record = [module](Siprix::CallId callId, const std::string& path) {
+        return Sdk::Call_RecordFile(module->handle, callId, path.c_str());
+    };
+    actions.stopRecord = [module](Siprix::CallId callId) {
+        return Sdk::Call_StopRecordFile(module->handle, callId);
+    };
+    actions.bye = [module](Siprix::CallId callId) {
+        return Sdk::Call_Bye(module->handle, callId);
+    };
+    return latency_.start(module->index, moduleParams, actions, err);
+}
+
+bool SiprixCliApp::startConfBench(const ConferenceParams& params, std::string& err)
+{
+    //Conference is made by the selected module
+    SipModule* module = findModule(sprxModule_);
+    if (module->conference.connectedCount())
+    {
+        //Mixer_MakeConference would join them to the measured conference
+        err = "Module has " + std::to_string(module->conference.connectedCount()) + " connected calls";
+        return false;
+    }
+    ConferenceParams moduleParams = params;
+    if (!moduleParams.accId)
+        moduleParams.accId = module->loadAccounts.empty() ? 1 : module->loadAccounts.front();
+    if (moduleParams.folder.empty())
+        moduleParams.folder = opts_.recording.folder + "/conference";
+
+    ConferenceBench::Actions actions;
+    actions.invite = [this, module, moduleParams](Siprix::CallId& callId) {
+        ModuleScope scope(*this, module->handle);
+        return inviteCall(moduleParams.accId, moduleParams.target, false, callId);
+    };
+    actions.bye = [module](Siprix::CallId callId) {
+        return Sdk::Call_Bye(module->handle, callId);
+    };
+    actions.merge = [this, module]() {
+        ModuleScope scope(*this, module->handle);
+        return makeConference();
+    };
+    actions.play = [this, module, moduleParams](Siprix::CallId callId, Siprix::PlayerId& playerId) {
+        ModuleScope scope(*this, module->handle);
+        std::string errText;
+        return playPrompts(callId, { moduleParams.prompt }, false, playerId, errText);
+    };
+    actions.record = [module](Siprix::CallId callId, const std::string& path) {
+        return Sdk::Call_RecordFile(module->handle, callId, path.c_str());
+    };
+    actions.stopRecord = [module](Siprix::CallId callId) {
+        return Sdk::Call_StopRecordFile(module->handle, callId);
+    };
+    actions.cpu = [module](uint64_t& processMs, uint64_t& moduleMs) {
+        processMs = procCpuMs();
+        moduleMs = 0;
+        for (int tid : module->threads)
+            moduleMs += procThreadCpuMs(tid);
+    };
+    return confBench_.start(module->index, moduleParams, actions, err);
+}
+
+ScenarioActions SiprixCliApp::makeScenarioActions()
+{
+    //Account given by params belongs to the selected module, otherwise
+    //calls are spread over modules and their accounts
+    const uint8_t selected = findModule(sprxModule_)->index;
+    ScenarioActions actions;
+    actions.invite = [this, selected](uint8_t& module, Siprix::AccountId accId, const char* ext, Siprix::CallId& callId) {
+        SipModule* sipModule = modules_[selected].get();
+        if (!accId)
+        {
+            for (size_t i = 0; (i < modules_.size()) && !accId; ++i)
+            {
+                sipModule = modules_[nextScenarioModule_++ % modules_.size()].get();
+                if (!sipModule->loadAccounts.empty())
+                    accId = sipModule->loadAccounts[sipModule->nextLoadAccount++ % sipModule->loadAccounts.size()];
+            }
+            if (!accId)
+                return Siprix::ErrorCode::EAccountNotFound;
+        }
+        module = sipModule->index;
+        ModuleScope scope(*this, sipModule->handle);
+        return inviteCall(accId, ext, false, callId);
+    };
+    actions.accept = [this](uint8_t module, Siprix::CallId callId) {
+        ModuleScope scope(*this, modules_[module]->handle);
+        const Siprix::ErrorCode err = prepareMedia(false);
+        return (err != Siprix::ErrorCode::EOK) ? err : Sdk::Call_Accept(modules_[module]->handle, callId, false);
+    };
+    actions.reject = [this](uint8_t module, Siprix::CallId callId, uint16_t statusCode) {
+        return Sdk::Call_Reject(modules_[module]->handle, callId, statusCode);
+    };
+    actions.bye = [this](uint8_t module, Siprix::CallId callId) {
+        return Sdk::Call_Bye(modules_[module]->handle, callId);
+    };
+    actions.dtmf = [this](uint8_t module, Siprix::CallId callId, const char* tones, uint16_t durationMs, uint16_t gapMs) {
+        return Sdk::Call_SendDtmf(modules_[module]->handle, callId, tones, durationMs, gapMs, Siprix::DtmfMethod::DTMF_RTP);
+    };
+    actions.hold = [this](uint8_t module, Siprix::CallId callId) {
+        return Sdk::Call_Hold(modules_[module]->handle, callId);
+    };
+    actions.transferBlind = [this](uint8_t module, Siprix::CallId callId, const char* ext) {
+        return Sdk::Call_TransferBlind(modules_[module]->handle, callId, ext);
+    };
+    actions.transferAttended = [this](uint8_t module, Siprix::CallId fromCallId, Siprix::CallId toCallId) {
+        return Sdk::Call_TransferAttended(modules_[module]->handle, fromCallId, toCallId);
+    };
+    actions.play = [this](uint8_t module, Siprix::CallId callId, const char* prompt, Siprix::PlayerId& playerId) {
+        ModuleScope scope(*this, modules_[module]->handle);
+        std::string errText;
+        return playPrompts(callId, { prompt }, false, playerId, errText);
+    };
+    return actions;
+}
+
+bool SiprixCliApp::startScenarios(const ScenarioParams& params, std::string& err)
+{
+    return scenarios_.start(params, makeScenarioActions(), err);
+}
+
+bool SiprixCliApp::startScript(const ScriptParams& params, std::string& err)
+{
+    return scripts_.start(params, makeScenarioActions(), err);
 }
 
-void SiprixCliApp::RecordCallToFile()
-{
-    bool start = true;
-    Siprix::CallId callId = 0;
-    std::cout << "Enter callId to start/stop recording: "; std::cin >> callId;
-    std::cout << "Enter 1 to start/0 stop recording: ";    std::cin >> start;
+bool SiprixCliApp::startSoak(const SoakParams& params, std::string& err)
+{
+    //Accounts of load generators are cycled, index goes through modules
+    SoakMonitor::Actions actions;
+    actions.calls = [this]() {
+        return stats_->callsCompleted.load(std::memory_order_relaxed) + stats_->callsFailed.load(std::memory_order_relaxed);
+    };
+    actions.appCalls = [this]() {
+        uint64_t calls = 0;
+        for (const auto& module : modules_)
+            calls += module->calls.size();
+        return calls;
+    };
+    actions.accounts = [this]() {
+        size_t accounts = 0;
+        for (const auto& module : modules_)
+            accounts += module->loadAccounts.size();
+        return accounts;
+    };
+    actions.registration = [this, expireTime = params.expireTime](size_t index, bool reg) {
+        for (const auto& module : modules_)
+        {
+            if (index >= module->loadAccounts.size())
+            {
+                index -= module->loadAccounts.size();
+                continue;
+            }
+            const Siprix::AccountId accId = module->loadAccounts[index];
+            return reg ? Sdk::Account_Register(module->handle, accId, expireTime)
+                       : Sdk::Account_Unregister(module->handle, accId);
+        }
+        return Siprix::ErrorCode::EAccountNotFound;
+    };
+    actions.finished = [this]() { startDrain(); };
+    return soak_.start(params, actions, err);
+}
+
+void SiprixCliApp::startAdmission(const AdmissionParams& params)
+{
+    AdmissionControl::Actions actions;
+    actions.calls = [this]() {
+        size_t calls = 0;
+        for (const auto& module : modules_)
+            calls += module->calls.size();
+        return calls;
+    };
+    actions.queueDepth = [this]() { return loop_.pendingTasks(); };
+    admission_.start(params, actions, *stats_);
+}
+
+bool SiprixCliApp::startDashboard(std::string& err)
+{
+    Dashboard::Sources sources;
+    sources.queueDepth = [this]() { return loop_.pendingTasks(); };
+    sources.status = [this]() -> const char* {
+        if (draining_)                    return "SHUTTING DOWN";
+        if (recovery_.isNetworkLost())    return "NETWORK LOST";
+        if (admission_.isOverloaded())    return "OVERLOADED";
+        return nullptr;
+    };
+    return dashboard_.start(opts_.dashboard, sources, *stats_, err);
+}
+
+void SiprixCliApp::setupRecovery()
+{
+    NetworkRecovery::Actions actions;
+    actions.collect = [this](std::vector<NetworkRecovery::Item>& accounts, size_t& priority,
+                             std::vector<NetworkRecovery::Item>& calls) {
+        //Accounts of calls go first
+        std::vector<NetworkRecovery::Item> others;
+        for (const auto& module : modules_)
+        {
+            std::unordered_set<Siprix::AccountId> withCalls;
+            for (const auto& call : module->calls)
+            {
+                withCalls.insert(call.second);
+                if (module->conference.isConnected(call.first))
+                    calls.push_back(NetworkRecovery::Item{ module->index, call.first });
+            }
+            //Accounts unregistered by user stay unregistered
+            for (const auto& acc : module->accounts)
+                if (!acc.second.unregistered)
+                    (withCalls.count(acc.first) ? accounts : others).push_back(NetworkRecovery::Item{ module->index, acc.first });
+        }
+        priority = accounts.size();
+        accounts.insert(accounts.end(), others.begin(), others.end());
+    };
+    actions.registration = [this](const NetworkRecovery::Item& acc) {
+        const SipModule& module = *modules_[acc.module];
+        auto it = module.accounts.find(acc.id);
+        if (it == module.accounts.end())
+            return Siprix::ErrorCode::EAccountNotFound;
+        return Sdk::Account_Register(module.handle, acc.id, it->second.expireTime);
+    };
+    actions.renegotiate = [this](const NetworkRecovery::Item& call) {
+        return Sdk::Call_Renegotiate(modules_[call.module]->handle, call.id);
+    };
+    actions.holdOriginations = [this](bool hold) {
+        for (const auto& module : modules_)
+            module->load.hold(hold);
+    };
+    recovery_.setup(opts_.recovery, actions);
+}
+
+bool SiprixCliApp::startAllocCheck(uint32_t calls, std::string& err)
+{
+    if (!AllocTracker::enabled())
+    {
+        err = "Allocations aren't tracked (build with ALLOC_TRACKING)";
+        return false;
+    }
+    if (allocChecker_.joinable())
+    {
+        err = "Allocation check is already running";
+        return false;
+    }
+    allocChecker_ = std::thread([this, calls]() { runAllocCheck(calls); });
+    return true;
+}
+
+void SiprixCliApp::runAllocCheck(uint32_t calls)
+{
+    //Callbacks are invoked by this thread like by SDK one, ids don't overlap real calls
+    static const Siprix::CallId kFirstCallId = 0x7F000000;
+    static const uint32_t kWarmupCalls = 100;
+    EventBridge& bridge = modules_[0]->bridge;
+    const Siprix::AccountId accId = modules_[0]->accounts.empty() ? 1 : modules_[0]->accounts.begin()->first;
+
+    //Each call is completed by loop before the next one, so pools and tables reach their size
+    auto simulate = [&](uint32_t index) {
+        const Siprix::CallId callId = kFirstCallId + index;
+        bridge.OnCallIncoming(callId, accId, false, "<sip:alloc@check>;tag=1", "<sip:check@alloc>");
+        bridge.OnCallConnected(callId, "<sip:alloc@check>;tag=1", "<sip:check@alloc>;tag=2", false);
+        bridge.OnCallDtmfReceived(callId, 5);
+        bridge.OnCallHeld(callId, Siprix::HoldState::Local);
+        bridge.OnCallHeld(callId, Siprix::HoldState::None);
+        bridge.OnCallTerminated(callId, 200);
+        loop_.post([this]() { allocCheckHandled_.fetch_add(1, std::memory_order_release); });
+        while ((allocCheckHandled_.load(std::memory_order_acquire) <= index) && !stopAllocCheck_)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    };
+
+    for (uint32_t i = 0; (i < kWarmupCalls) && !stopAllocCheck_; ++i)
+        simulate(i);
+
+    //Allocations of tagged scopes: callbacks on this thread and handling of events on the loop
+    std::vector<AllocTracker::Counters> before(AllocTracker::kMaxTags), after(AllocTracker::kMaxTags);
+    for (uint16_t tag = 1; tag < AllocTracker::tagsCount(); ++tag)
+        before[tag] = AllocTracker::ofTag(tag);
+    for (uint32_t i = 0; (i < calls) && !stopAllocCheck_; ++i)
+        simulate(kWarmupCalls + i);
+    if (stopAllocCheck_)
+        return;
+    for (uint16_t tag = 1; tag < AllocTracker::tagsCount(); ++tag)
+        after[tag] = AllocTracker::ofTag(tag);
+
+    std::ostringstream report;
+    uint64_t allocs = 0;
+    for (uint16_t tag = 1; tag < AllocTracker::tagsCount(); ++tag)
+    {
+        const AllocTracker::Counters c = after[tag] - before[tag];
+        allocs += c.allocs;
+        if (c.allocs)
+            report << "\n    " << AllocTracker::tagName(tag) << " allocs:" << c.allocs << " bytes:" << c.bytes;
+    }
+
+    loop_.post([this, calls, allocs, text = report.str()]() {
+        allocChecker_.join();
+        std::cout << "\nAllocation check: " << calls << " calls (after " << kWarmupCalls << " warm-up), "
+                  << allocs << " allocations (" << static_cast<double>(allocs) / (calls ? calls : 1) << " per call)"
+                  << text << "\n    ";
+        AllocTracker::print(std::cout);
+        std::cout << std::endl;
+        if (allocs)
+            exitCode_ = 1;
+        startDrain();
+    });
+}
+
+bool SiprixCliApp::loadPrompts()
+{
+    StartupProfiler::Scope phase(profiler_, "prompts");
+    std::string err;
+    bool loaded = opts_.promptsFolder.empty() || prompts_.addFolder(opts_.promptsFolder, err);
+
+    for (const auto& member : config("prompts").members())
+        loaded = loaded && prompts_.add(member.first, member.second.str(), err);
+
+    for (const auto& member : config("playlists").members())
+    {
+        std::vector<std::string> names;
+        for (const JsonValue& item : member.second.items())
+            names.push_back(item.str());
+        loaded = loaded && prompts_.addPlaylist(member.first, names, err);
+    }
+
+    if (!loaded)
+    {
+        std::cerr << "Can't load prompts: " << err << std::endl;
+        return false;
+    }
+    if (!prompts_.prompts().empty())
+        std::cout << "Loaded " << prompts_.prompts().size() << " prompts (" << prompts_.mappedBytes() / 1024
+                  << "kB prefetched), " << prompts_.playlistsCount() << " playlists" << std::endl;
+    return true;
+}
+
+void SiprixCliApp::RecordCallToFile()
+{
+    bool start = true;
+    Siprix::CallId callId = 0;
+    std::cout << "Enter callId to start/stop recording: "; if (!readArg(callId)) return;
+    std::cout << "Enter 1 to start/0 stop recording: ";    if (!readArg(start)) return;
+
+    std::string path, errText;
+    const int32_t err = recordCall(callId, start, path, errText);
+    if (err == ControlServer::ECtrlRecordRefused)
+        std::cout << "Can't record file: " << errText << std::endl;
+    else
+        displayCallErr(static_cast<Siprix::ErrorCode>(err), callId,
+                       start ? ("Record file started successfully: " + path).c_str() : "Record file stopped", "Can't record file");
+}
+
+int32_t SiprixCliApp::recordCall(Siprix::CallId callId, bool start, std::string& path, std::string& errText)
+{
+    const uint8_t module = findModule(sprxModule_)->index;
+    if (!start)
+    {
+        const Siprix::ErrorCode err = Sdk::Call_StopRecordFile(sprxModule_, callId);
+        tap_.remove(module, callId);
+        recordings_.finish(module, callId);
+        return err;
+    }
+
+    if (!recordings_.begin(module, callId, path, errText))
+        return ControlServer::ECtrlRecordRefused;
 
-    std::string filePath = std::to_string(callId) + ".wav";
-    const Siprix::ErrorCode err = start ? Siprix::Call_RecordFile(sprxModule_, callId, filePath.c_str())
-                                        : Siprix::Call_StopRecordFile(sprxModule_, callId);
-    displayCallErr(err, callId, "Record file started successfully", "Can't record file");
+    const Siprix::ErrorCode err = Sdk::Call_RecordFile(sprxModule_, callId, path.c_str());
+    if (err != Siprix::ErrorCode::EOK)
+        recordings_.cancel(module, callId);
+    return err;
 }
 
 void SiprixCliApp::MuteMicOfCall()
 {
     bool mute = true;
     Siprix::CallId callId = 0;
-    std::cout << "Enter callId where to mute mic: "; std::cin >> callId;    
-    std::cout << "Enter 1 to mute/0 unmute: ";       std::cin >> mute;
+    std::cout << "Enter callId where to mute mic: "; if (!readArg(callId)) return;    
+    std::cout << "Enter 1 to mute/0 unmute: ";       if (!readArg(mute)) return;
 
-    const Siprix::ErrorCode err = Siprix::Call_MuteMic(sprxModule_, callId, mute);
+    const Siprix::ErrorCode err = Sdk::Call_MuteMic(sprxModule_, callId, mute);
     displayCallErr(err, callId, "Mute state changed successfully", "Can't mute call");
 }
 
@@ -388,37 +1506,58 @@ void SiprixCliApp::MuteCamOfCall()
 {
     bool mute = true;
     Siprix::CallId callId = 0;
-    std::cout << "Enter callId where to mute camera: "; std::cin >> callId;
-    std::cout << "Enter 1 to mute/0 unmute: ";          std::cin >> mute;
+    std::cout << "Enter callId where to mute camera: "; if (!readArg(callId)) return;
+    std::cout << "Enter 1 to mute/0 unmute: ";          if (!readArg(mute)) return;
 
-    const Siprix::ErrorCode err = Siprix::Call_MuteCam(sprxModule_, callId, mute);
+    const Siprix::ErrorCode err = Sdk::Call_MuteCam(sprxModule_, callId, mute);
     displayCallErr(err, callId, "Mute state changed successfully", "Can't mute call");
 }
 
 void SiprixCliApp::ToggleHoldCall()
 {
     Siprix::CallId callId = 0;
-    std::cout << "Enter callId to hold: "; std::cin >> callId;
+    std::cout << "Enter callId to hold: "; if (!readArg(callId)) return;
 
-    const Siprix::ErrorCode err = Siprix::Call_Hold(sprxModule_, callId);
+    const Siprix::ErrorCode err = Sdk::Call_Hold(sprxModule_, callId);
     displayCallErr(err, callId, "Hold request sent", "Can't hold call");
 }
 
 void SiprixCliApp::SwitchToCall()
 {
     Siprix::CallId callId = 0;
-    std::cout << "Enter callId where to switch: ";   std::cin >> callId;
+    std::cout << "Enter callId where to switch: ";   if (!readArg(callId)) return;
 
-    const Siprix::ErrorCode err = Siprix::Mixer_SwitchToCall(sprxModule_, callId);
+    const Siprix::ErrorCode err = switchToCall(callId);
     displayCallErr(err, callId, "Switched to call successfully", "Can't switch to call");    
 }
 
 void SiprixCliApp::MakeConfCall()
 {
-    const Siprix::ErrorCode err = Siprix::Mixer_MakeConference(sprxModule_);
+    const Siprix::ErrorCode err = makeConference();
     displayCallErr(err, 0, "Calls joined to conference", "Can't make conference");
 }
 
+Siprix::ErrorCode SiprixCliApp::makeConference()
+{
+    //Conference of one call would only switch mixer to it
+    ConferenceTracker& conference = findModule(sprxModule_)->conference;
+    if (conference.connectedCount() < 2)
+        return Siprix::ErrorCode::EConfRequires2Calls;
+
+    conference.merging();
+    return Sdk::Mixer_MakeConference(sprxModule_);
+}
+
+Siprix::ErrorCode SiprixCliApp::switchToCall(Siprix::CallId callId)
+{
+    const ConferenceTracker& conference = findModule(sprxModule_)->conference;
+    if (!conference.isConnected(callId))
+        return Siprix::ErrorCode::ECallNotConnected;
+    if (!conference.isActive() && (conference.switched() == callId))
+        return Siprix::ErrorCode::ECallAlreadySwitched;
+    return Sdk::Mixer_SwitchToCall(sprxModule_, callId);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////
 //Devices
@@ -426,7 +1565,7 @@ void SiprixCliApp::MakeConfCall()
 void SiprixCliApp::DisplayPlayoutDevices()
 {
     uint32_t numberOfDevices=0;
-    Siprix::ErrorCode err = Dvc_GetPlayoutDevices(sprxModule_, &numberOfDevices);
+    Siprix::ErrorCode err = Sdk::Dvc_GetPlayoutDevices(sprxModule_, &numberOfDevices);
     if(!numberOfDevices || (err != Siprix::ErrorCode::EOK))
         return;
 
@@ -434,7 +1573,7 @@ void SiprixCliApp::DisplayPlayoutDevices()
     char guid[50] = "";
     std::cout << "Detected "<< numberOfDevices <<" playout audio devices:";
     for (uint32_t i = 0; i < numberOfDevices; ++i) {
-        err = Dvc_GetPlayoutDevice(sprxModule_, i, name, sizeof(name), guid, sizeof(guid));
+        err = Sdk::Dvc_GetPlayoutDevice(sprxModule_, i, name, sizeof(name), guid, sizeof(guid));
         std::cout << "\n    -" << i << "- " << name << " [" << guid<<"]";
     }
     std::cout << std::endl;
@@ -443,7 +1582,7 @@ void SiprixCliApp::DisplayPlayoutDevices()
 void SiprixCliApp::DisplayRecordDevices()
 {
     uint32_t numberOfDevices = 0;
-    Siprix::ErrorCode err = Dvc_GetRecordingDevices(sprxModule_, &numberOfDevices);
+    Siprix::ErrorCode err = Sdk::Dvc_GetRecordingDevices(sprxModule_, &numberOfDevices);
     if (!numberOfDevices || (err != Siprix::ErrorCode::EOK))
         return;
 
@@ -451,7 +1590,7 @@ void SiprixCliApp::DisplayRecordDevices()
     char guid[50] = "";
     std::cout << "Detected " << numberOfDevices << " recording audio devices:";
     for (uint32_t i = 0; i < numberOfDevices; ++i) {
-        err = Dvc_GetRecordingDevice(sprxModule_, i, name, sizeof(name), guid, sizeof(guid));
+        err = Sdk::Dvc_GetRecordingDevice(sprxModule_, i, name, sizeof(name), guid, sizeof(guid));
         std::cout << "\n    -" << i << "- " << name << " [" << guid << "]";
     }
     std::cout << std::endl;
@@ -460,7 +1599,7 @@ void SiprixCliApp::DisplayRecordDevices()
 void SiprixCliApp::DisplayVideoDevices()
 {
     uint32_t numberOfDevices = 0;
-    Siprix::ErrorCode err = Dvc_GetVideoDevices(sprxModule_, &numberOfDevices);
+    Siprix::ErrorCode err = Sdk::Dvc_GetVideoDevices(sprxModule_, &numberOfDevices);
     if (!numberOfDevices || (err != Siprix::ErrorCode::EOK))
         return;
 
@@ -468,7 +1607,7 @@ void SiprixCliApp::DisplayVideoDevices()
     char guid[50] = "";
     std::cout << "Detected " << numberOfDevices << " recording audio devices:";
     for (uint32_t i = 0; i < numberOfDevices; ++i) {
-        err = Dvc_GetVideoDevice(sprxModule_, i, name, sizeof(name), guid, sizeof(guid));
+        err = Sdk::Dvc_GetVideoDevice(sprxModule_, i, name, sizeof(name), guid, sizeof(guid));
         std::cout << "\n    -" << i << "- " << name << " [" << guid << "]";
     }
     std::cout << std::endl;
@@ -478,28 +1617,398 @@ void SiprixCliApp::SelectDevice()
 {
     char deviceType=0;
     std::cout << "Enter which device to set: p - Playback, r - Recording, v - Video: ";
-    std::cin >> deviceType;
+    if (!readArg(deviceType)) return;
 
     int deviceIndex=0;
     std::cout << "Enter device index: ";
-    std::cin >> deviceIndex;
+    if (!readArg(deviceIndex)) return;
 
     Siprix::ErrorCode err = Siprix::ErrorCode::EOK;
     switch (deviceType)
     {
-        case 'p': err = Dvc_SetPlayoutDevice(sprxModule_, deviceIndex); break;
-        case 'r': err = Dvc_SetRecordingDevice(sprxModule_, deviceIndex); break;
-        case 'v': err = Dvc_SetVideoDevice(sprxModule_, deviceIndex); break;
+        case 'p': err = Sdk::Dvc_SetPlayoutDevice(sprxModule_, deviceIndex); break;
+        case 'r': err = Sdk::Dvc_SetRecordingDevice(sprxModule_, deviceIndex); break;
+        case 'v': err = Sdk::Dvc_SetVideoDevice(sprxModule_, deviceIndex); break;
         default : std::cout<<"Wrong device type."<<std::endl;
     }
 
     if(err != Siprix::ErrorCode::EOK)
-        std::cout << "Err: " << err << " " << Siprix::GetErrorText(err) << std::endl;
+        std::cout << "Err: " << err << " " << Sdk::GetErrorText(err) << std::endl;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//Events
+
+void SiprixCliApp::onAppEvent(const AppEvent& ev)
+{
+    ALLOC_SCOPE_NAME(getAppEventName(ev.type));
+    const auto delay = std::chrono::steady_clock::now() - ev.time;
+    stats_->eventDelayUs.add(std::chrono::duration_cast<std::chrono::microseconds>(delay).count());
+    ++stats_->events[ev.type];
+
+    const uint64_t depth = loop_.pendingTasks();
+    if (depth > stats_->maxQueueDepth) stats_->maxQueueDepth = depth;
+
+    control_.publish(ev);
+
+    //Record is created before incoming call can be rejected
+    if (cdr_.isEnabled())
+        cdr_.onAppEvent(ev);
+    if (dashboard_.isEnabled())
+        dashboard_.onAppEvent(ev);
+
+    //Calls over limits are rejected before anything else handles them.
+    //Under overload bridge has rejected call already, before it was queued.
+    if ((ev.type == AppEvent::eCallIncoming) && ev.code)
+    {
+        admission_.onShedEarly();
+        return;
+    }
+    if ((ev.type == AppEvent::eCallIncoming) && admission_.isEnabled() && !draining_)
+    {
+        const SipModule& target = *modules_[ev.module];
+        const uint32_t code = admission_.admit(target.callsOfAccount(ev.relatedId));
+        if (code)
+        {
+            Sdk::Call_Reject(target.handle, ev.id, code);
+            return;
+        }
+    }
+
+    if (!firstRegistration_ && (ev.type == AppEvent::eAccountRegState) && (ev.code == Siprix::RegState::Success))
+    {
+        firstRegistration_ = true;
+        profiler_.milestone("first registration");
+        if (accountsProvisioned_)
+            reportStartup();
+    }
+
+    SipModule& module = *modules_[ev.module];
+    ++module.events;
+    if (ev.type == AppEvent::eCallConnected)  module.load.onCallConnected(ev.id);
+    if (ev.type == AppEvent::eCallTerminated) module.load.onCallTerminated(ev.id);
+    if (ev.type == AppEvent::eCallTerminated) tap_.remove(ev.module, ev.id);
+    if (ev.type == AppEvent::eCallTerminated) recordings_.finish(ev.module, ev.id);
+    if (ev.type == AppEvent::eCallTerminated) players_.onCallTerminated(ev.module, ev.id);
+    if (ev.type == AppEvent::ePlayerState)    players_.onPlayerState(ev.module, ev.id, static_cast<Siprix::PlayerState>(ev.code));
+    if (ev.type == AppEvent::eCallConnected)  module.conference.onCallConnected(ev.id);
+    if (ev.type == AppEvent::eCallTerminated) module.conference.onCallTerminated(ev.id);
+    if (ev.type == AppEvent::eCallSwitched)   module.conference.onCallSwitched(ev.id);
+
+    if (latency_.isRunning() && (latency_.module() == ev.module))
+    {
+        switch (ev.type)
+        {
+            case AppEvent::eCallIncoming:   latency_.onCallIncoming(ev.id); break;
+            case AppEvent::eCallConnected:  latency_.onCallConnected(ev.id); break;
+            case AppEvent::eCallTerminated: latency_.onCallTerminated(ev.id); break;
+            case AppEvent::ePlayerState:    latency_.onPlayerState(ev.id, static_cast<Siprix::PlayerState>(ev.code)); break;
+            default: break;
+        }
+    }
+
+    if (scenarios_.active())
+        scenarios_.onAppEvent(ev);
+
+    if (scripts_.isRunning() || scripts_.active())
+        scripts_.onAppEvent(ev);
+
+    if (ev.type == AppEvent::eAccountRegState)
+        soak_.onAccountRegState(static_cast<Siprix::RegState>(ev.code));
+    if ((ev.type == AppEvent::eAccountRegState) && recovery_.isRecovering())
+        recovery_.onAccountRegState(ev.module, ev.id, static_cast<Siprix::RegState>(ev.code));
+    //Accounts are unregistered by drain, not registered again
+    if ((ev.type == AppEvent::eNetworkState) && !draining_)
+        recovery_.onNetworkState(ev.text1.c_str(), static_cast<Siprix::NetworkState>(ev.code));
+
+    if (confBench_.isRunning() && (confBench_.module() == ev.module))
+    {
+        switch (ev.type)
+        {
+            case AppEvent::eCallConnected:  confBench_.onCallConnected(ev.id); break;
+            case AppEvent::eCallTerminated: confBench_.onCallTerminated(ev.id); break;
+            case AppEvent::eCallSwitched:   confBench_.onCallSwitched(ev.id); break;
+            case AppEvent::ePlayerState:    confBench_.onPlayerState(ev.id, static_cast<Siprix::PlayerState>(ev.code)); break;
+            default: break;
+        }
+    }
+
+    //Track existing calls
+    switch (ev.type)
+    {
+        case AppEvent::eCallIncoming:   module.addCall(ev.id, ev.relatedId); break;
+        case AppEvent::eCallProceeding:
+        case AppEvent::eCallConnected:  module.addCall(ev.id, 0); break;
+        case AppEvent::eCallRedirected:
+        {
+            auto it = module.calls.find(ev.id);
+            module.addCall(ev.relatedId, (it != module.calls.end()) ? it->second : 0);
+            break;
+        }
+        case AppEvent::eCallTerminated: module.removeCall(ev.id); break;
+        default: break;
+    }
+
+    //Calls of latency test and conference benchmark are recorded by them
+    if (opts_.tap.tapAll && (ev.type == AppEvent::eCallConnected) && !draining_ &&
+        !(latency_.isRunning() && (latency_.module() == ev.module)) &&
+        !(confBench_.isRunning() && (confBench_.module() == ev.module)))
+    {
+        std::string path, errText;
+        const int32_t err = tapCall(ev.module, ev.id, path, errText);
+        if (err != Siprix::ErrorCode::EOK)
+            std::cerr << "Can't tap call " << ev.id << ": " << (errText.empty() ? std::to_string(err) : errText) << std::endl;
+    }
+
+    if (draining_ && (ev.type == AppEvent::eCallIncoming))
+        Sdk::Call_Reject(module.handle, ev.id, 503);
+    if (drain_.isActive())
+    {
+        if (ev.type == AppEvent::eCallTerminated)  drain_.onCallTerminated(ev.module, ev.id);
+        if (ev.type == AppEvent::eAccountRegState) drain_.onAccountRegState(ev.module, ev.id, static_cast<Siprix::RegState>(ev.code));
+    }
+
+    //Dashboard shows state instead of the log of events
+    if (dashboard_.isEnabled())
+        return;
+
+    //Ids are unique only inside of module
+    if (modules_.size() > 1)
+        std::cout << "\n[module " << static_cast<uint32_t>(ev.module) << "]";
+
+    switch (ev.type)
+    {
+        case AppEvent::eTrialModeNotified:   OnTrialModeNotified(); break;
+        case AppEvent::eDevicesAudioChanged: OnDevicesAudioChanged(); break;
+        case AppEvent::eAccountRegState:     OnAccountRegState(ev.id, static_cast<Siprix::RegState>(ev.code), ev.text1.c_str()); break;
+        case AppEvent::eNetworkState:        OnNetworkState(ev.text1.c_str(), static_cast<Siprix::NetworkState>(ev.code)); break;
+        case AppEvent::ePlayerState:         OnPlayerState(ev.id, static_cast<Siprix::PlayerState>(ev.code)); break;
+        case AppEvent::eRingerState:         OnRingerState(ev.code != 0); break;
+        case AppEvent::eCallIncoming:        OnCallIncoming(ev.id, ev.relatedId, ev.withVideo, ev.text1.c_str(), ev.text2.c_str()); break;
+        case AppEvent::eCallConnected:       OnCallConnected(ev.id, ev.text1.c_str(), ev.text2.c_str(), ev.withVideo); break;
+        case AppEvent::eCallTerminated:      OnCallTerminated(ev.id, ev.code); break;
+        case AppEvent::eCallProceeding:      OnCallProceeding(ev.id, ev.text1.c_str()); break;
+        case AppEvent::eCallTransferred:     OnCallTransferred(ev.id, ev.code); break;
+        case AppEvent::eCallRedirected:      OnCallRedirected(ev.id, ev.relatedId, ev.text1.c_str()); break;
+        case AppEvent::eCallDtmfReceived:    OnCallDtmfReceived(ev.id, static_cast<uint16_t>(ev.code)); break;
+        case AppEvent::eCallHeld:            OnCallHeld(ev.id, static_cast<Siprix::HoldState>(ev.code)); break;
+        case AppEvent::eCallSwitched:        OnCallSwitched(ev.id, module.conference); break;
+        case AppEvent::eCallAudioDetected:   OnCallAudioDetected(ev.id, static_cast<TapDetection>(ev.code), ev.relatedId,
+                                                                 ev.text1.c_str(), ev.text2.c_str()); break;
+        default: break;
+    }
+}
+
+void SiprixCliApp::onSignal(int signo)
+{
+#ifdef SIGUSR1
+    if (signo == SIGUSR1)
+    {
+        printStats();
+        return;
+    }
+#endif
+    startDrain();
+}
+
+void SiprixCliApp::startDrain()
+{
+    //Repeated request quits without waiting, also before posted task below has started drain
+    if (draining_)
+    {
+        std::cout << "\nDrain aborted" << std::endl;
+        if (drain_.isActive())
+            drain_.abort();
+        else
+            loop_.stop();
+        return;
+    }
+    draining_ = true;
+
+    //Stop originating calls and adding accounts
+    stopLoad();
+    latency_.stop();
+    confBench_.stop();
+    scenarios_.stop();
+    scripts_.stop();
+    soak_.stop();
+    recovery_.stop();
+    stopProvisioning();
+
+    //Posted after batches of added accounts, which provisioning thread could post before it stopped
+    loop_.post([this]() {
+        std::vector<ShutdownDrain::Item> calls, accounts;
+        for (const auto& module : modules_)
+        {
+            for (const auto& call : module->calls)           calls.push_back(ShutdownDrain::Item{ module->index, call.first });
+            for (const auto& acc : module->accounts)         accounts.push_back(ShutdownDrain::Item{ module->index, acc.first });
+        }
+
+        std::cout << "\nShutting down: ending " << calls.size() << " calls, unregistering " << accounts.size()
+                  << " accounts (Q or signal - quit without waiting)" << std::endl;
+
+        drain_.start(opts_.drain, calls, accounts,
+            [this](const ShutdownDrain::Item& call) {
+                //Incoming call, which isn't answered yet, can't be ended by BYE
+                Siprix::ISiprixModule* handle = modules_[call.module]->handle;
+                Siprix::ErrorCode err = Sdk::Call_Bye(handle, call.id);
+                if (err != Siprix::ErrorCode::EOK)
+                    err = Sdk::Call_Reject(handle, call.id, 503);
+                return err;
+            },
+            [this](const ShutdownDrain::Item& acc) {
+                return Sdk::Account_Unregister(modules_[acc.module]->handle, acc.id);
+            },
+            [this]() { loop_.stop(); });
+    });
 }
 
+void SiprixCliApp::printStats()
+{
+    std::cout << "\n--- Stats queued:" << loop_.pendingTasks()
+              << " timers:" << loop_.timersCount()
+              << " loadCalls:" << activeLoadCalls() << " players:" << players_.activeCount() << "\n    ";
+    printAppStats(std::cout, *stats_);
+    std::cout << "\n    ";
+    recordings_.print(std::cout);
+    if (cdr_.isEnabled())
+    {
+        std::cout << "\n    ";
+        cdr_.print(std::cout);
+    }
+    std::cout << "\n    ";
+    tap_.print(std::cout);
+    std::cout << "\n    ";
+    prompts_.print(std::cout);
+    if (!latency_.runs().empty())
+    {
+        std::cout << "\n    ";
+        latency_.print(std::cout);
+    }
+    if (!confBench_.steps().empty())
+    {
+        std::cout << "\n    ";
+        confBench_.print(std::cout);
+    }
+    if (scenarios_.started())
+    {
+        std::cout << "\n    ";
+        scenarios_.print(std::cout);
+    }
+    if (scripts_.started())
+    {
+        std::cout << "\n    ";
+        scripts_.print(std::cout);
+    }
+    if (!soak_.samples().empty())
+    {
+        std::cout << "\n    ";
+        soak_.print(std::cout);
+    }
+    if (admission_.isEnabled())
+    {
+        std::cout << "\n    ";
+        admission_.print(std::cout);
+    }
+    if (recovery_.networkEvents() || !recovery_.runs().empty())
+    {
+        std::cout << "\n    ";
+        recovery_.print(std::cout);
+    }
+    if (AllocTracker::enabled())
+    {
+        std::cout << "\n    ";
+        AllocTracker::print(std::cout);
+    }
+    if (dashboard_.frames())
+    {
+        std::cout << "\n    ";
+        dashboard_.print(std::cout);
+    }
+    std::cout << "\n    ";
+    findModule(sprxModule_)->conference.print(std::cout);
+    if (sdkStatsEnabled())
+    {
+        std::cout << "\n    ";
+        printSdkStats(std::cout, 10);
+    }
+    std::cout << "\n    ";
+    printSdkDataStats(std::cout);
+    if (modules_.size() > 1)
+        printModuleStats();
+    std::cout << std::endl;
+}
 
 ////////////////////////////////////////////////////////////////////////////
-//Callbacks
+//Modules
+
+SipModule* SiprixCliApp::findModule(Siprix::ISiprixModule* handle) const
+{
+    for (const auto& module : modules_)
+        if (module->handle == handle) return module.get();
+    return nullptr;
+}
+
+bool SiprixCliApp::selectModule(uint32_t index)
+{
+    if (index >= modules_.size())
+        return false;
+    curModule_ = index;
+    sprxModule_ = modules_[index]->handle;
+    return true;
+}
+
+void SiprixCliApp::SelectModule()
+{
+    uint32_t index = 0;
+    std::cout << "Enter module index (0.." << modules_.size() - 1 << "): "; if (!readArg(index)) return;
+
+    if (selectModule(index))
+        std::cout << "Commands are applied to module " << index << std::endl;
+    else
+        std::cout << "Invalid module index" << std::endl;
+}
+
+void SiprixCliApp::updateModuleRates()
+{
+    //CPU of the module is CPU time of threads, which were started during its creation
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsedMs = std::chrono::duration<double, std::milli>(now - ratesTime_).count();
+    ratesTime_ = now;
+
+    for (const auto& module : modules_)
+    {
+        uint64_t cpuMs = 0;
+        for (int tid : module->threads)
+            cpuMs += procThreadCpuMs(tid);
+
+        module->cpuPercent = (elapsedMs > 0) ? (cpuMs - module->cpuMs) * 100.0 / elapsedMs : 0;
+        module->eventRate  = (elapsedMs > 0) ? (module->events - module->prevEvents) * 1000.0 / elapsedMs : 0;
+        module->cpuMs = cpuMs;
+        module->prevEvents = module->events;
+    }
+
+    const uint64_t processCpuMs = procCpuMs();
+    processCpuPercent_ = (elapsedMs > 0) ? (processCpuMs - processCpuMs_) * 100.0 / elapsedMs : 0;
+    processCpuMs_ = processCpuMs;
+}
+
+void SiprixCliApp::printModuleStats()
+{
+    updateModuleRates();
+
+    std::cout << "\n    process cpuMs:" << processCpuMs_ << " cpu:" << processCpuPercent_ << "%";
+    for (const auto& module : modules_)
+    {
+        std::cout << "\n    module:" << static_cast<uint32_t>(module->index)
+                  << " threads:" << module->threads.size()
+                  << " accounts:" << module->loadAccounts.size()
+                  << " cpuMs:" << module->cpuMs << " cpu:" << module->cpuPercent << "%"
+                  << " events:" << module->events << " events/s:" << module->eventRate
+                  << " loadCalls:" << module->load.activeCalls();
+    }
+}
 
 void SiprixCliApp::OnAccountRegState(Siprix::AccountId accId, Siprix::RegState state, const char* response)
 {
@@ -546,14 +2055,24 @@ void SiprixCliApp::OnCallIncoming(Siprix::CallId callId, Siprix::AccountId accId
 
 void SiprixCliApp::OnCallDtmfReceived(Siprix::CallId callId, uint16_t tone)
 {
-    char ch = (tone == 10) ? '*' : (tone==11 ? '#' : tone+'0');
+    char ch = getDtmfToneChar(tone);
     std::cout << "\n--- OnCallDtmfReceived callId:" << callId 
               << " tone:" << ch << std::endl;
 }
 
-void SiprixCliApp::OnCallSwitched(Siprix::CallId callId)
+void SiprixCliApp::OnCallAudioDetected(Siprix::CallId callId, TapDetection detection, uint32_t atMs,
+                                       const char* reason, const char* action)
 {
-    std::cout << "\n--- OnCallSwitched callId:" << callId << std::endl;
+    std::cout << "\n--- OnCallAudioDetected callId:" << callId << " " << getTapDetectionStr(detection)
+              << " (" << reason << ") at:" << atMs << "ms action:" << action << std::endl;
+}
+
+void SiprixCliApp::OnCallSwitched(Siprix::CallId callId, const ConferenceTracker& conference)
+{
+    std::cout << "\n--- OnCallSwitched callId:" << callId;
+    if (conference.isActive())
+        std::cout << " (conference of " << conference.members().size() << " calls)";
+    std::cout << std::endl;
 }
 
 void SiprixCliApp::OnCallHeld(Siprix::CallId callId, Siprix::HoldState state)
@@ -684,118 +2203,451 @@ bool SiprixCliApp::handleCmdMain(MenuId& menuId, char cmd)
         case 'A': menuId = eAccounts; handleCmdAccounts(cmd);  return false;
         case 'C': menuId = eCalls;    handleCmdCalls(cmd);     return false;
         case 'D': menuId = eDevices;  handleCmdDevices(cmd);   return false;
+        case 'M': SelectModule();  return false;
         case 'Q': case 'q': return true;//!!!
     }
 
     std::cout << " A  Accounts menu\n";
     std::cout << " C  Calls menu\n";
     std::cout << " D  Devices menu\n";
+    if (modules_.size() > 1)
+        std::cout << " M  Select module (current: " << curModule_ << ")\n";
     std::cout << " Q  => Quit\n";
     return false;
 }
 
 
+bool SiprixCliApp::handleCmd(char cmd)
+{
+    ALLOC_SCOPE("console");
+    ++stats_->commands;
+
+    bool menuExit = false;
+    switch (curMenu_)
+    {
+        case MenuId::eMain:     menuExit = handleCmdMain(curMenu_, cmd); break;
+        case MenuId::eAccounts: menuExit = handleCmdAccounts(cmd); break;
+        case MenuId::eDevices:  menuExit = handleCmdDevices(cmd); break;
+        case MenuId::eCalls:    menuExit = handleCmdCalls(cmd); break;
+    }//switch
+
+    if (menuExit)
+    {
+        if (curMenu_ == MenuId::eMain)
+        {
+            return true;
+        }
+        else {
+            curMenu_ = MenuId::eMain;
+            handleCmdMain(curMenu_, 0);//print main menu
+        }
+    }
+    return false;
+}
+
 void SiprixCliApp::handleCmds()
 {
-    //Run commands loop    
-    MenuId curMenu = MenuId::eMain;
-    handleCmdMain(curMenu, 0);
+    //Run commands loop (worker is headless - controlled by signals and control socket)
+    if (dashboard_.isEnabled())
+    {
+        input_.attach(loop_, [this]() { onConsoleInput(); });
+    }
+    else if (!opts_.isWorker())
+    {
+        handleCmdMain(curMenu_, 0);
+        printPrompt();
+        input_.attach(loop_, [this]() { onConsoleInput(); });
+    }
+    loop_.run();
+    dashboard_.stop();
+    stopProvisioning();
+    stopAllocCheck_ = true;
+    if (allocChecker_.joinable())
+        allocChecker_.join();
+    stopLoad();
+    latency_.stop();
+    confBench_.stop();
+    scenarios_.stop();
+    scripts_.stop();
+    soak_.stop();
+    recovery_.stop();
+    admission_.stop();
+    control_.stop();
+
+    //UnInitialize
+    for (const auto& module : modules_)
+        Sdk::Module_UnInitialize(module->handle);
+
+    //Files are closed by SDK at this moment
+    tap_.stop();
+    recordings_.stop();
+    cdr_.stop();
+}
 
-    while (true)
+void SiprixCliApp::onConsoleInput()
+{
+    if (promptDepth_ > 0)
+        return;//Data will be consumed by the command which waits for it
+
+    char cmd = '\0';
+    if (dashboard_.isEnabled())
+    {
+        //Keys of the dashboard: quit (again - quit without waiting) and repaint of the screen
+        while (!loop_.isStopped() && input_.nextChar(cmd))
+        {
+            if ((cmd == 'q') || (cmd == 'Q'))  startDrain();
+            else if ((cmd == 'r') || (cmd == 'R') || (cmd == '\x0c')) dashboard_.redraw();
+        }
+        return;
+    }
+    while (!loop_.isStopped() && input_.nextChar(cmd))
     {
-        std::cout << "\n>>> Enter command: ";
-        char cmd = '\0';
-        if (!(std::cin >> cmd))
+        if (handleCmd(cmd))
         {
-            std::cout << "Failed to read!\n";
-            std::cin.clear(); // Reset stream
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            startDrain();
             continue;
         }
+        printPrompt();
+    }
 
-        bool menuExit = false;
-        switch (curMenu)
+    if (input_.eof() && !inputClosed_)
+    {
+        inputClosed_ = true;
+        std::cout << "\nConsole input closed. Send SIGINT/SIGTERM to quit." << std::endl;
+    }
+}
+
+void SiprixCliApp::printPrompt()
+{
+    std::cout << "\n>>> Enter command: " << std::flush;
+}
+
+bool SiprixCliApp::readArg(std::string& value)
+{
+    //Keep handling events while user is typing
+    std::cout.flush();
+    ++promptDepth_;
+    bool ok = true;
+    while (!input_.nextToken(value))
+    {
+        if (input_.eof() || !loop_.runOnce(-1))
         {
-            case MenuId::eMain:     menuExit = handleCmdMain(curMenu, cmd); break;
-            case MenuId::eAccounts: menuExit = handleCmdAccounts(cmd); break;
-            case MenuId::eDevices:  menuExit = handleCmdDevices(cmd); break;
-            case MenuId::eCalls:    menuExit = handleCmdCalls(cmd); break;
-        }//switch
+            ok = false;
+            break;
+        }
+    }
+    --promptDepth_;
+    return ok;
+}
 
-        if (menuExit)
+bool SiprixCliApp::readArg(char& value)
+{
+    std::cout.flush();
+    ++promptDepth_;
+    bool ok = true;
+    while (!input_.nextChar(value))
+    {
+        if (input_.eof() || !loop_.runOnce(-1))
         {
-            if (curMenu == MenuId::eMain)
-            {
-                break;
-            }
-            else {
-                curMenu = MenuId::eMain;
-                handleCmdMain(curMenu, 0);//print main menu
-            }
+            ok = false;
+            break;
         }
-    }//while
+    }
+    --promptDepth_;
+    return ok;
+}
 
-    //UnInitialize
-    Module_UnInitialize(sprxModule_);
+template<typename T>
+bool SiprixCliApp::readArg(T& value)
+{
+    std::string token;
+    if (!readArg(token))
+        return false;
+
+    char* end = nullptr;
+    const long long number = strtoll(token.c_str(), &end, 10);
+    if (*end != '\0')
+    {
+        std::cout << "Failed to read!\n";
+        return false;
+    }
+    value = static_cast<T>(number);
+    return true;
 }
 
 bool SiprixCliApp::initializeSiprixModule()
 {
+    ratesTime_ = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < opts_.modules; ++i)
+    {
+        modules_.emplace_back(new SipModule(static_cast<uint8_t>(i), loop_, *this, *stats_));
+        SipModule* module = modules_.back().get();
+        module->bridge.setIncomingGate([this, module](Siprix::CallId callId) {
+            const uint32_t code = admission_.admitEarly();
+            if (code)
+                Sdk::Call_Reject(module->handle, callId, code);
+            return code;
+        });
+        if (!initializeModule(*modules_.back()))
+            return false;
+    }
+
+    std::cout << "Siprix module" << (modules_.size() > 1 ? "s" : "") << " successfully initialized.\nVersion: "
+              << Sdk::Module_Version(modules_[0]->handle) <<std::endl;
+    selectModule(0);
+    return true;
+}
+
+bool SiprixCliApp::initializeModule(SipModule& module)
+{
+    //Threads, which appear while module is being initialized, belong to it
+    const std::vector<int> threadsBefore = procListThreads();
+
+    const std::string prefix = (opts_.modules > 1) ? "module[" + std::to_string(module.index) + "] " : "";
+
     //Create module
-    sprxModule_ = Siprix::Module_Create();
-    if (!sprxModule_)
+    auto began = StartupProfiler::Clock::now();
+    module.handle = Sdk::Module_Create();
+    profiler_.phase(prefix + "Module_Create", began);
+    if (!module.handle)
     {
         std::cout << "Can't create siprix module." << std::endl;
         return false;
     }
 
+    //Each module requires own home folder and RTP ports
+    std::string homeFolder = opts_.homeFolder;
+    uint16_t rtpStartPort = opts_.rtpStartPort;
+    if (opts_.modules > 1)
+    {
+        if (!homeFolder.empty())
+            mkdir(homeFolder.c_str(), 0755);
+        homeFolder = (homeFolder.empty() ? std::string(".") : homeFolder) + "/module-" + std::to_string(module.index);
+        mkdir(homeFolder.c_str(), 0755);
+        rtpStartPort = static_cast<uint16_t>((rtpStartPort ? rtpStartPort : 10000) + module.index * opts_.rtpPortRange);
+    }
+
     //Initialize
-    Siprix::IniData* ini = Siprix::Ini_GetDefault();
-    //Ini_SetHomeFolder(ini, "SiprixUA");
-    Ini_SetLicense(ini, "...license-credentials...");
-    Ini_SetLogLevelFile(ini, Siprix::LogLevel::Debug);
-    Ini_SetLogLevelIde(ini, Siprix::LogLevel::NoLog);
-    Ini_SetTlsVerifyServer(ini, false);
-
-    const Siprix::ErrorCode err = Siprix::Module_Initialize(sprxModule_, ini);
+    SdkData<Siprix::IniData> iniData("module-" + std::to_string(module.index));
+    Siprix::IniData* ini = iniData.get();
+    if (!iniData.configured())
+    {
+        //Sdk::Ini_SetHomeFolder(ini, "SiprixUA");
+        if (!homeFolder.empty()) Sdk::Ini_SetHomeFolder(ini, homeFolder.c_str());
+        if (rtpStartPort)        Sdk::Ini_SetRtpStartPort(ini, rtpStartPort);
+        Sdk::Ini_SetLicense(ini, "...license-credentials...");
+        Sdk::Ini_SetLogLevelFile(ini, Siprix::LogLevel::Debug);
+        Sdk::Ini_SetLogLevelIde(ini, Siprix::LogLevel::NoLog);
+        Sdk::Ini_SetTlsVerifyServer(ini, false);
+
+        std::string cfgErr;
+        if (config("ini").isObject()) applyIniConfig(config("ini"), ini, cfgErr);
+        iniData.setConfigured();
+    }
+
+    began = StartupProfiler::Clock::now();
+    const Siprix::ErrorCode err = Sdk::Module_Initialize(module.handle, ini);
+    profiler_.phase(prefix + "Module_Initialize", began);
     if (err != Siprix::ErrorCode::EOK)
     {
-        std::cout << "Can't initialize siprix module. Err: "
-                  << err << " " << Siprix::GetErrorText(err) << std::endl;
+        std::cout << "Can't initialize siprix module " << static_cast<uint32_t>(module.index) << ". Err: "
+                  << err << " " << Sdk::GetErrorText(err) << std::endl;
         return false;
     }
     else{
-        std::cout << "Siprix module successfully initialized.\nVersion: "
-                  << Siprix::Module_Version(sprxModule_) <<std::endl;
+        //Video and devices are configured by 'prepareMedia' when the first call needs them
 
-        configureVideo();
-        
         //Set callbacks
-        Callback_SetEventHandler(sprxModule_, this);
+        began = StartupProfiler::Clock::now();
+        Sdk::Callback_SetEventHandler(module.handle, &module.bridge);
+        profiler_.phase(prefix + "Callback_SetEventHandler", began);
+
+        for (int tid : procListThreads())
+            if (std::find(threadsBefore.begin(), threadsBefore.end(), tid) == threadsBefore.end())
+                module.threads.push_back(tid);
         return true;
     }
 }
 
 void SiprixCliApp::configureVideo()
 {
-    //Siprix::VideoData* vdoData = Siprix::Vdo_GetDefault();
-    //Siprix::Vdo_SetBitrate(vdoData, 600);//600kbps
-    //Siprix::Vdo_SetFramerate(vdoData, 5);//5fps
-    //Siprix::Vdo_SetHeight(vdoData, 480); 
-    //Siprix::Vdo_SetWidth(vdoData,  640); //640x480
-    //Siprix::Vdo_SetNoCameraImgPath(vdoData, "logo.JPG");
+    //Siprix::VideoData* vdoData = Sdk::Vdo_GetDefault();
+    //Sdk::Vdo_SetBitrate(vdoData, 600);//600kbps
+    //Sdk::Vdo_SetFramerate(vdoData, 5);//5fps
+    //Sdk::Vdo_SetHeight(vdoData, 480); 
+    //Sdk::Vdo_SetWidth(vdoData,  640); //640x480
+    //Sdk::Vdo_SetNoCameraImgPath(vdoData, "logo.JPG");
+
+    //Sdk::Dvc_SetVideoDevice(sprxModule_, 555);//force to use NoCameraImg
+    //Sdk::Dvc_SetVideoParams(sprxModule_, vdoData);
+
+    const JsonValue& videoDevice = config("devices")["video"];
+    if (videoDevice.isNumber())
+    {
+        const Siprix::ErrorCode err = Sdk::Dvc_SetVideoDevice(sprxModule_, static_cast<uint16_t>(videoDevice.asInt()));
+        if (err != Siprix::ErrorCode::EOK)
+            std::cout << "Can't set video device. Err: " << err << " " << Sdk::GetErrorText(err) << std::endl;
+    }
+
+    if (!config("video").isObject())
+        return;
+
+    //Settings are the same for all modules, so object configured by the first one is reused
+    SdkData<Siprix::VideoData> vdoData("video");
+    if (!vdoData.configured())
+    {
+        std::string cfgErr;
+        applyVideoConfig(config("video"), vdoData.get(), cfgErr);
+        vdoData.setConfigured();
+    }
+    const Siprix::ErrorCode err = Sdk::Dvc_SetVideoParams(sprxModule_, vdoData.get());
+    if (err != Siprix::ErrorCode::EOK)
+        std::cout << "Can't set video params. Err: " << err << " " << Sdk::GetErrorText(err) << std::endl;
+}
+
+void SiprixCliApp::configureDevices()
+{
+    const JsonValue& devices = config("devices");
+    for (const auto& member : devices.members())
+    {
+        const uint16_t index = static_cast<uint16_t>(member.second.asInt());
+        Siprix::ErrorCode err = Siprix::ErrorCode::EOK;
+        if (member.first == "playout")        err = Sdk::Dvc_SetPlayoutDevice(sprxModule_, index);
+        else if (member.first == "recording") err = Sdk::Dvc_SetRecordingDevice(sprxModule_, index);
+
+        if (err != Siprix::ErrorCode::EOK)
+            std::cout << "Can't set " << member.first << " device " << index << ". Err: "
+                      << err << " " << Sdk::GetErrorText(err) << std::endl;
+    }
+}
+
+bool SiprixCliApp::loadMedia()
+{
+    if (sdkMediaInfo().loaded || !sdkIsDynamic())
+        return true;
+
+    std::string err;
+    const uint64_t rssKb = procRssKb();
+    if (!sdkLoadMedia(err))
+    {
+        std::cerr << err << std::endl;
+        return false;
+    }
+
+    const SdkLibInfo& lib = sdkMediaInfo();
+    profiler_.phase("dlopen " + lib.path + " (first call)", lib.began, lib.ended);
+    if (opts_.startupReport)
+        std::cout << "\n--- Media library loaded on the first call in "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(lib.ended - lib.began).count() << "us, RSS +"
+                  << static_cast<int64_t>(procRssKb() - rssKb) << "kB" << std::endl;
+    return true;
+}
+
+Siprix::ErrorCode SiprixCliApp::prepareMedia(bool withVideo)
+{
+    if (!loadMedia())
+        return Siprix::EInitializeFailure;
+
+    //Applied to module which the command is addressed to
+    SipModule* module = findModule(sprxModule_);
+    if (!module)
+        return Siprix::EOK;
+
+    if (!module->devicesConfigured)
+    {
+        module->devicesConfigured = true;
+        const auto began = StartupProfiler::Clock::now();
+        configureDevices();
+        profiler_.phase("configureDevices (first call)", began);
+        if (opts_.startupReport)
+            std::cout << "\n--- Devices configured on the first call in "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(StartupProfiler::Clock::now() - began).count() << "us" << std::endl;
+    }
+
+    if (withVideo && !module->videoConfigured)
+    {
+        module->videoConfigured = true;
+        const auto began = StartupProfiler::Clock::now();
+        configureVideo();
+        profiler_.phase("configureVideo (first video call)", began);
+        if (opts_.startupReport)
+            std::cout << "\n--- Video configured on the first video call in "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(StartupProfiler::Clock::now() - began).count() << "us" << std::endl;
+    }
+    return Siprix::EOK;
+}
 
-    //Siprix::Dvc_SetVideoDevice(sprxModule_, 555);//force to use NoCameraImg
-    //Siprix::Dvc_SetVideoParams(sprxModule_, vdoData);
+const JsonValue& SiprixCliApp::config(const char* section) const
+{
+    static const JsonValue kEmpty;
+    return opts_.config ? (*opts_.config)[section] : kEmpty;
 }
 
 
 int SiprixCliApp::run()
 {
+    //SDK libraries were opened in 'main', before config was parsed
+    for (const SdkLibInfo* lib : { &sdkMediaInfo(), &sdkCoreInfo() })
+        if (lib->loaded) profiler_.phase("dlopen " + lib->path, lib->began, lib->ended);
+
+    //Options and config file are parsed at this moment
+    profiler_.milestone("app started");
+
+    if (!loop_.open())
+        return 1;
+
+    loop_.setSignalHandler([this](int signo) { onSignal(signo); });
+    if (opts_.statsIntervalSec)
+    {
+        const uint32_t periodMs = opts_.statsIntervalSec * 1000;
+        loop_.addTimer(periodMs, periodMs, [this]() { printStats(); });
+    }
+
+    if (!opts_.controlSpec.empty())
+    {
+        StartupProfiler::Scope phase(profiler_, "control socket");
+        if (!control_.start(opts_.controlSpec))
+            return 1;
+    }
+
+    if (opts_.recording.folder.empty())
+        opts_.recording.folder = (opts_.homeFolder.empty() ? std::string(".") : opts_.homeFolder) + "/recordings";
+    std::string err;
+    if (!recordings_.start(opts_.recording, err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+    if (opts_.cdr.folder == "-")
+        opts_.cdr.folder = (opts_.homeFolder.empty() ? std::string(".") : opts_.homeFolder) + "/cdr";
+    if (!opts_.cdr.folder.empty() && !cdr_.start(opts_.cdr, err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+    if (!loadPrompts() || !checkTapActions())
+        return 1;
+    if (!tap_.start(opts_.tap, [this](uint8_t module, Siprix::CallId callId, const TapResult& result) {
+            onTapResult(module, callId, result); }, err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+
+    setupRecovery();
+    startAdmission(opts_.admission);
+    if (opts_.dashboard.enabled && !startDashboard(err))
+    {
+        std::cerr << err << std::endl;
+        return 1;
+    }
     if (initializeSiprixModule())
     {
+        //Load generator is started when accounts are added
+        provisionAccounts();
+        profiler_.milestone("ready for commands");
         handleCmds();
-        return 0;
+        return exitCode_;
     }
 
     return 1;
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "Admission.h"
+#include "AppEvent.h"
+#include "AudioQuality.h"
+#include "CdrWriter.h"
+#include "Conference.h"
+#include "Config.h"
+#include "ConsoleInput.h"
+#include "ControlServer.h"
+#include "Dashboard.h"
+#include "EventLoop.h"
+#include "LatencyTest.h"
+#include "LiveTap.h"
+#include "LoadGenerator.h"
+#include "NetworkRecovery.h"
+#include "NodeAllocator.h"
+#include "Prompts.h"
+#include "RecordingManager.h"
+#include "Scenario.h"
+#include "ScenarioScript.h"
+#include "SdkData.h"
+#include "SdkProxy.h"
+#include "Soak.h"
+#include "ShutdownDrain.h"
+#include "StartupProfiler.h"
+#include "Stats.h"
+
+////////////////////////////////////////////////////////////////////////////
+//AppOptions
+
+struct AppOptions
+{
+    uint32_t statsIntervalSec = 0;//Print stats periodically (0 - disabled)
+    bool startupReport = false;   //Print durations of the startup phases
+    bool signalingOnly = false;   //Don't load media library until the first call requires it
+    std::string controlSpec;      //Address of control socket (empty - disabled)
+    std::string homeFolder;       //Ini_SetHomeFolder (empty - SDK default)
+    uint16_t rtpStartPort = 0;    //Ini_SetRtpStartPort (0 - SDK default)
+    std::string accountsFile;     //Accounts to add on start
+    std::string configFile;       //Settings of the SDK and accounts to add on start
+    std::shared_ptr<const JsonValue> config;//Parsed and validated 'configFile'
+    LoadParams load;              //Generated calls (cps=0 - disabled)
+    uint32_t modules = 1;         //Number of Siprix modules in the process
+    DrainParams drain;            //Completion of calls and registrations on quit
+    RecordingParams recording;    //Storage of call recordings
+    CdrParams cdr;                //Call detail records (disabled when folder is empty)
+    std::string promptsFolder;    //Mp3 files played by name (file name without extension)
+    LatencyParams latency;        //Latency test started when accounts added (empty target - disabled)
+    std::string latencyGenerate;  //Write test signal to this WAV file and exit
+    std::string latencySignal = "chirp";
+    std::string latencyAnalyze;   //Analyze recordings (file or folder) against 'latency.reference' and exit
+    std::string qualityAnalyze;   //Check quality of recordings (file or folder) and exit
+    QualityParams quality;
+    TapParams tap;                //Live analysis of recordings (AMD, dead air)
+    ConferenceParams conference;  //Conference benchmark started when accounts added (empty target - disabled)
+    ScenarioParams scenario;      //Scenarios started when accounts added (empty target - disabled)
+    std::string script;           //Scenario script started when accounts added (uses target/count/rate of 'scenario')
+    bool soak = false;            //Soak monitor started when accounts added
+    SoakParams soakParams;
+    RecoveryParams recovery;      //Registrations and re-INVITEs after network change
+    AdmissionParams admission;    //Limits of incoming calls (overload protection)
+    uint32_t allocCheck = 0;      //Simulated calls measured for heap allocations, then app quits (0 - disabled)
+    DashboardParams dashboard;    //Full screen live view instead of the menu and log of events
+
+    //Supervisor mode
+    uint32_t workers = 0;         //Number of worker processes (0 - run single process)
+    std::string cpuAffinity;
+    uint16_t rtpPortRange = 1000; //Number of RTP ports reserved for each module
+
+    //Set for worker process
+    int32_t  workerIndex = -1;
+    uint32_t workerCount = 1;
+    bool isWorker() const { return workerIndex >= 0; }
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//AccountParams
+
+struct AccountParams
+{
+    std::string server;
+    std::string extension;
+    std::string password;
+    Siprix::SipTransport transport = Siprix::SipTransport::TCP;
+    uint32_t expireTime = 300;
+    const JsonValue* settings = nullptr;//Other Acc_* settings (item of the config file)
+};
+
+//AccData reused for accounts with the same settings (key - accTemplateKey of AccountParams::settings,
+//so accounts of the config which differ only by server, extension, password, ... share one).
+//Used by one thread: loop and provisioning thread have own ones.
+typedef std::map<std::string, SdkData<Siprix::AccData>> AccTemplates;
+
+//Profile of the originated call without x-headers: DestData with these settings is created once
+struct DestProfile
+{
+    Siprix::AccountId accId = 0;
+    bool video = false;
+
+    bool operator<(const DestProfile& other) const {
+        if (accId != other.accId) return accId < other.accId;
+        return video < other.video;
+    }
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//SipModule
+//One instance of Siprix module with own callbacks handler and load generator.
+
+struct SipModule
+{
+    SipModule(uint8_t idx, EventLoop& loop, IAppEventListener& listener, AppStats& stats)
+        : index(idx), bridge(loop, listener, idx), load(loop, stats) {}
+
+    uint8_t index;
+    Siprix::ISiprixModule* handle = nullptr;
+    EventBridge bridge;
+    LoadGenerator load;
+    std::vector<Siprix::AccountId> loadAccounts;//Accounts used to originate generated calls
+    size_t nextLoadAccount = 0;
+
+    //Existing calls and accounts (ended and unregistered on quit)
+    std::unordered_map<Siprix::CallId, Siprix::AccountId, std::hash<Siprix::CallId>, std::equal_to<Siprix::CallId>,
+                       NodeAllocator<std::pair<const Siprix::CallId, Siprix::AccountId>>> calls;//Account of call (0 - unknown), nodes are reused
+    std::unordered_map<Siprix::AccountId, uint32_t> accountCalls;//Number of calls of account (entries are kept)
+    struct AccountState {
+        uint32_t expireTime = 300;//Of the registration: configured one, then set by the last register of user
+        bool unregistered = false;//By user (console, control): network recovery doesn't register it again
+    };
+    std::unordered_map<Siprix::AccountId, AccountState> accounts;
+
+    //Devices and video are configured when the first call requires them
+    bool devicesConfigured = false;
+    bool videoConfigured = false;
+
+    //Calls mixed by the module
+    ConferenceTracker conference;
+
+    //Scaling measurement
+    std::vector<int> threads;//Threads started by Module_Create/Module_Initialize
+    uint64_t events = 0;
+    uint64_t cpuMs = 0;
+    double   cpuPercent = 0; //Since previous 'updateModuleRates'
+    double   eventRate = 0;
+    uint64_t prevEvents = 0;
+
+    //Account of call is set by the first one which tracks call (0 - unknown)
+    void addCall(Siprix::CallId callId, Siprix::AccountId accId)
+    {
+        if (calls.emplace(callId, accId).second && accId)
+            ++accountCalls[accId];
+    }
+    void removeCall(Siprix::CallId callId)
+    {
+        auto it = calls.find(callId);
+        if (it == calls.end())
+            return;
+        if (it->second)
+            --accountCalls[it->second];
+        calls.erase(it);
+    }
+    uint32_t callsOfAccount(Siprix::AccountId accId) const
+    {
+        auto it = accountCalls.find(accId);
+        return (it != accountCalls.end()) ? it->second : 0;
+    }
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//SiprixCliApp
+
+class SiprixCliApp : public IAppEventListener, public IControlHandler
+{
+public:
+    //Counters are written to 'sharedStats' when specified (worker of supervisor)
+    SiprixCliApp(const AppOptions& opts, AppStats* sharedStats = nullptr)
+        : opts_(opts), stats_(sharedStats ? sharedStats : &localStats_) {}
+    int run();
+
+    enum MenuId { eMain, eAccounts, eDevices, eCalls };
+
+protected:
+    //Menu
+    void handleCmds();
+    bool handleCmd(char cmd);
+    bool handleCmdMain(MenuId& menuId, char cmd);
+    bool handleCmdAccounts(char cmd);
+    bool handleCmdCalls(char cmd);
+    bool handleCmdDevices(char cmd);
+
+    //Console input
+    void onConsoleInput();
+    void printPrompt();
+    bool readArg(std::string& value);
+    bool readArg(char& value);
+    template<typename T> bool readArg(T& value);
+
+    //Control socket (implemented in ControlCommands.cxx)
+    int32_t onControlOp(const std::string& op, const JsonValue& args,
+                        JsonWriter& result, std::string& errText);
+
+    //Operations (shared by console commands and control socket)
+    Siprix::ErrorCode addAccount(const AccountParams& params, Siprix::AccountId& accId);
+    Siprix::AccData* makeAccData(const AccountParams& params, AccTemplates& templates) const;
+    Siprix::ErrorCode deleteAccount(Siprix::AccountId accId);
+    Siprix::ErrorCode registerAccount(Siprix::AccountId accId, uint32_t expireTime);
+    Siprix::ErrorCode unregisterAccount(Siprix::AccountId accId);
+    uint32_t expireTimeOf(const AccountParams& params) const;
+    Siprix::ErrorCode updSecureMedia(Siprix::AccountId accId, Siprix::SecureMedia mode);
+    Siprix::ErrorCode inviteCall(Siprix::AccountId accId, const std::string& destExt, bool withVideo, Siprix::CallId& callId,
+                                 const JsonValue* xHeaders = nullptr);
+    int32_t recordCall(Siprix::CallId callId, bool start, std::string& path, std::string& errText);
+    int32_t tapCall(uint8_t module, Siprix::CallId callId, std::string& path, std::string& errText);
+    void onTapResult(uint8_t module, Siprix::CallId callId, const TapResult& result);
+    bool checkTapActions();
+    Siprix::ErrorCode playPrompts(Siprix::CallId callId, const std::vector<std::string>& names, bool loop,
+                                  Siprix::PlayerId& playerId, std::string& errText);
+    Siprix::ErrorCode stopPlay(Siprix::PlayerId playerId);
+    bool loadPrompts();
+    bool startLatencyTest(const LatencyParams& params, std::string& err);
+    Siprix::ErrorCode makeConference();
+    Siprix::ErrorCode switchToCall(Siprix::CallId callId);
+    bool startConfBench(const ConferenceParams& params, std::string& err);
+    ScenarioActions makeScenarioActions();
+    bool startScenarios(const ScenarioParams& params, std::string& err);
+    bool startScript(const ScriptParams& params, std::string& err);
+    bool startSoak(const SoakParams& params, std::string& err);
+    void setupRecovery();
+    void startAdmission(const AdmissionParams& params);
+    bool startDashboard(std::string& err);
+    bool startAllocCheck(uint32_t calls, std::string& err);
+    void runAllocCheck(uint32_t calls);
+    void provisionAccounts();
+    void onAccountsProvisioned(size_t added, size_t total, StartupProfiler::Clock::time_point began);
+    void stopProvisioning();
+    void reportStartup();
+    bool startLoad(const LoadParams& params);
+    void stopLoad();
+    size_t activeLoadCalls() const;
+
+    //Graceful shutdown: new calls are rejected, existing ones ended, accounts unregistered
+    void startDrain();
+
+    //Modules ('sprxModule_' points to the selected one, commands are applied to it)
+    bool selectModule(uint32_t index);
+    SipModule* findModule(Siprix::ISiprixModule* handle) const;
+    void SelectModule();
+    void updateModuleRates();
+    void printModuleStats();
+
+    //Temporarily redirects commands to another module
+    struct ModuleScope {
+        ModuleScope(SiprixCliApp& app, Siprix::ISiprixModule* module) : app_(app), prev_(app.sprxModule_) { app.sprxModule_ = module; }
+        ~ModuleScope() { app_.sprxModule_ = prev_; }
+        SiprixCliApp& app_;
+        Siprix::ISiprixModule* prev_;
+    };
+
+    //Accounts
+    void AddAccount();
+    void DelAccount();
+    void UnregAccount();
+    void RegAccount();
+    void UpdSecureMediaAccount();
+
+    //Calls
+    void InitiateCall();
+    void EndCall();
+    void RejectCall();
+    void AcceptCall();
+    void SendDtmfToCall();
+    void TransferCallBlind();
+    void TransferCallAttended();
+    void PlayFileToCall();
+    void RecordCallToFile();
+    void MuteMicOfCall();
+    void MuteCamOfCall();
+    void ToggleHoldCall();
+    void SwitchToCall();
+    void MakeConfCall();
+
+    //Devices
+    void DisplayPlayoutDevices();
+    void DisplayRecordDevices();
+    void DisplayVideoDevices();
+    void SelectDevice();
+
+    //Events (raised by EventBridge, handled on the loop thread)
+    void onAppEvent(const AppEvent& ev);
+    void onSignal(int signo);
+    void printStats();
+
+    void OnTrialModeNotified();
+    void OnDevicesAudioChanged();
+
+    void OnAccountRegState(Siprix::AccountId accId, Siprix::RegState state, const char* response);
+    void OnNetworkState(const char* name, Siprix::NetworkState state);
+    void OnPlayerState(Siprix::PlayerId playerId, Siprix::PlayerState state);
+    void OnRingerState(bool started) {}
+
+    void OnCallIncoming(Siprix::CallId callId, Siprix::AccountId accId, bool withVideo, const char* hdrFrom, const char* hdrTo);
+    void OnCallConnected(Siprix::CallId callId, const char* hdrFrom, const char* hdrTo, bool withVideo);
+    void OnCallTerminated(Siprix::CallId callId, uint32_t statusCode);
+    void OnCallProceeding(Siprix::CallId callId, const char* response);
+    void OnCallTransferred(Siprix::CallId callId, uint32_t statusCode);
+    void OnCallRedirected(Siprix::CallId origCallId, Siprix::CallId relatedCallId, const char* referTo);
+    void OnCallDtmfReceived(Siprix::CallId callId, uint16_t tone);
+    void OnCallHeld(Siprix::CallId callId, Siprix::HoldState state);
+    void OnCallSwitched(Siprix::CallId callId, const ConferenceTracker& conference);
+    void OnCallAudioDetected(Siprix::CallId callId, TapDetection detection, uint32_t atMs, const char* reason, const char* action);
+
+    //Create and init siprix module
+    bool initializeSiprixModule();
+    bool initializeModule(SipModule& module);
+    void configureVideo();
+    void configureDevices();
+    Siprix::ErrorCode prepareMedia(bool withVideo);
+    bool loadMedia();
+    const JsonValue& config(const char* section) const;
+
+protected:
+    AppOptions opts_;
+    EventLoop loop_;
+    ConsoleInput input_;
+    ControlServer control_{ loop_, *this };
+    AppStats localStats_;
+    AppStats* stats_;
+
+    StartupProfiler profiler_;
+    bool firstRegistration_ = false;
+    bool accountsProvisioned_ = false;
+    bool startupReported_ = false;
+
+    //Accounts are added by separate thread, while loop already handles events and commands
+    std::thread provisioner_;
+    std::atomic<bool> stopProvisioning_{ false };
+
+    //Simulated callbacks of SDK, which are measured by allocation check
+    std::thread allocChecker_;
+    std::atomic<uint64_t> allocCheckHandled_{ 0 };
+    std::atomic<bool> stopAllocCheck_{ false };
+    int exitCode_ = 0;
+
+    //SDK data objects reused by operations of the loop thread
+    AccTemplates accTemplates_;
+    std::map<DestProfile, SdkData<Siprix::DestData>> destTemplates_;
+    SdkDataCache<Siprix::DestData> headerDests_{ 64 };//Invites with x-headers, by account, video and headers
+
+    ShutdownDrain drain_{ loop_ };
+    bool draining_ = false;//Set by startDrain at once: new calls are refused before drain_ starts
+    RecordingManager recordings_;
+    CdrWriter cdr_;
+
+    //Prompts played to calls and players started by SDK
+    PromptCatalog prompts_;
+    PlayerRegistry players_{
+        [this](uint8_t module, Siprix::CallId callId, const Prompt& prompt, bool loop, Siprix::PlayerId& playerId) {
+            return Sdk::Call_PlayFile(modules_[module]->handle, callId, prompt.path.c_str(), loop, &playerId); },
+        [this](uint8_t module, Siprix::PlayerId playerId) {
+            return Sdk::Call_StopPlayFile(modules_[module]->handle, playerId); } };
+
+    LatencyTest latency_{ loop_ };
+    ConferenceBench confBench_{ loop_ };
+    ScenarioScheduler scenarios_{ loop_ };
+    ScriptRunner scripts_{ loop_ };
+    SoakMonitor soak_{ loop_ };
+    NetworkRecovery recovery_{ loop_ };
+    AdmissionControl admission_{ loop_ };
+    Dashboard dashboard_{ loop_ };
+    size_t nextScenarioModule_ = 0;
+    LiveTap tap_{ loop_ };
+
+    MenuId curMenu_ = MenuId::eMain;
+    int  promptDepth_ = 0;
+    bool inputClosed_ = false;
+
+    std::vector<std::unique_ptr<SipModule>> modules_;
+    uint32_t curModule_ = 0;
+    std::chrono::steady_clock::time_point ratesTime_;
+    uint64_t processCpuMs_ = 0;
+    double   processCpuPercent_ = 0;
+    Siprix::ISiprixModule* sprxModule_ = nullptr;
+};
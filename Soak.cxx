@@ -0,0 +1,231 @@
+#include "Soak.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "ProcStats.h"
+
+//Fit is made when there are enough samples after warm-up and calls
+static const size_t   kSoakMinSamples = 6;
+static const uint64_t kSoakMinCalls = 1000;
+
+//Leak is suspected when calls explain growth (r^2) and it exceeds noise of the metric
+static const double kSoakMinR2 = 0.8;
+static const double kSoakMinGrowth[eSoakMetrics] = {
+    4096,  //RSS, kB
+    4096,  //Heap, kB
+    8,     //Fds
+    4,     //Threads
+    16,    //App calls
+};
+
+const char* getSoakMetricStr(SoakMetric metric)
+{
+    switch (metric)
+    {
+        case eSoakRssKb:    return "rssKb";
+        case eSoakHeapKb:   return "heapKb";
+        case eSoakFds:      return "fds";
+        case eSoakThreads:  return "threads";
+        case eSoakAppCalls: return "appCalls";
+        default:            return "???";
+    }
+}
+
+const char* getSoakLeakHint(SoakMetric metric)
+{
+    switch (metric)
+    {
+        case eSoakRssKb:    return "memory of the SDK not allocated by malloc or thread stacks, unless heap grows too";
+        case eSoakHeapKb:   return "malloc of the app or the SDK, unless appCalls grow too";
+        case eSoakFds:      return "sockets/files of the SDK or recordings which aren't closed";
+        case eSoakThreads:  return "threads of the SDK or app workers which don't exit";
+        case eSoakAppCalls: return "app keeps ended calls (OnCallTerminated missing or not handled)";
+        default:            return "";
+    }
+}
+
+bool SoakMonitor::start(const SoakParams& params, const Actions& actions, std::string& err)
+{
+    if (isRunning())
+    {
+        err = "Soak is already running";
+        return false;
+    }
+    if (!params.sampleSec)
+    {
+        err = "Soak requires sample interval";
+        return false;
+    }
+
+    params_  = params;
+    actions_ = actions;
+    samples_.clear();
+    unregistered_.clear();
+    regCredit_ = 0;
+    nextAccount_ = 0;
+    registrations_ = regFailures_ = regErrors_ = 0;
+    nextSampleSec_ = 0;
+
+    started_ = lastTick_ = EventLoop::Clock::now();
+    timer_ = loop_.addTimer(1000, 1000, [this]() { onTick(); });
+    std::cout << "Soak started: sample every " << params_.sampleSec << "s, accounts cycled every "
+              << params_.reregisterSec << "s, duration " << params_.durationSec << "s (0 - until quit)" << std::endl;
+    onTick();
+    return true;
+}
+
+void SoakMonitor::stop()
+{
+    if (!timer_)
+        return;
+    loop_.cancelTimer(timer_);
+    timer_ = 0;
+
+    //Accounts of the unfinished batch are registered back
+    for (size_t index : unregistered_)
+        actions_.registration(index, true);
+    unregistered_.clear();
+}
+
+void SoakMonitor::onAccountRegState(Siprix::RegState state)
+{
+    if (isRunning() && (state == Siprix::RegState::Failed))
+        ++regFailures_;
+}
+
+void SoakMonitor::onTick()
+{
+    const auto now = EventLoop::Clock::now();
+    const double elapsed = std::chrono::duration<double>(now - lastTick_).count();
+    const uint32_t sec = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now - started_).count());
+    lastTick_ = now;
+
+    if (params_.reregisterSec)
+        cycleRegistrations(elapsed);
+
+    const bool done = params_.durationSec && (sec >= params_.durationSec);
+    if (done || (sec >= nextSampleSec_))
+    {
+        sample();
+        nextSampleSec_ = sec + params_.sampleSec;
+    }
+
+    if (done)
+    {
+        stop();
+        std::cout << "\nSoak finished\n    ";
+        print(std::cout);
+        std::cout << std::endl;
+        if (actions_.finished)
+            actions_.finished();
+    }
+}
+
+void SoakMonitor::cycleRegistrations(double elapsedSec)
+{
+    for (size_t index : unregistered_)
+    {
+        if (actions_.registration(index, true) == Siprix::ErrorCode::EOK)
+            ++registrations_;
+        else
+            ++regErrors_;
+    }
+    unregistered_.clear();
+
+    const size_t accounts = actions_.accounts();
+    if (!accounts)
+        return;
+
+    regCredit_ += elapsedSec * static_cast<double>(accounts) / params_.reregisterSec;
+    const size_t batch = std::min(accounts, static_cast<size_t>(regCredit_));
+    regCredit_ -= static_cast<double>(batch);
+    for (size_t i = 0; i < batch; ++i)
+    {
+        const size_t index = nextAccount_++ % accounts;
+        if (actions_.registration(index, false) == Siprix::ErrorCode::EOK)
+            unregistered_.push_back(index);
+        else
+            ++regErrors_;
+    }
+}
+
+void SoakMonitor::sample()
+{
+    SoakSample s;
+    s.sec = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(EventLoop::Clock::now() - started_).count());
+    s.calls = actions_.calls();
+    s.registrations = registrations_;
+    s.values[eSoakRssKb]    = procRssKb();
+    s.values[eSoakHeapKb]   = procHeapKb();
+    s.values[eSoakFds]      = procOpenFds();
+    s.values[eSoakThreads]  = procThreadsCount();
+    s.values[eSoakAppCalls] = actions_.appCalls();
+    samples_.push_back(s);
+}
+
+SoakFit SoakMonitor::fit(SoakMetric metric) const
+{
+    SoakFit result;
+    const auto first = std::find_if(samples_.begin(), samples_.end(),
+                                    [this](const SoakSample& s) { return s.sec >= params_.warmupSec; });
+    const size_t n = static_cast<size_t>(samples_.end() - first);
+    if ((n < kSoakMinSamples) || (samples_.back().calls - first->calls < kSoakMinCalls))
+        return result;
+
+    //Least squares of value = a + b * calls (and of value by time)
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0, st = 0, stt = 0, sty = 0;
+    for (auto it = first; it != samples_.end(); ++it)
+    {
+        const double x = static_cast<double>(it->calls - first->calls);
+        const double t = static_cast<double>(it->sec - first->sec) / 3600;
+        const double y = static_cast<double>(it->values[metric]);
+        sx += x;  sxx += x * x;  sxy += x * y;
+        st += t;  stt += t * t;  sty += t * y;
+        sy += y;  syy += y * y;
+    }
+    const double count = static_cast<double>(n);
+    const double varX = count * sxx - sx * sx;
+    const double varY = count * syy - sy * sy;
+    const double varT = count * stt - st * st;
+    if (varX <= 0)
+        return result;
+
+    const double cov = count * sxy - sx * sy;
+    result.valid = true;
+    result.per1000Calls = cov / varX * 1000;
+    result.perHour = (varT > 0) ? (count * sty - st * sy) / varT : 0;
+    result.r2 = (varY > 0) ? cov * cov / (varX * varY) : 0;//Constant value - nothing to explain
+    result.growth = static_cast<int64_t>(samples_.back().values[metric]) - static_cast<int64_t>(first->values[metric]);
+    result.suspected = (result.per1000Calls > 0) && (result.r2 >= kSoakMinR2) &&
+                       (static_cast<double>(result.growth) >= kSoakMinGrowth[metric]);
+    return result;
+}
+
+void SoakMonitor::print(std::ostream& os) const
+{
+    os << "soak samples:" << samples_.size() << " registrations:" << registrations_ << " (errors " << regErrors_
+       << ", failed " << regFailures_ << ")";
+    if (samples_.empty())
+        return;
+
+    const SoakSample& last = samples_.back();
+    os << " sec:" << last.sec << " calls:" << last.calls;
+    for (int i = 0; i < eSoakMetrics; ++i)
+    {
+        const SoakMetric metric = static_cast<SoakMetric>(i);
+        const SoakFit f = fit(metric);
+        os << "\n      " << getSoakMetricStr(metric) << ":" << samples_.front().values[i] << "->" << last.values[i];
+        if (!f.valid)
+        {
+            os << " (no fit: " << kSoakMinSamples << " samples and " << kSoakMinCalls << " calls after "
+               << params_.warmupSec << "s warm-up required)";
+            continue;
+        }
+        os << " per1000calls:" << std::round(f.per1000Calls * 100) / 100 << " perHour:" << std::round(f.perHour * 100) / 100
+           << " r2:" << std::round(f.r2 * 1000) / 1000;
+        if (f.suspected)
+            os << " SUSPECTED LEAK: " << getSoakLeakHint(metric);
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+#include "SiprixCpp.h"
+#else
+#include "Siprix.h"
+#endif
+
+#include "EventLoop.h"
+
+////////////////////////////////////////////////////////////////////////////
+//SoakParams
+
+struct SoakParams
+{
+    uint32_t durationSec = 0;      //Run time, then app quits (0 - until quit)
+    uint32_t sampleSec = 60;       //Interval of samples
+    uint32_t warmupSec = 300;      //Samples taken earlier aren't fitted (pools and caches grow)
+    uint32_t reregisterSec = 300;  //Each account is unregistered and registered again once per period (0 - disabled)
+    uint32_t expireTime = 300;     //Of the new registration
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//SoakMonitor
+//Long run which looks for leaks. Calls are cycled by load generator (--load-*), accounts are
+//unregistered and registered again in small batches, so each one is cycled once per period.
+//Samples of RSS, heap (malloc), open fds, threads and call entries kept by the app are taken
+//with cumulative number of ended calls. After warm-up each metric is fitted by least squares
+//against calls: growth per 1000 calls which explains samples well (r^2) and exceeds noise
+//is reported as suspected leak. Invoked on the loop thread.
+
+enum SoakMetric
+{
+    eSoakRssKb,
+    eSoakHeapKb,
+    eSoakFds,
+    eSoakThreads,
+    eSoakAppCalls,  //Entries of calls kept by the app (active and not released after OnCallTerminated)
+    eSoakMetrics
+};
+
+const char* getSoakMetricStr(SoakMetric metric);
+
+//Where growth of the metric likely comes from
+const char* getSoakLeakHint(SoakMetric metric);
+
+struct SoakSample
+{
+    uint32_t sec = 0;          //Since start
+    uint64_t calls = 0;        //Ended calls (cumulative)
+    uint64_t registrations = 0;//Cycled (cumulative)
+    uint64_t values[eSoakMetrics] = {};
+};
+
+struct SoakFit
+{
+    bool valid = false;        //Enough samples and calls
+    double per1000Calls = 0;   //Slope
+    double perHour = 0;        //Growth by time over the same samples
+    double r2 = 0;             //Part of variance explained by calls
+    int64_t growth = 0;        //Last fitted sample - first one
+    bool suspected = false;
+};
+
+class SoakMonitor
+{
+public:
+    struct Actions {
+        std::function<uint64_t()> calls;             //Ended calls
+        std::function<uint64_t()> appCalls;          //Call entries kept by the app
+        std::function<size_t()> accounts;            //Accounts which are cycled
+        std::function<Siprix::ErrorCode(size_t index, bool reg)> registration;//Register/unregister account by index
+        std::function<void()> finished;              //Duration passed
+    };
+
+    SoakMonitor(EventLoop& loop) : loop_(loop) {}
+    ~SoakMonitor() { stop(); }
+
+    bool start(const SoakParams& params, const Actions& actions, std::string& err);
+    void stop();
+    bool isRunning() const { return timer_ != 0; }
+
+    //Results of registrations cycled by monitor
+    void onAccountRegState(Siprix::RegState state);
+
+    const SoakParams& params() const { return params_; }
+    const std::vector<SoakSample>& samples() const { return samples_; }
+    uint64_t regFailures() const { return regFailures_; }
+    uint64_t regErrors() const { return regErrors_; }
+    SoakFit fit(SoakMetric metric) const;
+    void print(std::ostream& os) const;
+
+protected:
+    void onTick();
+    void sample();
+    void cycleRegistrations(double elapsedSec);
+
+    EventLoop& loop_;
+    SoakParams params_;
+    Actions actions_;
+    EventLoop::TimerId timer_ = 0;
+    EventLoop::Clock::time_point started_;
+    EventLoop::Clock::time_point lastTick_;
+    uint32_t nextSampleSec_ = 0;
+
+    //Registrations: accounts unregistered by previous tick are registered by the next one
+    double regCredit_ = 0;
+    size_t nextAccount_ = 0;
+    std::vector<size_t> unregistered_;
+    uint64_t registrations_ = 0;
+    uint64_t regFailures_ = 0;
+    uint64_t regErrors_ = 0;
+
+    std::vector<SoakSample> samples_;
+};
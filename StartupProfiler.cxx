@@ -0,0 +1,46 @@
+#include "StartupProfiler.h"
+
+#include <iomanip>
+
+StartupProfiler::Clock::time_point StartupProfiler::processStart()
+{
+    static const Clock::time_point start = Clock::now();
+    return start;
+}
+
+void StartupProfiler::phase(const std::string& name, Clock::time_point began)
+{
+    entries_.push_back(Entry{ name, began, Clock::now(), false });
+}
+
+void StartupProfiler::phase(const std::string& name, Clock::time_point began, Clock::time_point ended)
+{
+    entries_.push_back(Entry{ name, began, ended, false });
+}
+
+void StartupProfiler::milestone(const std::string& name)
+{
+    entries_.push_back(Entry{ name, processStart(), Clock::now(), true });
+}
+
+void StartupProfiler::print(std::ostream& os) const
+{
+    //Columns: offset from the process start, duration, name
+    const auto toMs = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+
+    const std::streamsize precision = os.precision();
+    os << "\n--- Startup report (ms)\n"
+       << "     start  duration  phase\n" << std::fixed << std::setprecision(1);
+    for (const Entry& e : entries_)
+    {
+        if (e.milestone)
+            os << std::setw(10) << toMs(e.ended - processStart()) << std::setw(10) << "-" << "  " << e.name << "\n";
+        else
+            os << std::setw(10) << toMs(e.began - processStart()) << std::setw(10) << toMs(e.ended - e.began)
+               << "  " << e.name << "\n";
+    }
+    os.unsetf(std::ios::floatfield);
+    os.precision(precision);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////
+//StartupProfiler
+//Collects durations of the startup phases and time of the milestones
+//(measured from the process start) and prints them as one report.
+
+class StartupProfiler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    //Time when process started (captured on the first call, so call it at the beginning of 'main')
+    static Clock::time_point processStart();
+
+    //Phase which began at 'began' and ends now
+    void phase(const std::string& name, Clock::time_point began);
+
+    //Phase measured before profiler was available (for example, in 'main')
+    void phase(const std::string& name, Clock::time_point began, Clock::time_point ended);
+
+    //Moment since process start
+    void milestone(const std::string& name);
+
+    //Measures phase from constructor till destructor
+    class Scope {
+    public:
+        Scope(StartupProfiler& profiler, const std::string& name)
+            : profiler_(profiler), name_(name), began_(Clock::now()) {}
+        ~Scope() { profiler_.phase(name_, began_); }
+    private:
+        StartupProfiler& profiler_;
+        std::string name_;
+        Clock::time_point began_;
+    };
+
+    void print(std::ostream& os) const;
+
+protected:
+    struct Entry {
+        std::string name;
+        Clock::time_point began;
+        Clock::time_point ended;
+        bool milestone;
+    };
+    std::vector<Entry> entries_;
+};
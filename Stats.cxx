@@ -0,0 +1,36 @@
+#include "Stats.h"
+
+void printAppStats(std::ostream& os, const AppStats& stats)
+{
+    os << "events:" << stats.totalEvents()
+       << " commands:" << stats.commands
+       << " accounts:" << stats.accounts
+       << " maxQueueDepth:" << stats.maxQueueDepth << "\n   ";
+    for (int i = 0; i < AppEvent::eCount; ++i)
+    {
+        if (stats.events[i])
+            os << " " << getAppEventName(static_cast<AppEvent::Type>(i)) << ":" << stats.events[i];
+    }
+    os << "\n    eventDelayUs ";
+    stats.eventDelayUs.print(os);
+
+    if (stats.callsOriginated || stats.callsFailed)
+    {
+        os << "\n    calls originated:" << stats.callsOriginated
+           << " connected:" << stats.callsConnected
+           << " failed:" << stats.callsFailed
+           << " completed:" << stats.callsCompleted
+           << "\n    callSetupMs ";
+        stats.callSetupMs.print(os);
+    }
+
+    if (stats.callsAdmitted || stats.callsShed || stats.callsShedAccount || stats.overloads)
+    {
+        os << "\n    admission admitted:" << stats.callsAdmitted
+           << " shed:" << stats.callsShed
+           << " shedAccount:" << stats.callsShedAccount
+           << " overloads:" << stats.overloads
+           << " overloadMs:" << stats.overloadMs
+           << " overloaded:" << stats.overloaded;
+    }
+}
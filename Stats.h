@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+#include "AppEvent.h"
+
+////////////////////////////////////////////////////////////////////////////
+//Histogram
+//Lock-free histogram with log2 buckets (bucket N holds values [2^(N-1), 2^N)).
+//Doesn't allocate memory, so can be placed in shared memory and updated
+//by several threads/processes.
+
+class Histogram
+{
+public:
+    enum { kBuckets = 48 };
+
+    Histogram() { reset(); }
+
+    void add(uint64_t value)
+    {
+        buckets_[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t prevMax = max_.load(std::memory_order_relaxed);
+        while ((value > prevMax) && !max_.compare_exchange_weak(prevMax, value, std::memory_order_relaxed)) {}
+    }
+
+    void merge(const Histogram& other)
+    {
+        for (int i = 0; i < kBuckets; ++i)
+            buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        count_.fetch_add(other.count(), std::memory_order_relaxed);
+        sum_.fetch_add(other.sum(), std::memory_order_relaxed);
+        const uint64_t otherMax = other.max();
+        uint64_t prevMax = max_.load(std::memory_order_relaxed);
+        while ((otherMax > prevMax) && !max_.compare_exchange_weak(prevMax, otherMax, std::memory_order_relaxed)) {}
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < kBuckets; ++i)
+            buckets_[i].store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const   { return sum_.load(std::memory_order_relaxed); }
+    uint64_t max() const   { return max_.load(std::memory_order_relaxed); }
+    uint64_t avg() const   { const uint64_t n = count(); return n ? sum() / n : 0; }
+
+    //Returns upper bound of the bucket which contains requested percentile (0..100)
+    uint64_t percentile(double p) const
+    {
+        const uint64_t total = count();
+        if (!total)
+            return 0;
+
+        uint64_t rank = static_cast<uint64_t>(total * p / 100.0);
+        if (rank >= total) rank = total - 1;
+
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i)
+        {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen > rank)
+            {
+                const uint64_t upper = (i == 0) ? 0 : ((uint64_t(1) << i) - 1);
+                return (upper < max()) ? upper : max();
+            }
+        }
+        return max();
+    }
+
+    //Prints "n:<count> avg:<> p50:<> p99:<> max:<>"
+    void print(std::ostream& os) const
+    {
+        os << "n:" << count() << " avg:" << avg() << " p50:" << percentile(50)
+           << " p99:" << percentile(99) << " max:" << max();
+    }
+
+protected:
+    static int bucketOf(uint64_t value)
+    {
+        int bucket = 0;
+        while (value && (bucket < kBuckets - 1)) { value >>= 1; ++bucket; }
+        return bucket;
+    }
+
+    std::atomic<uint64_t> buckets_[kBuckets];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//AppStats
+//Counters of the application
+
+struct AppStats
+{
+    AppStats() { reset(); }
+
+    void reset()
+    {
+        for (int i = 0; i < AppEvent::eCount; ++i)
+            events[i].store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>* counter : { &commands, &maxQueueDepth, &accounts,
+                &callsOriginated, &callsConnected, &callsFailed, &callsCompleted,
+                &callsAdmitted, &callsShed, &callsShedAccount, &overloads, &overloadMs, &overloaded })
+            counter->store(0, std::memory_order_relaxed);
+        eventDelayUs.reset();
+        callSetupMs.reset();
+    }
+
+    void merge(const AppStats& other)
+    {
+        for (int i = 0; i < AppEvent::eCount; ++i)
+            add(events[i], other.events[i]);
+        add(commands, other.commands);
+        add(accounts, other.accounts);
+        add(callsOriginated, other.callsOriginated);
+        add(callsConnected, other.callsConnected);
+        add(callsFailed, other.callsFailed);
+        add(callsCompleted, other.callsCompleted);
+        add(callsAdmitted, other.callsAdmitted);
+        add(callsShed, other.callsShed);
+        add(callsShedAccount, other.callsShedAccount);
+        add(overloads, other.overloads);
+        add(overloadMs, other.overloadMs);
+        add(overloaded, other.overloaded);
+
+        const uint64_t depth = other.maxQueueDepth.load(std::memory_order_relaxed);
+        if (depth > maxQueueDepth.load(std::memory_order_relaxed))
+            maxQueueDepth.store(depth, std::memory_order_relaxed);
+        eventDelayUs.merge(other.eventDelayUs);
+        callSetupMs.merge(other.callSetupMs);
+    }
+
+    uint64_t totalEvents() const
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < AppEvent::eCount; ++i)
+            total += events[i].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    std::atomic<uint64_t> events[AppEvent::eCount];//Number of received callbacks by type
+    std::atomic<uint64_t> commands;                //Number of handled commands
+    std::atomic<uint64_t> maxQueueDepth;           //Max number of tasks waiting in the loop
+    std::atomic<uint64_t> accounts;                //Number of provisioned accounts
+
+    //Generated load
+    std::atomic<uint64_t> callsOriginated;         //Call_Invite succeeded
+    std::atomic<uint64_t> callsConnected;          //Originated call connected
+    std::atomic<uint64_t> callsFailed;             //Originated call terminated without connect (or Call_Invite failed)
+    std::atomic<uint64_t> callsCompleted;          //Connected call terminated
+
+    //Admission of incoming calls
+    std::atomic<uint64_t> callsAdmitted;           //Passed admission control
+    std::atomic<uint64_t> callsShed;               //Rejected with 503 while overloaded
+    std::atomic<uint64_t> callsShedAccount;        //Rejected with 486, account has max calls
+    std::atomic<uint64_t> overloads;               //Times overload state entered
+    std::atomic<uint64_t> overloadMs;              //Time spent in overload state
+    std::atomic<uint64_t> overloaded;              //1 - overloaded now (merged - number of overloaded workers)
+
+    Histogram eventDelayUs;                        //Time between callback raised and handled
+    Histogram callSetupMs;                         //Time between Call_Invite and OnCallConnected
+
+protected:
+    static void add(std::atomic<uint64_t>& dst, const std::atomic<uint64_t>& src)
+    {
+        dst.fetch_add(src.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+};
+
+//Prints counters in the human readable form
+void printAppStats(std::ostream& os, const AppStats& stats);
@@ -0,0 +1,347 @@
+#ifndef _WIN32
+
+#include "Supervisor.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+//Worker which lived less than this time is considered as failed to start
+static const auto kMinWorkerLifetime = std::chrono::seconds(5);
+static const uint32_t kMaxRestartDelayMs = 30000;
+
+////////////////////////////////////////////////////////////////////////////
+//Supervisor
+
+Supervisor::~Supervisor()
+{
+    if (slots_)
+    {
+        for (uint32_t i = 0; i < params_.workers; ++i)
+            slots_[i].~WorkerSlot();
+        munmap(slots_, sizeof(WorkerSlot) * params_.workers);
+    }
+}
+
+std::string Supervisor::workerHome(const std::string& homeFolder, uint32_t index)
+{
+    return (homeFolder.empty() ? std::string(".") : homeFolder) + "/worker-" + std::to_string(index);
+}
+
+bool Supervisor::createSlots()
+{
+    //Anonymous shared mapping is inherited by forked workers
+    void* mem = mmap(nullptr, sizeof(WorkerSlot) * params_.workers,
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        std::cerr << "Can't allocate shared memory: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    slots_ = static_cast<WorkerSlot*>(mem);
+    for (uint32_t i = 0; i < params_.workers; ++i)
+    {
+        new (&slots_[i]) WorkerSlot();
+        slots_[i].pid = 0;
+        slots_[i].restarts = 0;
+    }
+    return true;
+}
+
+bool Supervisor::parseAffinity()
+{
+    if (params_.cpuAffinity.empty())
+        return true;
+
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        std::cerr << "Can't get CPU affinity: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (params_.cpuAffinity == "auto")
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &allowed)) cpus_.push_back(cpu);
+        return true;
+    }
+
+    //List of CPUs: "0,2,4-7"
+    std::stringstream ss(params_.cpuAffinity);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        int first = 0, last = 0;
+        char dash = 0;
+        std::stringstream range(item);
+        range >> first;
+        if (range >> dash) range >> last;
+        else               last = first;
+
+        if (range.fail() || (first < 0) || (last < first) || (last >= CPU_SETSIZE))
+        {
+            std::cerr << "Invalid CPU list: " << params_.cpuAffinity << std::endl;
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus_.push_back(cpu);
+    }
+    return !cpus_.empty();
+#else
+    std::cerr << "CPU affinity isn't supported on this platform, ignored" << std::endl;
+    return true;
+#endif
+}
+
+int Supervisor::run()
+{
+    if ((params_.workers == 0) || !parseAffinity() || !createSlots() || !loop_.open())
+        return 1;
+
+    loop_.setSignalHandler([this](int signo) { onSignal(signo); });
+    if (!loop_.addSignal(SIGCHLD))
+    {
+        std::cerr << "Can't intercept SIGCHLD" << std::endl;
+        return 1;
+    }
+
+    workers_.resize(params_.workers);
+    for (uint32_t i = 0; i < params_.workers; ++i)
+        spawn(i);
+
+    if (params_.statsIntervalSec)
+    {
+        const uint32_t periodMs = params_.statsIntervalSec * 1000;
+        loop_.addTimer(periodMs, periodMs, [this]() { printStats(); });
+    }
+
+    std::cout << "Supervisor started " << params_.workers << " workers.\n"
+              << " S  => Print stats\n"
+              << " Q  => Quit" << std::endl;
+    input_.attach(loop_, [this]() { onConsoleInput(); });
+
+    loop_.run();
+    printStats();
+    return 0;
+}
+
+bool Supervisor::spawn(uint32_t index)
+{
+    Worker& worker = workers_[index];
+    worker.restartTimer = 0;
+    worker.started = std::chrono::steady_clock::now();
+
+    const pid_t pid = fork();
+    if (pid == -1)
+    {
+        std::cerr << "Can't fork worker " << index << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        runWorker(index);//doesn't return
+    }
+
+    setpgid(pid, pid);//As in runWorker: group is set whichever process runs first
+    slots_[index].pid = pid;
+    std::cout << "Worker " << index << " started. pid:" << pid << std::endl;
+    return true;
+}
+
+void Supervisor::runWorker(uint32_t index)
+{
+    //Own process group: Ctrl-C of the terminal goes only to supervisor, which stops workers by
+    //one SIGTERM (second signal would abort drain of the worker)
+    setpgid(0, 0);
+
+    //Workers handle their own signals, SIGCHLD was blocked only for supervisor
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+
+#ifdef __linux__
+    if (!cpus_.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus_[index % cpus_.size()], &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+            std::cerr << "Worker " << index << " can't set CPU affinity: " << strerror(errno) << std::endl;
+    }
+#endif
+
+    //Worker is headless: console belongs to supervisor, output goes to the log in worker's home
+    const std::string home = workerHome(params_.homeFolder, index);
+    if (!params_.homeFolder.empty())
+        mkdir(params_.homeFolder.c_str(), 0755);
+    mkdir(home.c_str(), 0755);
+
+    std::cout.flush();
+    std::cerr.flush();
+    const int nullFd = open("/dev/null", O_RDONLY);
+    const int logFd  = open((home + "/console.log").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (nullFd != -1) { dup2(nullFd, STDIN_FILENO); close(nullFd); }
+    if (logFd != -1)  { dup2(logFd, STDOUT_FILENO); dup2(logFd, STDERR_FILENO); close(logFd); }
+
+    const int exitCode = workerMain_(index, &slots_[index].stats);
+    std::cout.flush();
+    _exit(exitCode);
+}
+
+void Supervisor::onWorkerExit(uint32_t index, int status)
+{
+    WorkerSlot& slot = slots_[index];
+    slot.pid = 0;
+
+    if (WIFSIGNALED(status))
+        std::cout << "Worker " << index << " killed by signal " << WTERMSIG(status) << std::endl;
+    else
+        std::cout << "Worker " << index << " exited with code " << WEXITSTATUS(status) << std::endl;
+
+    if (stopping_)
+    {
+        if (runningWorkers() == 0)
+            loop_.stop();
+        return;
+    }
+
+    //Restart with exponential backoff when worker keeps failing right after start
+    Worker& worker = workers_[index];
+    if (std::chrono::steady_clock::now() - worker.started < kMinWorkerLifetime)
+        ++worker.failures;
+    else
+        worker.failures = 0;
+
+    uint32_t delayMs = 0;
+    if (worker.failures)
+    {
+        delayMs = 1000u << (worker.failures < 5 ? worker.failures - 1 : 5);
+        if (delayMs > kMaxRestartDelayMs) delayMs = kMaxRestartDelayMs;
+    }
+
+    ++slot.restarts;
+    std::cout << "Worker " << index << " will be restarted in " << delayMs << "ms" << std::endl;
+    worker.restartTimer = loop_.addTimer(delayMs, 0, [this, index]() { spawn(index); });
+}
+
+void Supervisor::reapWorkers()
+{
+    int status = 0;
+    pid_t pid = 0;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        for (uint32_t i = 0; i < params_.workers; ++i)
+        {
+            if (slots_[i].pid == pid)
+            {
+                onWorkerExit(i, status);
+                break;
+            }
+        }
+    }
+}
+
+uint32_t Supervisor::runningWorkers() const
+{
+    uint32_t running = 0;
+    for (uint32_t i = 0; i < params_.workers; ++i)
+        if (slots_[i].pid != 0) ++running;
+    return running;
+}
+
+void Supervisor::stopWorkers()
+{
+    if (stopping_)
+        return;
+    stopping_ = true;
+
+    for (uint32_t i = 0; i < params_.workers; ++i)
+    {
+        if (workers_[i].restartTimer)
+            loop_.cancelTimer(workers_[i].restartTimer);
+        const pid_t pid = slots_[i].pid;
+        if (pid) kill(pid, SIGTERM);
+    }
+
+    if (runningWorkers() == 0)
+    {
+        loop_.stop();
+        return;
+    }
+
+    std::cout << "Waiting for " << runningWorkers() << " workers to stop" << std::endl;
+    killTimer_ = loop_.addTimer(params_.stopTimeoutSec * 1000, 0, [this]() {
+        for (uint32_t i = 0; i < params_.workers; ++i)
+        {
+            const pid_t pid = slots_[i].pid;
+            if (pid)
+            {
+                std::cout << "Worker " << i << " didn't stop in time, killing" << std::endl;
+                kill(pid, SIGKILL);
+            }
+        }
+    });
+}
+
+void Supervisor::onSignal(int signo)
+{
+    switch (signo)
+    {
+        case SIGCHLD: reapWorkers(); break;
+        case SIGUSR1: printStats(); break;
+        default:
+            std::cerr << "Shutting down" << std::endl;
+            stopWorkers();
+    }
+}
+
+void Supervisor::onConsoleInput()
+{
+    char cmd = '\0';
+    while (input_.nextChar(cmd))
+    {
+        switch (cmd)
+        {
+            case 's':
+            case 'S': printStats(); break;
+            case 'q':
+            case 'Q': stopWorkers(); break;
+            default:  std::cout << "Unknown command" << std::endl;
+        }
+    }
+}
+
+void Supervisor::printStats()
+{
+    AppStats total;
+    std::cout << "\n--- Stats of " << params_.workers << " workers";
+    for (uint32_t i = 0; i < params_.workers; ++i)
+    {
+        const WorkerSlot& slot = slots_[i];
+        std::cout << "\n    worker:" << i << " pid:" << slot.pid << " restarts:" << slot.restarts
+                  << " events:" << slot.stats.totalEvents()
+                  << " accounts:" << slot.stats.accounts
+                  << " calls:" << slot.stats.callsOriginated;
+        total.merge(slot.stats);
+    }
+    std::cout << "\n--- Total ";
+    printAppStats(std::cout, total);
+    std::cout << std::endl;
+}
+
+#endif //_WIN32
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ConsoleInput.h"
+#include "EventLoop.h"
+#include "Stats.h"
+
+////////////////////////////////////////////////////////////////////////////
+//SupervisorParams
+
+struct SupervisorParams
+{
+    uint32_t workers = 0;         //Number of worker processes
+    std::string cpuAffinity;      //Empty - don't pin, "auto" - round robin over allowed CPUs, or list "0,2,4-7"
+    std::string homeFolder;       //Parent folder of the workers home folders
+    uint32_t statsIntervalSec = 0;//Print aggregated stats periodically (0 - disabled)
+    uint32_t stopTimeoutSec = 10; //Time given to workers to quit after SIGTERM, then they are killed
+};
+
+
+////////////////////////////////////////////////////////////////////////////
+//Supervisor
+//Forks worker processes, restarts them when crashed and aggregates their
+//counters, which workers update directly in the shared memory.
+//Signals: SIGINT/SIGTERM - stop workers and quit, SIGUSR1 - print stats.
+
+class Supervisor
+{
+public:
+    //Body of the worker process. Invoked in the child after fork, returns exit code.
+    typedef std::function<int(uint32_t index, AppStats* stats)> WorkerMain;
+
+    Supervisor(const SupervisorParams& params, WorkerMain workerMain)
+        : params_(params), workerMain_(workerMain) {}
+    ~Supervisor();
+
+    int run();
+
+    //Home folder of the worker: <homeFolder>/worker-<index>
+    static std::string workerHome(const std::string& homeFolder, uint32_t index);
+
+protected:
+    //Placed in the shared memory
+    struct WorkerSlot {
+        std::atomic<pid_t> pid;
+        std::atomic<uint32_t> restarts;
+        AppStats stats;
+    };
+
+    struct Worker {
+        std::chrono::steady_clock::time_point started;
+        uint32_t failures = 0;//Number of sequential short-living runs
+        EventLoop::TimerId restartTimer = 0;
+    };
+
+    bool createSlots();
+    bool parseAffinity();
+    bool spawn(uint32_t index);
+    void runWorker(uint32_t index);
+    void onWorkerExit(uint32_t index, int status);
+    void reapWorkers();
+    void stopWorkers();
+    uint32_t runningWorkers() const;
+
+    void onSignal(int signo);
+    void onConsoleInput();
+    void printStats();
+
+protected:
+    SupervisorParams params_;
+    WorkerMain workerMain_;
+    EventLoop loop_;
+    ConsoleInput input_;
+
+    WorkerSlot* slots_ = nullptr;
+    std::vector<Worker> workers_;
+    std::vector<int> cpus_;//CPUs to pin workers (empty - don't pin)
+
+    bool stopping_ = false;
+    EventLoop::TimerId killTimer_ = 0;
+};
+
+#endif //_WIN32
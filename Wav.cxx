@@ -0,0 +1,358 @@
+#include "Wav.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//'read(offset, buf, size)' reads bytes of the file
+template<typename Read>
+static bool parseWavInfo(const Read& read, uint64_t fileSize, WavInfo& info)
+{
+    char riff[12];
+    if (!read(0, riff, sizeof(riff)) || memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4))
+        return false;
+    memcpy(&info.riffSizeField, riff + 4, 4);
+
+    uint64_t offset = sizeof(riff);
+    while (offset + 8 <= fileSize)
+    {
+        char hdr[8];
+        if (!read(offset, hdr, sizeof(hdr)))
+            return false;
+        uint32_t size = 0;
+        memcpy(&size, hdr + 4, 4);
+
+        if (!memcmp(hdr, "fmt ", 4))
+        {
+            char fmt[16];
+            if ((size < sizeof(fmt)) || !read(offset + 8, fmt, sizeof(fmt)))
+                return false;
+            memcpy(&info.format,        fmt, 2);
+            memcpy(&info.channels,      fmt + 2, 2);
+            memcpy(&info.sampleRate,    fmt + 4, 4);
+            memcpy(&info.bitsPerSample, fmt + 14, 2);
+        }
+        else if (!memcmp(hdr, "data", 4))
+        {
+            //Size isn't updated when writer didn't close file properly
+            info.dataOffset = offset + 8;
+            info.dataSizeField = size;
+            info.dataSize = fileSize - info.dataOffset;
+            return info.channels != 0;
+        }
+        offset += 8 + size + (size & 1);
+    }
+    return false;
+}
+
+bool readWavInfo(FILE* f, uint64_t fileSize, WavInfo& info)
+{
+    return parseWavInfo([f](uint64_t offset, char* buf, size_t size) {
+        return (fseek(f, static_cast<long>(offset), SEEK_SET) == 0) && (fread(buf, 1, size, f) == size);
+    }, fileSize, info);
+}
+
+static int16_t ulawToPcm(uint8_t u)
+{
+    u = ~u;
+    const int exponent = (u >> 4) & 0x07;
+    const int mantissa = u & 0x0F;
+    const int magnitude = (((mantissa << 3) + 0x84) << exponent) - 0x84;
+    return static_cast<int16_t>((u & 0x80) ? -magnitude : magnitude);
+}
+
+static int16_t alawToPcm(uint8_t a)
+{
+    a ^= 0x55;
+    const int exponent = (a >> 4) & 0x07;
+    const int mantissa = a & 0x0F;
+    const int magnitude = exponent ? (((mantissa << 4) + 0x108) << (exponent - 1)) : ((mantissa << 4) + 8);
+    return static_cast<int16_t>((a & 0x80) ? magnitude : -magnitude);
+}
+
+void makeWavDecodeTable(uint16_t format, int16_t table[256])
+{
+    for (int i = 0; i < 256; ++i)
+        table[i] = (format == eWavAlaw) ? alawToPcm(static_cast<uint8_t>(i)) : ulawToPcm(static_cast<uint8_t>(i));
+}
+
+static bool isSupportedWav(const WavInfo& info)
+{
+    return info.sampleRate &&
+        (((info.format == eWavPcm) && (info.bitsPerSample == 16)) || (info.format == eWavAlaw) || (info.format == eWavMulaw));
+}
+
+bool readWav(const std::string& path, WavAudio& audio, std::string& err, size_t maxSamples)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        err = "can't open '" + path + "': " + strerror(errno);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    const uint64_t fileSize = static_cast<uint64_t>(ftell(f));
+    fseek(f, 0, SEEK_SET);
+
+    WavInfo info;
+    const bool valid = readWavInfo(f, fileSize, info);
+    const uint32_t bytesPerSample = (info.format == eWavPcm) ? 2 : 1;
+    if (!valid || !isSupportedWav(info))
+    {
+        fclose(f);
+        err = "'" + path + "' isn't PCM16, A-law or mu-law WAV file";
+        return false;
+    }
+
+    const size_t frameSize = bytesPerSample * info.channels;
+    size_t frames = static_cast<size_t>(info.dataSize / frameSize);
+    if (maxSamples && (frames > maxSamples))
+        frames = maxSamples;
+
+    //Decoding tables of 8-bit formats
+    int16_t table[256];
+    makeWavDecodeTable(info.format, table);
+
+    audio.sampleRate = info.sampleRate;
+    audio.samples.resize(frames);
+    fseek(f, static_cast<long>(info.dataOffset), SEEK_SET);
+
+    std::vector<uint8_t> buf(64 * 1024 - (64 * 1024) % frameSize);
+    size_t done = 0;
+    while (done < frames)
+    {
+        const size_t chunk = std::min(buf.size() / frameSize, frames - done);
+        const size_t read = fread(buf.data(), frameSize, chunk, f);
+        for (size_t i = 0; i < read; ++i)
+        {
+            const uint8_t* frame = buf.data() + i * frameSize;
+            if (bytesPerSample == 2)
+            {
+                int16_t v;
+                memcpy(&v, frame, 2);
+                audio.samples[done + i] = v / 32768.0f;
+            }
+            else
+                audio.samples[done + i] = table[frame[0]] / 32768.0f;
+        }
+        done += read;
+        if (read < chunk)
+            break;
+    }
+    audio.samples.resize(done);
+    fclose(f);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////
+//WavMapping
+
+WavMapping::~WavMapping()
+{
+    close();
+}
+
+bool WavMapping::open(const std::string& path, std::string& err)
+{
+    close();
+#ifdef _WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size;
+    if ((file_ == INVALID_HANDLE_VALUE) || !GetFileSizeEx(file_, &size))
+    {
+        err = "can't open '" + path + "'";
+        close();
+        return false;
+    }
+    size_ = static_cast<uint64_t>(size.QuadPart);
+    mapping_ = size_ ? CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    data_ = mapping_ ? static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) != 0))
+    {
+        err = "can't open '" + path + "': " + strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+    void* data = size_ ? mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (data != MAP_FAILED)
+    {
+        //File is read once from start to end
+        madvise(data, size_, MADV_SEQUENTIAL | MADV_WILLNEED);
+        data_ = static_cast<const uint8_t*>(data);
+    }
+#endif
+    const auto read = [this](uint64_t offset, char* buf, size_t size) {
+        if (offset + size > size_)
+            return false;
+        memcpy(buf, data_ + offset, size);
+        return true;
+    };
+    if (!data_ || !parseWavInfo(read, size_, info_) || !isSupportedWav(info_))
+    {
+        err = "'" + path + "' isn't PCM16, A-law or mu-law WAV file";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void WavMapping::close()
+{
+#ifdef _WIN32
+    if (data_)    UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+    mapping_ = nullptr;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (data_)
+        munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    info_ = WavInfo();
+}
+
+size_t WavMapping::frames() const
+{
+    const size_t frameSize = static_cast<size_t>(((info_.format == eWavPcm) ? 2 : 1) * info_.channels);
+    return frameSize ? static_cast<size_t>(info_.dataSize / frameSize) : 0;
+}
+
+const int16_t* WavMapping::samples(std::vector<int16_t>& buf) const
+{
+    const uint8_t* payload = data_ + info_.dataOffset;
+    const size_t count = frames();
+
+    //Mono PCM16 is used in place
+    if ((info_.format == eWavPcm) && (info_.channels == 1) && !(reinterpret_cast<uintptr_t>(payload) & 1))
+        return reinterpret_cast<const int16_t*>(payload);
+
+    buf.resize(count);
+    if (info_.format == eWavPcm)
+    {
+        for (size_t i = 0; i < count; ++i)
+            memcpy(&buf[i], payload + i * 2 * info_.channels, 2);
+    }
+    else
+    {
+        int16_t table[256];
+        makeWavDecodeTable(info_.format, table);
+        for (size_t i = 0; i < count; ++i)
+            buf[i] = table[payload[i * info_.channels]];
+    }
+    return buf.data();
+}
+
+bool writeWav(const std::string& path, uint32_t sampleRate, const std::vector<int16_t>& samples, std::string& err)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+    {
+        err = "can't create '" + path + "': " + strerror(errno);
+        return false;
+    }
+
+    const uint32_t dataSize = static_cast<uint32_t>(samples.size() * 2);
+    const uint32_t riffSize = 36 + dataSize;
+    const uint32_t fmtSize  = 16;
+    const uint16_t format   = eWavPcm;
+    const uint16_t channels = 1;
+    const uint32_t byteRate = sampleRate * 2;
+    const uint16_t align    = 2;
+    const uint16_t bits     = 16;
+
+    fwrite("RIFF", 1, 4, f); fwrite(&riffSize, 4, 1, f); fwrite("WAVE", 1, 4, f);
+    fwrite("fmt ", 1, 4, f); fwrite(&fmtSize, 4, 1, f);
+    fwrite(&format, 2, 1, f); fwrite(&channels, 2, 1, f); fwrite(&sampleRate, 4, 1, f);
+    fwrite(&byteRate, 4, 1, f); fwrite(&align, 2, 1, f); fwrite(&bits, 2, 1, f);
+    fwrite("data", 1, 4, f); fwrite(&dataSize, 4, 1, f);
+    const bool written = fwrite(samples.data(), 2, samples.size(), f) == samples.size();
+
+    if ((fclose(f) != 0) || !written)
+    {
+        err = "can't write '" + path + "'";
+        return false;
+    }
+    return true;
+}
+
+static bool hasWavExt(const std::string& name)
+{
+    if (name.size() < 4)
+        return false;
+    std::string ext = name.substr(name.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(::tolower(c)); });
+    return ext == ".wav";
+}
+
+static void listFolder(const std::string& folder, std::vector<std::string>& files)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileA((folder + "\\*").c_str(), &data);
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+    do {
+        const std::string name = data.cFileName;
+        if (name[0] == '.')
+            continue;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            listFolder(folder + "/" + name, files);
+        else if (hasWavExt(name))
+            files.push_back(folder + "/" + name);
+    } while (FindNextFileA(h, &data));
+    FindClose(h);
+#else
+    DIR* dir = opendir(folder.c_str());
+    if (!dir)
+        return;
+    while (const dirent* entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        if (name[0] == '.')
+            continue;
+        const std::string path = folder + "/" + name;
+        struct stat st;
+        if ((stat(path.c_str(), &st) == 0) && ((st.st_mode & S_IFMT) == S_IFDIR))
+            listFolder(path, files);
+        else if (hasWavExt(name))
+            files.push_back(path);
+    }
+    closedir(dir);
+#endif
+}
+
+bool listWavFiles(const std::string& path, std::vector<std::string>& files, std::string& err)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        err = "can't access '" + path + "': " + strerror(errno);
+        return false;
+    }
+
+    if ((st.st_mode & S_IFMT) == S_IFDIR)
+        listFolder(path, files);
+    else
+        files.push_back(path);
+    std::sort(files.begin(), files.end());
+    return true;
+}
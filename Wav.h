@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////
+//WAV files (RIFF fields are little-endian, as on all supported platforms)
+
+enum WavFormat : uint16_t
+{
+    eWavPcm   = 1,
+    eWavAlaw  = 6,
+    eWavMulaw = 7
+};
+
+struct WavInfo
+{
+    uint16_t format = 0;
+    uint16_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint16_t bitsPerSample = 0;
+    uint64_t dataOffset = 0;//Offset of 'data' chunk payload
+    uint64_t dataSize = 0;  //Actual size of payload (by file size)
+    uint32_t dataSizeField = 0;
+    uint32_t riffSizeField = 0;
+};
+
+//Parses header of opened file. Size of payload is taken from file size,
+//as header isn't updated when writer didn't close file properly.
+bool readWavInfo(FILE* f, uint64_t fileSize, WavInfo& info);
+
+//Table of A-law or mu-law decoding
+void makeWavDecodeTable(uint16_t format, int16_t table[256]);
+
+//Mono audio with samples in range [-1, 1]
+struct WavAudio
+{
+    uint32_t sampleRate = 0;
+    std::vector<float> samples;
+};
+
+//Reads first channel of PCM16, A-law or mu-law file ('maxSamples' 0 - whole file)
+bool readWav(const std::string& path, WavAudio& audio, std::string& err, size_t maxSamples = 0);
+
+//Memory-mapped WAV file (PCM16, A-law or mu-law), read sequentially
+class WavMapping
+{
+public:
+    WavMapping() = default;
+    WavMapping(const WavMapping&) = delete;
+    WavMapping& operator=(const WavMapping&) = delete;
+    ~WavMapping();
+
+    bool open(const std::string& path, std::string& err);
+    void close();
+
+    const WavInfo& info() const { return info_; }
+    uint64_t fileSize() const { return size_; }
+    size_t frames() const;
+
+    //First channel as PCM16: pointer to mapped payload of mono PCM16 file,
+    //otherwise samples are decoded into 'buf'
+    const int16_t* samples(std::vector<int16_t>& buf) const;
+
+protected:
+    const uint8_t* data_ = nullptr;
+    uint64_t size_ = 0;
+    WavInfo info_;
+#ifdef _WIN32
+    void* file_ = reinterpret_cast<void*>(-1);//INVALID_HANDLE_VALUE
+    void* mapping_ = nullptr;
+#endif
+};
+
+//Writes mono PCM16 file
+bool writeWav(const std::string& path, uint32_t sampleRate, const std::vector<int16_t>& samples, std::string& err);
+
+//Returns paths of *.wav files of the folder and its subfolders (or 'path' itself when it's a file)
+bool listWavFiles(const std::string& path, std::vector<std::string>& files, std::string& err);
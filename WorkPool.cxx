@@ -0,0 +1,84 @@
+#include "WorkPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Tasks of one thread
+struct WorkQueue
+{
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+
+    bool popFront(size_t& index)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty())
+            return false;
+        index = tasks.front();
+        tasks.pop_front();
+        return true;
+    }
+
+    bool popBack(size_t& index)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty())
+            return false;
+        index = tasks.back();
+        tasks.pop_back();
+        return true;
+    }
+};
+
+WorkStealingPool::Stats WorkStealingPool::run(size_t count, size_t threads, const Task& task)
+{
+    Stats stats;
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    stats.threads = std::max<size_t>(1, std::min(threads, count));
+    if (!count)
+        return stats;
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (size_t t = 0; t < stats.threads; ++t)
+        queues.emplace_back(new WorkQueue);
+    for (size_t i = 0; i < count; ++i)
+        queues[i % stats.threads]->tasks.push_back(i);
+
+    std::atomic<uint64_t> steals{ 0 };
+    const auto work = [&](size_t worker) {
+        size_t index;
+        for (;;)
+        {
+            if (queues[worker]->popFront(index))
+            {
+                task(index, worker);
+                continue;
+            }
+
+            //Queues are only drained, so nothing is left when all of them are empty
+            bool stolen = false;
+            for (size_t n = 1; !stolen && (n < queues.size()); ++n)
+                stolen = queues[(worker + n) % queues.size()]->popBack(index);
+            if (!stolen)
+                break;
+            ++steals;
+            task(index, worker);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < stats.threads; ++t)
+        pool.emplace_back(work, t);
+    work(0);
+    for (std::thread& t : pool)
+        t.join();
+
+    stats.steals = steals;
+    return stats;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+////////////////////////////////////////////////////////////////////////////
+//WorkStealingPool
+//Runs batch of independent tasks by several threads. Tasks are dealt round-robin to
+//per-thread queues (callers put the most expensive ones first), thread takes tasks
+//from the front of own queue and, when it's empty, steals from the back of others.
+
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void(size_t index, size_t worker)>;
+
+    struct Stats {
+        size_t threads = 0;
+        uint64_t steals = 0;
+    };
+
+    //'threads' 0 - number of CPU cores. Returns when all tasks completed.
+    static Stats run(size_t count, size_t threads, const Task& task);
+};